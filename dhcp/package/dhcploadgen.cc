@@ -0,0 +1,464 @@
+/*
+ * dhcploadgen.{cc,hh} -- emulate many dhcp clients to load-test a server
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "dhcploadgen.hh"
+#include "dhcpoptionutil.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/router.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+// Client frames are Ethernet/IP/UDP/DHCP; the IP header starts 2 bytes
+// into the buffer so it is word aligned.
+#define FRAME_HEADROOM	2
+#define DM_OFFSET	(sizeof(click_ether) + sizeof(click_ip) + sizeof(click_udp))
+
+DHCPLoadGen::DHCPLoadGen()
+    : _task(this), _timer(this),
+      _nclients(10000), _outstanding(256), _burst(32), _rounds(1),
+      _release(true), _timeout(2, 0), _stop(false), _active(true)
+{
+    static const uint8_t default_eth[6] = { 2, 0, 0, 0, 0, 0 };
+    _eth = EtherAddress(default_eth);
+}
+
+DHCPLoadGen::~DHCPLoadGen()
+{
+}
+
+int
+DHCPLoadGen::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+	.read("CLIENTS", _nclients)
+	.read("ETH", _eth)
+	.read("OUTSTANDING", _outstanding)
+	.read("BURST", _burst)
+	.read("ROUNDS", _rounds)
+	.read("RELEASE", _release)
+	.read("TIMEOUT", _timeout)
+	.read("STOP", _stop)
+	.read("ACTIVE", _active)
+	.complete() < 0)
+	return -1;
+    if (_nclients == 0 || _nclients > 0xFFFFFF)
+	return errh->error("CLIENTS must be between 1 and 16777215");
+    if (_outstanding == 0 || _burst == 0 || _rounds == 0)
+	return errh->error("OUTSTANDING, BURST and ROUNDS must be positive");
+    if (_rounds > 0xFFFF)
+	return errh->error("ROUNDS too large");
+    if (!_timeout)
+	_timeout = Timestamp(2, 0);
+    return 0;
+}
+
+int
+DHCPLoadGen::initialize(ErrorHandler *)
+{
+    _clients.resize(_nclients);
+    reset();
+    _task.initialize(this, _active);
+    _timer.initialize(this);
+    return 0;
+}
+
+void
+DHCPLoadGen::reset()
+{
+    for (uint32_t i = 0; i < _nclients; i++) {
+	_clients[i].state = S_IDLE;
+	_clients[i].rounds = 0;
+	_clients[i].attempt = 0;
+    }
+    _ready.clear();
+    for (uint32_t i = 0; i < _nclients; i++)
+	_ready.push_back(i);
+    _inflight.clear();
+    _busy = _finished = 0;
+    _first_start = _last_ack = Timestamp();
+    _discovers = _offers = _requests = _acks = _naks = 0;
+    _releases = _retries = _bad = 0;
+    _latency.clear();
+}
+
+// The xid carries the client index and the low bits of its attempt
+// number, so a reply maps straight back to its client and a reply to
+// an abandoned attempt is ignored.
+uint32_t
+DHCPLoadGen::xid(uint32_t index) const
+{
+    return htonl((index << 8) | (_clients[index].attempt & 0xFF));
+}
+
+void
+DHCPLoadGen::client_eth(uint32_t index, uint8_t *eth) const
+{
+    memcpy(eth, _eth.data(), 6);
+    uint32_t low = ((eth[3] << 16) | (eth[4] << 8) | eth[5]) + index;
+    eth[3] = low >> 16;
+    eth[4] = low >> 8;
+    eth[5] = low;
+}
+
+WritablePacket *
+DHCPLoadGen::make_bootrequest(uint32_t index, int mtype, uint32_t ciaddr)
+{
+    WritablePacket *q = Packet::make(FRAME_HEADROOM, 0,
+				     DM_OFFSET + sizeof(dhcpMessage), 0);
+    if (!q)
+	return 0;
+    memset(q->data(), 0, q->length());
+
+    click_ether *eh = reinterpret_cast<click_ether *>(q->data());
+    client_eth(index, eh->ether_shost);
+    memset(eh->ether_dhost, 0xFF, 6);
+    eh->ether_type = htons(ETHERTYPE_IP);
+    click_ip *ip = reinterpret_cast<click_ip *>(eh + 1);
+    q->set_ip_header(ip, sizeof(click_ip));
+
+    dhcpMessage *dm = reinterpret_cast<dhcpMessage *>(q->data() + DM_OFFSET);
+    dm->op = DHCP_BOOTREQUEST;
+    dm->htype = ARPHRD_ETHER;
+    dm->hlen = 6;
+    dm->xid = xid(index);
+    dm->ciaddr = ciaddr;
+    memcpy(dm->chaddr, eh->ether_shost, 6);
+    dm->magic = DHCP_MAGIC;
+    dm->options[0] = DHO_DHCP_MESSAGE_TYPE;
+    dm->options[1] = 1;
+    dm->options[2] = mtype;
+    return q;
+}
+
+// Trim the options area after o and fill in the IP and UDP headers.
+Packet *
+DHCPLoadGen::finish(WritablePacket *q, uint8_t *o)
+{
+    dhcpMessage *dm = reinterpret_cast<dhcpMessage *>(q->data() + DM_OFFSET);
+    *o++ = DHO_END;
+    q->take(DHCP_OPTIONS_SIZE - (o - dm->options));
+
+    click_ip *ip = q->ip_header();
+    ip->ip_v = 4;
+    ip->ip_hl = sizeof(click_ip) >> 2;
+    ip->ip_len = htons(q->length() - sizeof(click_ether));
+    ip->ip_ttl = 64;
+    ip->ip_p = IP_PROTO_UDP;
+    ip->ip_src.s_addr = 0;
+    ip->ip_dst.s_addr = 0xFFFFFFFFU;
+    ip->ip_sum = click_in_cksum((unsigned char *) ip, sizeof(click_ip));
+    click_udp *udp = reinterpret_cast<click_udp *>(ip + 1);
+    udp->uh_sport = htons(68);
+    udp->uh_dport = htons(67);
+    udp->uh_ulen = htons(q->length() - sizeof(click_ether) - sizeof(click_ip));
+    udp->uh_sum = 0;
+    q->set_dst_ip_anno(IPAddress(0xFFFFFFFFU));
+    return q;
+}
+
+void
+DHCPLoadGen::start(uint32_t index, bool retry)
+{
+    client &c = _clients[index];
+    Timestamp now = Timestamp::now();
+    c.attempt++;
+    c.state = S_SELECTING;
+    // Latency runs from the first DISCOVER, so it includes any
+    // timeouts and retries; only the retry timer uses the attempt's
+    // own start.
+    if (!retry) {
+	c.start = now;
+	_busy++;
+	if (!_first_start)
+	    _first_start = now;
+    }
+
+    inflight f;
+    f.index = index;
+    f.attempt = c.attempt;
+    f.start = now;
+    _inflight.push_back(f);
+    if (!_timer.scheduled())
+	_timer.schedule_after(_timeout);
+
+    if (WritablePacket *q = make_bootrequest(index, DHCP_DISCOVER, 0)) {
+	dhcpMessage *dm = reinterpret_cast<dhcpMessage *>(q->data() + DM_OFFSET);
+	_discovers++;
+	output(0).push(finish(q, dm->options + 3));
+    }
+}
+
+void
+DHCPLoadGen::send_request(uint32_t index, Packet *p, const dhcpMessage *offer)
+{
+    _clients[index].state = S_REQUESTING;
+    WritablePacket *q = make_bootrequest(index, DHCP_REQUEST, 0);
+    if (!q)
+	return;
+    dhcpMessage *dm = reinterpret_cast<dhcpMessage *>(q->data() + DM_OFFSET);
+    uint8_t *o = dm->options + 3;
+
+    *o++ = DHO_DHCP_REQUESTED_ADDRESS;
+    *o++ = 4;
+    memcpy(o, &offer->yiaddr, 4);
+    o += 4;
+
+    if (const uint8_t *leaseo = DHCPOptionUtil::fetch(p, DHO_DHCP_LEASE_TIME, 4)) {
+	*o++ = DHO_DHCP_LEASE_TIME;
+	*o++ = 4;
+	memcpy(o, leaseo, 4);
+	o += 4;
+    }
+    if (const uint8_t *servero = DHCPOptionUtil::fetch(p, DHO_DHCP_SERVER_IDENTIFIER, 4)) {
+	*o++ = DHO_DHCP_SERVER_IDENTIFIER;
+	*o++ = 4;
+	memcpy(o, servero, 4);
+	o += 4;
+    }
+
+    _requests++;
+    output(0).push(finish(q, o));
+}
+
+void
+DHCPLoadGen::send_release(uint32_t index, IPAddress ip, IPAddress server)
+{
+    WritablePacket *q = make_bootrequest(index, DHCP_RELEASE, ip.addr());
+    if (!q)
+	return;
+    dhcpMessage *dm = reinterpret_cast<dhcpMessage *>(q->data() + DM_OFFSET);
+    uint8_t *o = dm->options + 3;
+    *o++ = DHO_DHCP_SERVER_IDENTIFIER;
+    *o++ = 4;
+    memcpy(o, server.data(), 4);
+    o += 4;
+    _releases++;
+    output(0).push(finish(q, o));
+}
+
+void
+DHCPLoadGen::finish_round(uint32_t index)
+{
+    client &c = _clients[index];
+    c.rounds++;
+    _busy--;
+    if (c.rounds >= _rounds) {
+	c.state = S_DONE;
+	if (++_finished == _nclients) {
+	    _timer.unschedule();
+	    if (_stop)
+		router()->please_stop_driver();
+	    return;
+	}
+    } else {
+	c.state = S_IDLE;
+	_ready.push_back(index);
+    }
+    if (_active && !_task.scheduled())
+	_task.reschedule();
+}
+
+void
+DHCPLoadGen::push(int, Packet *p)
+{
+    const uint8_t *th = p->transport_header();
+    const uint8_t *mtype = th ? DHCPOptionUtil::fetch(p, DHO_DHCP_MESSAGE_TYPE, 1) : 0;
+    if (!mtype) {
+	_bad++;
+	p->kill();
+	return;
+    }
+
+    const dhcpMessage *dm = reinterpret_cast<const dhcpMessage *>(th + sizeof(click_udp));
+    uint32_t index = ntohl(dm->xid) >> 8;
+    uint8_t eth[6];
+    if (index >= _nclients || dm->xid != xid(index)
+	|| (client_eth(index, eth), memcmp(dm->chaddr, eth, 6) != 0)) {
+	_bad++;
+	p->kill();
+	return;
+    }
+
+    client &c = _clients[index];
+    if (*mtype == DHCP_OFFER && c.state == S_SELECTING) {
+	_offers++;
+	send_request(index, p, dm);
+    } else if (*mtype == DHCP_ACK && c.state == S_REQUESTING) {
+	Timestamp now = Timestamp::now();
+	_acks++;
+	_last_ack = now;
+	_latency.push_back((now - c.start).usecval());
+	if (_release) {
+	    const uint8_t *servero = DHCPOptionUtil::fetch(p, DHO_DHCP_SERVER_IDENTIFIER, 4);
+	    send_release(index, IPAddress(dm->yiaddr),
+			 servero ? IPAddress(servero) : IPAddress());
+	}
+	finish_round(index);
+    } else if (*mtype == DHCP_NACK && c.state == S_REQUESTING) {
+	_naks++;
+	start(index, true);
+    } else
+	_bad++;
+    p->kill();
+}
+
+bool
+DHCPLoadGen::run_task(Task *)
+{
+    if (!_active)
+	return false;
+    uint32_t n = 0;
+    while (n < _burst && _busy < _outstanding && _ready.size()) {
+	uint32_t index = _ready.front();
+	_ready.pop_front();
+	start(index, false);
+	n++;
+    }
+    if (_busy < _outstanding && _ready.size())
+	_task.fast_reschedule();
+    return n > 0;
+}
+
+void
+DHCPLoadGen::run_timer(Timer *)
+{
+    // Entries are in start order; anything younger than the timeout is
+    // still waiting for its reply.
+    Timestamp expiry = Timestamp::now() - _timeout;
+    while (_inflight.size() && _inflight.front().start <= expiry) {
+	inflight f = _inflight.front();
+	_inflight.pop_front();
+	client &c = _clients[f.index];
+	if (c.attempt == f.attempt
+	    && (c.state == S_SELECTING || c.state == S_REQUESTING)) {
+	    _retries++;
+	    start(f.index, true);
+	}
+    }
+    if (_inflight.size() && !_timer.scheduled())
+	_timer.schedule_at(_inflight.front().start + _timeout);
+}
+
+uint32_t
+DHCPLoadGen::percentile(Vector<uint32_t> &sorted, int pct) const
+{
+    if (!sorted.size())
+	return 0;
+    int i = (sorted.size() * pct + 99) / 100 - 1;
+    return sorted[i < 0 ? 0 : i];
+}
+
+static int
+uint32_compare(const void *a, const void *b, void *)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x < y ? -1 : x > y);
+}
+
+enum { H_STATS, H_TPS, H_LATENCY, H_DONE, H_ACTIVE, H_RESET };
+
+String
+DHCPLoadGen::read_handler(Element *e, void *thunk)
+{
+    DHCPLoadGen *lg = static_cast<DHCPLoadGen *>(e);
+    uint32_t done = lg->_latency.size();
+    Timestamp elapsed = lg->_last_ack - lg->_first_start;
+    uint64_t usec = elapsed.usecval();
+    uint64_t tps = usec ? ((uint64_t) done * 1000000) / usec : 0;
+
+    switch ((intptr_t) thunk) {
+      case H_TPS:
+	return String(tps);
+      case H_DONE:
+	return cp_unparse_bool(lg->_finished == lg->_nclients);
+      case H_ACTIVE:
+	return cp_unparse_bool(lg->_active);
+      case H_STATS:
+      case H_LATENCY: {
+	  Vector<uint32_t> sorted(lg->_latency);
+	  if (sorted.size())
+	      click_qsort(sorted.begin(), sorted.size(), sizeof(uint32_t),
+			  uint32_compare, 0);
+	  StringAccum sa;
+	  if ((intptr_t) thunk == H_LATENCY) {
+	      sa << lg->percentile(sorted, 50) << ' ' << lg->percentile(sorted, 99);
+	      return sa.take_string();
+	  }
+	  sa << "clients " << lg->_nclients << '\n'
+	     << "finished " << lg->_finished << '\n'
+	     << "handshakes " << done << '\n'
+	     << "discovers " << lg->_discovers << '\n'
+	     << "offers " << lg->_offers << '\n'
+	     << "requests " << lg->_requests << '\n'
+	     << "acks " << lg->_acks << '\n'
+	     << "naks " << lg->_naks << '\n'
+	     << "releases " << lg->_releases << '\n'
+	     << "retries " << lg->_retries << '\n'
+	     << "bad " << lg->_bad << '\n'
+	     << "elapsed " << elapsed << '\n'
+	     << "tps " << tps << '\n'
+	     << "p50 " << lg->percentile(sorted, 50) << '\n'
+	     << "p99 " << lg->percentile(sorted, 99) << '\n'
+	     << "max " << (sorted.size() ? sorted.back() : 0) << '\n';
+	  return sa.take_string();
+      }
+      default:
+	return String();
+    }
+}
+
+int
+DHCPLoadGen::write_handler(const String &s, Element *e, void *thunk,
+			   ErrorHandler *errh)
+{
+    DHCPLoadGen *lg = static_cast<DHCPLoadGen *>(e);
+    switch ((intptr_t) thunk) {
+      case H_ACTIVE:
+	if (!BoolArg().parse(s, lg->_active))
+	    return errh->error("syntax error");
+	if (lg->_active && !lg->_task.scheduled())
+	    lg->_task.reschedule();
+	return 0;
+      case H_RESET:
+	lg->_timer.unschedule();
+	lg->reset();
+	if (lg->_active && !lg->_task.scheduled())
+	    lg->_task.reschedule();
+	return 0;
+      default:
+	return -1;
+    }
+}
+
+void
+DHCPLoadGen::add_handlers()
+{
+    add_read_handler("stats", read_handler, (void *) H_STATS);
+    add_read_handler("tps", read_handler, (void *) H_TPS);
+    add_read_handler("latency", read_handler, (void *) H_LATENCY);
+    add_read_handler("done", read_handler, (void *) H_DONE);
+    add_read_handler("active", read_handler, (void *) H_ACTIVE);
+    add_write_handler("active", write_handler, (void *) H_ACTIVE);
+    add_write_handler("reset", write_handler, (void *) H_RESET);
+    add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(DHCPLoadGen)
+ELEMENT_REQUIRES(DHCPOptionUtil)
@@ -0,0 +1,205 @@
+#ifndef DHCPLOADGEN_HH
+#define DHCPLOADGEN_HH
+#include "dhcp_common.hh"
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timer.hh>
+#include <click/deque.hh>
+#include <click/etheraddress.hh>
+#include <click/ipaddress.hh>
+CLICK_DECLS
+
+/*
+=c
+
+DHCPLoadGen([I<keywords>])
+
+=s DHCP
+
+emulates many DHCP clients to load-test a DHCP server
+
+=d
+
+DHCPLoadGen runs the DHCPClient DISCOVER/OFFER/REQUEST/ACK exchange for
+CLIENTS clients at once, each with its own Ethernet address, and
+measures how long each handshake takes.  Output 0 emits complete
+Ethernet/IP/UDP frames addressed from the client to the broadcast
+address, with the IP header annotation set, ready for CheckDHCPMsg and
+DHCPClassifier in front of DHCPServerOffer and DHCPServerACKorNAK.  The
+servers' replies come back on input 0.
+
+At most OUTSTANDING handshakes are in flight at once; new ones start as
+old ones finish, BURST per task run.  A handshake that gets no reply in
+TIMEOUT is retried from the DISCOVER.  After an ACK a client optionally
+releases its lease, then waits for the next round.  Once every client
+has completed ROUNDS handshakes the generator stops, and stops the
+driver if STOP is true.
+
+Keyword arguments are:
+
+=over 8
+
+=item CLIENTS
+
+Number of emulated clients.  Default 10000.
+
+=item ETH
+
+Ethernet address of client 0; client I uses this address plus I in its
+low 24 bits.  Default 02:00:00:00:00:00.
+
+=item OUTSTANDING
+
+Maximum handshakes in flight.  Default 256.
+
+=item BURST
+
+Handshakes started per task run.  Default 32.
+
+=item ROUNDS
+
+Handshakes per client.  Default 1.
+
+=item RELEASE
+
+Boolean.  Send DHCPRELEASE after each ACK.  Default true.
+
+=item TIMEOUT
+
+Retry interval.  Default 2 seconds.
+
+=item STOP
+
+Boolean.  Stop the driver when done.  Default false.
+
+=item ACTIVE
+
+Boolean.  Default true.
+
+=back
+
+=h stats read-only
+
+Counts of messages sent and received, completed handshakes, elapsed
+time, handshakes per second, and handshake latency percentiles (p50,
+p99, max) in microseconds.
+
+=h tps read-only
+
+Completed handshakes per second.
+
+=h latency read-only
+
+p50 and p99 handshake latency, in microseconds, from the first DISCOVER
+to the ACK, including any retries.
+
+=h done read-only
+
+True once every client has finished all its rounds.
+
+=h active read/write
+
+=h reset write-only
+
+Forget all results and start over.
+
+=e
+
+  lg :: DHCPLoadGen(CLIENTS 50000, STOP true);
+  lease :: DHCPLeasePool(1:1:1:1:1:1, 10.0.0.1, 255.0.0.0,
+			 START 10.1.0.0, END 10.1.255.255);
+  lg -> CheckDHCPMsg -> c :: DHCPClassifier(discover, request, release, -);
+  c[0] -> DHCPServerOffer(lease) -> lg;
+  c[1] -> DHCPServerACKorNAK(lease) -> lg;
+  c[2] -> DHCPServerRelease(lease);
+  c[3] -> Discard;
+  DriverManager(wait, print lg.stats);
+
+=a
+
+DHCPClient, DHCPServerOffer, DHCPServerACKorNAK */
+
+class DHCPLoadGen : public Element
+{
+public:
+    DHCPLoadGen();
+    ~DHCPLoadGen();
+
+    const char *class_name() const { return "DHCPLoadGen"; }
+    const char *port_count() const { return PORTS_1_1; }
+    const char *processing() const { return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh);
+    int initialize(ErrorHandler *errh);
+    void add_handlers();
+
+    void push(int port, Packet *p);
+    bool run_task(Task *);
+    void run_timer(Timer *);
+
+private:
+    enum { S_IDLE, S_SELECTING, S_REQUESTING, S_DONE };
+
+    struct client {
+	uint8_t state;
+	uint16_t rounds;
+	uint32_t attempt;	// bumped on each (re)start
+	Timestamp start;	// of the current handshake's first attempt
+    };
+
+    // A handshake in flight, in start order, for retry.
+    struct inflight {
+	uint32_t index;
+	uint32_t attempt;
+	Timestamp start;
+    };
+
+    Task _task;
+    Timer _timer;
+
+    uint32_t _nclients;
+    EtherAddress _eth;
+    uint32_t _outstanding;
+    uint32_t _burst;
+    uint32_t _rounds;
+    bool _release;
+    Timestamp _timeout;
+    bool _stop;
+    bool _active;
+
+    Vector<client> _clients;
+    Deque<uint32_t> _ready;	// clients waiting to start a round
+    Deque<inflight> _inflight;
+    uint32_t _busy;		// handshakes in flight
+    uint32_t _finished;		// clients done with every round
+
+    Timestamp _first_start;
+    Timestamp _last_ack;
+    uint64_t _discovers;
+    uint64_t _offers;
+    uint64_t _requests;
+    uint64_t _acks;
+    uint64_t _naks;
+    uint64_t _releases;
+    uint64_t _retries;
+    uint64_t _bad;
+    Vector<uint32_t> _latency;	// usec, one per completed handshake
+
+    void reset();
+    uint32_t xid(uint32_t index) const;
+    void client_eth(uint32_t index, uint8_t *eth) const;
+    WritablePacket *make_bootrequest(uint32_t index, int mtype,
+				     uint32_t ciaddr);
+    Packet *finish(WritablePacket *q, uint8_t *o);
+    void start(uint32_t index, bool retry);
+    void send_request(uint32_t index, Packet *p, const dhcpMessage *offer);
+    void send_release(uint32_t index, IPAddress ip, IPAddress server);
+    void finish_round(uint32_t index);
+    uint32_t percentile(Vector<uint32_t> &sorted, int pct) const;
+
+    static String read_handler(Element *, void *);
+    static int write_handler(const String &, Element *, void *, ErrorHandler *);
+};
+
+CLICK_ENDDECLS
+#endif
@@ -79,7 +79,7 @@ DHCPServerACKorNAK::push(int, Packet *p)
 		/* SELECTING */
 		if(lease && lease->_ip == requested_ip) {
 			q = make_ack_packet(p, lease);
-			lease->_valid = true;
+			_leases->set_valid(lease);
 		}
 	} else if (!server && requested_ip && !ciaddr) {
 		/* INIT-REBOOT */
@@ -91,7 +91,7 @@ DHCPServerACKorNAK::push(int, Packet *p)
 				if (lease->_end <  Timestamp::now() ) {
 					q = make_nak_packet(p, lease);
 				} else {
-					lease->_valid = true;
+					_leases->set_valid(lease);
 					q = make_ack_packet(p, lease);
 				}
 			}
@@ -100,7 +100,7 @@ DHCPServerACKorNAK::push(int, Packet *p)
 		/* RENEW or REBIND */
 		if (lease) {
 			lease->_valid = true;
-			lease->extend();
+			_leases->renew(lease);
 			q = make_ack_packet(p, lease);
 		}
 	} else {
@@ -35,9 +35,8 @@ DHCPServerRelease::push(int, Packet *p)
 	EtherAddress eth(release_msg->chaddr);
 
 	const uint8_t *opt = DHCPOptionUtil::fetch(p, DHO_DHCP_SERVER_IDENTIFIER, 4);
-	IPAddress incoming_server_id(opt);
 	IPAddress server_id = _leases->_ip;
-	if (incoming_server_id != server_id) {
+	if (!opt || IPAddress(opt) != server_id) {
 		click_chatter("[R] I am not the Server");
 		goto done;
 	}
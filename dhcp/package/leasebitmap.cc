@@ -0,0 +1,231 @@
+/*
+ * leasebitmap.{cc,hh} -- free-address bitmap for dhcp lease tables
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/error.hh>
+#include <click/integers.hh>
+#include <click/args.hh>
+#include "leasebitmap.hh"
+CLICK_DECLS
+
+LeaseBitmap::LeaseBitmap()
+    : _nbits(0), _nfree(0), _cursor(0)
+{
+}
+
+void
+LeaseBitmap::clear()
+{
+    _ranges.clear();
+    _by_addr.clear();
+    _leaf.clear();
+    _summary.clear();
+    _reserved.clear();
+    _nbits = _nfree = _cursor = 0;
+}
+
+void
+LeaseBitmap::set_bit(uint32_t bit)
+{
+    uint32_t w = bit >> 5, m = 1U << (bit & 31);
+    if (_leaf[w] & m)
+	return;
+    if (!_leaf[w])
+	_summary[w >> 5] |= 1U << (w & 31);
+    _leaf[w] |= m;
+    _nfree++;
+}
+
+void
+LeaseBitmap::clear_bit(uint32_t bit)
+{
+    uint32_t w = bit >> 5, m = 1U << (bit & 31);
+    if (!(_leaf[w] & m))
+	return;
+    _leaf[w] &= ~m;
+    if (!_leaf[w])
+	_summary[w >> 5] &= ~(1U << (w & 31));
+    _nfree--;
+}
+
+int
+LeaseBitmap::add_range(IPAddress lo_addr, IPAddress hi_addr, ErrorHandler *errh)
+{
+    uint32_t lo = ntohl(lo_addr.addr()), hi = ntohl(hi_addr.addr());
+    if (hi < lo)
+	return errh->error("range %s-%s is empty", lo_addr.unparse().c_str(),
+			   hi_addr.unparse().c_str());
+    uint32_t n = hi - lo + 1;
+    if (n == 0 || n > 0x7FFFFFFFU - _nbits)
+	return errh->error("address pool too large");
+
+    // _by_addr stays sorted by lo, which is also what catches overlaps.
+    int pos = 0;
+    while (pos < _by_addr.size() && _ranges[_by_addr[pos]].lo < lo)
+	pos++;
+    if ((pos > 0 && _ranges[_by_addr[pos - 1]].hi >= lo)
+	|| (pos < _by_addr.size() && _ranges[_by_addr[pos]].lo <= hi))
+	return errh->error("range %s-%s overlaps another range",
+			   lo_addr.unparse().c_str(), hi_addr.unparse().c_str());
+
+    Range r;
+    r.lo = lo;
+    r.hi = hi;
+    r.base = _nbits;
+    _ranges.push_back(r);
+    _by_addr.insert(_by_addr.begin() + pos, _ranges.size() - 1);
+
+    uint32_t end = _nbits + n;
+    _leaf.resize((end + 31) >> 5, 0);
+    _summary.resize((_leaf.size() + 31) >> 5, 0);
+    uint32_t bit = _nbits;
+    for (; bit < end && (bit & 31); bit++)
+	set_bit(bit);
+    for (; bit + 32 <= end; bit += 32) {
+	_leaf[bit >> 5] = 0xFFFFFFFFU;
+	_summary[bit >> 10] |= 1U << ((bit >> 5) & 31);
+	_nfree += 32;
+    }
+    for (; bit < end; bit++)
+	set_bit(bit);
+    _nbits = end;
+    return 0;
+}
+
+// A RANGE keyword argument: "LO HI".
+int
+LeaseBitmap::add_range(const String &str, ErrorHandler *errh)
+{
+    Vector<String> words;
+    cp_spacevec(str, words);
+    IPAddress lo, hi;
+    if (words.size() != 2
+	|| !IPAddressArg().parse(words[0], lo)
+	|| !IPAddressArg().parse(words[1], hi))
+	return errh->error("RANGE should be %<LO HI%>");
+    return add_range(lo, hi, errh);
+}
+
+int
+LeaseBitmap::bit_of(IPAddress ip) const
+{
+    uint32_t a = ntohl(ip.addr());
+    int l = 0, r = _by_addr.size() - 1;
+    while (l <= r) {
+	int m = (l + r) / 2;
+	const Range &rg = _ranges[_by_addr[m]];
+	if (a < rg.lo)
+	    r = m - 1;
+	else if (a > rg.hi)
+	    l = m + 1;
+	else
+	    return rg.base + (a - rg.lo);
+    }
+    return -1;
+}
+
+IPAddress
+LeaseBitmap::addr_of(uint32_t bit) const
+{
+    int l = 0, r = _ranges.size() - 1;
+    while (l < r) {
+	int m = (l + r + 1) / 2;
+	if (_ranges[m].base <= bit)
+	    l = m;
+	else
+	    r = m - 1;
+    }
+    return IPAddress(htonl(_ranges[l].lo + (bit - _ranges[l].base)));
+}
+
+int
+LeaseBitmap::find_from(uint32_t bit) const
+{
+    if (!_nfree)
+	return -1;
+    if (bit >= _nbits)
+	bit = 0;
+
+    uint32_t w = bit >> 5;
+    if (uint32_t word = _leaf[w] & (0xFFFFFFFFU << (bit & 31)))
+	return (w << 5) + ffs_lsb(word) - 1;
+
+    // Walk the summary from the next leaf word to the end, then wrap.
+    // The wrapped pass covers w itself, so a free bit is always found.
+    uint32_t start = w + 1;
+    for (int pass = 0; pass < 2; pass++, start = 0) {
+	uint32_t s = start >> 5;
+	uint32_t mask = 0xFFFFFFFFU << (start & 31);
+	for (; s < (uint32_t) _summary.size(); s++, mask = 0xFFFFFFFFU)
+	    if (uint32_t sw = _summary[s] & mask) {
+		uint32_t lw = (s << 5) + ffs_lsb(sw) - 1;
+		return (lw << 5) + ffs_lsb(_leaf[lw]) - 1;
+	    }
+    }
+    return -1;
+}
+
+bool
+LeaseBitmap::is_free(IPAddress ip) const
+{
+    int bit = bit_of(ip);
+    return bit >= 0 && test_bit(bit);
+}
+
+bool
+LeaseBitmap::take(IPAddress ip)
+{
+    int bit = bit_of(ip);
+    if (bit < 0 || !test_bit(bit))
+	return false;
+    clear_bit(bit);
+    return true;
+}
+
+void
+LeaseBitmap::release(IPAddress ip)
+{
+    int bit = bit_of(ip);
+    if (bit >= 0 && !_reserved.get(ip))
+	set_bit(bit);
+}
+
+void
+LeaseBitmap::reserve(IPAddress ip)
+{
+    _reserved.set(ip, true);
+    take(ip);
+}
+
+IPAddress
+LeaseBitmap::next_free()
+{
+    int bit = find_from(_cursor);
+    if (bit < 0)
+	return IPAddress();
+    _cursor = bit + 1;
+    return addr_of(bit);
+}
+
+IPAddress
+LeaseBitmap::free_near(uint32_t hint) const
+{
+    int bit = find_from(_nbits ? hint % _nbits : 0);
+    if (bit < 0)
+	return IPAddress();
+    return addr_of(bit);
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(LeaseBitmap)
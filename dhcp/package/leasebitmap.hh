@@ -0,0 +1,78 @@
+#ifndef LEASEBITMAP_HH
+#define LEASEBITMAP_HH
+#include <click/ipaddress.hh>
+#include <click/hashtable.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+class ErrorHandler;
+
+/*
+ * Free-address allocator for DHCP lease tables.
+ *
+ * The pool is one or more disjoint address ranges, numbered one after
+ * another into a single bit space; a set bit means the address is free.
+ * A summary bitmap above the leaves has one bit per nonempty leaf word,
+ * so a search skips 1024 allocated addresses per summary word and
+ * finds the next free address with find-first-set.  Taking or
+ * releasing an address is O(1) plus a binary search over the ranges.
+ *
+ * Reserved addresses are taken for good: release() leaves them alone.
+ */
+
+class LeaseBitmap {
+public:
+    LeaseBitmap();
+
+    void clear();
+    int add_range(IPAddress lo, IPAddress hi, ErrorHandler *errh);
+    int add_range(const String &str, ErrorHandler *errh);
+    void reserve(IPAddress ip);
+
+    bool contains(IPAddress ip) const	{ return bit_of(ip) >= 0; }
+    bool is_free(IPAddress ip) const;
+    bool is_reserved(IPAddress ip) const { return _reserved.get(ip); }
+
+    bool take(IPAddress ip);
+    void release(IPAddress ip);
+
+    // The next free address after the one last returned, wrapping, so
+    // addresses are handed out round-robin.  Does not take it; the
+    // lease table does that when the lease is inserted.
+    IPAddress next_free();
+    // The first free address at or after the hint'th address in the
+    // pool, wrapping.
+    IPAddress free_near(uint32_t hint) const;
+
+    uint32_t size() const		{ return _nbits; }
+    uint32_t free_count() const		{ return _nfree; }
+    int nranges() const			{ return _ranges.size(); }
+
+private:
+    struct Range {
+	uint32_t lo;		// host byte order, inclusive
+	uint32_t hi;
+	uint32_t base;		// bit number of lo
+    };
+
+    Vector<Range> _ranges;	// in bit order
+    Vector<int> _by_addr;	// indexes into _ranges, sorted by lo
+    Vector<uint32_t> _leaf;
+    Vector<uint32_t> _summary;
+    HashTable<IPAddress, bool> _reserved;
+    uint32_t _nbits;
+    uint32_t _nfree;
+    uint32_t _cursor;
+
+    int bit_of(IPAddress ip) const;
+    IPAddress addr_of(uint32_t bit) const;
+    int find_from(uint32_t bit) const;
+
+    bool test_bit(uint32_t bit) const {
+	return _leaf[bit >> 5] & (1U << (bit & 31));
+    }
+    void set_bit(uint32_t bit);
+    void clear_bit(uint32_t bit);
+};
+
+CLICK_ENDDECLS
+#endif
@@ -53,11 +53,17 @@ LeaseHash::cast(const char *n)
 Lease *
 LeaseHash::new_lease_any(EtherAddress eth) 
 {
-	IPAddress ip = hash(eth);
 	Lease *l = DHCPLeaseTable::rev_lookup(eth);
 	if (l) {
 		return l;
 	} else {
+		IPAddress ip;
+		if (_free.size()) {
+			uint32_t crc = update_crc(0, (char *)eth.data(), 6);
+			if (!(ip = _free.free_near(crc)))
+				return 0;
+		} else
+			ip = hash(eth);
 		Lease l;
 		l._eth = eth;
 		l._ip = ip;
@@ -76,18 +82,50 @@ LeaseHash::new_lease(EtherAddress eth, IPAddress)
 	return new_lease_any(eth);
 }
 
+bool
+LeaseHash::insert(Lease l)
+{
+	_free.take(l._ip);
+	return DHCPLeaseTable::insert(l);
+}
+
+void
+LeaseHash::remove(EtherAddress eth)
+{
+	if (Lease *l = rev_lookup(eth))
+		_free.release(l->_ip);
+	DHCPLeaseTable::remove(eth);
+}
+
 int
 LeaseHash::configure( Vector<String> &conf, ErrorHandler *errh )
 {
+    Vector<String> ranges;
+    Vector<IPAddress> reserved;
     if (Args(conf, this, errh)
 	.read_mp("ETH", _eth)
 	.read_mp("MASK", _subnet)
+	.read_all("RANGE", AnyArg(), ranges)
+	.read_all("RESERVE", reserved)
+	.read("JOURNAL", FilenameArg(), _journal_file)
+	.read("JOURNAL_SYNC", _journal_sync)
+	.read("EXPIRE", _expire)
+	.read("GRACE", SecondsArg(), _grace)
+	.read("EXPIRE_TICK", SecondsArg(), _expire_tick)
 	.complete() < 0)
 	return -1;
     _ip = hash(_eth);
+
+    _free.clear();
+    for (int i = 0; i < ranges.size(); i++)
+	if (_free.add_range(ranges[i], errh) < 0)
+	    return -1;
+    for (int i = 0; i < reserved.size(); i++)
+	_free.reserve(reserved[i]);
     return 0;
 }
 
 
 EXPORT_ELEMENT(LeaseHash LeaseHash-LeaseHash)
+ELEMENT_REQUIRES(LeaseBitmap)
 CLICK_ENDDECLS
@@ -10,6 +10,7 @@
 
 #include <click/timestamp.hh>
 #include "leasetable.hh"
+#include "leasebitmap.hh"
 /*
  * =c
  * DHCPLeaseHash(ETH, MASK)
@@ -23,6 +24,13 @@
  * DHCPLeaseHash is responsible of keeping track of free,
  * reserved, and allocated leases.
  *
+ * With no RANGE, the address is the subnet's first octet followed by
+ * three bytes of a hash of the client's Ethernet address.  With one or
+ * more RANGE keywords, the hash picks a starting point in the ranges
+ * and the client gets the first free address from there, so two
+ * clients never collide.  RANGE, RESERVE, JOURNAL, JOURNAL_SYNC, EXPIRE,
+ * GRACE and EXPIRE_TICK are as for DHCPLeasePool.
+ *
  * =e
  * DHCPLeaseHash(192.168.10.9, 192.168.10.0);
  *
@@ -58,11 +66,14 @@ public:
 
   Lease *new_lease(EtherAddress, IPAddress);
   Lease *new_lease_any(EtherAddress);
+  bool insert(Lease);
+  void remove(EtherAddress);
   IPAddress get_server_ip();
   IPAddress hash(EtherAddress);
 private:
 
   IPAddress _subnet;
+  LeaseBitmap _free;
 };
 
 #endif /* LEASEHASH_HH */
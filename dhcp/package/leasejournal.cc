@@ -0,0 +1,346 @@
+/*
+ * leasejournal.{cc,hh} -- crash-safe on-disk journal of dhcp leases
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include "leasejournal.hh"
+#if CLICK_USERLEVEL
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <stdio.h>
+# include <errno.h>
+#endif
+CLICK_DECLS
+
+#define JOURNAL_MAGIC	0x444c4a31U	/* "DLJ1" */
+#define JOURNAL_VERSION	1
+#define JOURNAL_CHUNK	65536
+
+struct DHCPLeaseJournalHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t first_seq;
+};
+
+DHCPLeaseJournal::DHCPLeaseJournal()
+    : _sync(false), _fd(-1), _map(0), _map_size(0), _tail(0), _seq(0),
+      _records(0)
+{
+}
+
+DHCPLeaseJournal::~DHCPLeaseJournal()
+{
+    close();
+}
+
+// FNV-1a over everything but the check word.  An all-zero record,
+// which is what preallocated space looks like, never checks out.
+uint32_t
+DHCPLeaseJournal::checksum(const DHCPLeaseJournalRecord &r)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&r);
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < offsetof(DHCPLeaseJournalRecord, check); i++)
+	h = (h ^ p[i]) * 16777619U;
+    return h;
+}
+
+void
+DHCPLeaseJournal::lease_record(DHCPLeaseJournalRecord &r, const Lease &l)
+{
+    memset(&r, 0, sizeof(r));
+    r.op = OP_ADD;
+    r.valid = l._valid ? 1 : 0;
+    memcpy(r.eth, l._eth.data(), 6);
+    r.ip = l._ip.addr();
+    r.start = l._start.sec();
+    r.end = l._end.sec();
+    r.duration = l._duration.sec();
+}
+
+#if CLICK_USERLEVEL
+
+int
+DHCPLeaseJournal::map_file(int fd, size_t size, ErrorHandler *errh)
+{
+    void *m = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED)
+	return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+    _fd = fd;
+    _map = (unsigned char *) m;
+    _map_size = size;
+    return 0;
+}
+
+int
+DHCPLeaseJournal::open(const String &filename, bool sync, LiveMap &live,
+		       ErrorHandler *errh)
+{
+    close();
+    _filename = filename;
+    _sync = sync;
+
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+	return errh->error("%s: %s", filename.c_str(), strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+	::close(fd);
+	return errh->error("%s: %s", filename.c_str(), strerror(errno));
+    }
+
+    size_t size = st.st_size;
+    bool fresh = (size < sizeof(DHCPLeaseJournalHeader));
+    if (fresh) {
+	size = JOURNAL_CHUNK;
+	if (ftruncate(fd, size) < 0) {
+	    ::close(fd);
+	    return errh->error("%s: %s", filename.c_str(), strerror(errno));
+	}
+    }
+    if (map_file(fd, size, errh) < 0) {
+	::close(fd);
+	return -1;
+    }
+
+    DHCPLeaseJournalHeader *h = (DHCPLeaseJournalHeader *) _map;
+    if (fresh) {
+	h->magic = JOURNAL_MAGIC;
+	h->version = JOURNAL_VERSION;
+	h->record_size = sizeof(DHCPLeaseJournalRecord);
+	h->first_seq = 0;
+    } else if (h->magic != JOURNAL_MAGIC || h->version != JOURNAL_VERSION
+	       || h->record_size != sizeof(DHCPLeaseJournalRecord)) {
+	close();
+	return errh->error("%s: not a lease journal", filename.c_str());
+    }
+
+    // Replay up to the first record that is torn, out of sequence, or
+    // was never written.  Later appends overwrite it.
+    _seq = h->first_seq;
+    _records = 0;
+    _tail = sizeof(DHCPLeaseJournalHeader);
+    while (_tail + sizeof(DHCPLeaseJournalRecord) <= _map_size) {
+	const DHCPLeaseJournalRecord *r =
+	    (const DHCPLeaseJournalRecord *) (_map + _tail);
+	if (r->seq != _seq || r->check != checksum(*r))
+	    break;
+	EtherAddress eth(r->eth);
+	if (r->op == OP_ADD) {
+	    Lease l;
+	    l._eth = eth;
+	    l._ip = IPAddress(r->ip);
+	    l._start = Timestamp(r->start, 0);
+	    l._end = Timestamp(r->end, 0);
+	    l._duration = Timestamp(r->duration, 0);
+	    l._valid = r->valid;
+	    live.set(eth, l);
+	} else if (r->op == OP_REMOVE) {
+	    LiveMap::iterator it = live.find(eth);
+	    if (it && it.value()._ip == IPAddress(r->ip))
+		live.erase(eth);
+	} else
+	    break;
+	_tail += sizeof(DHCPLeaseJournalRecord);
+	_seq++;
+	_records++;
+    }
+
+    // Discard everything past the last good record.  Otherwise a later
+    // append could fill the gap with exactly the sequence number a
+    // stale record beyond it expects, and the next replay would run on
+    // into records that were superseded long ago.  Shrinking and
+    // regrowing the file reads back as zeros, including the rest of the
+    // page _tail is in.
+    if (_tail < _map_size
+	&& (ftruncate(_fd, _tail) < 0 || ftruncate(_fd, _map_size) < 0)) {
+	close();
+	return errh->error("%s: %s", filename.c_str(), strerror(errno));
+    }
+    return 0;
+}
+
+void
+DHCPLeaseJournal::close()
+{
+    if (_map) {
+	msync(_map, _map_size, MS_SYNC);
+	munmap(_map, _map_size);
+    }
+    if (_fd >= 0)
+	::close(_fd);
+    _map = 0;
+    _map_size = 0;
+    _fd = -1;
+}
+
+bool
+DHCPLeaseJournal::grow(size_t want)
+{
+    size_t size = _map_size;
+    while (size < want)
+	size += (size < 16 * JOURNAL_CHUNK ? size : 16 * JOURNAL_CHUNK);
+    if (ftruncate(_fd, size) < 0)
+	return false;
+    munmap(_map, _map_size);
+    _map = 0;
+    int fd = _fd;
+    _fd = -1;
+    if (map_file(fd, size, ErrorHandler::default_handler()) < 0) {
+	::close(fd);
+	return false;
+    }
+    return true;
+}
+
+bool
+DHCPLeaseJournal::append(DHCPLeaseJournalRecord &r)
+{
+    if (!_map)
+	return false;
+    if (_tail + sizeof(r) > _map_size && !grow(_tail + sizeof(r)))
+	return false;
+    r.seq = _seq;
+    r.check = checksum(r);
+    memcpy(_map + _tail, &r, sizeof(r));
+    if (_sync) {
+	// msync wants a page-aligned start.
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = ((uintptr_t) (_map + _tail)) & ~(page - 1);
+	msync((void *) start, (uintptr_t) (_map + _tail + sizeof(r)) - start,
+	      MS_SYNC);
+    }
+    _tail += sizeof(r);
+    _seq++;
+    _records++;
+    return true;
+}
+
+int
+DHCPLeaseJournal::compact(const DHCPLeaseTable::LeaseMap &leases,
+			  ErrorHandler *errh)
+{
+    if (!_map)
+	return errh->error("lease journal is not open");
+
+    String tmpname = _filename + ".tmp";
+    int fd = ::open(tmpname.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+	return errh->error("%s: %s", tmpname.c_str(), strerror(errno));
+
+    size_t need = sizeof(DHCPLeaseJournalHeader)
+	+ leases.size() * sizeof(DHCPLeaseJournalRecord);
+    size_t size = JOURNAL_CHUNK;
+    while (size < need + JOURNAL_CHUNK / 2)
+	size *= 2;
+    void *m = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+	m = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+	::close(fd);
+	unlink(tmpname.c_str());
+	return errh->error("%s: %s", tmpname.c_str(), strerror(errno));
+    }
+
+    // Sequence numbers restart, so no record of the old file can be
+    // mistaken for a continuation of the new one.
+    unsigned char *map = (unsigned char *) m;
+    DHCPLeaseJournalHeader *h = (DHCPLeaseJournalHeader *) map;
+    h->magic = JOURNAL_MAGIC;
+    h->version = JOURNAL_VERSION;
+    h->record_size = sizeof(DHCPLeaseJournalRecord);
+    h->first_seq = _seq + 1;
+    uint32_t seq = h->first_seq;
+    size_t tail = sizeof(DHCPLeaseJournalHeader);
+    for (DHCPLeaseTable::LeaseIter it = leases.begin(); it.live(); it++) {
+	DHCPLeaseJournalRecord r;
+	lease_record(r, it.value());
+	r.seq = seq++;
+	r.check = checksum(r);
+	memcpy(map + tail, &r, sizeof(r));
+	tail += sizeof(r);
+    }
+
+    if (msync(map, size, MS_SYNC) < 0
+	|| rename(tmpname.c_str(), _filename.c_str()) < 0) {
+	munmap(map, size);
+	::close(fd);
+	unlink(tmpname.c_str());
+	return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+    }
+
+    munmap(_map, _map_size);
+    ::close(_fd);
+    _fd = fd;
+    _map = map;
+    _map_size = size;
+    _tail = tail;
+    _seq = seq;
+    _records = leases.size();
+    return 0;
+}
+
+#else
+
+int
+DHCPLeaseJournal::open(const String &, bool, LiveMap &, ErrorHandler *errh)
+{
+    return errh->error("lease journals require the user-level driver");
+}
+
+void
+DHCPLeaseJournal::close()
+{
+}
+
+bool
+DHCPLeaseJournal::append(DHCPLeaseJournalRecord &)
+{
+    return false;
+}
+
+int
+DHCPLeaseJournal::compact(const DHCPLeaseTable::LeaseMap &,
+			  ErrorHandler *errh)
+{
+    return errh->error("lease journals require the user-level driver");
+}
+
+#endif
+
+bool
+DHCPLeaseJournal::append_add(const Lease &l)
+{
+    DHCPLeaseJournalRecord r;
+    lease_record(r, l);
+    return append(r);
+}
+
+bool
+DHCPLeaseJournal::append_remove(EtherAddress eth, IPAddress ip)
+{
+    DHCPLeaseJournalRecord r;
+    memset(&r, 0, sizeof(r));
+    r.op = OP_REMOVE;
+    memcpy(r.eth, eth.data(), 6);
+    r.ip = ip.addr();
+    return append(r);
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(DHCPLeaseJournal)
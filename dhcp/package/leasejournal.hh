@@ -0,0 +1,81 @@
+#ifndef LEASEJOURNAL_HH
+#define LEASEJOURNAL_HH
+#include <click/string.hh>
+#include <click/hashtable.hh>
+#include "leasetable.hh"
+CLICK_DECLS
+
+/*
+ * An append-only, memory-mapped journal of lease changes, used by
+ * DHCPLeaseTable when a JOURNAL file is configured.
+ *
+ * The file is a short header followed by fixed-size records, each
+ * either adding (or updating) the lease for an Ethernet address or
+ * removing it.  Every record carries a sequence number and a checksum,
+ * so replay stops cleanly at a torn or stale record left by a crash;
+ * whatever follows that record is then zeroed, so it can never be
+ * replayed later.
+ * Compaction rewrites the file with one record per live lease and
+ * renames it into place, so a restart replays only live leases.
+ *
+ * Journals need the user-level driver.
+ */
+
+struct DHCPLeaseJournalRecord {
+    uint8_t op;
+    uint8_t valid;
+    uint8_t eth[6];
+    uint32_t ip;
+    uint32_t seq;
+    int32_t start;
+    int32_t end;
+    int32_t duration;
+    uint32_t check;
+};
+
+class DHCPLeaseJournal {
+public:
+    DHCPLeaseJournal();
+    ~DHCPLeaseJournal();
+
+    typedef HashTable<EtherAddress, Lease> LiveMap;
+
+    int open(const String &filename, bool sync, LiveMap &live,
+	     ErrorHandler *errh);
+    void close();
+
+    bool append_add(const Lease &l);
+    bool append_remove(EtherAddress eth, IPAddress ip);
+    int compact(const DHCPLeaseTable::LeaseMap &leases, ErrorHandler *errh);
+
+    // Compaction is worthwhile once dead records outnumber live ones
+    // by a margin.
+    bool needs_compaction(int live) const {
+	return _records > 2 * (uint32_t) live + COMPACT_SLACK;
+    }
+
+    uint32_t records() const { return _records; }
+    size_t size() const { return _tail; }
+
+    enum { OP_ADD = 1, OP_REMOVE = 2 };
+    enum { COMPACT_SLACK = 1024 };
+
+private:
+    String _filename;
+    bool _sync;
+    int _fd;
+    unsigned char *_map;
+    size_t _map_size;
+    size_t _tail;
+    uint32_t _seq;
+    uint32_t _records;
+
+    bool append(DHCPLeaseJournalRecord &r);
+    bool grow(size_t want);
+    int map_file(int fd, size_t size, ErrorHandler *errh);
+    static uint32_t checksum(const DHCPLeaseJournalRecord &r);
+    static void lease_record(DHCPLeaseJournalRecord &r, const Lease &l);
+};
+
+CLICK_ENDDECLS
+#endif
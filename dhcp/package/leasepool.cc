@@ -50,14 +50,10 @@ LeasePool::new_lease_any(EtherAddress eth)
     if (l) {
         return l;
     }
-    while (_free_list.size()) {
-        IPAddress next = _free_list[0];
-        _free_list.pop_front();
-        if (_free.find(next)) {
-            return new_lease(eth, next);
-        }
-    }
-    return 0;
+    IPAddress ip = _free.next_free();
+    if (!ip)
+        return 0;
+    return new_lease(eth, ip);
 }
 
 Lease *
@@ -67,7 +63,7 @@ LeasePool::new_lease(EtherAddress eth, IPAddress ip)
     if (l) {
         return l;
     }
-    if (_free.get(ip)) {
+    if (_free.is_free(ip)) {
         Lease l;
         l._eth = eth;
         l._ip = ip;
@@ -82,15 +78,14 @@ LeasePool::new_lease(EtherAddress eth, IPAddress ip)
 
 bool
 LeasePool::insert(Lease l) {
-    _free.erase(l._ip);
+    _free.take(l._ip);
     return DHCPLeaseTable::insert(l);
 }
 
 void
 LeasePool::remove(EtherAddress eth) {
     if (Lease *l = rev_lookup(eth)) {
-        _free.set(l->_ip, l->_ip);
-        _free_list.push_back(l->_ip);
+        _free.release(l->_ip);
     }
     return DHCPLeaseTable::remove(eth);
 }
@@ -98,22 +93,53 @@ LeasePool::remove(EtherAddress eth) {
 int
 LeasePool::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+    Vector<String> ranges;
+    Vector<IPAddress> reserved;
     if (Args(conf, this, errh)
         .read_mp("ETH", _eth)
         .read_mp("IP", _ip)
         .read_mp("MASK", _subnet)
         .read("START", _start)
         .read("END", _end)
+        .read_all("RANGE", AnyArg(), ranges)
+        .read_all("RESERVE", reserved)
+        .read("JOURNAL", FilenameArg(), _journal_file)
+        .read("JOURNAL_SYNC", _journal_sync)
+        .read("EXPIRE", _expire)
+        .read("GRACE", SecondsArg(), _grace)
+        .read("EXPIRE_TICK", SecondsArg(), _expire_tick)
         .complete() < 0)
         return -1;
 
-    for (uint32_t x = ntohl(_start.addr()); x <= ntohl(_end.addr()); x++) {
-        IPAddress ip = IPAddress(htonl(x));
-        _free.set(ip, ip);
-        _free_list.push_back(ip);
-    }
+    _free.clear();
+    if ((_start || _end) && _free.add_range(_start, _end, errh) < 0)
+        return -1;
+    for (int i = 0; i < ranges.size(); i++)
+        if (_free.add_range(ranges[i], errh) < 0)
+            return -1;
+    for (int i = 0; i < reserved.size(); i++)
+        _free.reserve(reserved[i]);
     return 0;
 }
 
+String
+LeasePool::read_handler(Element *e, void *)
+{
+    LeasePool *lp = (LeasePool *) e;
+    StringAccum sa;
+    sa << "size " << lp->_free.size() << "\n"
+       << "free " << lp->_free.free_count() << "\n"
+       << "ranges " << lp->_free.nranges() << "\n";
+    return sa.take_string();
+}
+
+void
+LeasePool::add_handlers()
+{
+    DHCPLeaseTable::add_handlers();
+    add_read_handler("pool", read_handler, 0);
+}
+
 EXPORT_ELEMENT(LeasePool LeasePool-LeasePool)
+ELEMENT_REQUIRES(LeaseBitmap)
 CLICK_ENDDECLS
@@ -10,6 +10,7 @@
 #include <click/timer.hh>
 #include <click/timestamp.hh>
 #include "leasetable.hh"
+#include "leasebitmap.hh"
 
 /*
  * =c
@@ -24,6 +25,65 @@
  * LeasePool is responsible of keeping track of free,
  * reservered, and allocated leases.
  *
+ * The free set is a two-level bitmap (see leasebitmap.hh), one bit per
+ * address, so large pools take little memory and start quickly.
+ *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item START, END
+ *
+ * IP addresses. The range of addresses handed out.
+ *
+ * =item RANGE
+ *
+ * Two IP addresses, "LO HI". Another range of addresses to hand out.
+ * May be given more than once; ranges must not overlap each other or
+ * START..END.
+ *
+ * =item RESERVE
+ *
+ * IP address. Never hand out this address. May be given more than once.
+ *
+ * =item JOURNAL
+ *
+ * Filename. If set, leases are logged to this file and reloaded from
+ * it at startup. User-level only.
+ *
+ * =item JOURNAL_SYNC
+ *
+ * Boolean. If true, every journal append is flushed to disk before the
+ * reply goes out. Default false.
+ *
+ * =item EXPIRE
+ *
+ * Boolean. If true, leases that are not renewed are reclaimed. Default
+ * true.
+ *
+ * =item GRACE
+ *
+ * Seconds. How long after its end time a lease is reclaimed. Default 0.
+ *
+ * =item EXPIRE_TICK
+ *
+ * Seconds. Granularity of lease expiry. Default 1.
+ *
+ * =back
+ *
+ * =h pool read-only
+ *
+ * Pool size, free addresses, and number of ranges.
+ *
+ * =h expiry read-only
+ *
+ * Pending expiry timers, leases expired so far, and expirations per
+ * second over the last minute.
+ *
+ * =h expire_rate read-only
+ *
+ * Expirations per second over the last minute.
+ *
  * =e
  * LeasePool(11:22:33:44:55:66, 192.168.10.1, 192.168.10.0, START 192.168.10.10, END 192.168.10.250);
  *
@@ -42,15 +102,13 @@ public:
     const char *processing() const { return AGNOSTIC; }
     void *cast(const char *);
     int configure(Vector<String> &conf, ErrorHandler *errh);
+    void add_handlers();
 
     uint32_t get_default_duration();
     uint32_t get_max_duration();
     IPAddress get_server_ip_addr();
     IPAddress get_subnet_mask();
 
-    void free_list_push(IPAddress);
-    IPAddress free_list_pop();
-
     bool _read_conf_file;
     bool _read_leases_file;
     uint32_t _default_duration;
@@ -65,10 +123,11 @@ public:
     bool insert(Lease);
 
 private:
-    Deque<IPAddress> _free_list;
-    HashTable<IPAddress, IPAddress> _free;
+    LeaseBitmap _free;
     IPAddress _start;
     IPAddress _end;
+
+    static String read_handler(Element *, void *);
 };
 
 #endif /* LEASEPOOL_HH */
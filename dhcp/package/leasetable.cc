@@ -23,13 +23,19 @@
 #include <clicknet/udp.h>
 #include <click/straccum.hh>
 #include "leasetable.hh"
+#include "leasejournal.hh"
 
 DHCPLeaseTable::DHCPLeaseTable()
+    : _journal_sync(false), _journal(0), _expire(true), _grace(0),
+      _expire_tick(1), _expire_timer(this), _compact_timer(this),
+      _expired(0), _hist_sec(0)
 {
+    memset(_expired_hist, 0, sizeof(_expired_hist));
 }
 
 DHCPLeaseTable::~DHCPLeaseTable()
 {
+    delete _journal;
 }
 
 int
@@ -39,11 +45,121 @@ DHCPLeaseTable::configure( Vector<String> &conf, ErrorHandler *errh )
 	.read_mp("ETH", _eth)
 	.read_mp("IP", _ip)
 	.read_mp("MASK", _subnet)
+	.read("JOURNAL", FilenameArg(), _journal_file)
+	.read("JOURNAL_SYNC", _journal_sync)
+	.read("EXPIRE", _expire)
+	.read("GRACE", SecondsArg(), _grace)
+	.read("EXPIRE_TICK", SecondsArg(), _expire_tick)
 	.complete() < 0)
 	return -1;
     return 0;
 }
 
+int
+DHCPLeaseTable::initialize(ErrorHandler *errh)
+{
+    if (_expire) {
+	if (!_expire_tick)
+	    _expire_tick = 1;
+	_hist_sec = Timestamp::now().sec();
+	_wheel.initialize(_expire_tick, _hist_sec);
+	_expire_timer.initialize(this);
+	_expire_timer.schedule_after_sec(_expire_tick);
+    }
+
+    if (!_journal_file)
+	return 0;
+
+    // Replay before attaching the journal, so the inserts below are
+    // not journaled a second time.
+    DHCPLeaseJournal *j = new DHCPLeaseJournal;
+    DHCPLeaseJournal::LiveMap live;
+    if (j->open(_journal_file, _journal_sync, live, errh) < 0) {
+	delete j;
+	return -1;
+    }
+    for (DHCPLeaseJournal::LiveMap::iterator it = live.begin(); it.live(); it++)
+	insert(it.value());
+    _journal = j;
+    _compact_timer.initialize(this);
+    if (_journal->records() > (uint32_t) _leases.size())
+	return _journal->compact(_leases, errh);
+    return 0;
+}
+
+void
+DHCPLeaseTable::cleanup(CleanupStage)
+{
+    delete _journal;
+    _journal = 0;
+}
+
+void
+DHCPLeaseTable::schedule_expiry(const Lease &l)
+{
+    if (_expire)
+	_wheel.schedule(l._eth, l._end.sec() + _grace);
+}
+
+void
+DHCPLeaseTable::run_timer(Timer *t)
+{
+    if (t == &_compact_timer) {
+	if (_journal && _journal->needs_compaction(_leases.size()))
+	    _journal->compact(_leases, ErrorHandler::default_handler());
+	return;
+    }
+
+    uint32_t now = Timestamp::now().sec();
+    _due.clear();
+    _wheel.advance(now, _due);
+
+    // A wheel entry whose deadline no longer matches its lease was
+    // overtaken by a renewal, or the lease is already gone.
+    uint32_t n = 0;
+    for (int i = 0; i < _due.size(); i++) {
+	Lease *l = rev_lookup(_due[i].eth);
+	if (l && (uint32_t) l->_end.sec() + _grace == _due[i].deadline) {
+	    remove(_due[i].eth);
+	    n++;
+	}
+    }
+    _expired += n;
+
+    if ((int32_t) (now - _hist_sec) >= RATE_WINDOW)
+	memset(_expired_hist, 0, sizeof(_expired_hist));
+    else
+	for (uint32_t s = _hist_sec + 1; (int32_t) (s - now) <= 0; s++)
+	    _expired_hist[s % RATE_WINDOW] = 0;
+    _hist_sec = now;
+    _expired_hist[now % RATE_WINDOW] += n;
+
+    _expire_timer.reschedule_after_sec(_expire_tick);
+}
+
+String
+DHCPLeaseTable::expire_rate() const
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < RATE_WINDOW; i++)
+	sum += _expired_hist[i];
+    // In hundredths, so a rate below one lease per second is not 0.
+    uint32_t r = (sum * 100 + RATE_WINDOW / 2) / RATE_WINDOW;
+    StringAccum sa;
+    sa.snprintf(24, "%u.%02u", r / 100, r % 100);
+    return sa.take_string();
+}
+
+// Compaction rewrites the whole file, so it runs from a timer rather
+// than on the packet that tipped the balance.
+void
+DHCPLeaseTable::journal_compact_check()
+{
+    if (_journal->needs_compaction(_leases.size())
+	&& !_compact_timer.scheduled())
+	_compact_timer.schedule_now();
+}
+
 void *
 DHCPLeaseTable::cast(const char *n)
 {
@@ -77,6 +193,10 @@ DHCPLeaseTable::remove(EtherAddress eth)
 	IPAddress ip = l->_ip;
 	_leases.erase(ip);
 	_ips.erase(eth);
+	if (_journal) {
+	    _journal->append_remove(eth, ip);
+	    journal_compact_check();
+	}
     }
 }
 
@@ -86,10 +206,36 @@ DHCPLeaseTable::insert(Lease l) {
 	EtherAddress eth = l._eth;
 	_ips.set(eth, ip);
 	_leases.set(ip, l);
+	schedule_expiry(l);
+	if (_journal) {
+		_journal->append_add(l);
+		journal_compact_check();
+	}
 	return true;
 }
 
-enum {H_LEASES};
+void
+DHCPLeaseTable::renew(Lease *l)
+{
+	l->extend();
+	schedule_expiry(*l);
+	if (_journal) {
+		_journal->append_add(*l);
+		journal_compact_check();
+	}
+}
+
+void
+DHCPLeaseTable::set_valid(Lease *l)
+{
+	l->_valid = true;
+	if (_journal) {
+		_journal->append_add(*l);
+		journal_compact_check();
+	}
+}
+
+enum {H_LEASES, H_JOURNAL, H_COMPACT_JOURNAL, H_EXPIRY, H_EXPIRE_RATE};
 String
 DHCPLeaseTable::read_handler(Element *e, void *thunk)
 {
@@ -107,15 +253,51 @@ DHCPLeaseTable::read_handler(Element *e, void *thunk)
 		}
 		return sa.take_string() + "\n";
 	}
+	case H_JOURNAL: {
+		StringAccum sa;
+		if (lt->_journal)
+			sa << "records " << lt->_journal->records() << "\n"
+			   << "bytes " << lt->_journal->size() << "\n";
+		return sa.take_string();
+	}
+	case H_EXPIRY: {
+		StringAccum sa;
+		sa << "pending " << lt->_wheel.pending() << "\n"
+		   << "expired " << lt->_expired << "\n"
+		   << "rate " << lt->expire_rate() << "\n";
+		return sa.take_string();
+	}
+	case H_EXPIRE_RATE:
+		return String(lt->expire_rate());
 	default:
 		return String();
 	}
 }
+
+int
+DHCPLeaseTable::write_handler(const String &, Element *e, void *thunk,
+			      ErrorHandler *errh)
+{
+	DHCPLeaseTable *lt = (DHCPLeaseTable *)e;
+	switch ((uintptr_t) thunk) {
+	case H_COMPACT_JOURNAL:
+		if (!lt->_journal)
+			return errh->error("no JOURNAL configured");
+		return lt->_journal->compact(lt->_leases, errh);
+	default:
+		return -1;
+	}
+}
 void
 DHCPLeaseTable::add_handlers() 
 {
 	add_read_handler("leases", read_handler, (void *) H_LEASES);
+	add_read_handler("journal", read_handler, (void *) H_JOURNAL);
+	add_read_handler("expiry", read_handler, (void *) H_EXPIRY);
+	add_read_handler("expire_rate", read_handler, (void *) H_EXPIRE_RATE);
+	add_write_handler("compact_journal", write_handler, (void *) H_COMPACT_JOURNAL);
 }
 
 EXPORT_ELEMENT(DHCPLeaseTable)
+ELEMENT_REQUIRES(DHCPLeaseJournal LeaseTimerWheel)
 
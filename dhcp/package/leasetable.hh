@@ -4,8 +4,10 @@
 #include <click/ipaddress.hh>
 #include <click/etheraddress.hh>
 #include <click/hashtable.hh>
+#include <click/timer.hh>
+#include "leasewheel.hh"
 CLICK_DECLS
-
+class DHCPLeaseJournal;
 
 
 class Lease {
@@ -23,8 +25,7 @@ class Lease {
 		Timestamp now = Timestamp::now();
 		_start.set_sec(now.sec());
 		_start.set_subsec(now.subsec());
-		_end.set_sec( _start.sec() + now.sec() );
-		_end.set_subsec( _start.subsec() + now.subsec() );
+		_end = _start + _duration;
 	}
 };
 
@@ -34,6 +35,19 @@ class Lease {
  * implement your own dhcp lease server, subclass this and 
  * implement new_lease_any and new_lease. See leasepool.cc
  * for an example
+ *
+ * Subclasses that accept the JOURNAL keyword get a persistent lease
+ * journal: every insert, renew, remove and validation is appended to
+ * the file, and at initialize the live leases in it are inserted again.
+ * The journal is compacted automatically from a timer, off the packet
+ * path, or on a write to the compact_journal handler. JOURNAL_SYNC
+ * makes every append synchronous.
+ *
+ * Leases expire GRACE seconds after their end time (default 0) unless
+ * EXPIRE is false. Deadlines live in a LeaseTimerWheel advanced every
+ * EXPIRE_TICK seconds (default 1), so expiry never scans the table.
+ * The expiry handler reports pending wheel entries, leases expired, and
+ * the expiry rate per second over the last minute, to two decimals.
  */
 class DHCPLeaseTable : public Element {
 public:
@@ -42,6 +56,9 @@ public:
   const char* class_name() const { return "DHCPLeaseTable"; }
   void* cast(const char*);
   int configure( Vector<String> &conf, ErrorHandler *errh );
+  int initialize(ErrorHandler *errh);
+  void cleanup(CleanupStage);
+  void run_timer(Timer *);
   virtual Lease *lookup(IPAddress ip);
   virtual Lease *rev_lookup(EtherAddress eth);
 
@@ -55,6 +72,8 @@ public:
 	  return 0;
   }
   virtual bool insert(Lease);
+  void renew(Lease *);
+  void set_valid(Lease *);
 
 
   IPAddress _ip;
@@ -66,10 +85,32 @@ public:
 
   HashTable<EtherAddress, IPAddress> _ips;
 
+  String _journal_file;
+  bool _journal_sync;
+  DHCPLeaseJournal *_journal;
+
+  bool _expire;
+  uint32_t _grace;
+  uint32_t _expire_tick;
+  Timer _expire_timer;
+  Timer _compact_timer;
+  LeaseTimerWheel _wheel;
+  Vector<LeaseTimerWheel::Entry> _due;
+  uint64_t _expired;
+  enum { RATE_WINDOW = 60 };
+  uint32_t _expired_hist[RATE_WINDOW];	// expirations per second
+  uint32_t _hist_sec;
 
   static String read_handler(Element *e, void *thunk);
+  static int write_handler(const String &, Element *, void *,
+			   ErrorHandler *);
   void add_handlers();
 
+private:
+  void journal_compact_check();
+  void schedule_expiry(const Lease &l);
+  String expire_rate() const;
+
 };
 
 CLICK_ENDDECLS
@@ -0,0 +1,79 @@
+/*
+ * leasewheel.{cc,hh} -- timer wheel of dhcp lease deadlines
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "leasewheel.hh"
+CLICK_DECLS
+
+LeaseTimerWheel::LeaseTimerWheel()
+    : _tick(1), _last(0), _pending(0)
+{
+}
+
+void
+LeaseTimerWheel::initialize(uint32_t tick, uint32_t now)
+{
+    for (int i = 0; i < NSLOTS; i++)
+	_slots[i].clear();
+    _tick = tick ? tick : 1;
+    _last = now / _tick;
+    _pending = 0;
+}
+
+void
+LeaseTimerWheel::schedule(const EtherAddress &eth, uint32_t deadline)
+{
+    // Round up, so an entry is due by the time its slot runs.  Anything
+    // already due goes in the next slot to be run.
+    uint32_t t = deadline / _tick + (deadline % _tick != 0);
+    if ((int32_t) (t - _last) <= 0)
+	t = _last + 1;
+    Entry e;
+    e.eth = eth;
+    e.deadline = deadline;
+    _slots[t % NSLOTS].push_back(e);
+    _pending++;
+}
+
+void
+LeaseTimerWheel::run_slot(Vector<Entry> &slot, uint32_t now,
+			  Vector<Entry> &due)
+{
+    int keep = 0;
+    for (int i = 0; i < slot.size(); i++)
+	if ((int32_t) (slot[i].deadline - now) <= 0)
+	    due.push_back(slot[i]);
+	else
+	    slot[keep++] = slot[i];
+    _pending -= slot.size() - keep;
+    slot.resize(keep);
+}
+
+void
+LeaseTimerWheel::advance(uint32_t now, Vector<Entry> &due)
+{
+    uint32_t t = now / _tick;
+    if ((int32_t) (t - _last) <= 0)
+	return;
+    // After a long stall every slot is due; run each once.
+    uint32_t n = t - _last;
+    if (n > NSLOTS)
+	n = NSLOTS;
+    for (uint32_t i = 1; i <= n; i++)
+	run_slot(_slots[(t - n + i) % NSLOTS], now, due);
+    _last = t;
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(LeaseTimerWheel)
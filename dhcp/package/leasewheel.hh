@@ -0,0 +1,50 @@
+#ifndef LEASEWHEEL_HH
+#define LEASEWHEEL_HH
+#include <click/etheraddress.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+ * Hashed timer wheel of lease deadlines, used by DHCPLeaseTable to
+ * expire leases without scanning the whole table.
+ *
+ * A deadline goes in slot ceil(deadline / tick) mod NSLOTS; deadlines
+ * more than one turn away simply stay in their slot until a later turn.
+ * Entries are never removed early: renewing a lease schedules a second
+ * entry, and the table drops the first when it comes due and no longer
+ * matches the lease.  An entry is looked at once per turn until it is
+ * due, so with TICK chosen so a turn covers the usual lease time, expiry
+ * costs O(1) amortized per lease.
+ */
+
+class LeaseTimerWheel {
+public:
+    struct Entry {
+	EtherAddress eth;
+	uint32_t deadline;	// seconds
+    };
+
+    LeaseTimerWheel();
+
+    void initialize(uint32_t tick, uint32_t now);
+    void schedule(const EtherAddress &eth, uint32_t deadline);
+
+    // Append every entry due at or before now to due.
+    void advance(uint32_t now, Vector<Entry> &due);
+
+    uint32_t tick() const		{ return _tick; }
+    uint32_t pending() const		{ return _pending; }
+
+    enum { NSLOTS = 4096 };
+
+private:
+    Vector<Entry> _slots[NSLOTS];
+    uint32_t _tick;
+    uint32_t _last;		// last tick advanced over
+    uint32_t _pending;
+
+    void run_slot(Vector<Entry> &slot, uint32_t now, Vector<Entry> &due);
+};
+
+CLICK_ENDDECLS
+#endif
@@ -43,18 +43,31 @@ IGMP::~IGMP()
 int
 IGMP::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-  if (conf.size() != 1)
-    return errh->error("wrong number of arguments; expected 'IGMP(MulticastTable element)'");
+  Element *e;
+  activequerier=true;
+  _query_interval=125000;
+  _response_interval=10000;
+  _last_member_interval=1000;
+  _robustness=2;
+  if (cp_va_kparse(conf, this, errh,
+				   "MCASTTABLE", cpkP+cpkM, cpElement, &e,
+				   "QUERIER", 0, cpBool, &activequerier,
+				   "QUERY_INTERVAL", 0, cpSecondsAsMilli, &_query_interval,
+				   "RESPONSE_INTERVAL", 0, cpSecondsAsMilli, &_response_interval,
+				   "LAST_MEMBER_INTERVAL", 0, cpSecondsAsMilli, &_last_member_interval,
+				   "ROBUSTNESS", 0, cpUnsigned, &_robustness,
+				   cpEnd) < 0)
+	return -1;
+  if (_robustness == 0)
+	return errh->error("ROBUSTNESS must be at least 1");
+  if (_response_interval >= _query_interval)
+	return errh->error("RESPONSE_INTERVAL must be less than QUERY_INTERVAL");
 
   // get MulticastTable element
-  Element *e = cp_element(conf[0], this, errh);
-  if (!e) {
-    return -1;
-  }
-  else {
-	MCastTable = (IPMulticastTable *)e->cast("IPMulticastTable");
-	return 0;
-  }
+  MCastTable = (IPMulticastTable *)e->cast("IPMulticastTable");
+  if (!MCastTable)
+	return errh->error("%s is not an IPMulticastTable", e->name().c_str());
+  return 0;
 }
 
 /*******************************************************************************************
@@ -64,8 +77,12 @@ IGMP::configure(Vector<String> &conf, ErrorHandler *errh)
  *******************************************************************************************/
 int IGMP::initialize(ErrorHandler *errh)
 {
+  uint64_t now=now_msec();
+  _wheel.initialize(TICK, now);
+  _startup_queries=_robustness;
+  _next_general_query=now;
   _igmptimer.initialize(this);
-  _igmptimer.schedule_after_msec(INTERVAL);
+  _igmptimer.schedule_after_msec(TICK);
 
   /*****************************************************************************************
   // ** for performance tests, add a number of groups and receivers ***
@@ -132,6 +149,10 @@ IGMP::simple_action(Packet *p)
    */
 
   unsigned short grouprecord_counter;
+  // fixed part of a group record, without its sources
+  const unsigned int grouprecordsize = sizeof(grouprecord) - sizeof(unsigned int);
+  const igmpv3report *report;
+  const unsigned char *record;
 
   switch(*(char *)igmpmessage)
 	{
@@ -146,6 +167,7 @@ IGMP::simple_action(Packet *p)
 	  }
 	  MCastTable->addgroup(ip->ip_dst);
 	  MCastTable->joingroup(IPAddress(ip->ip_src), IPAddress(ip->ip_dst), PAINT_ANNO(p));
+	  start_timer(IGMPTimerKey::GROUP, IPAddress(ip->ip_src), IPAddress(ip->ip_dst), IPAddress(), membership_interval());
 	  break;
 	  
 	case 0x16:
@@ -154,6 +176,7 @@ IGMP::simple_action(Packet *p)
 	  }
 	  MCastTable->addgroup(ip->ip_dst);
 	  MCastTable->joingroup(IPAddress(ip->ip_src), IPAddress(ip->ip_dst), PAINT_ANNO(p));
+	  start_timer(IGMPTimerKey::GROUP, IPAddress(ip->ip_src), IPAddress(ip->ip_dst), IPAddress(), membership_interval());
 	  break;
 	  
 	case 0x17:
@@ -169,33 +192,55 @@ IGMP::simple_action(Packet *p)
 	  if(click_in_cksum((unsigned char*)igmpmessage, (ntohs(ip->ip_len) - (ip->ip_hl * 4)))!=0) {
 		debug_msg("IGMPv3 message has wrong checksum!");
 	  }
-	  v3report = (igmpv3report *) igmpmessage;
+	  report = (const igmpv3report *) igmpmessage;
+	  if((const unsigned char *) report->grouprecords > p->end_data()) {
+		debug_msg("truncated IGMPv3 report");
+		break;
+	  }
 
-	  for(grouprecord_counter=0; grouprecord_counter < ntohs(v3report->no_of_grouprecords); grouprecord_counter++)
+	  // group records carry a variable number of sources, so they are walked
+	  // by length and each one is checked against the end of the packet
+	  record = (const unsigned char *) report->grouprecords;
+	  for(grouprecord_counter=0; grouprecord_counter < ntohs(report->no_of_grouprecords); grouprecord_counter++)
 		{
+		  const grouprecord *gr = (const grouprecord *) record;
+		  if(record + grouprecordsize > p->end_data()) {
+			debug_msg("truncated IGMPv3 report");
+			break;
+		  }
+		  unsigned short no_of_sources = ntohs(gr->no_of_sources);
+		  record += grouprecordsize + no_of_sources * sizeof(gr->sources[0]) + gr->aux_data_len * 4;
+		  if(record > p->end_data()) {
+			debug_msg("truncated IGMPv3 report");
+			break;
+		  }
 
-		  switch(v3report->grouprecords[grouprecord_counter].type) {
+		  switch(gr->type) {
 
 		  case 0x01: 
-			// host answered to a query, keepalive timer can be restarted, to be implemented in host
-			debug_msg("MODE_IS_INCLUDE"); //recv group mode
-			MCastTable->set_receiver_mode(IPAddress(ip->ip_src), IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address), INCLUDEMODE);
+			// host answered to a query, refresh its state and rebuild any we lost
+			debug_msg("MODE_IS_INCLUDE");
+			mode_is_include(IPAddress(ip->ip_src),
+							IPAddress(gr->multicast_address),
+							no_of_sources,
+							gr->sources,
+							PAINT_ANNO(p));
 			break; 
 
 		  case 0x02:
-			// host answered to a query, keepalive timer can be restarted, to be implemented in host
+			// host answered to a query, refresh its state and rebuild any we lost
 			debug_msg("MODE_IS_EXCLUDE"); 
-			MCastTable->set_receiver_mode(IPAddress(ip->ip_src),
-										  IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address),
-										  EXCLUDEMODE);
+			mode_is_exclude(IPAddress(ip->ip_src),
+							IPAddress(gr->multicast_address),
+							PAINT_ANNO(p));
 			break;
 
 		  case 0x03:
 			debug_msg("CHANGE_TO_INCLUDE_MODE");
 			change_to_include_mode(IPAddress(ip->ip_src),
-								   IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address),
-								   ntohs(v3report->grouprecords[grouprecord_counter].no_of_sources),
-								   grouprecord_counter,
+								   IPAddress(gr->multicast_address),
+								   no_of_sources,
+								   gr->sources,
 								   PAINT_ANNO(p));
 
 			break;
@@ -203,30 +248,30 @@ IGMP::simple_action(Packet *p)
 			debug_msg("CHANGE_TO_EXCLUDE_MODE");
 
 			change_to_exclude_mode(IPAddress(ip->ip_src),
-								   IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address),
-								   ntohs(v3report->grouprecords[grouprecord_counter].no_of_sources),
-								   grouprecord_counter,
+								   IPAddress(gr->multicast_address),
+								   no_of_sources,
+								   gr->sources,
 								   PAINT_ANNO(p));
 
 			break;
 		  case 0x05:
 			debug_msg("ALLOW_NEW_SOURCES");
 			allow_new_sources(IPAddress(ip->ip_src),
-							  IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address),
-							  ntohs(v3report->grouprecords[grouprecord_counter].no_of_sources),
-							  grouprecord_counter,
+							  IPAddress(gr->multicast_address),
+							  no_of_sources,
+							  gr->sources,
 							  PAINT_ANNO(p));
 			break;
 		  case 0x06:
 			debug_msg("BLOCK_OLD_SOURCES");
 			block_old_sources(IPAddress(ip->ip_src),
-							  IPAddress(v3report->grouprecords[grouprecord_counter].multicast_address),
-							  ntohs(v3report->grouprecords[grouprecord_counter].no_of_sources),
-							  grouprecord_counter );
+							  IPAddress(gr->multicast_address),
+							  no_of_sources,
+							  gr->sources);
 			break;
 		  default:
+			debug_msg("Unknown type in IGMP grouprecord");
 			break;
-			debug_msg("Unknown type in IGMP grouprecord or bad group record pointer");
 		  }
 		}
 	  break;
@@ -237,6 +282,58 @@ IGMP::simple_action(Packet *p)
   return p;
 }
 
+/*******************************************************************************************
+ *                                                                                         *
+ * mode_is_include is called after the arrival of type 1 group records                     *
+ *                                                                                         *
+ * it restarts the timers of the given sources, and adds them again if they are missing    *
+ *                                                                                         *
+ *******************************************************************************************/
+bool 
+IGMP::mode_is_include(IPAddress recv,
+					  IPAddress group,
+					  unsigned short no_of_sources,
+					  const unsigned int *sources,
+					  unsigned int paintanno) 
+{
+  if(no_of_sources == 0) return false;
+  MCastTable->addgroup(group);  
+  MCastTable->joingroup(recv, group, paintanno);  
+  MCastTable->set_receiver_mode(recv, group, INCLUDEMODE);
+  stop_timer(IGMPTimerKey::GROUP, recv, group, IPAddress());
+  for(unsigned int source_counter=0; source_counter!=no_of_sources; source_counter++)
+	{
+	  MCastTable->addsource(recv,
+							group,
+							IPAddress(ntohl(sources[source_counter])));
+	  start_timer(IGMPTimerKey::SOURCE,
+				  recv,
+				  group,
+				  IPAddress(sources[source_counter]),
+				  membership_interval());
+	}
+  return true;
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * mode_is_exclude is called after the arrival of type 2 group records                     *
+ *                                                                                         *
+ * it restarts the group timer, and joins the group again if the receiver is missing       *
+ *                                                                                         *
+ *******************************************************************************************/
+bool 
+IGMP::mode_is_exclude(IPAddress recv,
+					  IPAddress group,
+					  unsigned int paintanno) 
+{
+  MCastTable->addgroup(group);  
+  MCastTable->joingroup(recv, group, paintanno);  
+  MCastTable->set_receiver_mode(recv, group, EXCLUDEMODE);
+  start_timer(IGMPTimerKey::GROUP, recv, group, IPAddress(), membership_interval());
+  return true;
+}
+
 /*******************************************************************************************
  *                                                                                         *
  * change_to_exclude_mode is called after the arrival of type 4 group records              *
@@ -248,21 +345,22 @@ bool
 IGMP::change_to_exclude_mode(IPAddress recv,
 							 IPAddress group,
 							 unsigned short no_of_sources,
-							 unsigned short groupcounter,
+							 const unsigned int *sources,
 							 unsigned int paintanno) 
 {
   MCastTable->addgroup(group);  
   MCastTable->joingroup(recv, group, paintanno);  
   MCastTable->set_receiver_mode(recv, group, EXCLUDEMODE);
+  start_timer(IGMPTimerKey::GROUP, recv, group, IPAddress(), membership_interval());
   for(unsigned int source_counter=0; source_counter!=no_of_sources; source_counter++)
 	{
 	  MCastTable->addsource(recv,
 							group,
-							IPAddress(ntohl(v3report->grouprecords[groupcounter].sources[source_counter])));
-	  query(group,
-			IPAddress(ntohl(v3report->grouprecords[groupcounter].sources[source_counter])));
+							IPAddress(ntohl(sources[source_counter])));
+	  schedule_query(group,
+					 IPAddress(ntohl(sources[source_counter])));
 	}
-  if(no_of_sources==0)  query(group, IPAddress("0.0.0.0"));
+  if(no_of_sources==0)  schedule_query(group, IPAddress("0.0.0.0"));
   return true;
 }
 
@@ -278,7 +376,7 @@ bool
 IGMP::change_to_include_mode(IPAddress recv,
 							 IPAddress group,
 							 unsigned short no_of_sources,
-							 unsigned short groupcounter,
+							 const unsigned int *sources,
 							 unsigned int paintanno) 
 {
   MCastTable->addgroup(group);  
@@ -291,12 +389,17 @@ IGMP::change_to_include_mode(IPAddress recv,
 		{
 		  MCastTable->addsource(recv,
 								group,
-								IPAddress(ntohl(v3report->grouprecords[groupcounter].sources[source_counter])));
-		  query(group,
-				IPAddress(ntohl(v3report->grouprecords[groupcounter].sources[source_counter])));
+								IPAddress(ntohl(sources[source_counter])));
+		  start_timer(IGMPTimerKey::SOURCE,
+					  recv,
+					  group,
+					  IPAddress(sources[source_counter]),
+					  membership_interval());
+		  schedule_query(group,
+						 IPAddress(ntohl(sources[source_counter])));
 		}
 	}
-  if(no_of_sources==0) query(group, IPAddress("0.0.0.0"));
+  if(no_of_sources==0) schedule_query(group, IPAddress("0.0.0.0"));
   return true;
 }
 
@@ -308,7 +411,7 @@ IGMP::change_to_include_mode(IPAddress recv,
  *                                                                                         *
  *******************************************************************************************/	  
 bool 
-IGMP::allow_new_sources(IPAddress recv, IPAddress group, unsigned short no_of_sources, unsigned short groupcounter, unsigned int paintanno) 
+IGMP::allow_new_sources(IPAddress recv, IPAddress group, unsigned short no_of_sources, const unsigned int *sources, unsigned int paintanno) 
 {
   MCastTable->addgroup(group);  
   // before doing anything else a group has to be joined
@@ -321,10 +424,15 @@ IGMP::allow_new_sources(IPAddress recv, IPAddress group, unsigned short no_of_so
   // the list of allowed sources is added to the multicast forwarding table
   for(unsigned int source_counter=0; source_counter!=no_of_sources; source_counter++)
 	{
-	  MCastTable->addsource(recv, group, IPAddress(ntohl(v3report->grouprecords[groupcounter].sources[source_counter])));
-	  query(group, IPAddress(ntohl(v3report->grouprecords[groupcounter].sources[source_counter])));
+	  MCastTable->addsource(recv, group, IPAddress(ntohl(sources[source_counter])));
+	  start_timer(IGMPTimerKey::SOURCE,
+				  recv,
+				  group,
+				  IPAddress(sources[source_counter]),
+				  membership_interval());
+	  schedule_query(group, IPAddress(ntohl(sources[source_counter])));
 	}
-  if(no_of_sources==0)  query(group, IPAddress("0.0.0.0"));
+  if(no_of_sources==0)  schedule_query(group, IPAddress("0.0.0.0"));
   return true;
 }
 
@@ -336,17 +444,21 @@ IGMP::allow_new_sources(IPAddress recv, IPAddress group, unsigned short no_of_so
  *                                                                                         *
  *******************************************************************************************/
 bool
-IGMP::block_old_sources(IPAddress recv, IPAddress group, unsigned short no_of_sources, unsigned short groupcounter) 
+IGMP::block_old_sources(IPAddress recv, IPAddress group, unsigned short no_of_sources, const unsigned int *sources) 
 {
    for(unsigned int source_counter=0; source_counter!=no_of_sources; source_counter++)
 	{
 	  MCastTable->delsource(recv,
 							group,
-							IPAddress(v3report->grouprecords[groupcounter].sources[source_counter]));
-	  query(group,
-			IPAddress(v3report->grouprecords[groupcounter].sources[source_counter]));
+							IPAddress(sources[source_counter]));
+	  stop_timer(IGMPTimerKey::SOURCE,
+				 recv,
+				 group,
+				 IPAddress(sources[source_counter]));
+	  schedule_query(group,
+					 IPAddress(ntohl(sources[source_counter])));
 	}
-   if(no_of_sources==0) query(group, IPAddress("0.0.0.0"));
+   if(no_of_sources==0) schedule_query(group, IPAddress("0.0.0.0"));
    return true;
 }
 
@@ -399,8 +511,10 @@ IGMP::query(IPAddress group, IPAddress source)
   igmpbegin = (unsigned char *)q->data()+sizeof(click_ip);
   igp=(igmpv3querie *) igmpbegin;
   igp->type=0x11;
-  // the responsecode may vary, the value 1 is ok
-  igp->responsecode=1;
+  // maximum response time in 1/10 seconds, general queries get
+  // RESPONSE_INTERVAL, specific ones LAST_MEMBER_INTERVAL
+  uint32_t response=(group==a.addr() ? _response_interval : _last_member_interval) / 100;
+  igp->responsecode=(response < 128 ? response : 127);
   // in a general query the group address is set to 0
   igp->group=group;
   // to create group specific queries just set a group address
@@ -409,7 +523,7 @@ IGMP::query(IPAddress group, IPAddress source)
   
   // querier robustness value (qrv) instructs the host to send all messages 
   // qrv times
-  igp->s_and_qrv=0x03; 
+  igp->s_and_qrv=(_robustness < 8 ? _robustness : 0); 
   igp->qqic=0x00;
 
   if(source==a.addr())	igp->no_of_sources=0x00;
@@ -450,19 +564,119 @@ IGMP::query(IPAddress group, IPAddress source)
 
 /*******************************************************************************************
  *                                                                                         *
- * run_timer is called continually, it reschedules itself                                  *
+ * timers: group timers (receivers in exclude mode and IGMPv1/v2 receivers), source        *
+ * timers (sources a receiver includes) and query timers (repeated specific queries)       *
+ * all run on one timer wheel                                                              *
+ *                                                                                         *
+ *******************************************************************************************/
+uint64_t
+IGMP::now_msec()
+{
+  return Timestamp::now().msecval();
+}
+
+void
+IGMP::start_timer(int kind, IPAddress recv, IPAddress group, IPAddress source, uint32_t delay)
+{
+  IGMPTimerKey key(kind, recv, group, source);
+  timerstate ts;
+  ts.deadline=now_msec() + delay;
+  ts.queries=0;
+  _timers.set(key, ts);
+  _wheel.schedule(key, ts.deadline);
+}
+
+void
+IGMP::stop_timer(int kind, IPAddress recv, IPAddress group, IPAddress source)
+{
+  _timers.erase(IGMPTimerKey(kind, recv, group, source));
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * schedule_query sends a group or group-and-source specific query now and robustness-1    *
+ * more at the last member query interval; a query already pending is restarted            *
+ *                                                                                         *
+ *******************************************************************************************/
+void
+IGMP::schedule_query(IPAddress group, IPAddress source)
+{
+  if(!activequerier) return;
+  IGMPTimerKey key(IGMPTimerKey::QUERY, IPAddress(), group, source);
+  bool pending=_timers.find(key);
+  timerstate ts;
+  ts.deadline=now_msec() + _last_member_interval;
+  ts.queries=_robustness - 1;
+  if(ts.queries==0) {
+	_timers.erase(key);
+	query(group, source);
+	return;
+  }
+  _timers.set(key, ts);
+  _wheel.schedule(key, ts.deadline);
+  if(!pending) query(group, source);
+}
+
+void
+IGMP::expire(const IGMPTimerWheel::Entry &e)
+{
+  HashTable<IGMPTimerKey, timerstate>::iterator it=_timers.find(e.key);
+  // restarted or stopped since this entry was scheduled
+  if(!it || it.value().deadline!=e.deadline) return;
+
+  const IGMPTimerKey &k=e.key;
+  switch(k.kind) {
+  case IGMPTimerKey::GROUP:
+	_timers.erase(k);
+	// an include mode receiver stays as long as one of its sources does
+	if(MCastTable->get_receiver_mode(k.receiver, k.group)!=INCLUDEMODE) {
+	  debug_msg("IGMP: group membership timed out");
+	  MCastTable->leavegroup(k.receiver, k.group);
+	}
+	break;
+  case IGMPTimerKey::SOURCE:
+	_timers.erase(k);
+	debug_msg("IGMP: source timed out");
+	MCastTable->delsource(k.receiver, k.group, k.source);
+	break;
+  case IGMPTimerKey::QUERY:
+	query(k.group, k.source);
+	if(--it.value().queries==0)
+	  _timers.erase(k);
+	else {
+	  it.value().deadline=e.deadline + _last_member_interval;
+	  _wheel.schedule(k, it.value().deadline);
+	}
+	break;
+  }
+}
+
+/*******************************************************************************************
  *                                                                                         *
- * for now it calls the function that generates general queries                            *
- * other queries might be added in future releases                                         *
+ * run_timer is called every TICK, it expires due timers and sends general queries         *
  *                                                                                         *
  *******************************************************************************************/
 void
 IGMP::run_timer(Timer *)
 {
-  //  debug_msg("IGMP run timer .X.X.");  
-  //  MCastTable->printgroups(true);
-  //  query(IPAddress("0.0.0.0"), IPAddress("0.0.0.0"));
-  _igmptimer.reschedule_after_msec(INTERVAL);
+  uint64_t now=now_msec();
+  _due.clear();
+  _wheel.advance(now, _due);
+  for(int i=0; i<_due.size(); i++)
+	expire(_due[i]);
+
+  if(activequerier && now >= _next_general_query) {
+	//  MCastTable->printgroups(true);
+	query(IPAddress("0.0.0.0"), IPAddress("0.0.0.0"));
+	if(_startup_queries > 0) {
+	  _startup_queries--;
+	  _next_general_query=now + _query_interval / 4;
+	}
+	else
+	  _next_general_query=now + _query_interval;
+  }
+  _igmptimer.reschedule_after_msec(TICK);
 }
 
 EXPORT_ELEMENT(IGMP)
+ELEMENT_REQUIRES(IGMPTimerWheel)
@@ -4,10 +4,12 @@
 #include "ipmulticasttable.hh"
 #include <click/timer.hh>
 #include <click/element.hh>
+#include <click/hashtable.hh>
+#include "igmptimerwheel.hh"
 
 /*
 =c
-IGMP(IPMulticastTable)
+IGMP(IPMulticastTable [, I<keywords>])
 
 =s IPv4 Multicast
 
@@ -18,6 +20,44 @@ This element checks whether an arriving IGMP message is valid (checksum) and tak
 
 It manages the databank of listeners kept in the IPMulticastTable element.
 
+Memberships time out as in RFC3376: a receiver in EXCLUDE mode (and any
+IGMPv1/v2 receiver) is dropped from its group, and a source a receiver
+INCLUDEs is dropped from its list, when no report has refreshed it for
+the group membership interval (ROBUSTNESS * QUERY_INTERVAL +
+RESPONSE_INTERVAL).  General queries go out every QUERY_INTERVAL, the
+first ROBUSTNESS of them a quarter interval apart.  Every group or
+group-and-source specific query is repeated ROBUSTNESS times,
+LAST_MEMBER_INTERVAL apart.  All timers share one timer wheel, so
+starting or restarting a timer costs O(1) however many receivers,
+groups and sources there are.
+
+Keyword arguments are:
+
+=over 8
+
+=item QUERIER
+
+Boolean.  Send queries.  Default true.
+
+=item QUERY_INTERVAL
+
+Time between general queries.  Default 125 seconds.
+
+=item RESPONSE_INTERVAL
+
+Maximum response time advertised in general queries.  Default 10 seconds.
+
+=item LAST_MEMBER_INTERVAL
+
+Time between repetitions of group and source specific queries, also
+advertised as their maximum response time.  Default 1 second.
+
+=item ROBUSTNESS
+
+Robustness variable.  Default 2.
+
+=back
+
 =e
 mct::MulticastTable("pimctl");
 
@@ -52,25 +92,57 @@ private:
   void query(IPAddress, IPAddress);
   //  void generalquery();
   void run_timer(Timer *);
-  bool change_to_include_mode(IPAddress, IPAddress, unsigned short, unsigned short, unsigned int);
-  bool change_to_exclude_mode(IPAddress, IPAddress, unsigned short, unsigned short, unsigned int);
-  bool allow_new_sources(IPAddress, IPAddress, unsigned short, unsigned short, unsigned int);  
-  bool block_old_sources(IPAddress, IPAddress, unsigned short, unsigned short);
+  bool mode_is_include(IPAddress, IPAddress, unsigned short, const unsigned int *, unsigned int);
+  bool mode_is_exclude(IPAddress, IPAddress, unsigned int);
+  bool change_to_include_mode(IPAddress, IPAddress, unsigned short, const unsigned int *, unsigned int);
+  bool change_to_exclude_mode(IPAddress, IPAddress, unsigned short, const unsigned int *, unsigned int);
+  bool allow_new_sources(IPAddress, IPAddress, unsigned short, const unsigned int *, unsigned int);  
+  bool block_old_sources(IPAddress, IPAddress, unsigned short, const unsigned int *);
 
   /* if there is another igmp router on the same network the router with the lowest IP address 
    * keeps being active, the other one is disabled
    * if activequerier is false, this router does not generate IGMP queries 
    *
-   * this is not working yet
+   * the election is not working yet, activequerier is set by the QUERIER keyword
    */
 
   bool activequerier; 
 
 
   igmpv1andv2message *v1andv2message;
-  igmpv3report *v3report;
 
-  static const int INTERVAL = 4000; // RFC says 125000;
+  /* group, source and query timers
+   *
+   * _timers holds the deadline of every running timer; the wheel only
+   * says when to look at a timer, an entry whose deadline is no longer
+   * the one in _timers belongs to a timer that was restarted or stopped
+   */
+  struct timerstate {
+	uint64_t deadline;         // msec
+	unsigned int queries;      // query timers: queries still to send
+  };
+
+  HashTable<IGMPTimerKey, timerstate> _timers;
+  IGMPTimerWheel _wheel;
+  Vector<IGMPTimerWheel::Entry> _due;
+
+  uint32_t _query_interval;    // msec
+  uint32_t _response_interval;
+  uint32_t _last_member_interval;
+  unsigned int _robustness;
+  unsigned int _startup_queries;
+  uint64_t _next_general_query;
+
+  uint32_t membership_interval() const {
+	return _robustness * _query_interval + _response_interval;
+  }
+  static uint64_t now_msec();
+  void start_timer(int, IPAddress, IPAddress, IPAddress, uint32_t);
+  void stop_timer(int, IPAddress, IPAddress, IPAddress);
+  void schedule_query(IPAddress, IPAddress);
+  void expire(const IGMPTimerWheel::Entry &);
+
+  static const int TICK = 100; // msec
   Timer _igmptimer;
 };
 
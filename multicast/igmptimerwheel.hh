@@ -0,0 +1,72 @@
+#ifndef IGMPTIMERWHEEL_HH
+#define IGMPTIMERWHEEL_HH
+#include <click/ipaddress.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+ * IGMPTimerWheel: hashed timer wheel for the IGMP element's group,
+ * source and query timers
+ *
+ * A deadline (msec) goes in slot ceil(deadline / tick) mod NSLOTS.
+ * Entries are never removed early: restarting a timer schedules a new
+ * entry, and IGMP ignores an entry that comes due but no longer matches
+ * the deadline it has on record.  Scheduling is O(1), and an entry is
+ * looked at once per turn of the wheel until it is due.
+ */
+
+struct IGMPTimerKey {
+  enum { GROUP, SOURCE, QUERY };
+
+  IPAddress receiver;          // 0 for query timers
+  IPAddress group;
+  IPAddress source;            // network byte order, 0 for group timers
+  int kind;
+
+  IGMPTimerKey() : kind(GROUP) { }
+  IGMPTimerKey(int k, IPAddress r, IPAddress g, IPAddress s)
+	: receiver(r), group(g), source(s), kind(k) { }
+
+  size_t hashcode() const {
+	return ((receiver.addr() * 2654435761U) ^ group.addr()
+			^ (source.addr() * 40503U)) + kind;
+  }
+  bool operator==(const IGMPTimerKey &k) const {
+	return receiver == k.receiver && group == k.group
+	  && source == k.source && kind == k.kind;
+  }
+};
+
+class IGMPTimerWheel {
+ public:
+
+  struct Entry {
+	IGMPTimerKey key;
+	uint64_t deadline;         // msec
+  };
+
+  IGMPTimerWheel();
+
+  void initialize(uint32_t tick, uint64_t now);
+  void schedule(const IGMPTimerKey &key, uint64_t deadline);
+
+  // Append every entry due at or before now to due.
+  void advance(uint64_t now, Vector<Entry> &due);
+
+  uint32_t tick() const		{ return _tick; }
+  uint32_t pending() const		{ return _pending; }
+
+  enum { NSLOTS = 4096 };
+
+ private:
+
+  Vector<Entry> _slots[NSLOTS];
+  uint32_t _tick;
+  uint64_t _last;              // last tick advanced over
+  uint32_t _pending;
+
+  void run_slot(Vector<Entry> &slot, uint64_t now, Vector<Entry> &due);
+};
+
+CLICK_ENDDECLS
+#endif
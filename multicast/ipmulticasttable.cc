@@ -19,6 +19,9 @@
 #include <click/config.h>
 #include "ipmulticasttable.hh"
 #include "pimcontrol.hh"
+#include "mcastfwdcache.hh"
+#include "mcastfanout.hh"
+#include "mcastsourcefilter.hh"
 #include <click/ipaddress.hh>
 #include <click/router.hh>
 #include <click/confparse.hh>
@@ -62,16 +65,45 @@ IPMulticastTable::configure(Vector<String> &conf, ErrorHandler *errh)
 }
 
 int
-IPMulticastTable::initialize(ErrorHandler *errh)
+IPMulticastTable::initialize(ErrorHandler *)
 {
-  bool b=false;
+  _fwd.initialize(this);
+  return 0;
+}
 
-  for(unsigned int i=0; i<no_of_interfaces; ++i) { 
-	interfaces.push_back(b);
+/*******************************************************************************************
+ *                                                                                         *
+ * join_handler: "GROUP RECEIVER [SOURCE]" joins a receiver as an IGMP report would,       *
+ *               in INCLUDE mode with SOURCE if one is given                               *
+ *                                                                                         *
+ *******************************************************************************************/
+int
+IPMulticastTable::join_handler(const String &s, Element *e, void *, ErrorHandler *errh)
+{
+  IPMulticastTable *mct=static_cast<IPMulticastTable *>(e);
+  Vector<String> words;
+  cp_spacevec(cp_uncomment(s), words);
+  IPAddress group, recv, source;
+  if ((words.size()!=2 && words.size()!=3)
+	  || !cp_ip_address(words[0], &group) || !cp_ip_address(words[1], &recv)
+	  || (words.size()==3 && !cp_ip_address(words[2], &source)))
+	return errh->error("expected GROUP RECEIVER [SOURCE]");
+  mct->addgroup(group);
+  mct->joingroup(recv, group, 0);
+  if (words.size()==3) {
+	// sources go in host byte order, as IGMP passes them
+	mct->set_receiver_mode(recv, group, INCLUDEMODE);
+	mct->addsource(recv, group, IPAddress(ntohl(source.addr())));
   }
   return 0;
 }
 
+void
+IPMulticastTable::add_handlers()
+{
+  add_write_handler("join", join_handler, 0);
+}
+
 bool IPMulticastTable::addgroup(IPAddress group)
 {
   MulticastGroup newgroup;
@@ -97,6 +129,7 @@ bool IPMulticastTable::joingroup(IPAddress recv, IPAddress group, unsigned int i
 {
   receiver new_receiver;           // create new receiver struct
   new_receiver.receiver=recv;      // initialize this new struct with receivers IP address
+  new_receiver.mode=EXCLUDEMODE;   // IGMPv1/v2 joins are EXCLUDE {}, IGMPv3 reports set the mode
 
   Vector<MulticastGroup>::iterator i;
 
@@ -120,6 +153,7 @@ bool IPMulticastTable::joingroup(IPAddress recv, IPAddress group, unsigned int i
 	  	  debug_msg("IPMulticasttable: Adding %d.%d.%d.%d to group %d.%d.%d.%d", p2[0], p2[1], p2[2], p2[3], p[0], p[1], p[2], p[3]);
 		  (*i).interface_id=interface;
 		  (*i).receivers.push_back(new_receiver); 
+		  update_route(group);
 	}
   }
    // printgroups(true);
@@ -162,8 +196,8 @@ bool IPMulticastTable::leavegroup(IPAddress recv, IPAddress group)
 			// (XXX) send a listener query first
 			multicastgroups.erase(i);
 			debug_msg("IPMulticasttable: deleted group");
-			return true;
 		  }
+		  update_route(group);
 		  return true;  
 		}
 	  }
@@ -234,46 +268,100 @@ bool IPMulticastTable::printgroups(bool printreceivers)
  *******************************************************************************************/
 void IPMulticastTable::push(int port, Packet *p_in)
 {
-  bool submitted_packet=false;
   IPAddress group=IPAddress(p_in->dst_ip_anno());
-  Vector<MulticastGroup>::iterator  i;
-  for(i=multicastgroups.begin(); i!=multicastgroups.end(); ++i)
+  IPAddress source=IPAddress(p_in->ip_header()->ip_src);
+  const MulticastForwardingCache<IPAddress>::Route *route=_fwd.lookup(source, group);
+  // an empty route is a source every receiver of the group has blocked
+  if(route && route->out.size())
 	{
-	  //	  click_chatter("IPMulticasttable: scanning %x for %x",(*i).group.addr() ,group.addr());
-	  if(((*i).receivers.size() != 0) && 
-		 //		 interfaces[(*i).interface_id]==false &&
-		 group.addr()==(*i).group.addr())
-
-		
-		{
-		  //	  click_chatter("IPMulticasttable: ipv4mct push found group");
-		  interfaces[(*i).interface_id]=true;
-		  Vector<receiver>::iterator a;
-		  for(a=(*i).receivers.begin(); a!=(*i).receivers.end(); ++a)
-			{
-			  submitted_packet=true;
-			  Packet *q_in = p_in->clone();
-			  WritablePacket *p = q_in->uniqueify();
-			  click_ip *ip = p->ip_header();
-			  ip->ip_ttl=(ip->ip_ttl)-1;
-			  IPAddress r=IPAddress((*a).receiver.addr());
-			  q_in->set_dst_ip_anno(r);
-			  int hlen = ip->ip_hl << 2;
-			  ip->ip_sum = 0;
-			  ip->ip_sum = click_in_cksum((unsigned char *)ip, hlen);
-			  // debug_msg("IPMulticasttable: pushing packet with new dst_ip_anno to ip router");
-			  output(0).push(p);
-			}
+	  //	  click_chatter("IPMulticasttable: ipv4mct push found group");
+	  // p_in goes on to the PIM table unchanged, so make one writable
+	  // copy and share it between all receivers
+	  if(Packet *q_in = p_in->clone())
+		if(WritablePacket *p = q_in->uniqueify()) {
+		  mcast_dec_ttl(p->ip_header());
+		  // debug_msg("IPMulticasttable: pushing packets with new dst_ip_anno to ip router");
+		  mcast_fanout(output(0), p, route->out);
 		}
 	}
   // after forwarding the multicast stream to all connected hosts, forward the stream to the PIM table
   // debug_msg("IPMulticasttable: IPMulticastTable pushes stream to PIM table");
+  output(1).push(p_in);
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * update_route: compiles the source filters of a group's receivers after a membership     *
+ *               change, installs an (S,G) entry for every source some receiver lists and  *
+ *               a (*,G) entry for all other sources, and drops entries no longer needed;  *
+ *               a listed source nobody wants keeps an empty (S,G) entry, so its traffic   *
+ *               does not fall back to the (*,G) receivers that excluded it                *
+ *                                                                                         *
+ *******************************************************************************************/
+void IPMulticastTable::update_route(IPAddress group)
+{
+  Vector<MulticastForwardingCache<IPAddress>::Update> updates;
+  MulticastForwardingCache<IPAddress>::Update u;
+
+  Vector<MulticastGroup>::iterator i;
+  for(i=multicastgroups.begin(); i!=multicastgroups.end(); ++i)
+	if((*i).group.addr()==group.addr()) break;
+
+  Vector<receiver> empty;
+  Vector<receiver> &rs=(i!=multicastgroups.end() ? (*i).receivers : empty);
+  MulticastSourceFilter filter(rs.size());
+  for(int r=0; r<rs.size(); ++r) {
+	// sources are stored in network byte order, like ip_src
+	if(rs[r].mode==INCLUDEMODE)
+	  for(int j=0; j<rs[r].sources.size(); ++j)
+		filter.include(r, rs[r].sources[j]);
+	else {
+	  filter.exclude(r);
+	  for(int j=0; j<rs[r].sources.size(); ++j)
+		filter.exclude(r, rs[r].sources[j]);
+	}
+  }
 
-  for(unsigned int intr=0; intr<(no_of_interfaces-1); ++intr) { 
-	interfaces[intr]=false;
+  // every listed source gets an (S,G) entry, empty if no receiver wants it;
+  // replacing an entry in place never exposes the (*,G) entry in between
+  Vector<int> members;
+  Vector<IPAddress> routed;
+  for(int j=0; j<filter.sources().size(); ++j) {
+	u.source=filter.sources()[j];
+	members.clear();
+	filter.receivers(u.source, members);
+	for(int m=0; m<members.size(); ++m)
+	  u.route.out.push_back(rs[members[m]].receiver);
+	updates.push_back(u);
+	u.route.out.clear();
+	routed.push_back(u.source);
   }
-  
-  output(1).push(p_in);
+
+  u.source=IPAddress();
+  members.clear();
+  filter.receivers(u.source, members);
+  for(int m=0; m<members.size(); ++m)
+	u.route.out.push_back(rs[members[m]].receiver);
+  // a group nobody receives needs no (*,G) entry
+  u.remove=(members.size()==0);
+  updates.push_back(u);
+  u.route.out.clear();
+
+  // (S,G) entries of sources no longer listed go
+  u.remove=true;
+  HashTable<IPAddress, Vector<IPAddress> >::iterator old=_routed_sources.find(group);
+  if(old)
+	for(int j=0; j<old.value().size(); ++j)
+	  if(!filter.listed(old.value()[j])) {
+		u.source=old.value()[j];
+		updates.push_back(u);
+	  }
+
+  if(routed.size()==0)
+	_routed_sources.erase(group);
+  else
+	_routed_sources[group].swap(routed);
+  _fwd.update(group, updates);
 }
 
 /*******************************************************************************************
@@ -302,6 +390,7 @@ bool IPMulticastTable::addsource(IPAddress recv, IPAddress group, IPAddress sa)
 
 				}
 				(*re).sources.push_back(ntohl(IPAddress(sa)));
+				update_route(group);
 				if (pimenable==true) {
 				  debug_msg("IPMulticasttable: PIM join");
 				  pPim->join(group, sa);
@@ -336,13 +425,14 @@ bool IPMulticastTable::delsource(IPAddress recv, IPAddress group, IPAddress sa)
 				for(a=(*re).sources.begin(); a!=(*re).sources.end(); ++a) {
 				  if((*a).addr()==sa.addr()) {
 					(*re).sources.erase(a);
+					update_route(group);
 					// "dead" receivers are dropped from the list
 					if((get_receiver_mode(recv, group)==INCLUDEMODE) && ((*re).sources.size()==0)) {
 					  leavegroup(recv, group);
 					  // if this group has no more receivers connected to the router PIM is informed
 					  if ((pimenable) && (pPim->noPIMreceivers(group, htonl(sa)))) pPim->prune(group, htonl(sa));
-					  return true;
 					}
+					return true;
 				  }
 				}
 			  }
@@ -385,6 +475,7 @@ IPMulticastTable::set_receiver_mode(IPAddress recv, IPAddress group, MODE mode)
 			{
 			  if((*a).receiver.addr()==recv.addr())  {
 				(*a).mode=mode;
+				update_route(group);
 				return true;
 				debug_msg("IPMulticasttable: setmode %x", mode);
 			  }
@@ -423,4 +514,5 @@ bool IPMulticastTable::getIGMPreceivers(IPAddress source, IPAddress group)
 }
 
 EXPORT_ELEMENT(IPMulticastTable)
+ELEMENT_REQUIRES(MulticastSourceFilter)
   
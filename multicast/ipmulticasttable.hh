@@ -3,6 +3,8 @@
 CLICK_DECLS
 #include <click/element.hh>
 #include "pimcontrol.hh"
+#include "mcastfwdcache.hh"
+#include <click/hashtable.hh>
 
 
 /*
@@ -16,6 +18,20 @@ IPMulticastTable(PIMControl)
 Includes data structures to store addresses of receivers of multicast streams (IPv4).
 Each multicast group entry can hold information about senders and receivers.
 The data structures is based upon STL containers.
+Data packets are forwarded from a hashed (source, group) cache that the
+membership calls keep up to date, so forwarding does not depend on the
+number of groups.  Each group's INCLUDE and EXCLUDE source lists are
+compiled into receiver bitmaps, giving one cache entry per listed
+source and one for every other source, so a packet from source S
+reaches exactly the receivers whose filters let S through.  The data
+path reads that cache without locking, so it may run on several
+threads while IGMP and PIM change the membership.
+
+=h join write-only
+
+"GROUP RECEIVER [SOURCE]": RECEIVER joins GROUP as for an IGMP report,
+in INCLUDE mode with SOURCE if one is given.  MulticastBench fills the
+table this way.
 
 =e
 mct::IPMulticastTable("pimctl");
@@ -59,10 +75,10 @@ class IPMulticastTable : public Element {
   MulticastGroup *gp;
 
   Vector<MulticastGroup> multicastgroups;
-  Vector<bool> interfaces;
 
   int configure(Vector<String> &, ErrorHandler *);
   int initialize(ErrorHandler *);
+  void add_handlers();
   bool printreceiver(Vector<MulticastGroup>::iterator);
   bool addgroup(IPAddress);
   bool joingroup(IPAddress, IPAddress, unsigned int);
@@ -76,9 +92,14 @@ class IPMulticastTable : public Element {
   bool getIGMPreceivers(IPAddress, IPAddress);
 
 private:
+  static int join_handler(const String &, Element *, void *, ErrorHandler *);
   bool pimenable;
   unsigned int no_of_interfaces;
   PIMControl* pPim;
+
+  MulticastForwardingCache<IPAddress> _fwd;
+  HashTable<IPAddress, Vector<IPAddress> > _routed_sources; // sources with an (S,G) entry, per group
+  void update_route(IPAddress);
 };
 
 CLICK_ENDDECLS
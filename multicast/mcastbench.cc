@@ -0,0 +1,485 @@
+/*
+ * mcastbench.{cc,hh} -- IPv4 and IPv6 multicast forwarding scalability benchmark
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "mcastbench.hh"
+#include <click/confparse.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/router.hh>
+#include <click/glue.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ip.h>
+#include <clicknet/ip6.h>
+#include <clicknet/udp.h>
+#if CLICK_USERLEVEL
+# include <stdio.h>
+# include <unistd.h>
+#endif
+#include "debug.hh"
+
+MulticastBench::MulticastBench()
+  : _mct(0), _pimft(0), _mct_join(0), _pim_join(0), _task(this), _populate_kb(0)
+{
+}
+
+MulticastBench::~MulticastBench()
+{
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * configure: get the tables to fill and the shape of the membership                       *
+ *                                                                                         *
+ *******************************************************************************************/
+int
+MulticastBench::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  Element *pe=0;
+  _ip6=false;
+  _ngroups=1000;
+  _nreceivers=10;
+  _nsources=0;
+  _nneighbors=1;
+  _length=64;
+  _burst=32;
+  _limit=1000000;
+  _nsamples=100000;
+  _stop=false;
+  _active=true;
+  if (cp_va_kparse(conf, this, errh,
+				   "MCASTTABLE", cpkP+cpkM, cpElement, &_mct,
+				   "IP6", 0, cpBool, &_ip6,
+				   "GROUPS", 0, cpUnsigned, &_ngroups,
+				   "RECEIVERS", 0, cpUnsigned, &_nreceivers,
+				   "SOURCES", 0, cpUnsigned, &_nsources,
+				   "PIMTABLE", 0, cpElement, &pe,
+				   "PIM_NEIGHBORS", 0, cpUnsigned, &_nneighbors,
+				   "LENGTH", 0, cpUnsigned, &_length,
+				   "BURST", 0, cpUnsigned, &_burst,
+				   "LIMIT", 0, cpUnsigned, &_limit,
+				   "SAMPLES", 0, cpUnsigned, &_nsamples,
+				   "STOP", 0, cpBool, &_stop,
+				   "ACTIVE", 0, cpBool, &_active,
+				   cpEnd) < 0)
+	return -1;
+
+#if !HAVE_IP6
+  if (_ip6)
+	return errh->error("IP6 needs Click built with IPv6 support");
+#endif
+  const char *mct_class=(_ip6 ? "IP6MulticastTable" : "IPMulticastTable");
+  const char *pim_class=(_ip6 ? "IP6PIMForwardingTable" : "PIMForwardingTable");
+  if (!_mct->cast(mct_class))
+	return errh->error("%s is not an %s", _mct->name().c_str(), mct_class);
+  if (pe && !pe->cast(pim_class))
+	return errh->error("%s is not a %s", pe->name().c_str(), pim_class);
+  _pimft=pe;
+
+  if (_ngroups == 0 || _ngroups > 0xFFFFFF)
+	return errh->error("GROUPS must be between 1 and 16777215");
+  if (_nreceivers > 0xFFFFFF || _nsources > 0xFFFF || _nneighbors > 255)
+	return errh->error("RECEIVERS, SOURCES or PIM_NEIGHBORS too large");
+  unsigned min_length=(_ip6 ? sizeof(click_ip6) : sizeof(click_ip)) + sizeof(click_udp);
+  if (_length < min_length)
+	return errh->error("LENGTH must be at least %u", min_length);
+  if (_burst == 0)
+	_burst = 1;
+  return 0;
+}
+
+int
+MulticastBench::initialize(ErrorHandler *errh)
+{
+  _mct_join=Router::handler(_mct, "join");
+  if (!_mct_join || !_mct_join->writable())
+	return errh->error("%s has no join handler", _mct->name().c_str());
+  if (_pimft) {
+	_pim_join=Router::handler(_pimft, "join");
+	if (!_pim_join || !_pim_join->writable())
+	  return errh->error("%s has no join handler", _pimft->name().c_str());
+  }
+  uint32_t n=_ngroups;
+  _ngroups=0;
+  populate(n, _nreceivers);
+  reset();
+  _task.initialize(this, _active);
+  return 0;
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * addresses: the Nth group, receiver, source, PIM interface or PIM neighbor; see the      *
+ *            table in mcastbench.hh                                                       *
+ *                                                                                         *
+ *******************************************************************************************/
+IPAddress
+MulticastBench::ip_address(int kind, uint32_t n)
+{
+  switch (kind) {
+  case A_GROUP:
+	return IPAddress(htonl(0xE8000001 + n));
+  case A_RECEIVER:
+	return IPAddress(htonl(0x0A000001 + n));
+  case A_SOURCE:
+	return IPAddress(htonl(0xAC100001 + n));
+  case A_INTERFACE:
+	return IPAddress(htonl(0xC0A80001 | (n << 8)));
+  default:
+	return IPAddress(htonl(0xC0A80002 | (n << 8)));
+  }
+}
+
+#if HAVE_IP6
+IP6Address
+MulticastBench::ip6_address(int kind, uint32_t n)
+{
+  IP6Address a;
+  uint32_t *d=a.data32();
+  d[0]=htonl(0x20010DB8);
+  d[1]=0;
+  d[2]=0;
+  switch (kind) {
+  case A_GROUP:
+	d[0]=htonl(0xFF3E0000);
+	d[3]=htonl(0x80000001 + n);
+	break;
+  case A_RECEIVER:
+	d[3]=htonl(1 + n);
+	break;
+  case A_SOURCE:
+	d[1]=htonl(0x00010000);
+	d[3]=htonl(1 + n);
+	break;
+  default:
+	d[1]=htonl(0x00FF0000 | n);
+	d[3]=htonl(kind==A_INTERFACE ? 1 : 2);
+	break;
+  }
+  return a;
+}
+#endif
+
+String
+MulticastBench::address(int kind, uint32_t n) const
+{
+#if HAVE_IP6
+  if (_ip6)
+	return ip6_address(kind, n).unparse();
+#endif
+  return ip_address(kind, n).unparse();
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * populate: adds n groups through the tables' own membership calls, as IGMP and PIM       *
+ *           would, and records the time and memory that took                              *
+ *                                                                                         *
+ *******************************************************************************************/
+void
+MulticastBench::populate(uint32_t n, uint32_t receivers)
+{
+  if (n > 0xFFFFFF - _ngroups)
+	n = 0xFFFFFF - _ngroups;
+  ErrorHandler *errh=ErrorHandler::default_handler();
+  uint32_t kb=resident_kb();
+  Timestamp start=Timestamp::now();
+
+  for (uint32_t g=_ngroups; g<_ngroups+n; g++) {
+	String group=address(A_GROUP, g);
+	for (uint32_t r=0; r<receivers; r++) {
+	  String join=group + " " + address(A_RECEIVER, r);
+	  if (_nsources)
+		join+=" " + address(A_SOURCE, r % _nsources);
+	  _mct_join->call_write(join, _mct, errh);
+	}
+	if (_pimft) {
+	  // one channel per group and interface: the PIM tables keep one source per group
+	  String source=address(A_SOURCE, _nsources ? g % _nsources : 0);
+	  for (uint32_t i=0; i<_nneighbors; i++)
+		_pim_join->call_write(address(A_INTERFACE, i) + " " + address(A_NEIGHBOR, i)
+							  + " " + group + " " + source, _pimft, errh);
+	}
+  }
+
+  _ngroups+=n;
+  _populate_time+=Timestamp::now() - start;
+  uint32_t now_kb=resident_kb();
+  _populate_kb+=(now_kb > kb ? now_kb - kb : 0);
+  debug_msg("MulticastBench: %u groups", _ngroups);
+}
+
+uint32_t
+MulticastBench::resident_kb()
+{
+#if CLICK_USERLEVEL
+  unsigned long size, rss;
+  FILE *f=fopen("/proc/self/statm", "r");
+  if (!f)
+	return 0;
+  int ok=fscanf(f, "%lu %lu", &size, &rss);
+  fclose(f);
+  if (ok != 2)
+	return 0;
+  return rss * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+  return 0;
+#endif
+}
+
+void
+MulticastBench::reset()
+{
+  _sent=0;
+  _replicas=0;
+  _measured=0;
+  _first_send=_last_send=Timestamp();
+  _latency.clear();
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * data path: packet i goes to group i mod GROUPS, from the next source of that group      *
+ *                                                                                         *
+ *******************************************************************************************/
+Packet *
+MulticastBench::make_packet(uint64_t i)
+{
+  uint32_t g=i % _ngroups;
+  uint32_t s=(_nsources ? (i / _ngroups) % _nsources : 0);
+#if HAVE_IP6
+  if (_ip6)
+	return make_ip6_packet(g, s);
+#endif
+  return make_ip_packet(g, s);
+}
+
+Packet *
+MulticastBench::make_ip_packet(uint32_t g, uint32_t s)
+{
+  WritablePacket *q=Packet::make(_length);
+  if (!q)
+	return 0;
+  memset(q->data(), 0, _length);
+
+  click_ip *ip=reinterpret_cast<click_ip *>(q->data());
+  ip->ip_v=4;
+  ip->ip_hl=sizeof(click_ip) >> 2;
+  ip->ip_len=htons(_length);
+  ip->ip_ttl=64;
+  ip->ip_p=IP_PROTO_UDP;
+  ip->ip_src=ip_address(A_SOURCE, s).in_addr();
+  ip->ip_dst=ip_address(A_GROUP, g).in_addr();
+  ip->ip_sum=click_in_cksum((const unsigned char *)ip, sizeof(click_ip));
+
+  click_udp *udp=reinterpret_cast<click_udp *>(ip + 1);
+  udp->uh_sport=htons(5000);
+  udp->uh_dport=htons(5001);
+  udp->uh_ulen=htons(_length - sizeof(click_ip));
+
+  q->set_ip_header(ip, sizeof(click_ip));
+  q->set_dst_ip_anno(ip_address(A_GROUP, g));
+  return q;
+}
+
+#if HAVE_IP6
+Packet *
+MulticastBench::make_ip6_packet(uint32_t g, uint32_t s)
+{
+  WritablePacket *q=Packet::make(_length);
+  if (!q)
+	return 0;
+  memset(q->data(), 0, _length);
+
+  click_ip6 *ip=reinterpret_cast<click_ip6 *>(q->data());
+  ip->ip6_flow=htonl(0x60000000);
+  ip->ip6_plen=htons(_length - sizeof(click_ip6));
+  ip->ip6_nxt=IP_PROTO_UDP;
+  ip->ip6_hlim=64;
+  ip->ip6_src=ip6_address(A_SOURCE, s);
+  ip->ip6_dst=ip6_address(A_GROUP, g);
+
+  click_udp *udp=reinterpret_cast<click_udp *>(ip + 1);
+  udp->uh_sport=htons(5000);
+  udp->uh_dport=htons(5001);
+  udp->uh_ulen=htons(_length - sizeof(click_ip6));
+
+  q->set_ip6_header(ip);
+  SET_DST_IP6_ANNO(q, ip6_address(A_GROUP, g));
+  return q;
+}
+#endif
+
+void
+MulticastBench::record_latency(uint32_t nsec)
+{
+  // reservoir sampling: every packet is equally likely to be kept
+  _measured++;
+  if (_latency.size() < (int)_nsamples)
+	_latency.push_back(nsec);
+  else if (_nsamples) {
+	uint32_t k=click_random() % _measured;
+	if (k < _nsamples)
+	  _latency[k]=nsec;
+  }
+}
+
+bool
+MulticastBench::run_task(Task *)
+{
+  if (!_active || (_limit && _sent >= _limit))
+	return false;
+
+  uint32_t n=0;
+  while (n < _burst && (!_limit || _sent < _limit)) {
+	Packet *p=make_packet(_sent);
+	if (!p)
+	  break;
+	Timestamp t0=Timestamp::now();
+	if (!_sent)
+	  _first_send=t0;
+	output(0).push(p);
+	_last_send=Timestamp::now();
+	record_latency((_last_send - t0).nsecval());
+	_sent++;
+	n++;
+  }
+
+  if (_limit && _sent >= _limit) {
+	if (_stop)
+	  router()->please_stop_driver();
+  }
+  else
+	_task.fast_reschedule();
+  return n > 0;
+}
+
+void
+MulticastBench::push(int, Packet *p)
+{
+  _replicas++;
+  p->kill();
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * handlers                                                                                *
+ *                                                                                         *
+ *******************************************************************************************/
+uint32_t
+MulticastBench::percentile(const Vector<uint32_t> &sorted, int pct)
+{
+  if (!sorted.size())
+	return 0;
+  int i=(sorted.size() * pct + 99) / 100 - 1;
+  return sorted[i < 0 ? 0 : i];
+}
+
+static int
+uint32_compare(const void *a, const void *b, void *)
+{
+  uint32_t x=*(const uint32_t *)a, y=*(const uint32_t *)b;
+  return (x < y ? -1 : x > y);
+}
+
+enum { H_STATS, H_PPS, H_LATENCY, H_ACTIVE, H_POPULATE, H_RESET };
+
+String
+MulticastBench::read_handler(Element *e, void *thunk)
+{
+  MulticastBench *mb=static_cast<MulticastBench *>(e);
+  Timestamp elapsed=mb->_last_send - mb->_first_send;
+  uint64_t usec=elapsed.usecval();
+  uint64_t pps=usec ? (mb->_sent * 1000000) / usec : 0;
+  uint64_t rpps=usec ? (mb->_replicas * 1000000) / usec : 0;
+
+  switch ((intptr_t)thunk) {
+  case H_PPS:
+	return String(rpps);
+  case H_ACTIVE:
+	return cp_unparse_bool(mb->_active);
+  case H_STATS:
+  case H_LATENCY: {
+	Vector<uint32_t> sorted(mb->_latency);
+	if (sorted.size())
+	  click_qsort(sorted.begin(), sorted.size(), sizeof(uint32_t), uint32_compare, 0);
+	StringAccum sa;
+	if ((intptr_t)thunk == H_LATENCY) {
+	  sa << percentile(sorted, 50) << ' ' << percentile(sorted, 99);
+	  return sa.take_string();
+	}
+	sa << "family " << (mb->_ip6 ? "ipv6" : "ipv4") << '\n'
+	   << "groups " << mb->_ngroups << '\n'
+	   << "receivers " << mb->_nreceivers << '\n'
+	   << "sources " << mb->_nsources << '\n'
+	   << "pim_neighbors " << (mb->_pimft ? mb->_nneighbors : 0) << '\n'
+	   << "sent " << mb->_sent << '\n'
+	   << "replicas " << mb->_replicas << '\n'
+	   << "elapsed " << elapsed << '\n'
+	   << "pps " << pps << '\n'
+	   << "replicated_pps " << rpps << '\n'
+	   << "fanout " << (mb->_sent ? (double)mb->_replicas / mb->_sent : 0) << '\n'
+	   << "p50_ns " << percentile(sorted, 50) << '\n'
+	   << "p99_ns " << percentile(sorted, 99) << '\n'
+	   << "max_ns " << (sorted.size() ? sorted.back() : 0) << '\n'
+	   << "populate_kb " << mb->_populate_kb << '\n'
+	   << "populate_time " << mb->_populate_time << '\n';
+	return sa.take_string();
+  }
+  default:
+	return String();
+  }
+}
+
+int
+MulticastBench::write_handler(const String &s, Element *e, void *thunk, ErrorHandler *errh)
+{
+  MulticastBench *mb=static_cast<MulticastBench *>(e);
+  switch ((intptr_t)thunk) {
+  case H_ACTIVE:
+	if (!cp_bool(cp_uncomment(s), &mb->_active))
+	  return errh->error("syntax error");
+	break;
+  case H_POPULATE: {
+	uint32_t n;
+	if (!cp_unsigned(cp_uncomment(s), &n))
+	  return errh->error("expected number of groups");
+	mb->populate(n, mb->_nreceivers);
+	break;
+  }
+  case H_RESET:
+	mb->reset();
+	break;
+  default:
+	return -1;
+  }
+  if (mb->_active && !mb->_task.scheduled())
+	mb->_task.reschedule();
+  return 0;
+}
+
+void
+MulticastBench::add_handlers()
+{
+  add_read_handler("stats", read_handler, (void *)H_STATS);
+  add_read_handler("pps", read_handler, (void *)H_PPS);
+  add_read_handler("latency", read_handler, (void *)H_LATENCY);
+  add_read_handler("active", read_handler, (void *)H_ACTIVE);
+  add_write_handler("active", write_handler, (void *)H_ACTIVE);
+  add_write_handler("populate", write_handler, (void *)H_POPULATE);
+  add_write_handler("reset", write_handler, (void *)H_RESET);
+  add_task_handlers(&_task);
+}
+
+EXPORT_ELEMENT(MulticastBench)
@@ -0,0 +1,219 @@
+#ifndef MCASTBENCH_HH
+#define MCASTBENCH_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timestamp.hh>
+#include <click/ipaddress.hh>
+#if HAVE_IP6
+# include <click/ip6address.hh>
+#endif
+class Handler;
+
+/*
+=c
+MulticastBench(MCASTTABLE [, I<keywords>])
+
+=s IPv4 Multicast
+
+=d
+Measures how IPMulticastTable and PIMForwardingTable forwarding scales
+with the number of groups, receivers and SSM sources, or, with IP6,
+how IP6MulticastTable and IP6PIMForwardingTable do.
+
+At initialization MulticastBench fills MCASTTABLE through its join
+handler: GROUPS groups, each joined by RECEIVERS receivers.  If SOURCES
+is not 0, receiver I includes source I modulo SOURCES, as an IGMPv3 or
+MLDv2 INCLUDE report would; otherwise receivers join (*,G).  With
+PIMTABLE, PIM_NEIGHBORS interfaces each get a neighbor joined, through
+PIMTABLE's join handler, to a channel of every group.  The addresses
+are:
+
+   IPv4              IPv6
+   232.0.0.1 + G     ff3e::8000:1 + G     groups
+   10.0.0.1 + R      2001:db8::1 + R      receivers
+   172.16.0.1 + S    2001:db8:1::1 + S    sources
+   192.168.I.1       2001:db8:ff:I::1     PIM interfaces
+   192.168.I.2       2001:db8:ff:I::2     PIM neighbors
+
+Output 0 then sends UDP packets of LENGTH bytes, cycling through every
+group and, for each group, every source; at most BURST per task run
+and LIMIT in all (0 means no limit).  Connect it to MCASTTABLE.  The
+replicas the tables emit come back on input 0, where they are counted
+and dropped.  Per-packet latency is the time output 0's push takes,
+which covers the lookup and the whole fan-out when the replicas are
+pushed straight back; it is sampled into a reservoir of SAMPLES
+packets.
+
+Memory is the growth of the process's resident set while the tables
+were filled (user-level only).  The fill time includes parsing the
+join handler arguments.
+
+Keyword arguments are:
+
+=over 8
+
+=item IP6
+
+Boolean.  Drive IPv6 tables and send IPv6 packets.  Needs Click built
+with IPv6 support.  Default false.
+
+=item GROUPS
+
+Number of groups.  Default 1000.
+
+=item RECEIVERS
+
+Receivers per group.  Default 10.
+
+=item SOURCES
+
+Number of SSM sources; 0 means (*,G) joins.  Default 0.
+
+=item PIMTABLE
+
+PIMForwardingTable, or IP6PIMForwardingTable with IP6, to fill as
+well.  Default none.
+
+=item PIM_NEIGHBORS
+
+Number of PIM interfaces and neighbors.  Default 1.
+
+=item LENGTH
+
+Packet length, IP or IPv6 header included.  Default 64.
+
+=item BURST
+
+Packets per task run.  Default 32.
+
+=item LIMIT
+
+Packets to send.  Default 1000000.
+
+=item SAMPLES
+
+Latency samples kept.  Default 100000.
+
+=item STOP
+
+Boolean.  Stop the driver after LIMIT packets.  Default false.
+
+=item ACTIVE
+
+Boolean.  Default true.
+
+=back
+
+=h stats read-only
+
+Table sizes, packets sent, replicas received, elapsed time, packets and
+replicas per second, mean fan-out, per-packet latency (p50, p99, max)
+in nanoseconds, and the memory and time taken to fill the tables.
+
+=h pps read-only
+
+Replicas per second.
+
+=h latency read-only
+
+p50 and p99 per-packet latency in nanoseconds.
+
+=h populate write-only
+
+Add the given number of groups, filled like the first ones, so the
+same run can measure several table sizes.
+
+=h reset write-only
+
+Forget all results and start sending again.
+
+=h active read/write
+
+=e
+require(multicast);
+
+mct :: IPMulticastTable(1);
+pimft :: PIMForwardingTable(192.168.0.1);
+bench :: MulticastBench(mct, GROUPS 10000, RECEIVERS 20, SOURCES 4,
+			PIMTABLE pimft, PIM_NEIGHBORS 2, STOP true);
+bench -> mct;
+mct[0] -> bench;
+mct[1] -> pimft -> bench;
+DriverManager(wait, print bench.stats);
+
+See also mcast_bench.click and ip6mcast_bench.click.
+
+=a
+IPMulticastTable, PIMForwardingTable, IP6MulticastTable,
+IP6PIMForwardingTable
+*/
+
+class MulticastBench : public Element { public:
+
+  MulticastBench();
+  ~MulticastBench();
+
+  const char *class_name() const	{ return "MulticastBench"; }
+  const char *port_count() const	{ return "1/1"; }
+  const char *processing() const	{ return "h/h"; }
+
+  int configure(Vector<String> &, ErrorHandler *);
+  int initialize(ErrorHandler *);
+  void add_handlers();
+
+  void push(int, Packet *);
+  bool run_task(Task *);
+
+ private:
+
+  Element *_mct;
+  Element *_pimft;
+  const Handler *_mct_join;
+  const Handler *_pim_join;
+
+  bool _ip6;
+  uint32_t _ngroups;
+  uint32_t _nreceivers;
+  uint32_t _nsources;
+  uint32_t _nneighbors;
+  uint32_t _length;
+  uint32_t _burst;
+  uint32_t _limit;
+  uint32_t _nsamples;
+  bool _stop;
+  bool _active;
+
+  Task _task;
+
+  uint64_t _sent;
+  uint64_t _replicas;
+  uint64_t _measured;          // packets offered to the latency reservoir
+  Timestamp _first_send;
+  Timestamp _last_send;
+  Vector<uint32_t> _latency;   // nsec, a uniform sample of all packets
+
+  uint32_t _populate_kb;       // resident set growth while filling the tables
+  Timestamp _populate_time;
+
+  // the IPv4 or IPv6 hooks
+  enum { A_GROUP, A_RECEIVER, A_SOURCE, A_INTERFACE, A_NEIGHBOR };
+  static IPAddress ip_address(int, uint32_t);
+  Packet *make_ip_packet(uint32_t, uint32_t);
+#if HAVE_IP6
+  static IP6Address ip6_address(int, uint32_t);
+  Packet *make_ip6_packet(uint32_t, uint32_t);
+#endif
+  String address(int, uint32_t) const;
+
+  void populate(uint32_t, uint32_t);
+  void reset();
+  Packet *make_packet(uint64_t);
+  void record_latency(uint32_t);
+  static uint32_t resident_kb();
+  static uint32_t percentile(const Vector<uint32_t> &, int);
+
+  static String read_handler(Element *, void *);
+  static int write_handler(const String &, Element *, void *, ErrorHandler *);
+};
+
+#endif
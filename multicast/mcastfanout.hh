@@ -0,0 +1,50 @@
+#ifndef MCASTFANOUT_HH
+#define MCASTFANOUT_HH
+#include <click/element.hh>
+#include <click/ipaddress.hh>
+#include <click/vector.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+
+/*
+ * Multicast replication without per-receiver payload copies.
+ *
+ * Every copy of a forwarded packet carries the same IP header -- the
+ * destination stays the group address and only the TTL drops by one --
+ * so copies differ only in their destination annotation.  The header is
+ * therefore rewritten once, on one writable packet, and the copies are
+ * clones sharing its buffer.  An element further down that has to write
+ * to a copy uniqueifies it as usual.
+ */
+
+// Decrement the TTL and update the header checksum incrementally (RFC 1624).
+inline void
+mcast_dec_ttl(click_ip *ip)
+{
+  ip->ip_ttl--;
+  uint32_t sum = (~ntohs(ip->ip_sum) & 0xFFFF) + 0xFEFF;
+  ip->ip_sum = ~htons(sum + (sum >> 16));
+}
+
+// Push one copy of p to out for every address in dsts, with the
+// destination annotation set.  p itself is the last copy, or is killed
+// if dsts is empty.
+inline void
+mcast_fanout(const Element::Port &out, WritablePacket *p, const Vector<IPAddress> &dsts)
+{
+  int n = dsts.size();
+  if (n == 0) {
+	p->kill();
+	return;
+  }
+  for (int i = 0; i < n - 1; i++)
+	if (Packet *q = p->clone()) {
+	  q->set_dst_ip_anno(dsts[i]);
+	  out.push(q);
+	}
+  p->set_dst_ip_anno(dsts[n - 1]);
+  out.push(p);
+}
+
+CLICK_ENDDECLS
+#endif
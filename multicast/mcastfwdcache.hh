@@ -0,0 +1,346 @@
+#ifndef MCASTFWDCACHE_HH
+#define MCASTFWDCACHE_HH
+#include <click/vector.hh>
+#include <click/timestamp.hh>
+#include <click/timer.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+class Element;
+
+/*
+ * MulticastForwardingCache<A>: hashed (source, group) -> outgoing list
+ *
+ * IPMulticastTable and PIMForwardingTable keep their membership in
+ * Vectors that are easy to edit but slow to search per packet.  Every
+ * control call that changes a group recomputes that group's entries
+ * here, so push() does one hash lookup instead of walking all groups.
+ * A is the address type, IPAddress here; the multicast6 package keeps
+ * its own IP6MulticastForwardingCache.
+ *
+ * An entry with a zero source is a (*,G) entry.  lookup(S, G) tries the
+ * exact (S,G) channel first and falls back to (*,G).  An (S,G) entry
+ * may have an empty route: it stops the fallback, so a source every
+ * receiver has blocked is dropped rather than sent to the (*,G) list.
+ * Tables that only ever install (*,G) entries use lookup(G).
+ *
+ * The data path takes no lock and writes nothing.  Each channel is a
+ * Node in a chained hash table, and a Node's route is never written
+ * once readers can reach it.  Changing a channel links a new Node in
+ * place of the old one with a single pointer store; removing one
+ * unlinks it the same way, and a reader standing on it still finds the
+ * rest of the chain.  Either way only that channel's Node is retired,
+ * and the table is copied only when it doubles.  Retired Nodes (and
+ * tables) are freed by a timer GRACE_MSEC later, far longer than any
+ * push() holds on to a Route.  Writers are serialized by _lock.  Each
+ * channel changes atomically; update() changes a group's channels one
+ * after another.
+ *
+ * The owning element must call initialize() from its own initialize(),
+ * which sets up the reclaim timer.
+ */
+
+template <typename A>
+class MulticastForwardingCache {
+ public:
+
+  struct Route {
+	Vector<A> out;             // receivers or PIM neighbors to copy to
+  };
+
+  struct Update {
+	A source;
+	Route route;
+	bool remove;               // drop the channel instead
+	Update() : remove(false) { }
+  };
+
+  MulticastForwardingCache();
+  ~MulticastForwardingCache();
+
+  void initialize(Element *owner)	{ _reclaim_timer.initialize(owner); }
+
+  // data path: the result stays valid for GRACE_MSEC
+  inline const Route *lookup(const A &source, const A &group) const;
+  inline const Route *lookup(const A &group) const;
+  int size() const			{ return _size; }
+
+  // control path: an empty route stays, and matches packets to drop
+  void set(const A &source, const A &group, const Route &);
+  void remove(const A &source, const A &group);
+  // apply several changes to one group's channels, in order
+  void update(const A &group, const Vector<Update> &);
+  void clear();
+
+  enum { GRACE_MSEC = 1000 };
+
+ private:
+
+  struct Node {
+	A source;
+	A group;
+	Route route;
+	Node * volatile next;
+  };
+
+  struct Table {
+	uint32_t mask;             // bucket count - 1, a power of two
+	Node * volatile *buckets;
+  };
+
+  struct Retired {
+	Node *node;                // or
+	Table *table;              // with all the Nodes still linked in it
+	Timestamp when;
+  };
+
+  Table * volatile _table;
+  int _size;
+  int _nsources;               // (S,G) entries; 0 means skip the first probe
+  Vector<Retired> _retired;
+  Timer _reclaim_timer;
+  Spinlock _lock;
+
+  static inline uint32_t hash(const A &source, const A &group) {
+	return (source.hashcode() * 2654435761U) ^ group.hashcode();
+  }
+  static inline const Node *find(const Table *, const A &source, const A &group);
+  static Table *make_table(uint32_t nbuckets);
+  static void free_table(Table *);
+
+  void apply(const A &source, const A &group, const Route *);
+  void grow();
+  void retire(Node *, Table *);
+  void reclaim();
+  static void reclaim_hook(Timer *, void *);
+};
+
+template <typename A> inline const typename MulticastForwardingCache<A>::Node *
+MulticastForwardingCache<A>::find(const Table *t, const A &source, const A &group)
+{
+  const Node *n = t->buckets[hash(source, group) & t->mask];
+  for (; n; n = n->next)
+	if (n->source == source && n->group == group)
+	  return n;
+  return 0;
+}
+
+template <typename A> inline const typename MulticastForwardingCache<A>::Route *
+MulticastForwardingCache<A>::lookup(const A &source, const A &group) const
+{
+  const Table *t = _table;
+  const Node *n = 0;
+  if (_nsources && source != A())
+	n = find(t, source, group);
+  if (!n)
+	n = find(t, A(), group);
+  return n ? &n->route : 0;
+}
+
+template <typename A> inline const typename MulticastForwardingCache<A>::Route *
+MulticastForwardingCache<A>::lookup(const A &group) const
+{
+  const Node *n = find(_table, A(), group);
+  return n ? &n->route : 0;
+}
+
+template <typename A>
+MulticastForwardingCache<A>::MulticastForwardingCache()
+  : _table(make_table(16)), _size(0), _nsources(0),
+	_reclaim_timer(reclaim_hook, this)
+{
+}
+
+template <typename A>
+MulticastForwardingCache<A>::~MulticastForwardingCache()
+{
+  for (int i = 0; i < _retired.size(); i++)
+	if (_retired[i].table)
+	  free_table(_retired[i].table);
+	else
+	  delete _retired[i].node;
+  free_table(_table);
+}
+
+template <typename A> typename MulticastForwardingCache<A>::Table *
+MulticastForwardingCache<A>::make_table(uint32_t nbuckets)
+{
+  Table *t = new Table;
+  t->mask = nbuckets - 1;
+  t->buckets = new Node * volatile[nbuckets];
+  for (uint32_t i = 0; i < nbuckets; i++)
+	t->buckets[i] = 0;
+  return t;
+}
+
+template <typename A> void
+MulticastForwardingCache<A>::free_table(Table *t)
+{
+  for (uint32_t i = 0; i <= t->mask; i++)
+	for (Node *n = t->buckets[i], *next; n; n = next) {
+	  next = n->next;
+	  delete n;
+	}
+  delete[] t->buckets;
+  delete t;
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * retire: queues a Node or Table no reader can newly reach; the reclaim timer frees it    *
+ *         once every reader that might still hold it is done; called with _lock held      *
+ *                                                                                         *
+ *******************************************************************************************/
+template <typename A> void
+MulticastForwardingCache<A>::retire(Node *n, Table *t)
+{
+  Retired r;
+  r.node = n;
+  r.table = t;
+  r.when = Timestamp::now();
+  _retired.push_back(r);
+  if (_reclaim_timer.initialized() && !_reclaim_timer.scheduled())
+	_reclaim_timer.schedule_after_msec(GRACE_MSEC);
+}
+
+template <typename A> void
+MulticastForwardingCache<A>::reclaim()
+{
+  _lock.acquire();
+  Timestamp limit = Timestamp::now() - Timestamp::make_msec(GRACE_MSEC);
+  // _retired is in retirement order
+  int i = 0;
+  for (; i < _retired.size() && _retired[i].when <= limit; i++)
+	if (_retired[i].table)
+	  free_table(_retired[i].table);
+	else
+	  delete _retired[i].node;
+  if (i) {
+	for (int j = i; j < _retired.size(); j++)
+	  _retired[j - i] = _retired[j];
+	_retired.resize(_retired.size() - i);
+  }
+  if (_retired.size())
+	_reclaim_timer.schedule_at(_retired[0].when + Timestamp::make_msec(GRACE_MSEC));
+  _lock.release();
+}
+
+template <typename A> void
+MulticastForwardingCache<A>::reclaim_hook(Timer *, void *thunk)
+{
+  static_cast<MulticastForwardingCache<A> *>(thunk)->reclaim();
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * grow: rebuilds the table with twice the buckets; the old table keeps its own Nodes, so  *
+ *       readers still walking it are unaffected, and is retired whole                     *
+ *                                                                                         *
+ *******************************************************************************************/
+template <typename A> void
+MulticastForwardingCache<A>::grow()
+{
+  Table *old = _table;
+  Table *t = make_table(2 * (old->mask + 1));
+  for (uint32_t i = 0; i <= old->mask; i++)
+	for (const Node *o = old->buckets[i]; o; o = o->next) {
+	  Node *n = new Node(*o);
+	  Node * volatile &head = t->buckets[hash(n->source, n->group) & t->mask];
+	  n->next = head;
+	  head = n;
+	}
+  click_fence();
+  _table = t;
+  retire(0, old);
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * apply: installs the outgoing list of a channel, or removes the channel if r is null;    *
+ *        called with _lock held                                                           *
+ *                                                                                         *
+ *******************************************************************************************/
+template <typename A> void
+MulticastForwardingCache<A>::apply(const A &source, const A &group, const Route *r)
+{
+  Table *t = _table;
+  Node * volatile *link = &t->buckets[hash(source, group) & t->mask];
+  while (*link && !((*link)->source == source && (*link)->group == group))
+	link = &(*link)->next;
+  Node *old = *link;
+  bool sg = (source != A());
+
+  if (!r) {
+	if (old) {
+	  // readers on old still find the rest of the chain through it
+	  *link = old->next;
+	  retire(old, 0);
+	  _size--;
+	  if (sg)
+		_nsources--;
+	}
+	return;
+  }
+
+  Node *n = new Node;
+  n->source = source;
+  n->group = group;
+  n->route = *r;
+  if (old) {
+	n->next = old->next;
+	click_fence();
+	*link = n;
+	retire(old, 0);
+  } else {
+	Node * volatile &head = t->buckets[hash(source, group) & t->mask];
+	n->next = head;
+	click_fence();
+	head = n;
+	_size++;
+	if (sg)
+	  _nsources++;
+	if ((uint32_t) _size > 2 * (t->mask + 1))
+	  grow();
+  }
+}
+
+template <typename A> void
+MulticastForwardingCache<A>::set(const A &source, const A &group, const Route &r)
+{
+  _lock.acquire();
+  apply(source, group, &r);
+  _lock.release();
+}
+
+template <typename A> void
+MulticastForwardingCache<A>::remove(const A &source, const A &group)
+{
+  _lock.acquire();
+  apply(source, group, 0);
+  _lock.release();
+}
+
+template <typename A> void
+MulticastForwardingCache<A>::update(const A &group, const Vector<Update> &u)
+{
+  _lock.acquire();
+  for (int i = 0; i < u.size(); i++)
+	apply(u[i].source, group, u[i].remove ? 0 : &u[i].route);
+  _lock.release();
+}
+
+template <typename A> void
+MulticastForwardingCache<A>::clear()
+{
+  _lock.acquire();
+  Table *old = _table;
+  Table *t = make_table(16);
+  click_fence();
+  _table = t;
+  _size = 0;
+  _nsources = 0;
+  retire(0, old);
+  _lock.release();
+}
+
+CLICK_ENDDECLS
+#endif
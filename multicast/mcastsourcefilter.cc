@@ -0,0 +1,77 @@
+/*
+ * mcastsourcefilter.{cc,hh} -- per-group source filters as receiver bitmaps
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "mcastsourcefilter.hh"
+#include <click/integers.hh>
+CLICK_DECLS
+
+MulticastSourceFilter::MulticastSourceFilter(int nreceivers)
+  : _nwords((nreceivers + 31) / 32), _exclude_mode(_nwords, 0), _index(-1)
+{
+}
+
+int
+MulticastSourceFilter::source_index(IPAddress source)
+{
+  HashTable<IPAddress, int>::iterator it = _index.find_insert(source, -1);
+  if (it.value() < 0) {
+	it.value() = _sources.size();
+	_sources.push_back(source);
+	for (int w = 0; w < _nwords; w++) {
+	  _include.push_back(0);
+	  _exclude.push_back(0);
+	}
+  }
+  return it.value();
+}
+
+void
+MulticastSourceFilter::include(int r, IPAddress source)
+{
+  int i = source_index(source);
+  _include[i * _nwords + r / 32] |= 1U << (r % 32);
+}
+
+void
+MulticastSourceFilter::exclude(int r)
+{
+  _exclude_mode[r / 32] |= 1U << (r % 32);
+}
+
+void
+MulticastSourceFilter::exclude(int r, IPAddress source)
+{
+  int i = source_index(source);
+  _exclude[i * _nwords + r / 32] |= 1U << (r % 32);
+}
+
+void
+MulticastSourceFilter::receivers(IPAddress source, Vector<int> &out) const
+{
+  int i = _index.get(source);
+  for (int w = 0; w < _nwords; w++) {
+	uint32_t bits = _exclude_mode[w];
+	if (i >= 0)
+	  bits = _include[i * _nwords + w] | (bits & ~_exclude[i * _nwords + w]);
+	while (bits) {
+	  int b = ffs_lsb(bits) - 1;
+	  out.push_back(w * 32 + b);
+	  bits &= bits - 1;
+	}
+  }
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(MulticastSourceFilter)
@@ -0,0 +1,54 @@
+#ifndef MCASTSOURCEFILTER_HH
+#define MCASTSOURCEFILTER_HH
+#include <click/ipaddress.hh>
+#include <click/hashtable.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+ * MulticastSourceFilter: the INCLUDE/EXCLUDE source lists of all
+ * receivers of one group, compiled into receiver bitmaps
+ *
+ * Receivers are numbered 0..n-1.  Each source that appears in some
+ * receiver's list gets two bitmaps: the receivers that include it and
+ * the receivers that exclude it.  One more bitmap holds the receivers
+ * in EXCLUDE mode.  Receivers of a packet from S are then
+ *
+ *   include[S] | (exclude_mode & ~exclude[S])
+ *
+ * and a source nobody lists reaches exactly the EXCLUDE mode receivers.
+ * IPMulticastTable compiles a group's filter whenever its membership
+ * changes and installs one forwarding cache entry per listed source
+ * plus the (*,G) entry.
+ */
+
+class MulticastSourceFilter {
+ public:
+
+  MulticastSourceFilter(int nreceivers);
+
+  void include(int r, IPAddress source);
+  void exclude(int r);                     // receiver r is in EXCLUDE mode
+  void exclude(int r, IPAddress source);
+
+  // every source in some receiver's list
+  const Vector<IPAddress> &sources() const	{ return _sources; }
+  bool listed(IPAddress source) const	{ return _index.get(source) >= 0; }
+
+  // append the receivers that want traffic from source to out
+  void receivers(IPAddress source, Vector<int> &out) const;
+
+ private:
+
+  int _nwords;                 // bitmap words per set
+  Vector<uint32_t> _exclude_mode;
+  HashTable<IPAddress, int> _index;
+  Vector<IPAddress> _sources;
+  Vector<uint32_t> _include;   // _nwords words per listed source
+  Vector<uint32_t> _exclude;
+
+  int source_index(IPAddress);
+};
+
+CLICK_ENDDECLS
+#endif
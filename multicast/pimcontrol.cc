@@ -24,7 +24,7 @@
 #include <click/packet_anno.hh>
 #include "debug.hh"
 
-PIMControl::PIMControl(): _timer(this)
+PIMControl::PIMControl(): source_connected(false), _timer(this), _jptimer(this)
 {
 }
 
@@ -36,6 +36,8 @@ int PIMControl::initialize(ErrorHandler *errh)
 {
   _timer.initialize(this);
   _timer.schedule_after_msec(1000);
+  _jptimer.initialize(this);
+  _next_refresh=Timestamp::now().msecval() + _refresh;
   return 0;
 }
 
@@ -47,18 +49,32 @@ int PIMControl::initialize(ErrorHandler *errh)
 int
 PIMControl::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-  if (conf.size() != 1)
-    return errh->error("wrong number of arguments; expected 'PIMControl(PIMForwardingTable element)'");
+  Element *e;
+  _delay=20;
+  _refresh=60000;
+  _holdtime=0;
+  _mtu=1500;
+  if (cp_va_kparse(conf, this, errh,
+				   "PIMFORWARDINGTABLE", cpkP+cpkM, cpElement, &e,
+				   "DELAY", 0, cpSecondsAsMilli, &_delay,
+				   "REFRESH", 0, cpSecondsAsMilli, &_refresh,
+				   "HOLDTIME", 0, cpSeconds, &_holdtime,
+				   "MTU", 0, cpUnsigned, &_mtu,
+				   cpEnd) < 0)
+	return -1;
+  // upstream routers keep a channel for 3.5 refresh periods (RFC 4601)
+  if (_holdtime == 0)
+	_holdtime = (_refresh ? (_refresh * 7) / 2000 : 0xFFFF);
+  if (_holdtime > 0xFFFF)
+	_holdtime = 0xFFFF;
+  if (_mtu < 68)
+	return errh->error("MTU must be at least 68");
 
   // get PIMForwardingTable element
-  Element *e = cp_element(conf[0], this, errh);
-  if (!e) {
-    return -1;
-  }
-  else {
-	PIMTable = (PIMForwardingTable *)e->cast("PIMForwardingTable");
-	return 0;
-  }
+  PIMTable = (PIMForwardingTable *)e->cast("PIMForwardingTable");
+  if (!PIMTable)
+	return errh->error("%s is not a PIMForwardingTable", e->name().c_str());
+  return 0;
 }
 
 void
@@ -80,98 +96,167 @@ PIMControl::prune(IPAddress group, IPAddress source)
   }
 }
 
+/*******************************************************************************************
+ *                                                                                         *
+ * generatejoin: queues a join or prune of (source, group) to be sent with the others      *
+ *               collected over DELAY; a later request for the channel replaces this one   *
+ *                                                                                         *
+ *******************************************************************************************/
 void 
 PIMControl::generatejoin(IPAddress group, IPAddress source, bool join)
 {
-  
   debug_msg("generatejoin PIM");
-  WritablePacket *q = 0;
-
-  click_ip *nip;
-  IPoptions* ipoptions; // make sure routers open this packet
-  Pim_Header *header;
-  Pim_IPv4_Join_Prune *joinprune;
-  Pim_IPv4_Group_Record *grouprecord;
-  Pim_IPv4_Source *sender;
-  Pim_IPv4_Unicast *unicastneighbor;
-
-  q = Packet::make(sizeof(*nip) +
-				   sizeof(*ipoptions) +
-				   sizeof(*header) +
-				   sizeof(*unicastneighbor) +
-				   sizeof(*joinprune) +
-				   sizeof(*grouprecord) + 
-				   sizeof(*sender));
-
-
-  nip = reinterpret_cast<click_ip *>(q->data());
-
-  ipoptions=(IPoptions*)(q->data() + sizeof(*nip));
-  header=(Pim_Header *)((char *)ipoptions + sizeof(*ipoptions));
-  unicastneighbor=(Pim_IPv4_Unicast *)((char *)header + sizeof(*header));
-  joinprune=(Pim_IPv4_Join_Prune *)((char *)unicastneighbor + sizeof(*unicastneighbor));
-  grouprecord=(Pim_IPv4_Group_Record *)((char *)joinprune + sizeof(*joinprune));
-  sender=(Pim_IPv4_Source *)((char *)grouprecord + sizeof(*grouprecord));
-
+  Channel c(group, source);
+  _pending.set(c, join);
+  if(join)
+	_joined.set(c, true);
+  else
+	_joined.erase(c);
+
+  if(_delay==0)
+	flush_joinprune();
+  else if(!_jptimer.scheduled())
+	_jptimer.schedule_after_msec(_delay);
+}
 
-  nip->ip_v = 4;
-  nip->ip_tos = 0;		
-  nip->ip_id = 0x5ff4; htons(0x67);
-  nip->ip_off = 0;
-  nip->ip_tos =0xc0;
-  nip->ip_ttl = 2;
-  nip->ip_p = 0x67;
-  nip->ip_sum = 0;
-  nip->ip_dst = IPAddress("224.0.0.13"); // IPAddress(htonl(source));
-  nip->ip_hl = 6; // (sizeof(*nip) >> 2) + 1; // +1 for ipotions
-  nip->ip_len=htons(q->length());
+/*******************************************************************************************
+ *                                                                                         *
+ * flush_joinprune: sends all queued joins and prunes, sorted by source, since the source  *
+ *                  address decides where a message goes                                   *
+ *                                                                                         *
+ *******************************************************************************************/
+void
+PIMControl::flush_joinprune()
+{
+  if(_pending.size()==0) return;
+
+  Vector<joinprunebatch> batches;
+  HashTable<IPAddress, int> index(-1);
+  for(HashTable<Channel, bool>::iterator it=_pending.begin(); it; ++it) {
+	int n=index.get(it.key().source);
+	if(n<0) {
+	  n=batches.size();
+	  index.set(it.key().source, n);
+	  batches.push_back(joinprunebatch());
+	  batches[n].source=it.key().source;
+	}
+	batches[n].groups.push_back(it.key().group);
+	batches[n].joins.push_back(it.value());
+  }
+  _pending.clear();
+  _jptimer.unschedule();
 
-  ipoptions->data[0]=0x94;
-  ipoptions->data[1]=0x04;
-  ipoptions->data[2]=0x00;
-  ipoptions->data[3]=0x00;
+  for(int n=0; n<batches.size(); n++)
+	send_joinprune(batches[n]);
+}
 
-  header->ver_type=0x23;
-  header->checksum=0x0;
-  header->reserved=0x0;
-
-  unicastneighbor->addr_family=1;
-  unicastneighbor->encoding_type=0;
-  //  click_chatter("pimctl got upstream-neighbor from pimtable: %x",IPAddress( PIMTable->get_upstreamneighbor(group, source)));
-  //  memcpy((void *)&unicastneighbor->addr, &buf, 4);
-  // this address is fixed on the outgoing interface
-
-  joinprune->reserved=0;
-  joinprune->no_of_groups=1;
-  joinprune->holdtime=0xffff; // 0xffff does instruct next router not to ask again
-
-  grouprecord->addr_family=1;
-  grouprecord->encoding_type=0;
-  grouprecord->swr=4;
-  grouprecord->mask_len=32;
-  grouprecord->addr=IPAddress(group);
+/*******************************************************************************************
+ *                                                                                         *
+ * send_joinprune: builds the Join/Prune messages for one source, one group record per     *
+ *                 group, as many records per message as fit in MTU                        *
+ *                                                                                         *
+ *******************************************************************************************/
+void 
+PIMControl::send_joinprune(const joinprunebatch &b)
+{
+  const uint32_t fixed=sizeof(click_ip) +
+	sizeof(IPoptions) +
+	sizeof(Pim_Header) +
+	sizeof(Pim_IPv4_Unicast) +
+	sizeof(Pim_IPv4_Join_Prune);
+  const uint32_t perrecord=sizeof(Pim_IPv4_Group_Record) + sizeof(Pim_IPv4_Source);
+  int maxrecords=(_mtu - fixed) / perrecord;
+  if(maxrecords > 255) maxrecords=255; // no_of_groups is one byte
+  if(maxrecords < 1) maxrecords=1;
+
+  for(int first=0; first<b.groups.size(); first+=maxrecords) {
+	int no_of_groups=b.groups.size() - first;
+	if(no_of_groups > maxrecords) no_of_groups=maxrecords;
+
+	WritablePacket *q = 0;
+
+	click_ip *nip;
+	IPoptions* ipoptions; // make sure routers open this packet
+	Pim_Header *header;
+	Pim_IPv4_Join_Prune *joinprune;
+	Pim_IPv4_Group_Record *grouprecord;
+	Pim_IPv4_Source *sender;
+	Pim_IPv4_Unicast *unicastneighbor;
+
+	q = Packet::make(fixed + no_of_groups*perrecord);
+	if(!q) return;
+
+	nip = reinterpret_cast<click_ip *>(q->data());
+
+	ipoptions=(IPoptions*)(q->data() + sizeof(*nip));
+	header=(Pim_Header *)((char *)ipoptions + sizeof(*ipoptions));
+	unicastneighbor=(Pim_IPv4_Unicast *)((char *)header + sizeof(*header));
+	joinprune=(Pim_IPv4_Join_Prune *)((char *)unicastneighbor + sizeof(*unicastneighbor));
+
+	nip->ip_v = 4;
+	nip->ip_tos = 0;		
+	nip->ip_id = 0x5ff4;
+	nip->ip_off = 0;
+	nip->ip_tos =0xc0;
+	nip->ip_ttl = 2;
+	nip->ip_p = 0x67;
+	nip->ip_sum = 0;
+	nip->ip_dst = IPAddress("224.0.0.13"); // IPAddress(htonl(source));
+	nip->ip_hl = 6; // (sizeof(*nip) >> 2) + 1; // +1 for ipotions
+	nip->ip_len=htons(q->length());
+
+	ipoptions->data[0]=0x94;
+	ipoptions->data[1]=0x04;
+	ipoptions->data[2]=0x00;
+	ipoptions->data[3]=0x00;
+
+	header->ver_type=0x23;
+	header->checksum=0x0;
+	header->reserved=0x0;
+
+	unicastneighbor->addr_family=1;
+	unicastneighbor->encoding_type=0;
+	// this address is fixed on the outgoing interface
+
+	joinprune->reserved=0;
+	joinprune->no_of_groups=no_of_groups;
+	joinprune->holdtime=htons(_holdtime); // 0xffff does instruct next router not to ask again
+
+	grouprecord=(Pim_IPv4_Group_Record *)((char *)joinprune + sizeof(*joinprune));
+	for(int i=first; i<first+no_of_groups; i++) {
+	  sender=(Pim_IPv4_Source *)((char *)grouprecord + sizeof(*grouprecord));
+
+	  grouprecord->addr_family=1;
+	  grouprecord->encoding_type=0;
+	  grouprecord->swr=4;
+	  grouprecord->mask_len=32;
+	  grouprecord->addr=IPAddress(b.groups[i]);
   
-  if(join) {
-	grouprecord->no_of_joined_sources=htons(1);
-	grouprecord->no_of_pruned_sources=0;
-  }
-  else {
-	grouprecord->no_of_joined_sources=0;
-	grouprecord->no_of_pruned_sources=htons(1);
-  }
-
-  sender->addr_family=1;
-  sender->encoding_type=0;
-  sender->swr=4;
-  sender->mask_len=32;
-  sender->addr=htonl(IPAddress(source));
+	  if(b.joins[i]) {
+		grouprecord->no_of_joined_sources=htons(1);
+		grouprecord->no_of_pruned_sources=0;
+	  }
+	  else {
+		grouprecord->no_of_joined_sources=0;
+		grouprecord->no_of_pruned_sources=htons(1);
+	  }
+
+	  sender->addr_family=1;
+	  sender->encoding_type=0;
+	  sender->swr=4;
+	  sender->mask_len=32;
+	  sender->addr=htonl(IPAddress(b.source));
+
+	  grouprecord=(Pim_IPv4_Group_Record *)((char *)sender + sizeof(*sender));
+	}
   
-  q->set_ip_header(nip, nip->ip_hl << 2);
-  q->set_dst_ip_anno((IPAddress(htonl(source))));
-  q->timestamp_anno().assign_now();
-  SET_FIX_IP_SRC_ANNO(q, true);
+	q->set_ip_header(nip, nip->ip_hl << 2);
+	q->set_dst_ip_anno((IPAddress(htonl(b.source))));
+	q->timestamp_anno().assign_now();
+	SET_FIX_IP_SRC_ANNO(q, true);
 
-  output(1).push(q); 
+	output(1).push(q); 
+  }
 }
 
 void
@@ -252,10 +337,26 @@ PIMControl::generate_hello()
 }
 
 void
-PIMControl::run_timer(Timer *)
+PIMControl::run_timer(Timer *t)
 {
+  if(t==&_jptimer) {
+	flush_joinprune();
+	return;
+  }
+
   //  generatejoin(IPAddress("232.2.2.2"), IPAddress("192.168.20.2"));
   generate_hello();
+
+  // refresh all joined channels, in as few messages as they fit
+  uint64_t now=Timestamp::now().msecval();
+  if(_refresh && now >= _next_refresh) {
+	debug_msg("PIMControl: refreshing %d channels", _joined.size());
+	for(HashTable<Channel, bool>::iterator it=_joined.begin(); it; ++it)
+	  if(!_pending.find(it.key()))
+		_pending.set(it.key(), true);
+	flush_joinprune();
+	_next_refresh=now + _refresh;
+  }
   _timer.reschedule_after_msec(3000); // XXX
 }
 
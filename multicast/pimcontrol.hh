@@ -4,10 +4,11 @@
 #include "protocoldefinitions.hh"
 #include <click/timer.hh>
 #include <click/element.hh>
+#include <click/hashtable.hh>
 
 /*
 =c
-PIMControl(PIMForwardingTable)
+PIMControl(PIMForwardingTable [, I<keywords>])
 
 =s IPv4 Multicast
 
@@ -15,6 +16,39 @@ PIMControl(PIMForwardingTable)
 Handles the PIM protocol, i.e. generation of Hello-messages and detection of connected PIM routers.
 This management information is needed for PIMForwardingTable.
 
+Joins and prunes are not sent one per channel.  They are collected for
+DELAY, a later request for a channel replacing an earlier one, and then
+sent as Join/Prune messages carrying as many group records as fit in
+MTU.  Messages go towards the source, which decides the upstream
+neighbor, so each message holds the channels of one source.  Every
+REFRESH all channels still joined are sent again the same way, so
+upstream state can time out after HOLDTIME instead of living forever.
+
+Keyword arguments are:
+
+=over 8
+
+=item DELAY
+
+Time joins and prunes are held to be sent together.  0 sends each one
+at once.  Default 20 milliseconds.
+
+=item REFRESH
+
+Time between refreshes of all joined channels.  0 disables refreshing.
+Default 60 seconds.
+
+=item HOLDTIME
+
+Holdtime advertised in Join/Prune messages.  Default 3.5 times REFRESH,
+or forever (0xFFFF) if REFRESH is 0.
+
+=item MTU
+
+Maximum size of a Join/Prune message, IP header included.  Default 1500.
+
+=back
+
 =e
 PIMControl("pimft") -> rt;
 =a
@@ -41,12 +75,47 @@ class PIMControl : public Element { public:
   void join(IPAddress, IPAddress);
   void prune(IPAddress, IPAddress);
   void generatejoin(IPAddress, IPAddress, bool);
+  void flush_joinprune();
   void run_timer(Timer *);
   void generate_hello();
   bool noPIMreceivers(IPAddress, IPAddress);
   bool noIGMPreceivers(IPAddress, IPAddress);
   Timer _timer;
 
+ private:
+
+  struct Channel {
+	IPAddress group;
+	IPAddress source;          // as passed to generatejoin
+	Channel() { }
+	Channel(IPAddress g, IPAddress s) : group(g), source(s) { }
+	size_t hashcode() const {
+	  return (source.addr() * 2654435761U) ^ group.addr();
+	}
+	bool operator==(const Channel &c) const {
+	  return group == c.group && source == c.source;
+	}
+  };
+
+  // the group records of one source's Join/Prune messages
+  struct joinprunebatch {
+	IPAddress source;
+	Vector<IPAddress> groups;
+	Vector<bool> joins;
+  };
+
+  HashTable<Channel, bool> _pending;  // join (true) or prune (false) not sent yet
+  HashTable<Channel, bool> _joined;   // joined upstream, sent again every REFRESH
+
+  uint32_t _delay;             // msec
+  uint32_t _refresh;           // msec
+  uint32_t _holdtime;          // sec
+  uint32_t _mtu;
+  uint64_t _next_refresh;
+  Timer _jptimer;
+
+  void send_joinprune(const joinprunebatch &);
+
 };
 
 #endif
@@ -18,6 +18,8 @@
 
 #include <click/config.h>
 #include "pimforwardingtable.hh"
+#include "mcastfwdcache.hh"
+#include "mcastfanout.hh"
 #include <click/ipaddress.hh>
 #include <click/router.hh>
 #include <click/error.hh>
@@ -69,6 +71,41 @@ PIMForwardingTable::configure(Vector<String> &conf, ErrorHandler *errh)
   return 0; 
 }
 
+int
+PIMForwardingTable::initialize(ErrorHandler *)
+{
+  _fwd.initialize(this);
+  return 0;
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * join_handler: "INTERFACE NEIGHBOR GROUP SOURCE" adds the interface and neighbor and     *
+ *               joins the neighbor to the channel, as a PIM join would                    *
+ *                                                                                         *
+ *******************************************************************************************/
+int
+PIMForwardingTable::join_handler(const String &s, Element *e, void *, ErrorHandler *errh)
+{
+  PIMForwardingTable *pft=static_cast<PIMForwardingTable *>(e);
+  Vector<String> words;
+  cp_spacevec(cp_uncomment(s), words);
+  IPAddress interface, neighbor, group, source;
+  if (words.size()!=4
+	  || !cp_ip_address(words[0], &interface) || !cp_ip_address(words[1], &neighbor)
+	  || !cp_ip_address(words[2], &group) || !cp_ip_address(words[3], &source))
+	return errh->error("expected INTERFACE NEIGHBOR GROUP SOURCE");
+  pft->addinterface(interface, neighbor);
+  pft->addgroup(interface, group, source, neighbor);
+  return 0;
+}
+
+void
+PIMForwardingTable::add_handlers()
+{
+  add_write_handler("join", join_handler, 0);
+}
+
 
 /*******************************************************************************************
  *                                                                                         *
@@ -100,6 +137,7 @@ bool PIMForwardingTable::addgroup(IPAddress interface,
 		}
 		// before finally adding the group address.
 		(*i).groupsources.push_back(gs);
+		update_route(source, group);
 		printgroups();
 		return true;
 	  }
@@ -129,6 +167,7 @@ bool PIMForwardingTable::delgroup(IPAddress interface,
 		  if( ( (*g).group.addr()==group.addr() ) &&  ( (*g).source.addr()==htonl(source.addr())) ) {
 
 			(*i).groupsources.erase(g);
+			update_route(source, group);
 			return true;
 		  }
 		}
@@ -179,39 +218,41 @@ void PIMForwardingTable::push(int port, Packet *p_in)
   click_ip* ip;
   ip=(click_ip *)p_in->data();
   IPAddress source=IPAddress(ip->ip_src);
-  if(piminterfaces.size()!=0) {
-	Vector<piminterface>::iterator  i;
-	for(i=piminterfaces.begin(); i!=piminterfaces.end(); ++i)
-	  {
+  const MulticastForwardingCache<IPAddress>::Route *route=_fwd.lookup(source, group);
+  if(route) {
+	if(WritablePacket *p = p_in->uniqueify()) {
+	  mcast_dec_ttl(p->ip_header());
+	  mcast_fanout(output(0), p, route->out);
+	  // click_chatter("PIMForwardingTable: forwarding ...");
+	}
+  }
+  else
+	{
+	  //	debug_msg("PIMForwardingTable: PIM forwarding table is empty, no other PIM routers requested this group");
+	  p_in->kill();
+	}
+}
 
-		if((*i).groupsources.size() != 0)
-		  {
-			Vector<groupsource>::iterator  g;
-			for(g=(*i).groupsources.begin(); g!=(*i).groupsources.end(); ++g) {
-			  //			  click_chatter("PIMForwardingTable: comparing %x to %x",(*g).group.addr(), group.addr()); 
-			  if((*g).source.addr()==ntohl(source.addr()) && (group.addr())==((*g).group.addr())) 
-				{
-				  Packet *q_in = p_in->clone();
-				  WritablePacket *p = q_in->uniqueify();
-				  click_ip *ip = p->ip_header();
-				  ip->ip_ttl=(ip->ip_ttl)-1;
-				  //				  p->set_dst_ip_anno(IPAddress(htonl((*g).neighbor.addr())));
-				  p->set_dst_ip_anno(IPAddress((*i).neighbor.addr()));
-				  int hlen = ip->ip_hl << 2;
-				  ip->ip_sum = 0;
-				  ip->ip_sum = click_in_cksum((unsigned char *)ip, hlen);
-				  output(0).push(p);
-				  // click_chatter("PIMForwardingTable: forwarding ...");
-				}
-			}
-		  }
-		else
-		  {
-			//	debug_msg("PIMForwardingTable: PIM forwarding table is empty, no other PIM routers requested this group");
-		  }
-		
-	  }
+/*******************************************************************************************
+ *                                                                                         *
+ * update_route: recomputes the list of neighbors a channel is forwarded to                *
+ *               source is in network byte order, as passed to addgroup and delgroup       *
+ *                                                                                         *
+ *******************************************************************************************/
+void PIMForwardingTable::update_route(IPAddress source, IPAddress group)
+{
+  MulticastForwardingCache<IPAddress>::Route route;
+  Vector<piminterface>::iterator i;
+  for(i=piminterfaces.begin(); i!=piminterfaces.end(); ++i) {
+	Vector<groupsource>::iterator g;
+	for(g=(*i).groupsources.begin(); g!=(*i).groupsources.end(); ++g)
+	  if((*g).source.addr()==ntohl(source.addr()) && (*g).group.addr()==group.addr())
+		route.out.push_back((*i).neighbor);
   }
+  if(route.out.size())
+	_fwd.set(source, group, route);
+  else
+	_fwd.remove(source, group);
 }
 
 uint32_t PIMForwardingTable::get_upstreamneighbor(IPAddress interface)
@@ -2,6 +2,7 @@
 #define PIMFORWARDINGTABLE_HH
 CLICK_DECLS
 #include <click/element.hh>
+#include "mcastfwdcache.hh"
 
 /*
 =c
@@ -11,6 +12,13 @@ PIMForwardingTable()
 
 =d
 Takes care of arriving multicast traffic. Streams are duplicated and forwarded to neighbouring routers which are connected to Rendezvous Point or Source Path Trees.
+Each (source, group) channel is looked up in a hashed forwarding cache that addgroup and delgroup keep up to date; a channel with source 0.0.0.0 matches any source.
+
+=h join write-only
+
+"INTERFACE NEIGHBOR GROUP SOURCE": adds the PIM interface and its
+neighbor if they are new, and joins the neighbor to the (SOURCE, GROUP)
+channel as for a PIM join.  MulticastBench fills the table this way.
 
 =a
 IPMulticastTable, IGMP, PIMControl, PIM, IPMulticastEtherEncap, FixPIMSource
@@ -29,6 +37,8 @@ class PIMForwardingTable : public Element {
   PIMForwardingTable();
   ~PIMForwardingTable();
   int configure(Vector<String> &, ErrorHandler *);
+  int initialize(ErrorHandler *);
+  void add_handlers();
 
   const char *class_name() const	{ return "PIMForwardingTable"; }
   const char *port_count() const	{ return "1/1"; }
@@ -67,6 +77,11 @@ class PIMForwardingTable : public Element {
   void push(int, Packet *);
   uint32_t get_upstreamneighbor(IPAddress);
   bool getPIMreceivers(IPAddress, IPAddress);
+
+ private:
+  static int join_handler(const String &, Element *, void *, ErrorHandler *);
+  MulticastForwardingCache<IPAddress> _fwd;
+  void update_route(IPAddress, IPAddress);
 };
 
 CLICK_ENDDECLS
@@ -52,7 +52,10 @@ ICMP6Checksum::addchecksum(Packet *p_in)
   hopbyhopheader *hopbyhop=(hopbyhopheader *) (q->data() + sizeof(*ip));
   mldv2querie *igp=(mldv2querie *)((char *)hopbyhop + sizeof(*hopbyhop));
 
-  unsigned short chk=in6_cksum(&ip->ip6_src, &ip->ip6_dst, htons(28), 0x3a, 0x00, (unsigned char *)igp, htons(sizeof(*igp)));
+  // MLD queries carry a variable number of sources, so take the length from the IPv6 header
+  unsigned short len=ntohs(ip->ip6_plen)-sizeof(*hopbyhop);
+  igp->checksum=0;
+  unsigned short chk=in6_cksum(&ip->ip6_src, &ip->ip6_dst, htons(len), 0x3a, 0x00, (unsigned char *)igp, htons(len));
 
   igp->checksum=htons(chk);
 return q;
@@ -0,0 +1,39 @@
+#ifndef IP6MCASTFANOUT_HH
+#define IP6MCASTFANOUT_HH
+#include <click/element.hh>
+#include <click/ip6address.hh>
+#include <click/packet_anno.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+ * IPv6 multicast replication without per-receiver payload copies.
+ *
+ * Every copy of a forwarded packet has the same IPv6 header and differs
+ * only in its destination annotation, so the copies are clones sharing
+ * one buffer.  An element further down that has to write to a copy
+ * uniqueifies it as usual.
+ */
+
+// Push one copy of p to out for every address in dsts, with the
+// destination annotation set.  p itself is the last copy, or is killed
+// if dsts is empty.
+inline void
+mcast6_fanout(const Element::Port &out, Packet *p, const Vector<IP6Address> &dsts)
+{
+  int n = dsts.size();
+  if (n == 0) {
+	p->kill();
+	return;
+  }
+  for (int i = 0; i < n - 1; i++)
+	if (Packet *q = p->clone()) {
+	  SET_DST_IP6_ANNO(q, dsts[i]);
+	  out.push(q);
+	}
+  SET_DST_IP6_ANNO(p, dsts[n - 1]);
+  out.push(p);
+}
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,218 @@
+/*
+ * ip6mcastfwdcache.{cc,hh} -- hashed IPv6 multicast forwarding cache
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ip6mcastfwdcache.hh"
+#include <click/element.hh>
+CLICK_DECLS
+
+IP6MulticastForwardingCache::IP6MulticastForwardingCache()
+  : _table(make_table(16)), _size(0), _nsources(0),
+	_reclaim_timer(reclaim_hook, this)
+{
+}
+
+IP6MulticastForwardingCache::~IP6MulticastForwardingCache()
+{
+  for (int i = 0; i < _retired.size(); i++)
+	if (_retired[i].table)
+	  free_table(_retired[i].table);
+	else
+	  delete _retired[i].node;
+  free_table(_table);
+}
+
+IP6MulticastForwardingCache::Table *
+IP6MulticastForwardingCache::make_table(uint32_t nbuckets)
+{
+  Table *t = new Table;
+  t->mask = nbuckets - 1;
+  t->buckets = new Node * volatile[nbuckets];
+  for (uint32_t i = 0; i < nbuckets; i++)
+	t->buckets[i] = 0;
+  return t;
+}
+
+void
+IP6MulticastForwardingCache::free_table(Table *t)
+{
+  for (uint32_t i = 0; i <= t->mask; i++)
+	for (Node *n = t->buckets[i], *next; n; n = next) {
+	  next = n->next;
+	  delete n;
+	}
+  delete[] t->buckets;
+  delete t;
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * retire: queues a Node or Table no reader can newly reach; the reclaim timer frees it    *
+ *         once every reader that might still hold it is done; called with _lock held      *
+ *                                                                                         *
+ *******************************************************************************************/
+void
+IP6MulticastForwardingCache::retire(Node *n, Table *t)
+{
+  Retired r;
+  r.node = n;
+  r.table = t;
+  r.when = Timestamp::now();
+  _retired.push_back(r);
+  if (_reclaim_timer.initialized() && !_reclaim_timer.scheduled())
+	_reclaim_timer.schedule_after_msec(GRACE_MSEC);
+}
+
+void
+IP6MulticastForwardingCache::reclaim()
+{
+  _lock.acquire();
+  Timestamp limit = Timestamp::now() - Timestamp::make_msec(GRACE_MSEC);
+  // _retired is in retirement order
+  int i = 0;
+  for (; i < _retired.size() && _retired[i].when <= limit; i++)
+	if (_retired[i].table)
+	  free_table(_retired[i].table);
+	else
+	  delete _retired[i].node;
+  if (i) {
+	for (int j = i; j < _retired.size(); j++)
+	  _retired[j - i] = _retired[j];
+	_retired.resize(_retired.size() - i);
+  }
+  if (_retired.size())
+	_reclaim_timer.schedule_at(_retired[0].when + Timestamp::make_msec(GRACE_MSEC));
+  _lock.release();
+}
+
+void
+IP6MulticastForwardingCache::reclaim_hook(Timer *, void *thunk)
+{
+  static_cast<IP6MulticastForwardingCache *>(thunk)->reclaim();
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * grow: rebuilds the table with twice the buckets; the old table keeps its own Nodes, so  *
+ *       readers still walking it are unaffected, and is retired whole                     *
+ *                                                                                         *
+ *******************************************************************************************/
+void
+IP6MulticastForwardingCache::grow()
+{
+  Table *old = _table;
+  Table *t = make_table(2 * (old->mask + 1));
+  for (uint32_t i = 0; i <= old->mask; i++)
+	for (const Node *o = old->buckets[i]; o; o = o->next) {
+	  Node *n = new Node(*o);
+	  Node * volatile &head = t->buckets[hash(n->source, n->group) & t->mask];
+	  n->next = head;
+	  head = n;
+	}
+  click_fence();
+  _table = t;
+  retire(0, old);
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * apply: installs the outgoing list of a channel, or removes the channel if r is null;    *
+ *        called with _lock held                                                           *
+ *                                                                                         *
+ *******************************************************************************************/
+void
+IP6MulticastForwardingCache::apply(const IP6Address &source, const IP6Address &group, const Route *r)
+{
+  Table *t = _table;
+  Node * volatile *link = &t->buckets[hash(source, group) & t->mask];
+  while (*link && !((*link)->source == source && (*link)->group == group))
+	link = &(*link)->next;
+  Node *old = *link;
+  bool sg = (source != IP6Address());
+
+  if (!r) {
+	if (old) {
+	  // readers on old still find the rest of the chain through it
+	  *link = old->next;
+	  retire(old, 0);
+	  _size--;
+	  if (sg)
+		_nsources--;
+	}
+	return;
+  }
+
+  Node *n = new Node;
+  n->source = source;
+  n->group = group;
+  n->route = *r;
+  if (old) {
+	n->next = old->next;
+	click_fence();
+	*link = n;
+	retire(old, 0);
+  } else {
+	Node * volatile &head = t->buckets[hash(source, group) & t->mask];
+	n->next = head;
+	click_fence();
+	head = n;
+	_size++;
+	if (sg)
+	  _nsources++;
+	if ((uint32_t) _size > 2 * (t->mask + 1))
+	  grow();
+  }
+}
+
+void
+IP6MulticastForwardingCache::set(const IP6Address &source, const IP6Address &group, const Route &r)
+{
+  _lock.acquire();
+  apply(source, group, &r);
+  _lock.release();
+}
+
+void
+IP6MulticastForwardingCache::remove(const IP6Address &source, const IP6Address &group)
+{
+  _lock.acquire();
+  apply(source, group, 0);
+  _lock.release();
+}
+
+void
+IP6MulticastForwardingCache::update(const IP6Address &group, const Vector<Update> &u)
+{
+  _lock.acquire();
+  for (int i = 0; i < u.size(); i++)
+	apply(u[i].source, group, u[i].remove ? 0 : &u[i].route);
+  _lock.release();
+}
+
+void
+IP6MulticastForwardingCache::clear()
+{
+  _lock.acquire();
+  Table *old = _table;
+  Table *t = make_table(16);
+  click_fence();
+  _table = t;
+  _size = 0;
+  _nsources = 0;
+  retire(0, old);
+  _lock.release();
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(IP6MulticastForwardingCache)
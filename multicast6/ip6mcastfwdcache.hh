@@ -0,0 +1,146 @@
+#ifndef IP6MCASTFWDCACHE_HH
+#define IP6MCASTFWDCACHE_HH
+#include <click/ip6address.hh>
+#include <click/vector.hh>
+#include <click/timestamp.hh>
+#include <click/timer.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+class Element;
+
+/*
+ * IP6MulticastForwardingCache: hashed (source, group) -> outgoing list
+ *
+ * The IPv6 counterpart of the multicast package's forwarding cache.
+ * IP6MulticastTable and IP6PIMForwardingTable keep their membership in
+ * Vectors; each control call that changes a group recomputes that
+ * group's entries here, and push() does one lookup on the 128-bit
+ * (S,G) key instead of comparing every group address.
+ *
+ * An entry with source :: is a (*,G) entry.  lookup(S, G) tries the
+ * exact (S,G) channel first and falls back to (*,G).  An (S,G) entry
+ * may have an empty route: it stops the fallback, so a source every
+ * receiver has blocked is dropped rather than sent to the (*,G) list.
+ * Tables that only ever install (*,G) entries use lookup(G).
+ *
+ * The data path takes no lock and writes nothing.  Each channel is a
+ * Node in a chained hash table, and a Node's route is never written
+ * once readers can reach it.  Changing a channel links a new Node in
+ * place of the old one with a single pointer store; removing one
+ * unlinks it the same way, and a reader standing on it still finds the
+ * rest of the chain.  Either way only that channel's Node is retired,
+ * and the table is copied only when it doubles.  Retired Nodes (and
+ * tables) are freed by a timer GRACE_MSEC later, far longer than any
+ * push() holds on to a Route.  Writers are serialized by _lock.  Each
+ * channel changes atomically; update() changes a group's channels one
+ * after another.
+ *
+ * The owning element must call initialize() from its own initialize(),
+ * which sets up the reclaim timer.
+ */
+
+class IP6MulticastForwardingCache {
+ public:
+
+  struct Route {
+	Vector<IP6Address> out;    // receivers or PIM neighbors to copy to
+  };
+
+  struct Update {
+	IP6Address source;
+	Route route;
+	bool remove;               // drop the channel instead
+	Update() : remove(false) { }
+  };
+
+  IP6MulticastForwardingCache();
+  ~IP6MulticastForwardingCache();
+
+  void initialize(Element *owner)	{ _reclaim_timer.initialize(owner); }
+
+  // data path: the result stays valid for GRACE_MSEC
+  inline const Route *lookup(const IP6Address &source, const IP6Address &group) const;
+  inline const Route *lookup(const IP6Address &group) const;
+  int size() const			{ return _size; }
+
+  // control path: an empty route stays, and matches packets to drop
+  void set(const IP6Address &source, const IP6Address &group, const Route &);
+  void remove(const IP6Address &source, const IP6Address &group);
+  // apply several changes to one group's channels, in order
+  void update(const IP6Address &group, const Vector<Update> &);
+  void clear();
+
+  enum { GRACE_MSEC = 1000 };
+
+ private:
+
+  struct Node {
+	IP6Address source;
+	IP6Address group;
+	Route route;
+	Node * volatile next;
+  };
+
+  struct Table {
+	uint32_t mask;             // bucket count - 1, a power of two
+	Node * volatile *buckets;
+  };
+
+  struct Retired {
+	Node *node;                // or
+	Table *table;              // with all the Nodes still linked in it
+	Timestamp when;
+  };
+
+  Table * volatile _table;
+  int _size;
+  int _nsources;               // (S,G) entries; 0 means skip the first probe
+  Vector<Retired> _retired;
+  Timer _reclaim_timer;
+  Spinlock _lock;
+
+  static inline uint32_t hash(const IP6Address &source, const IP6Address &group) {
+	return (source.hashcode() * 2654435761U) ^ group.hashcode();
+  }
+  static inline const Node *find(const Table *, const IP6Address &source, const IP6Address &group);
+  static Table *make_table(uint32_t nbuckets);
+  static void free_table(Table *);
+
+  void apply(const IP6Address &source, const IP6Address &group, const Route *);
+  void grow();
+  void retire(Node *, Table *);
+  void reclaim();
+  static void reclaim_hook(Timer *, void *);
+};
+
+inline const IP6MulticastForwardingCache::Node *
+IP6MulticastForwardingCache::find(const Table *t, const IP6Address &source, const IP6Address &group)
+{
+  const Node *n = t->buckets[hash(source, group) & t->mask];
+  for (; n; n = n->next)
+	if (n->source == source && n->group == group)
+	  return n;
+  return 0;
+}
+
+inline const IP6MulticastForwardingCache::Route *
+IP6MulticastForwardingCache::lookup(const IP6Address &source, const IP6Address &group) const
+{
+  const Table *t = _table;
+  const Node *n = 0;
+  if (_nsources && source != IP6Address())
+	n = find(t, source, group);
+  if (!n)
+	n = find(t, IP6Address(), group);
+  return n ? &n->route : 0;
+}
+
+inline const IP6MulticastForwardingCache::Route *
+IP6MulticastForwardingCache::lookup(const IP6Address &group) const
+{
+  const Node *n = find(_table, IP6Address(), group);
+  return n ? &n->route : 0;
+}
+
+CLICK_ENDDECLS
+#endif
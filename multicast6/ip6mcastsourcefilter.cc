@@ -0,0 +1,77 @@
+/*
+ * ip6mcastsourcefilter.{cc,hh} -- per-group IPv6 source filters as receiver bitmaps
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ip6mcastsourcefilter.hh"
+#include <click/integers.hh>
+CLICK_DECLS
+
+IP6MulticastSourceFilter::IP6MulticastSourceFilter(int nreceivers)
+  : _nwords((nreceivers + 31) / 32), _exclude_mode(_nwords, 0), _index(-1)
+{
+}
+
+int
+IP6MulticastSourceFilter::source_index(const IP6Address &source)
+{
+  HashTable<IP6Address, int>::iterator it = _index.find_insert(source, -1);
+  if (it.value() < 0) {
+	it.value() = _sources.size();
+	_sources.push_back(source);
+	for (int w = 0; w < _nwords; w++) {
+	  _include.push_back(0);
+	  _exclude.push_back(0);
+	}
+  }
+  return it.value();
+}
+
+void
+IP6MulticastSourceFilter::include(int r, const IP6Address &source)
+{
+  int i = source_index(source);
+  _include[i * _nwords + r / 32] |= 1U << (r % 32);
+}
+
+void
+IP6MulticastSourceFilter::exclude(int r)
+{
+  _exclude_mode[r / 32] |= 1U << (r % 32);
+}
+
+void
+IP6MulticastSourceFilter::exclude(int r, const IP6Address &source)
+{
+  int i = source_index(source);
+  _exclude[i * _nwords + r / 32] |= 1U << (r % 32);
+}
+
+void
+IP6MulticastSourceFilter::receivers(const IP6Address &source, Vector<int> &out) const
+{
+  int i = _index.get(source);
+  for (int w = 0; w < _nwords; w++) {
+	uint32_t bits = _exclude_mode[w];
+	if (i >= 0)
+	  bits = _include[i * _nwords + w] | (bits & ~_exclude[i * _nwords + w]);
+	while (bits) {
+	  int b = ffs_lsb(bits) - 1;
+	  out.push_back(w * 32 + b);
+	  bits &= bits - 1;
+	}
+  }
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(IP6MulticastSourceFilter)
@@ -0,0 +1,55 @@
+#ifndef IP6MCASTSOURCEFILTER_HH
+#define IP6MCASTSOURCEFILTER_HH
+#include <click/ip6address.hh>
+#include <click/hashtable.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+ * IP6MulticastSourceFilter: the INCLUDE/EXCLUDE source lists of all
+ * receivers of one group, compiled into receiver bitmaps
+ *
+ * The IPv6 counterpart of the multicast package's filter.  Receivers
+ * are numbered 0..n-1.  Each source that appears in some receiver's
+ * list gets two bitmaps: the receivers that include it and the
+ * receivers that exclude it.  One more bitmap holds the receivers
+ * in EXCLUDE mode.  Receivers of a packet from S are then
+ *
+ *   include[S] | (exclude_mode & ~exclude[S])
+ *
+ * and a source nobody lists reaches exactly the EXCLUDE mode receivers.
+ * IP6MulticastTable compiles a group's filter whenever its membership
+ * changes and installs one forwarding cache entry per listed source
+ * plus the (*,G) entry.
+ */
+
+class IP6MulticastSourceFilter {
+ public:
+
+  IP6MulticastSourceFilter(int nreceivers);
+
+  void include(int r, const IP6Address &source);
+  void exclude(int r);                     // receiver r is in EXCLUDE mode
+  void exclude(int r, const IP6Address &source);
+
+  // every source in some receiver's list
+  const Vector<IP6Address> &sources() const	{ return _sources; }
+  bool listed(const IP6Address &source) const	{ return _index.get(source) >= 0; }
+
+  // append the receivers that want traffic from source to out
+  void receivers(const IP6Address &source, Vector<int> &out) const;
+
+ private:
+
+  int _nwords;                 // bitmap words per set
+  Vector<uint32_t> _exclude_mode;
+  HashTable<IP6Address, int> _index;
+  Vector<IP6Address> _sources;
+  Vector<uint32_t> _include;   // _nwords words per listed source
+  Vector<uint32_t> _exclude;
+
+  int source_index(const IP6Address &);
+};
+
+CLICK_ENDDECLS
+#endif
@@ -21,6 +21,8 @@
 #include <click/error.hh>
 #include <click/confparse.hh>
 #include "ip6multicasttable.hh"
+#include "ip6mcastsourcefilter.hh"
+#include "ip6mcastfanout.hh"
 
 IP6MulticastTable::IP6MulticastTable()
 {
@@ -40,6 +42,7 @@ IP6MulticastTable::configure(Vector<String> &conf, ErrorHandler *errh)
 {
   if (conf.size() != 1) {
 	use_pim = false;
+	pPim = 0;
     debug_msg("No PIM-SM element named, router-to-router protocol is disabled.");
 	return 0;
   }
@@ -51,6 +54,7 @@ IP6MulticastTable::configure(Vector<String> &conf, ErrorHandler *errh)
 	  return -1;
 	}
 	pPim = (IP6PIMControl *)e->cast("IP6PIMControl");
+	use_pim = (pPim != 0);
 	/*  }
 		else {
  // return errh->error("wrong number of arguments; expected 'IP6MulticastTable(optional PIM element)'");
@@ -59,6 +63,46 @@ IP6MulticastTable::configure(Vector<String> &conf, ErrorHandler *errh)
   }
 }
 
+int
+IP6MulticastTable::initialize(ErrorHandler *)
+{
+  _fwd.initialize(this);
+  return 0;
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * join_handler: "GROUP RECEIVER [SOURCE]" joins a receiver as an MLD report would,        *
+ *               in INCLUDE mode with SOURCE if one is given                               *
+ *                                                                                         *
+ *******************************************************************************************/
+int
+IP6MulticastTable::join_handler(const String &s, Element *e, void *, ErrorHandler *errh)
+{
+  IP6MulticastTable *mct=static_cast<IP6MulticastTable *>(e);
+  Vector<String> words;
+  cp_spacevec(cp_uncomment(s), words);
+  click_in6_addr group, recv, source;
+  if ((words.size()!=2 && words.size()!=3)
+	  || !cp_ip6_address(words[0], (unsigned char *)&group)
+	  || !cp_ip6_address(words[1], (unsigned char *)&recv)
+	  || (words.size()==3 && !cp_ip6_address(words[2], (unsigned char *)&source)))
+	return errh->error("expected GROUP RECEIVER [SOURCE]");
+  mct->addgroup(IP6Address(group));
+  mct->joingroup(IP6Address(recv), IP6Address(group));
+  if (words.size()==3) {
+	mct->set_receiver_mode(IP6Address(recv), IP6Address(group), INCLUDEMODE);
+	mct->addsource(IP6Address(recv), IP6Address(group), IP6Address(source));
+  }
+  return 0;
+}
+
+void
+IP6MulticastTable::add_handlers()
+{
+  add_write_handler("join", join_handler, 0);
+}
+
 
 void
 IP6MulticastTable::printIP6(IP6Address group)
@@ -90,6 +134,7 @@ bool IP6MulticastTable::joingroup(IP6Address recv, IP6Address group)
 {
   receiver new_receiver;           // create new receiver struct
   new_receiver.receiver=recv;      // initialize this new struct with receivers IP address
+  new_receiver.mode=EXCLUDEMODE;   // MLDv1 and exclude {} listeners
 
   Vector<MulticastGroup>::iterator i;
 
@@ -116,6 +161,7 @@ bool IP6MulticastTable::joingroup(IP6Address recv, IP6Address group)
 	  debug_msg("  to group");
    	  printIP6(group);
 	  (*i).receivers.push_back(new_receiver); 
+	  update_route(group);
 	}
   }
    // printgroups(true);
@@ -153,8 +199,8 @@ bool IP6MulticastTable::leavegroup(IP6Address recv, IP6Address group)
 		  if((*i).receivers.begin()==(*i).receivers.end()) {
 			// (XXX) send a listener query first
 			multicastgroups.erase(i);
-			return true;
 		  }
+		  update_route(group);
 		  return true;
 		}
 	  }
@@ -215,31 +261,123 @@ bool IP6MulticastTable::printgroups(bool printreceivers)
  *******************************************************************************************/
 void IP6MulticastTable::push(int port, Packet *p_in)
 {
-  bool submitted_packet=false;
-  click_in6_addr group=click_in6_addr(DST_IP6_ANNO(p_in));
-  Vector<MulticastGroup>::iterator  i;
-  for(i=multicastgroups.begin(); i!=multicastgroups.end(); ++i)
+  IP6Address group=IP6Address(DST_IP6_ANNO(p_in));
+  IP6Address source=IP6Address(p_in->ip6_header()->ip6_src);
+  const IP6MulticastForwardingCache::Route *route=_fwd.lookup(source, group);
+  // an empty route is a source every receiver of the group has blocked
+  if(route && route->out.size())
 	{
-	  if(((*i).receivers.size() != 0) && IP6Address(group)==IP6Address((*i).group)) 
-
-		{
-		  Vector<receiver>::iterator a;
-		  for(a=(*i).receivers.begin(); a!=(*i).receivers.end(); ++a)
-			{
-			  submitted_packet=true;
-			  Packet *q_in = p_in->clone();
-			  WritablePacket *p = q_in->uniqueify();
-			  click_ip6 *ip = p->ip6_header();
-			  ip->ip6_hlim++;
-			  click_in6_addr r=click_in6_addr((*a).receiver);
-			  SET_DST_IP6_ANNO(p, r);
-			  output(0).push(p);
-			}
+	  // p_in goes on to the PIM table unchanged, so make one writable
+	  // copy and share it between all receivers
+	  if(Packet *q_in = p_in->clone())
+		if(WritablePacket *p = q_in->uniqueify()) {
+		  p->ip6_header()->ip6_hlim++;
+		  mcast6_fanout(output(0), p, route->out);
 		}
 	}
 	output(1).push(p_in);
 }
 
+/*******************************************************************************************
+ *                                                                                         *
+ * embedded_rp: the RP address embedded in an FF70::/12 group, which MLD lists as a        *
+ *              source of the group's receivers so that IP6PIMControl joins towards it     *
+ *                                                                                         *
+ *******************************************************************************************/
+static IP6Address embedded_rp(const IP6Address &group)
+{
+  IP6Address rp;
+  const unsigned char *g=group.data();
+  unsigned char *r=rp.data();
+  int plen=(g[3] > 64 ? 64 : g[3]);
+  memcpy(r, g + 4, plen / 8);
+  if(plen % 8)
+	r[plen / 8]=g[4 + plen / 8] & (0xFF << (8 - plen % 8));
+  r[15]=g[2] & 0x0F;
+  return rp;
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * update_route: compiles the source filters of a group's receivers after a membership     *
+ *               change, installs an (S,G) entry for every source some receiver lists and  *
+ *               a (*,G) entry for all other sources, and drops entries no longer needed;  *
+ *               a listed source nobody wants keeps an empty (S,G) entry, so its traffic   *
+ *               does not fall back to the (*,G) receivers that excluded it                *
+ *                                                                                         *
+ *******************************************************************************************/
+void IP6MulticastTable::update_route(const IP6Address &group)
+{
+  Vector<IP6MulticastForwardingCache::Update> updates;
+  IP6MulticastForwardingCache::Update u;
+
+  Vector<MulticastGroup>::iterator i;
+  for(i=multicastgroups.begin(); i!=multicastgroups.end(); ++i)
+	if(IP6Address((*i).group)==group) break;
+
+  // the embedded RP is there for PIM, it filters no traffic
+  bool has_rp=group.matches_prefix(IP6Address("FF70::0"), IP6Address("FFF0::0"));
+  IP6Address rp=(has_rp ? embedded_rp(group) : IP6Address());
+
+  Vector<receiver> empty;
+  Vector<receiver> &rs=(i!=multicastgroups.end() ? (*i).receivers : empty);
+  IP6MulticastSourceFilter filter(rs.size());
+  for(int r=0; r<rs.size(); ++r) {
+	if(rs[r].mode==INCLUDEMODE) {
+	  for(int j=0; j<rs[r].sources.size(); ++j)
+		if(!has_rp || IP6Address(rs[r].sources[j])!=rp)
+		  filter.include(r, IP6Address(rs[r].sources[j]));
+	}
+	else {
+	  filter.exclude(r);
+	  for(int j=0; j<rs[r].sources.size(); ++j)
+		if(!has_rp || IP6Address(rs[r].sources[j])!=rp)
+		  filter.exclude(r, IP6Address(rs[r].sources[j]));
+	}
+  }
+
+  // every listed source gets an (S,G) entry, empty if no receiver wants it;
+  // replacing an entry in place never exposes the (*,G) entry in between
+  Vector<int> members;
+  Vector<IP6Address> routed;
+  for(int j=0; j<filter.sources().size(); ++j) {
+	u.source=filter.sources()[j];
+	members.clear();
+	filter.receivers(u.source, members);
+	for(int m=0; m<members.size(); ++m)
+	  u.route.out.push_back(IP6Address(rs[members[m]].receiver));
+	updates.push_back(u);
+	u.route.out.clear();
+	routed.push_back(u.source);
+  }
+
+  u.source=IP6Address();
+  members.clear();
+  filter.receivers(u.source, members);
+  for(int m=0; m<members.size(); ++m)
+	u.route.out.push_back(IP6Address(rs[members[m]].receiver));
+  // a group nobody receives needs no (*,G) entry
+  u.remove=(members.size()==0);
+  updates.push_back(u);
+  u.route.out.clear();
+
+  // (S,G) entries of sources no longer listed go
+  u.remove=true;
+  HashTable<IP6Address, Vector<IP6Address> >::iterator old=_routed_sources.find(group);
+  if(old)
+	for(int j=0; j<old.value().size(); ++j)
+	  if(!filter.listed(old.value()[j])) {
+		u.source=old.value()[j];
+		updates.push_back(u);
+	  }
+
+  if(routed.size()==0)
+	_routed_sources.erase(group);
+  else
+	_routed_sources[group].swap(routed);
+  _fwd.update(group, updates);
+}
+
 /*******************************************************************************************
  *                                                                                         *
  * addsource: SSM function, adds a source address to a pair of group<->interface           *
@@ -259,16 +397,17 @@ bool IP6MulticastTable::addsource(IP6Address recv, IP6Address group, IP6Address
 			  if(IP6Address((*re).receiver)==IP6Address(recv)) {
 				Vector<click_in6_addr>::iterator a;
 				for(a=(*re).sources.begin(); a!=(*re).sources.end(); a++) {
-				  //  if(IP6Address((*a))==IP6Address(sa)) {// PIM-Embedded RP test
+				  if(IP6Address((*a))==IP6Address(sa)) {
 					//					debug_msg("addsource: Duplicate request to add source");
-				  return false; 
-				  //				  }
+					return false; 
+				  }
 
 				}
 				(*re).sources.push_back(click_in6_addr(sa));
+				update_route(group);
 				//const unsigned char *p = sa.data();
 				//	debug_msg("IP source address: %d.%d.%d.%d", p[0], p[1], p[2], p[3]);
-				if ( (pPim->noPIMreceivers(group, sa)) ) {
+				if ( use_pim && (pPim->noPIMreceivers(group, sa)) ) {
 					  pPim->generatejoinprune(group, sa, true);
 				  	}
 				return true;				
@@ -301,7 +440,8 @@ bool IP6MulticastTable::delsource(IP6Address recv, IP6Address group, IP6Address
 					(*re).sources.erase(a);
 					// "dead" receivers are dropped from the list
 					if((get_receiver_mode(recv, group)==INCLUDEMODE) && ((*re).sources.size()==0)) leavegroup(recv, group); 
-					if ( pPim->noPIMreceivers(group, sa) ) {
+					else update_route(group);
+					if ( use_pim && pPim->noPIMreceivers(group, sa) ) {
 					  pPim->generatejoinprune(group, sa, false);
 					}
 					return true;
@@ -347,6 +487,7 @@ IP6MulticastTable::set_receiver_mode(IP6Address recv, IP6Address group, MODE mod
 			{
 			  if(IP6Address((*a).receiver)==IP6Address(recv))  {
 				(*a).mode=mode;
+				update_route(group);
 				return true;
 				//				debug_msg("setmode %x", mode);
 			  }
@@ -378,3 +519,4 @@ bool IP6MulticastTable::getMLDreceivers(IP6Address source, IP6Address group)
 }
 
 EXPORT_ELEMENT(IP6MulticastTable)
+ELEMENT_REQUIRES(IP6MulticastForwardingCache IP6MulticastSourceFilter)
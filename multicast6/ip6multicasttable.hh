@@ -6,6 +6,8 @@
 #include <clicknet/ip6.h>
 #include <click/ip6address.hh>
 #include "debug.hh"
+#include <click/hashtable.hh>
+#include "ip6mcastfwdcache.hh"
 
 
 /*
@@ -18,6 +20,16 @@ IP6MulticastTable(IP6PIMControl)
 Includes data structures to store addresses of receivers of multicast streams (IPv6).
 Each multicast group entry can hold information about senders and receivers.
 The data structures is based upon STL containers.
+Data packets are forwarded from a hashed cache keyed on (source, group).
+Each membership change compiles the changed group's INCLUDE and EXCLUDE source
+lists into one entry per listed source plus a (*,G) entry for all other sources,
+so MLDv2 source filters are honoured; all copies of a packet share one buffer.
+
+=h join write-only
+
+"GROUP RECEIVER [SOURCE]": RECEIVER joins GROUP as for an MLD report,
+in INCLUDE mode with SOURCE if one is given.  MulticastBench fills the
+table this way.
 
 =e
 mct::IP6MulticastTable("pimctl");
@@ -77,6 +89,8 @@ class IP6MulticastTable : public Element {
   Vector<MulticastGroup> multicastgroups;
 
   int configure(Vector<String> &, ErrorHandler *);
+  int initialize(ErrorHandler *);
+  void add_handlers();
   void printIP6(IP6Address);
   bool printreceiver(Vector<MulticastGroup>::iterator);
   bool addgroup(IP6Address);
@@ -89,6 +103,12 @@ class IP6MulticastTable : public Element {
   bool printgroups(bool);
   void push(int, Packet *);
   bool getMLDreceivers(IP6Address, IP6Address);
+
+ private:
+  static int join_handler(const String &, Element *, void *, ErrorHandler *);
+  IP6MulticastForwardingCache _fwd;
+  HashTable<IP6Address, Vector<IP6Address> > _routed_sources; // sources with an (S,G) entry, per group
+  void update_route(const IP6Address &);
 };
 
 CLICK_ENDDECLS
@@ -18,6 +18,7 @@
 
 #include <click/config.h>
 #include "ip6pimforwardingtable.hh"
+#include "ip6mcastfanout.hh"
 #include <click/ipaddress.hh>
 #include <click/router.hh>
 #include <click/error.hh>
@@ -71,6 +72,42 @@ IP6PIMForwardingTable::configure(Vector<String> &conf, ErrorHandler *errh)
   return 0; 
 }
 
+int
+IP6PIMForwardingTable::initialize(ErrorHandler *)
+{
+  _fwd.initialize(this);
+  return 0;
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * join_handler: "INTERFACE NEIGHBOR GROUP SOURCE" adds the interface and neighbor and     *
+ *               joins the neighbor to the group, as a PIM join would                      *
+ *                                                                                         *
+ *******************************************************************************************/
+int
+IP6PIMForwardingTable::join_handler(const String &s, Element *e, void *, ErrorHandler *errh)
+{
+  IP6PIMForwardingTable *pft=static_cast<IP6PIMForwardingTable *>(e);
+  Vector<String> words;
+  cp_spacevec(cp_uncomment(s), words);
+  click_in6_addr a[4];
+  if (words.size()!=4)
+	return errh->error("expected INTERFACE NEIGHBOR GROUP SOURCE");
+  for (int i=0; i<4; i++)
+	if (!cp_ip6_address(words[i], (unsigned char *)&a[i]))
+	  return errh->error("expected INTERFACE NEIGHBOR GROUP SOURCE");
+  pft->addinterface(IP6Address(a[0]), IP6Address(a[1]));
+  pft->addgroup(IP6Address(a[0]), IP6Address(a[2]), IP6Address(a[3]), IP6Address(a[1]));
+  return 0;
+}
+
+void
+IP6PIMForwardingTable::add_handlers()
+{
+  add_write_handler("join", join_handler, 0);
+}
+
 
 /*******************************************************************************************
  *                                                                                         *
@@ -98,10 +135,12 @@ bool IP6PIMForwardingTable::addgroup(IP6Address interface,
 		// and check for double entries...
 		Vector<groupsource>::iterator g;
 		for(g=(*i).groupsources.begin(); g!=(*i).groupsources.end(); ++g) {
-		  if( (*g).group==IP6Address(gs.group) ) return false;
+		  if( (*g).group==IP6Address(gs.group) &&
+		      channel_source((*g).group, (*g).source)==channel_source(group, source) ) return false;
 		}
 		// before finally adding the group address.
 		(*i).groupsources.push_back(gs);
+		update_route(channel_source(group, source), group);
 		printgroups();
 		return true;
 	  }
@@ -127,10 +166,12 @@ bool IP6PIMForwardingTable::delgroup(IP6Address interface, IP6Address group, IP6
 		  //	debug_msg("IP6PIMForwardingTable delgroup at group %x", IP6Address(group));
 			//		  if( ( (*g).group.addr()==IP6Address(group) ) &&  ( (*g).source.addr()==htonl(source.addr())) ) { (X)
 	
-		  if( //( (*g).source==IP6Address(source)) &&  // not for mldv1 and embedded rp addres
+		  // embedded RP joins name the RP, not a source: see channel_source
+		  if( channel_source((*g).group, (*g).source)==channel_source(group, source) &&
 		     (*g).group==IP6Address(group)   ) {
 
 			(*i).groupsources.erase(g);
+			update_route(channel_source(group, source), group);
 			return true;
 		  }
 		}
@@ -183,37 +224,50 @@ bool IP6PIMForwardingTable::printgroups()
 void IP6PIMForwardingTable::push(int port, Packet *p_in)
 {
   IP6Address group=DST_IP6_ANNO(p_in);
-  click_ip6* ip;
-  ip=(click_ip6 *)p_in->data();
-  IP6Address source=IP6Address(ip->ip6_src);
-  if(piminterfaces.size()!=0) {
-	Vector<piminterface>::iterator  i;
-	for(i=piminterfaces.begin(); i!=piminterfaces.end(); ++i)
-	  {
+  IP6Address source=IP6Address(p_in->ip6_header()->ip6_src);
+  // an SSM channel first, then the (*,G) entry of an embedded RP group
+  const IP6MulticastForwardingCache::Route *route=_fwd.lookup(source, group);
+  if(route)
+	mcast6_fanout(output(0), p_in, route->out);
+  else
+	{
+	  //	debug_msg("IP6PIMForwardingTable PIM forwarding table is empty, no other PIM routers requested this group");
+	  p_in->kill();
+	}
+}
 
-		if((*i).groupsources.size() != 0)
-		  {
-			Vector<groupsource>::iterator  g;
-			for(g=(*i).groupsources.begin(); g!=(*i).groupsources.end(); ++g) {
-
-			  if( // (*g).source==source && not for embedded RP and MLDv1...
-			     group==(*g).group)
-				{
-				  Packet *q_in = p_in->clone();
-				  WritablePacket *p = q_in->uniqueify();
-				  SET_DST_IP6_ANNO(p, (*i).neighbor);
-				  output(0).push(p);
-				  // debug_msg("IP6PIMForwardingTable forwarding ...");
-				}
-			}
-		  }
-		else
-		  {
-			//	debug_msg("IP6PIMForwardingTable PIM forwarding table is empty, no other PIM routers requested this group");
-		  }
-		
-	  }
+/*******************************************************************************************
+ *                                                                                         *
+ * channel_source: the source of the channel a join is forwarded on; a join for an         *
+ *                 embedded RP group carries the RP and makes the (*,G) entry, source ::   *
+ *                                                                                         *
+ *******************************************************************************************/
+IP6Address IP6PIMForwardingTable::channel_source(const IP6Address &group, const IP6Address &source)
+{
+  if(group.matches_prefix(IP6Address("FF70::0"), IP6Address("FFF0::0")))
+	return IP6Address();
+  return source;
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * update_route: recomputes the list of neighbors a channel is forwarded to                *
+ *                                                                                         *
+ *******************************************************************************************/
+void IP6PIMForwardingTable::update_route(const IP6Address &source, const IP6Address &group)
+{
+  IP6MulticastForwardingCache::Route route;
+  Vector<piminterface>::iterator i;
+  for(i=piminterfaces.begin(); i!=piminterfaces.end(); ++i) {
+	Vector<groupsource>::iterator g;
+	for(g=(*i).groupsources.begin(); g!=(*i).groupsources.end(); ++g)
+	  if((*g).group==group && channel_source((*g).group, (*g).source)==source)
+		route.out.push_back((*i).neighbor);
   }
+  if(route.out.size())
+	_fwd.set(source, group, route);
+  else
+	_fwd.remove(source, group);
 }
 
 
@@ -254,3 +308,4 @@ bool IP6PIMForwardingTable::getPIMreceivers(IP6Address source, IP6Address group)
 
 
 EXPORT_ELEMENT(IP6PIMForwardingTable)
+ELEMENT_REQUIRES(IP6MulticastForwardingCache)
@@ -3,6 +3,7 @@
 CLICK_DECLS
 #include <click/element.hh>
 #include <click/ip6address.hh>
+#include "ip6mcastfwdcache.hh"
 
 /*
 =c
@@ -12,6 +13,14 @@ IP6PIMForwardingTable()
 
 =d
 Takes care of arriving multicast traffic. Streams are duplicated and forwarded to neighbouring routers which are connected to Rendezvous Point or Source Path Trees.
+The neighbors of each channel are kept in a hashed forwarding cache that addgroup and delgroup keep up to date; copies share one packet buffer.
+Source specific joins give (S,G) entries matched on the packet's source; joins for embedded RP groups (FF70::/12) name the RP and give one (*,G) entry for all sources.
+
+=h join write-only
+
+"INTERFACE NEIGHBOR GROUP SOURCE": adds the PIM interface and its
+neighbor if they are new, and joins the neighbor to GROUP as for a PIM
+join naming SOURCE.  MulticastBench fills the table this way.
 
 =a
 IPv6MulticastTable, MLD, IP6PIMControl, IP6PIM, IP6MC_EtherEncap, IP6FixPIMSource
@@ -30,6 +39,8 @@ class IP6PIMForwardingTable : public Element {
   IP6PIMForwardingTable();
   ~IP6PIMForwardingTable();
   int configure(Vector<String> &, ErrorHandler *);
+  int initialize(ErrorHandler *);
+  void add_handlers();
 
   const char *class_name() const	{ return "IP6PIMForwardingTable"; }
   const char *port_count() const	{ return "1/1"; }
@@ -67,6 +78,12 @@ class IP6PIMForwardingTable : public Element {
   bool printgroups();
   void push(int, Packet *);
   bool getPIMreceivers(IP6Address, IP6Address);
+
+ private:
+  static int join_handler(const String &, Element *, void *, ErrorHandler *);
+  IP6MulticastForwardingCache _fwd;
+  static IP6Address channel_source(const IP6Address &, const IP6Address &);
+  void update_route(const IP6Address &, const IP6Address &);
 };
 
 CLICK_ENDDECLS
@@ -43,19 +43,31 @@ MLD::~MLD()
 int
 MLD::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-  if (conf.size() != 1)
-    return errh->error("wrong number of arguments; expected 'MLD(IP6MulticastTable element)'");
+  Element *e;
+  querierstate=true;
+  _query_interval=125000;
+  _response_interval=10000;
+  _last_listener_interval=1000;
+  _robustness=2;
+  if (cp_va_kparse(conf, this, errh,
+				   "MCASTTABLE", cpkP+cpkM, cpElement, &e,
+				   "QUERIER", 0, cpBool, &querierstate,
+				   "QUERY_INTERVAL", 0, cpSecondsAsMilli, &_query_interval,
+				   "RESPONSE_INTERVAL", 0, cpSecondsAsMilli, &_response_interval,
+				   "LAST_LISTENER_INTERVAL", 0, cpSecondsAsMilli, &_last_listener_interval,
+				   "ROBUSTNESS", 0, cpUnsigned, &_robustness,
+				   cpEnd) < 0)
+	return -1;
+  if (_robustness == 0)
+	return errh->error("ROBUSTNESS must be at least 1");
+  if (_response_interval >= _query_interval)
+	return errh->error("RESPONSE_INTERVAL must be less than QUERY_INTERVAL");
 
   // get Multicast6 element
-  Element *e = cp_element(conf[0], this, errh);
-  if (!e) {
-    return -1;
-  }
-  else {
-	MCastTable = (IP6MulticastTable *)e->cast("IP6MulticastTable");
-
-	return 0;
-  }
+  MCastTable = (IP6MulticastTable *)e->cast("IP6MulticastTable");
+  if (!MCastTable)
+	return errh->error("%s is not an IP6MulticastTable", e->name().c_str());
+  return 0;
 }
 
 /*******************************************************************************************
@@ -66,10 +78,14 @@ MLD::configure(Vector<String> &conf, ErrorHandler *errh)
 int MLD::initialize(ErrorHandler *errh)
 {
   // debug_msg("MLD: mld initil");
-  _timer.initialize(this);
-  _timer.schedule_after_msec(QUERY_INTERVAL);
+  _now=now_msec();
+  _wheel.initialize(TICK, _now);
   // at startup the router assumes he is the only MLDv2 router in its subnet
-  querierstate=true;
+  // and sends robustness general queries in quick succession
+  _startup_queries=_robustness;
+  _next_general_query=_now;
+  _timer.initialize(this);
+  _timer.schedule_after_msec(TICK);
 
   // ** for performance tests, add a number of groups and receivers ***
   // IP6Address group;
@@ -140,11 +156,16 @@ MLD::simple_action(Packet *p)
 
   // some counters are needed to access datastructure
   unsigned short grouprecord_counter;
-  short source_counter;
+  // a group record is followed by its sources and aux_data_len words of auxiliary data
+  const unsigned int grouprecordsize=sizeof(grouprecord)-sizeof(click_in6_addr);
+  const unsigned char *record;
   // variable holding ICMPv6 checksum
   unsigned short chk;
 
-  switch(*(char *)mldmessage)
+  // all timers started by this message share one clock reading
+  _now=now_msec();
+
+  switch(*(unsigned char *)mldmessage)
 	{
 	case 130:
 	  // (XXX) this has to be filled with some action
@@ -155,7 +176,7 @@ MLD::simple_action(Packet *p)
 			      v2query->checksum,
 			      (unsigned char *)v2query,
 			      htons(sizeof(*v2query))));
-	  if(chk!=v1report->checksum)
+	  if(chk!=v2query->checksum)
 		{
 		  debug_msg("MLD: incorrect checksum, MLD message discarded!");
 		  break;
@@ -188,12 +209,12 @@ MLD::simple_action(Packet *p)
 	  else {
 		MCastTable->addgroup(IP6Address(v1report->group));
 		MCastTable->joingroup(IP6Address(ip->ip6_src), IP6Address(v1report->group));  	  
-		if ( IP6Address(v1report->group).matches_prefix(IP6Address("FF70::0"),
-								IP6Address("FFF0::0")) )     {
+		if ( has_embedded_rp(IP6Address(v1report->group)) )     {
 		  MCastTable->addsource(IP6Address(ip->ip6_src),
 					IP6Address(v1report->group),
 					IP6Address(extract_rp(IP6Address(v1report->group))));
 		}
+		start_timer(MLDTimerKey::ADDRESS, IP6Address(ip->ip6_src), IP6Address(v1report->group), IP6Address(), listener_interval());
 		break;
 	  }
 	  
@@ -212,13 +233,7 @@ MLD::simple_action(Packet *p)
 		}
 	  else {
 		//		MCastTable->addgroup(IP6Address(v1report->group));
-		if ( IP6Address(v1report->group).matches_prefix(IP6Address("FF70::0"),
-								IP6Address("FFF0::0")) )     {
-		  MCastTable->delsource(IP6Address(ip->ip6_src),
-					IP6Address(v1report->group),
-					IP6Address(extract_rp(IP6Address(v1report->group))));
-		}
-		MCastTable->leavegroup(IP6Address(ip->ip6_src), IP6Address(v1report->group)); 
+		drop_listener(IP6Address(ip->ip6_src), IP6Address(v1report->group));
 	  } 	  
 	  break;
 	  
@@ -232,54 +247,58 @@ MLD::simple_action(Packet *p)
 	  if(chk!=report->checksum)
 		{
 		  debug_msg("MLD: incorrect checksum, MLDv2 message discarded!");
+		  break;
 		}
 	  else {
+		// group records differ in length, walk them one by one and stop
+		// at the end of the packet
+		record=(const unsigned char *)report->grouprecords;
 		for(grouprecord_counter=0; grouprecord_counter < ntohs(report->no_of_grouprecords); grouprecord_counter++)
 		  {
-			switch(report->grouprecords[grouprecord_counter].type) {
+			const grouprecord *gr=(const grouprecord *)record;
+			if(record + grouprecordsize > p->end_data())
+			  break;
+			unsigned short no_of_sources=ntohs(gr->no_of_sources);
+			record += grouprecordsize + no_of_sources*sizeof(click_in6_addr) + gr->aux_data_len*4;
+			if(record > p->end_data()) {
+			  debug_msg("MLD: truncated MLDv2 report");
+			  break;
+			}
+			IP6Address group=IP6Address(gr->multicast_address);
+			switch(gr->type) {
 			case 0x01: 
 			  // debug_msg("MLD: MLDv2 include");
-			  // MODE_IS_INCLUDE, generated by hosts, ignored by router
+			  // MODE_IS_INCLUDE, a host's answer to a query, refreshes its sources
+			  mode_is_include(IP6Address(ip->ip6_src), group, no_of_sources, gr->sources);
 			  break; 
 			case 0x02:
 			  // debug_msg("MLD: MLDv2 exclude");
-			  // MODE_IS_EXCLUDE, generated by hosts, ignored by router
+			  // MODE_IS_EXCLUDE, a host's answer to a query, refreshes its address
+			  mode_is_exclude(IP6Address(ip->ip6_src), group);
 			  break;
 			case 0x03:
 			  debug_msg("MLD: CHANGE_TO_INCLUDE_MODE");
-			  change_to_include_mode(IP6Address(ip->ip6_src),
-						 IP6Address(report->grouprecords[grouprecord_counter].multicast_address),
-						 ntohs(report->grouprecords[grouprecord_counter].no_of_sources),
-						 grouprecord_counter);
-			  
+			  change_to_include_mode(IP6Address(ip->ip6_src), group, no_of_sources, gr->sources);
 			  break;
 			case 0x04:
 			  debug_msg("MLD: CHANGE_TO_EXCLUDE_MODE");
-			  MCastTable->addgroup(IP6Address(report->grouprecords[grouprecord_counter].multicast_address));
-			  change_to_exclude_mode(IP6Address(ip->ip6_src),
-						 IP6Address(report->grouprecords[grouprecord_counter].multicast_address),
-						 ntohs(report->grouprecords[grouprecord_counter].no_of_sources), grouprecord_counter);
-			  
+			  MCastTable->addgroup(group);
+			  change_to_exclude_mode(IP6Address(ip->ip6_src), group, no_of_sources, gr->sources);
 			  break;
 			case 0x05:
 			  debug_msg("MLD: ALLOW_NEW_SOURCES");
-			  allow_new_sources(IP6Address(ip->ip6_src),
-					    IP6Address(report->grouprecords[grouprecord_counter].multicast_address),
-					    ntohs(report->grouprecords[grouprecord_counter].no_of_sources), grouprecord_counter );
-			  
+			  allow_new_sources(IP6Address(ip->ip6_src), group, no_of_sources, gr->sources);
 			  break;
 			case 0x06:
 			  debug_msg("MLD: BLOCK_OLD_SOURCES");
-			  block_old_sources(IP6Address(ip->ip6_src),
-					    IP6Address(report->grouprecords[grouprecord_counter].multicast_address),
-					    ntohs(report->grouprecords[grouprecord_counter].no_of_sources),
-					    grouprecord_counter );
-			  
+			  block_old_sources(IP6Address(ip->ip6_src), group, no_of_sources, gr->sources);
 			  break;
 			default:
 			  debug_msg("MLD: Unknown type in MLD grouprecord");
 			}
 		  } 
+		// the specific queries of all records go out together
+		flush_queries();
 		break;
 	  }
 	default:
@@ -288,6 +307,47 @@ MLD::simple_action(Packet *p)
   return p;
 }
 
+/*******************************************************************************************
+ *                                                                                         *
+ * mode_is_include and mode_is_exclude are called after the arrival of type 1 and 2        *
+ * group records, a listener's answer to a query                                           *
+ *                                                                                         *
+ * they restart the listener's source or address timers, and recreate state the router     *
+ * has lost                                                                                *
+ *                                                                                         *
+ *******************************************************************************************/
+bool
+MLD::mode_is_include(IP6Address recv,
+		     IP6Address group,
+		     unsigned short no_of_sources,
+		     const click_in6_addr *sources)
+{
+  if(no_of_sources==0) return false;
+  MCastTable->addgroup(group);
+  MCastTable->joingroup(recv, group);
+  MCastTable->set_receiver_mode(recv, group, INCLUDEMODE);
+  stop_timer(MLDTimerKey::ADDRESS, recv, group, IP6Address());
+
+  for(unsigned int source_counter=0; source_counter!=no_of_sources; source_counter++)
+	{
+	  MCastTable->addsource(recv, group, IP6Address(sources[source_counter]));
+	  start_timer(MLDTimerKey::SOURCE, recv, group, IP6Address(sources[source_counter]), listener_interval());
+	}
+  return true;
+}
+
+bool
+MLD::mode_is_exclude(IP6Address recv,
+		     IP6Address group)
+{
+  MCastTable->addgroup(group);
+  if(MCastTable->joingroup(recv, group) && has_embedded_rp(group))
+	MCastTable->addsource(recv, group, IP6Address(extract_rp(group)));
+  MCastTable->set_receiver_mode(recv, group, EXCLUDEMODE);
+  start_timer(MLDTimerKey::ADDRESS, recv, group, IP6Address(), listener_interval());
+  return true;
+}
+
 /*******************************************************************************************
  *                                                                                         *
  * change_to_exclude_mode is called after the arrival of type 4 group records              *
@@ -299,12 +359,13 @@ bool
 MLD::change_to_exclude_mode(IP6Address recv,
 			    IP6Address group,
 			    unsigned short no_of_sources,
-			    unsigned short groupcounter) 
+			    const click_in6_addr *sources) 
 {
   MCastTable->joingroup(recv, group);  
   MCastTable->set_receiver_mode(recv, group, EXCLUDEMODE);
+  start_timer(MLDTimerKey::ADDRESS, recv, group, IP6Address(), listener_interval());
 
-  if ( no_of_sources==0 && group.matches_prefix(IP6Address("FF70::0"), IP6Address("FFF0::0")) )     {
+  if ( no_of_sources==0 && has_embedded_rp(group) )     {
       MCastTable->addsource(IP6Address(recv), IP6Address(group), IP6Address(extract_rp(group)));
       debug_msg("MLD: mld calls mcasttable addsource");
     }
@@ -313,8 +374,10 @@ MLD::change_to_exclude_mode(IP6Address recv,
 	{
 	  MCastTable->addsource(IP6Address(recv),
 				IP6Address(group),
-				IP6Address(report->grouprecords[groupcounter].sources[source_counter]));
+				IP6Address(sources[source_counter]));
+	  schedule_query(group, IP6Address(sources[source_counter]));
 	}
+  if(no_of_sources==0) schedule_query(group, IP6Address());
   return true;
 }
 
@@ -329,18 +392,25 @@ bool
 MLD::change_to_include_mode(IP6Address recv,
 			    IP6Address group,
 			    unsigned short no_of_sources,
-			    unsigned short groupcounter) 
+			    const click_in6_addr *sources) 
 {
   MCastTable->joingroup(recv, group);  
   MCastTable->set_receiver_mode(recv, group, INCLUDEMODE);
+  // from now on the listener's sources keep it in the group
+  stop_timer(MLDTimerKey::ADDRESS, recv, group, IP6Address());
 
   for(unsigned int source_counter=0; source_counter!=no_of_sources; source_counter++)
 	{
 	  MCastTable->addsource(IP6Address(recv),
 				IP6Address(group),
-				IP6Address(report->grouprecords[groupcounter].sources[source_counter]));
+				IP6Address(sources[source_counter]));
+	  start_timer(MLDTimerKey::SOURCE, recv, group, IP6Address(sources[source_counter]), listener_interval());
+	  schedule_query(group, IP6Address(sources[source_counter]));
 	}
-  if(no_of_sources == 0) MCastTable->leavegroup(recv, group);
+  if(no_of_sources == 0) {
+	drop_listener(recv, group);
+	schedule_query(group, IP6Address());
+  }
   return true;
 }
 
@@ -355,7 +425,7 @@ bool
 MLD::allow_new_sources(IP6Address recv,
 		       IP6Address group,
 		       unsigned short no_of_sources,
-		       unsigned short groupcounter) 
+		       const click_in6_addr *sources) 
 {
 
   MCastTable->joingroup(recv, group);
@@ -366,8 +436,10 @@ MLD::allow_new_sources(IP6Address recv,
 	{
 	  MCastTable->addsource(IP6Address(recv),
 				IP6Address(group),
-				IP6Address(report->grouprecords[groupcounter].sources[source_counter]));
+				IP6Address(sources[source_counter]));
+	  start_timer(MLDTimerKey::SOURCE, recv, group, IP6Address(sources[source_counter]), listener_interval());
 	}
+  return true;
 }
 
 /*******************************************************************************************
@@ -381,35 +453,61 @@ bool
 MLD::block_old_sources(IP6Address recv,
 		       IP6Address group,
 		       unsigned short no_of_sources,
-		       unsigned short groupcounter) 
+		       const click_in6_addr *sources) 
 {
    for(unsigned int source_counter=0; source_counter!=no_of_sources; source_counter++)
 	{
 	  MCastTable->delsource(recv,
 				group,
-				IP6Address(report->grouprecords[groupcounter].sources[source_counter]));
+				IP6Address(sources[source_counter]));
+	  stop_timer(MLDTimerKey::SOURCE, recv, group, IP6Address(sources[source_counter]));
+	  schedule_query(group, IP6Address(sources[source_counter]));
 	}
+   return true;
 }
 
 /*******************************************************************************************
  *                                                                                         *
- * query is called to generate query messages. all arriving changes of state of an         *
- * interface are followed by a group/source specific query                                 *
+ * drop_listener removes a listener from an address, after an MLDv1 done message, an       *
+ * empty change to include record or when its address timer runs out                       *
+ *                                                                                         *
+ * the embedded RP source is deleted first, so PIM is told to prune                        *
+ *                                                                                         *
+ *******************************************************************************************/
+void
+MLD::drop_listener(IP6Address recv, IP6Address group)
+{
+  stop_timer(MLDTimerKey::ADDRESS, recv, group, IP6Address());
+  if ( has_embedded_rp(group) )     {
+	MCastTable->delsource(recv, group, IP6Address(extract_rp(group)));
+  }
+  MCastTable->leavegroup(recv, group); 
+}
+
+bool
+MLD::has_embedded_rp(IP6Address group)
+{
+  return group.matches_prefix(IP6Address("FF70::0"), IP6Address("FFF0::0"));
+}
+
+/*******************************************************************************************
  *                                                                                         *
+ * query generates query messages: general queries (group ::, no sources), multicast       *
+ * address specific queries (no sources) and address and source specific queries           *
  *                                                                                         *
  *******************************************************************************************/
 void
-MLD::generalquery()
+MLD::query(const IP6Address &group, const IP6Address *sources, int no_of_sources)
 {
-  debug_msg("MLD: generalquery");
   WritablePacket *q = 0;
 
   click_ip6 *nip;
-  void *mldbegin;
   mldv2querie *igp;
   hopbyhopheader *hopbyhop;
+  bool general=(group==IP6Address());
 
-  q = Packet::make(sizeof(*nip)+sizeof(*hopbyhop)+sizeof(*igp));
+  q = Packet::make(sizeof(*nip)+sizeof(*hopbyhop)+sizeof(*igp)+no_of_sources*sizeof(click_in6_addr));
+  if(!q) return;
 
   nip = reinterpret_cast<click_ip6 *>(q->data());
   hopbyhop=(hopbyhopheader *) (q->data() + sizeof(*nip));
@@ -417,26 +515,38 @@ MLD::generalquery()
 
   nip->ip6_flow = 0;		// set flow to 0 (includes version)
   nip->ip6_v = 6;		// then set version to 6
-  nip->ip6_plen=htons(sizeof(*igp)+sizeof(*hopbyhop));
+  nip->ip6_plen=htons(sizeof(*igp)+sizeof(*hopbyhop)+no_of_sources*sizeof(click_in6_addr));
   nip->ip6_nxt=0x00; //i.e. protocal: hop-by-hop message
   nip->ip6_hlim=0x01; //kill at next router
   nip->ip6_src = IP6Address("fe80::204:23ff:fe45:9d71");
  
-  nip->ip6_dst = IP6Address("ff02::1");
-  SET_DST_IP6_ANNO(q, IP6Address("ff02::1"));
+  // specific queries go to the multicast address they ask about
+  IP6Address dst=(general ? IP6Address("ff02::1") : group);
+  nip->ip6_dst = dst;
+  SET_DST_IP6_ANNO(q, dst);
   hopbyhop->type=0x3a;  //MLD router alert
   hopbyhop->length=0;
   hopbyhop->parameter=0x0502;
+  hopbyhop->empty=0;
+
+  // maximum response delay in milliseconds, general queries get
+  // RESPONSE_INTERVAL, specific ones LAST_LISTENER_INTERVAL
+  uint32_t response=(general ? _response_interval : _last_listener_interval);
+  uint32_t qqi=_query_interval / 1000;
 
   igp->type=130;
   igp->code=0x00;
   igp->checksum=0x0000;
-  igp->responsecode=0x01;
+  igp->responsecode=htons(response < 32768 ? response : 32767);
   igp->reserved=0;
-  igp->group=IP6Address("::"); 
-  igp->res_and_s_and_qrv=0x03; 
-  igp->qqic=0x00;
-  igp->no_of_sources=0x00;
+  igp->group=group; 
+  igp->res_and_s_and_qrv=(_robustness < 8 ? _robustness : 0); 
+  igp->qqic=(qqi < 128 ? qqi : 127);
+  igp->no_of_sources=htons(no_of_sources);
+
+  click_in6_addr *sa=(click_in6_addr *)(igp + 1);
+  for(int i=0; i<no_of_sources; i++)
+	sa[i]=sources[i];
 
   output(1).push(q);  
 }
@@ -504,25 +614,163 @@ MLD::extract_rp(IP6Address group)
 
 /*******************************************************************************************
  *                                                                                         *
- * run_timer is called continually, it reschedules itself                                  *
+ * timers: address timers (listeners in exclude mode and MLDv1 listeners), source timers   *
+ * (sources a listener includes) and query timers (repeated specific queries) all run on   *
+ * one timer wheel                                                                         *
+ *                                                                                         *
+ *******************************************************************************************/
+uint64_t
+MLD::now_msec()
+{
+  return Timestamp::now().msecval();
+}
+
+void
+MLD::start_timer(int kind, const IP6Address &recv, const IP6Address &group, const IP6Address &source, uint32_t delay)
+{
+  MLDTimerKey key(kind, recv, group, source);
+  timerstate ts;
+  ts.deadline=_now + delay;
+  ts.queries=0;
+  _timers.set(key, ts);
+  _wheel.schedule(key, ts.deadline);
+}
+
+void
+MLD::stop_timer(int kind, const IP6Address &recv, const IP6Address &group, const IP6Address &source)
+{
+  _timers.erase(MLDTimerKey(kind, recv, group, source));
+}
+
+/*******************************************************************************************
  *                                                                                         *
- * for now it calls the function that generates general queries                            *
- * other queries might be added in future releases                                         *
+ * schedule_query queues an address or address-and-source specific query to be sent with  *
+ * the others of this report or tick, and robustness-1 more at the last listener query     *
+ * interval; a query already pending is restarted                                          *
+ *                                                                                         *
+ *******************************************************************************************/
+void
+MLD::schedule_query(const IP6Address &group, const IP6Address &source)
+{
+  if(!querierstate) return;
+  MLDTimerKey key(MLDTimerKey::QUERY, IP6Address(), group, source);
+  bool pending=_timers.find(key);
+  timerstate ts;
+  ts.deadline=_now + _last_listener_interval;
+  ts.queries=_robustness - 1;
+  if(ts.queries==0) {
+	_timers.erase(key);
+	_queries.push_back(key);
+	return;
+  }
+  _timers.set(key, ts);
+  _wheel.schedule(key, ts.deadline);
+  if(!pending) _queries.push_back(key);
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * flush_queries sends the queued specific queries, one per multicast address carrying all *
+ * of its sources (split so that each query fits the minimum MTU)                          *
+ *                                                                                         *
+ *******************************************************************************************/
+void
+MLD::flush_queries()
+{
+  if(_queries.size()==0) return;
+
+  Vector<addressqueries> out;
+  HashTable<MLDTimerKey, int> index(-1);
+
+  for(int i=0; i<_queries.size(); i++) {
+	MLDTimerKey key(MLDTimerKey::QUERY, IP6Address(), _queries[i].group, IP6Address());
+	int n=index.get(key);
+	if(n<0) {
+	  n=out.size();
+	  index.set(key, n);
+	  out.push_back(addressqueries());
+	  out[n].group=_queries[i].group;
+	  out[n].address=false;
+	}
+	if(_queries[i].source==IP6Address())
+	  out[n].address=true;
+	else
+	  out[n].sources.push_back(_queries[i].source);
+  }
+  _queries.clear();
+
+  for(int n=0; n<out.size(); n++) {
+	if(out[n].address)
+	  query(out[n].group, 0, 0);
+	for(int i=0; i<out[n].sources.size(); i+=MAX_QUERY_SOURCES) {
+	  int count=out[n].sources.size() - i;
+	  query(out[n].group, &out[n].sources[i], count < MAX_QUERY_SOURCES ? count : MAX_QUERY_SOURCES);
+	}
+  }
+}
+
+void
+MLD::expire(const MLDTimerWheel::Entry &e)
+{
+  HashTable<MLDTimerKey, timerstate>::iterator it=_timers.find(e.key);
+  // restarted or stopped since this entry was scheduled
+  if(!it || it.value().deadline!=e.deadline) return;
+
+  const MLDTimerKey &k=e.key;
+  switch(k.kind) {
+  case MLDTimerKey::ADDRESS:
+	_timers.erase(k);
+	// an include mode listener stays as long as one of its sources does
+	if(MCastTable->get_receiver_mode(k.listener, k.group)!=INCLUDEMODE) {
+	  debug_msg("MLD: listener timed out");
+	  drop_listener(k.listener, k.group);
+	}
+	break;
+  case MLDTimerKey::SOURCE:
+	_timers.erase(k);
+	debug_msg("MLD: source timed out");
+	MCastTable->delsource(k.listener, k.group, k.source);
+	break;
+  case MLDTimerKey::QUERY:
+	_queries.push_back(k);
+	if(--it.value().queries==0)
+	  _timers.erase(k);
+	else {
+	  it.value().deadline=e.deadline + _last_listener_interval;
+	  _wheel.schedule(k, it.value().deadline);
+	}
+	break;
+  }
+}
+
+/*******************************************************************************************
+ *                                                                                         *
+ * run_timer is called every TICK, it expires due timers and sends general queries         *
  *                                                                                         *
  *******************************************************************************************/
 void
 MLD::run_timer(Timer *)
 {
-  debug_msg("MLD: run timer");  
   //  MCastTable->printgroups(true);
-  if(querierstate) {
-    //	generalquery();
-	_timer.reschedule_after_msec(QUERY_INTERVAL);
-  }
-  else {
-	// see RFC 3810 for the correct time value... 
-	_timer.reschedule_after_msec( (QUERY_INTERVAL*2) + (QUERY_RESPONSE_INTERVAL/2) );
+  _now=now_msec();
+  _due.clear();
+  _wheel.advance(_now, _due);
+  for(int i=0; i<_due.size(); i++)
+	expire(_due[i]);
+  flush_queries();
+
+  if(querierstate && _now >= _next_general_query) {
+	debug_msg("MLD: generalquery");
+	query(IP6Address(), 0, 0);
+	if(_startup_queries > 0) {
+	  _startup_queries--;
+	  _next_general_query=_now + _query_interval / 4;
+	}
+	else
+	  _next_general_query=_now + _query_interval;
   }
+  _timer.reschedule_after_msec(TICK);
 }
 
 EXPORT_ELEMENT(MLD)
+ELEMENT_REQUIRES(MLDTimerWheel)
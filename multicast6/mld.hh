@@ -4,10 +4,12 @@
 #include "ip6protocoldefinitions.hh"
 #include <click/timer.hh>
 #include <click/element.hh>
+#include <click/hashtable.hh>
+#include "mldtimerwheel.hh"
 
 /*
 =c
-MLD(IP6MulticastTable)
+MLD(IP6MulticastTable [, I<keywords>])
 
 =s IPv6 Multicast
 
@@ -18,6 +20,49 @@ This element checks whether an arriving MLD message is valid (checksum) and take
 
 It manages the databank of listeners kept in the IP6MulticastTable element.
 
+Listener state times out as in RFC3810: a listener in EXCLUDE mode (and
+any MLDv1 listener) is dropped from its address, and a source a listener
+INCLUDEs is dropped from its list, when no report has refreshed it for
+the multicast address listener interval (ROBUSTNESS * QUERY_INTERVAL +
+RESPONSE_INTERVAL).  Dropping the last listener of an embedded-RP
+address also prunes it from PIM.  General queries go out every
+QUERY_INTERVAL, the first ROBUSTNESS of them a quarter interval apart.
+Every address or address-and-source specific query is repeated
+ROBUSTNESS times, LAST_LISTENER_INTERVAL apart.
+
+All timers share one timer wheel, so starting or restarting a timer
+costs O(1) however many listeners, addresses and sources there are.
+All records of one report are handled against the same clock, and the
+specific queries they trigger, like those due in the same timer tick,
+go out as one query per address carrying all of its sources.
+
+Keyword arguments are:
+
+=over 8
+
+=item QUERIER
+
+Boolean.  Send queries.  Default true.
+
+=item QUERY_INTERVAL
+
+Time between general queries.  Default 125 seconds.
+
+=item RESPONSE_INTERVAL
+
+Maximum response time advertised in general queries.  Default 10 seconds.
+
+=item LAST_LISTENER_INTERVAL
+
+Time between repetitions of address and source specific queries, also
+advertised as their maximum response time.  Default 1 second.
+
+=item ROBUSTNESS
+
+Robustness variable.  Default 2.
+
+=back
+
 =e
 mct::IP6MulticastTable("pimctl");
 mcc :: Classifier(6/11 24/ff, // UDP Multicast traffic
@@ -57,12 +102,15 @@ class MLD : public Element { public:
 
 private:
 
-  void generalquery();
+  void query(const IP6Address &, const IP6Address *, int);
   void run_timer(Timer *);
-  bool change_to_include_mode(IP6Address, IP6Address, unsigned short, unsigned short);
-  bool change_to_exclude_mode(IP6Address, IP6Address, unsigned short, unsigned short);
-  bool allow_new_sources(IP6Address, IP6Address, unsigned short, unsigned short);  
-  bool block_old_sources(IP6Address, IP6Address, unsigned short, unsigned short);
+  bool mode_is_include(IP6Address, IP6Address, unsigned short, const click_in6_addr *);
+  bool mode_is_exclude(IP6Address, IP6Address);
+  bool change_to_include_mode(IP6Address, IP6Address, unsigned short, const click_in6_addr *);
+  bool change_to_exclude_mode(IP6Address, IP6Address, unsigned short, const click_in6_addr *);
+  bool allow_new_sources(IP6Address, IP6Address, unsigned short, const click_in6_addr *);  
+  bool block_old_sources(IP6Address, IP6Address, unsigned short, const click_in6_addr *);
+  void drop_listener(IP6Address, IP6Address);
   bool has_embedded_rp(IP6Address group);
   IP6Address extract_rp(IP6Address group);
 
@@ -76,9 +124,52 @@ private:
   mldv2report *report;
   mldv1message *v1report;
   mldv2querie *v2query;
-  static const int QUERY_INTERVAL = 125000;
-  static const int QUERY_RESPONSE_INTERVAL = 10000;
-  //  static const int QUERY_INTERVAL = 125000;
+
+  /* address, source and query timers
+   *
+   * _timers holds the deadline of every running timer; the wheel only
+   * says when to look at a timer, an entry whose deadline is no longer
+   * the one in _timers belongs to a timer that was restarted or stopped
+   */
+  struct timerstate {
+	uint64_t deadline;         // msec
+	unsigned int queries;      // query timers: queries still to send
+  };
+
+  HashTable<MLDTimerKey, timerstate> _timers;
+  MLDTimerWheel _wheel;
+  Vector<MLDTimerWheel::Entry> _due;
+  // specific queries to send at the end of the current report or tick,
+  // as (::, address, source) keys
+  Vector<MLDTimerKey> _queries;
+
+  struct addressqueries {
+	IP6Address group;
+	bool address;              // an address specific query is due as well
+	Vector<IP6Address> sources;
+  };
+
+  uint32_t _query_interval;    // msec
+  uint32_t _response_interval;
+  uint32_t _last_listener_interval;
+  unsigned int _robustness;
+  unsigned int _startup_queries;
+  uint64_t _next_general_query;
+  uint64_t _now;               // clock for the report or tick being handled
+
+  uint32_t listener_interval() const {
+	return _robustness * _query_interval + _response_interval;
+  }
+  static uint64_t now_msec();
+  void start_timer(int, const IP6Address &, const IP6Address &, const IP6Address &, uint32_t);
+  void stop_timer(int, const IP6Address &, const IP6Address &, const IP6Address &);
+  void schedule_query(const IP6Address &, const IP6Address &);
+  void flush_queries();
+  void expire(const MLDTimerWheel::Entry &);
+
+  static const int TICK = 100; // msec
+  // sources per query, so that a query fits the IPv6 minimum MTU
+  static const int MAX_QUERY_SOURCES = (1280 - 40 - 8 - 28) / 16;
   Timer _timer;
 };
 
@@ -0,0 +1,75 @@
+#ifndef MLDTIMERWHEEL_HH
+#define MLDTIMERWHEEL_HH
+#include <click/ip6address.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+ * MLDTimerWheel: hashed timer wheel for the MLD element's address,
+ * source and query timers
+ *
+ * The IPv6 counterpart of the multicast package's IGMPTimerWheel.  A
+ * deadline (msec) goes in slot ceil(deadline / tick) mod NSLOTS.
+ * Entries are never removed early: restarting a timer schedules a new
+ * entry, and MLD ignores an entry that comes due but no longer matches
+ * the deadline it has on record.
+ */
+
+struct MLDTimerKey {
+  enum { ADDRESS, SOURCE, QUERY };
+
+  IP6Address listener;         // :: for query timers
+  IP6Address group;
+  IP6Address source;           // :: for address timers
+  int kind;
+
+  MLDTimerKey() : kind(ADDRESS) { }
+  MLDTimerKey(int k, const IP6Address &l, const IP6Address &g, const IP6Address &s)
+	: listener(l), group(g), source(s), kind(k) { }
+
+  size_t hashcode() const {
+	const uint32_t *l = listener.data32(), *g = group.data32(), *s = source.data32();
+	uint32_t h = kind;
+	for (int i = 0; i < 4; i++)
+	  h = (h * 2654435761U) ^ l[i] ^ (g[i] * 40503U) ^ (s[i] * 2246822519U);
+	return h;
+  }
+  bool operator==(const MLDTimerKey &k) const {
+	return listener == k.listener && group == k.group
+	  && source == k.source && kind == k.kind;
+  }
+};
+
+class MLDTimerWheel {
+ public:
+
+  struct Entry {
+	MLDTimerKey key;
+	uint64_t deadline;         // msec
+  };
+
+  MLDTimerWheel();
+
+  void initialize(uint32_t tick, uint64_t now);
+  void schedule(const MLDTimerKey &key, uint64_t deadline);
+
+  // Append every entry due at or before now to due.
+  void advance(uint64_t now, Vector<Entry> &due);
+
+  uint32_t tick() const		{ return _tick; }
+  uint32_t pending() const		{ return _pending; }
+
+  enum { NSLOTS = 4096 };
+
+ private:
+
+  Vector<Entry> _slots[NSLOTS];
+  uint32_t _tick;
+  uint64_t _last;              // last tick advanced over
+  uint32_t _pending;
+
+  void run_slot(Vector<Entry> &slot, uint64_t now, Vector<Entry> &due);
+};
+
+CLICK_ENDDECLS
+#endif
@@ -29,11 +29,25 @@ CLICK_DECLS
 
 
 Defragment::Defragment()
+  : _timeout_ms(2000),
+    _max_frag_size(2304),
+    _max_bytes(1048576),
+    _bytes(0),
+    _reassembled(0),
+    _expired(0),
+    _dupes(0),
+    _overflows(0),
+    _timer(this)
 {
 }
 
 Defragment::~Defragment()
 {
+  for (PIIter iter = _packets.begin(); iter.live(); iter++) {
+    if (iter.value().p) {
+      iter.value().p->kill();
+    }
+  }
 }
 
 int
@@ -44,20 +58,67 @@ Defragment::configure(Vector<String> &conf, ErrorHandler *errh)
   if (cp_va_kparse(conf, this, errh,
 		   /* not required */
 		   "DEBUG", 0, cpBool, &_debug,
+		   "TIMEOUT", 0, cpUnsigned, &_timeout_ms,
+		   "MAX_FRAG_SIZE", 0, cpUnsigned, &_max_frag_size,
+		   "MAX_BYTES", 0, cpUnsigned, &_max_bytes,
 		   cpEnd) < 0)
     return -1;
   return 0;
 }
 
+int
+Defragment::initialize(ErrorHandler *)
+{
+  /* a partial packet's deadline is at most half a turn of the wheel away */
+  _wheel.initialize(_timeout_ms / (NSLOTS / 2), Timestamp::now().msecval());
+  _timer.initialize(this);
+  return 0;
+}
+
+void
+Defragment::schedule_expiry(const PacketKey &key, uint64_t deadline)
+{
+  _wheel.schedule(key, deadline);
+  if (!_timer.scheduled()) {
+    _timer.schedule_after_msec(_wheel.tick());
+  }
+}
+
+void
+Defragment::run_timer(Timer *)
+{
+  _due.clear();
+  _wheel.advance(Timestamp::now().msecval(), _due);
+  for (int x = 0; x < _due.size(); x++) {
+    PacketInfo *nfo = _packets.findp(_due[x].key);
+    if (nfo && nfo->expire == _due[x].deadline) {
+      if (_debug) {
+	click_chatter("%{element} packet %d expired with %d/%d frags\n",
+		      this,
+		      nfo->packet,
+		      nfo->fragments_rx,
+		      nfo->num_frags);
+      }
+      _bytes -= nfo->p->length();
+      nfo->p->kill();
+      _packets.remove(_due[x].key);
+      _expired++;
+    }
+  }
+  if (_wheel.pending()) {
+    _timer.reschedule_after_msec(_wheel.tick());
+  }
+}
+
 Packet *
 Defragment::simple_action(Packet *p)
 {
 
-  if (p->length() < sizeof(struct click_ether)) {
+  if (p->length() < frag_header::packet_size(1, 0)) {
     click_chatter("%{element}: packet too small: %d vs %d\n",
 		  this,
 		  p->length(),
-		  sizeof(struct click_ether));
+		  frag_header::packet_size(1, 0));
 
     p->kill();
     return 0;
@@ -68,6 +129,18 @@ Defragment::simple_action(Packet *p)
   struct frag_header *fh = (struct frag_header *) p->data();
   struct frag *f = (struct frag *) (p->data() + sizeof(struct frag_header));
 
+  /* the checksum covers frag_size bytes, so they must all be there */
+  if (fh->frag_size > _max_frag_size ||
+      p->length() < frag_header::packet_size(1, fh->frag_size)) {
+    click_chatter("%{element} packet %d frag %d has size %d, length %d\n",
+		  this,
+		  f->packet_num,
+		  f->frag_num,
+		  fh->frag_size,
+		  p->length());
+    p->kill();
+    return 0;
+  }
 
   if (!f->valid_checksum(fh->frag_size)) {
     click_chatter("%{element} frag failed checksum\n",
@@ -76,31 +149,74 @@ Defragment::simple_action(Packet *p)
     return 0;
   }
   EtherAddress src = EtherAddress(fh->src);
+  PacketKey key(src, f->packet_num);
 
-  PacketInfo *nfo = _packets.findp(f->packet_num);
+  PacketInfo *nfo = _packets.findp(key);
 
   if (!nfo) {
-    _packets.insert(f->packet_num, PacketInfo(src, f->packet_num, 
-					      fh->frag_size,
-					      fh->num_frags_packet));
-    nfo = _packets.findp(f->packet_num);
+    if (!fh->num_frags_packet || fh->num_frags_packet > MAX_FRAGS) {
+      click_chatter("%{element} packet %d has %d frags\n",
+		    this,
+		    f->packet_num,
+		    fh->num_frags_packet);
+      p->kill();
+      return 0;
+    }
+    PacketInfo n(src, f->packet_num, fh->frag_size, fh->num_frags_packet);
+    unsigned len = frag_header::packet_size(n.num_frags, n.frag_size);
+    if (_bytes + len > _max_bytes) {
+      if (_debug) {
+	click_chatter("%{element} no room for packet %d, %d bytes held\n",
+		      this,
+		      f->packet_num,
+		      _bytes);
+      }
+      _overflows++;
+      p->kill();
+      return 0;
+    }
+    n.p = Packet::make(len);
+    if (!n.p) {
+      click_chatter("%{element} couldn't create packet\n",
+		    this);
+      p->kill();
+      return 0;
+    }
+    memcpy(n.p->data(), p->data(), sizeof(frag_header));
+    _bytes += len;
+    n.expire = Timestamp::now().msecval() + _timeout_ms;
+    _packets.insert(key, n);
+    nfo = _packets.findp(key);
+    schedule_expiry(key, nfo->expire);
   }
 
-  if (f->frag_num >= nfo->fragments.size()) {
+  if (f->frag_num >= nfo->num_frags) {
     click_chatter("%{element} packet %d frag_num is %d size is %d\n",
 		  this,
 		  f->packet_num,
 		  f->frag_num,
-		  nfo->fragments.size());
+		  nfo->num_frags);
+    p->kill();
+    return 0;
+  }
+
+  if (fh->frag_size != nfo->frag_size) {
+    click_chatter("%{element} packet %d frag %d has size %d, expected %d\n",
+		  this,
+		  f->packet_num,
+		  f->frag_num,
+		  fh->frag_size,
+		  nfo->frag_size);
     p->kill();
     return 0;
   }
 
-  if (nfo->fragments[f->frag_num]) {
+  if (nfo->has(f->frag_num)) {
     click_chatter("%{element} repeat frag [%d %d]\n",
 		  this,
 		  f->packet_num,
 		  f->frag_num);
+    _dupes++;
     p->kill();
     return 0;
   }
@@ -116,63 +232,40 @@ Defragment::simple_action(Packet *p)
 		  
   }
 
-  nfo->fragments[f->frag_num] = p;
+  struct frag_header *fh2 = (struct frag_header *) nfo->p->data();
+  memcpy(fh2->get_frag(f->frag_num),
+	 f,
+	 nfo->frag_size + sizeof(struct frag));
+  p->kill();
+  nfo->set(f->frag_num);
   nfo->fragments_rx++;
 
   if (nfo->fragments_rx != nfo->num_frags) {
     return 0;
   }
-  int len = frag_header::packet_size(nfo->num_frags, nfo->frag_size);
   if (_debug) {
     click_chatter("%{element} received %d packets, defragmenting frag_size %d num_frags %d len %d\n",
 		  this,
 		  nfo->fragments_rx,
 		  nfo->frag_size,
 		  nfo->num_frags,
-		  len);
+		  nfo->p->length());
   }
 
-  WritablePacket *p_out = Packet::make(len);
-  
-  if (!p_out) {
-    click_chatter("%{element} couldn't create packet\n",
-		  this);
-    return 0;
-  }
-  if (!nfo->fragments[0]) {
-    click_chatter("%{element} fragment %d is null!\n",
-		  this,
-		  0);
-  }
-
-  memcpy(p_out->data(), 
-	 nfo->fragments[0]->data(), 
-	 sizeof(frag_header));
-  struct frag_header *fh2 = (struct frag_header *) p_out->data();
   fh2->num_frags = fh2->num_frags_packet = nfo->num_frags;
-  fh2->num_frags = nfo->num_frags;
   fh2->packet_num = nfo->packet;
   fh2->frag_size = nfo->frag_size;
   fh2->set_checksum();
-  for (int x = 0; x < nfo->num_frags; x++) {
-    if (!nfo->fragments[x]) {
-      click_chatter("%{element} fragment %d is null!\n",
-		    this,
-		    x);
-    }
-    memcpy(fh2->get_frag(x),
-	   nfo->fragments[x]->data() + sizeof(frag_header),
-	   nfo->frag_size + sizeof(struct frag));
-    nfo->fragments[x]->kill();
-    nfo->fragments[x] = 0;
-  }
 
-  _packets.remove(nfo->packet);
+  WritablePacket *p_out = nfo->p;
+  _bytes -= p_out->length();
+  _packets.remove(key);
+  _reassembled++;
   return p_out;
 }
 
 
-enum {H_DEBUG, };
+enum {H_DEBUG, H_TIMEOUT, H_STATS, };
 
 static String 
 Defragment_read_param(Element *e, void *thunk)
@@ -181,6 +274,15 @@ Defragment_read_param(Element *e, void *thunk)
     switch ((uintptr_t) thunk) {
       case H_DEBUG:
 	return String(td->_debug) + "\n";
+      case H_TIMEOUT:
+	return String(td->_timeout_ms) + "\n";
+      case H_STATS:
+	return "partial " + String(td->_packets.size()) +
+	  " reassembled " + String(td->_reassembled) +
+	  " expired " + String(td->_expired) +
+	  " repeats " + String(td->_dupes) +
+	  " bytes " + String(td->_bytes) +
+	  " overflows " + String(td->_overflows) + "\n";
     default:
       return String();
     }
@@ -207,6 +309,8 @@ void
 Defragment::add_handlers()
 {
   add_read_handler("debug", Defragment_read_param, (void *) H_DEBUG);
+  add_read_handler("timeout", Defragment_read_param, (void *) H_TIMEOUT);
+  add_read_handler("stats", Defragment_read_param, (void *) H_STATS);
 
   add_write_handler("debug", Defragment_write_param, (void *) H_DEBUG);
 }
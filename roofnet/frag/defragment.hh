@@ -4,19 +4,37 @@
 #include <clicknet/ether.h>
 #include <click/etheraddress.hh>
 #include <click/hashmap.hh>
+#include <click/timer.hh>
+#include <click/vector.hh>
+#include "../timerwheel.hh"
 CLICK_DECLS
 
+/*
+ * Reassembles the single-fragment packets from Fragment back into one
+ * packet per (source, packet number).  The first fragment to arrive
+ * allocates the whole output packet, num_frags * frag_size, and each
+ * fragment is copied into its place and freed as it arrives; a bitmap
+ * records which fragments are in.  Packets still incomplete TIMEOUT
+ * msecs (default 2000) after their first fragment are dropped.
+ *
+ * Fragments larger than MAX_FRAG_SIZE bytes (default 2304) are dropped
+ * unchecked, and a new packet is dropped if reassembling it would take
+ * the partial packets past MAX_BYTES (default 1048576) in all.
+ */
+
 class Defragment : public Element { public:
-  
+
   Defragment();
   ~Defragment();
 
   const char *class_name() const	{ return "Defragment"; }
   const char *port_count() const	{ return PORTS_1_1; }
   const char *processing() const	{ return AGNOSTIC; }
-  
+
   int configure(Vector<String> &, ErrorHandler *);
   bool can_live_reconfigure() const	{ return true; }
+  int initialize(ErrorHandler *);
+  void run_timer(Timer *);
 
   Packet *simple_action(Packet *);
 
@@ -24,6 +42,22 @@ class Defragment : public Element { public:
   void add_handlers();
 
 
+  enum { MAX_FRAGS = 256 };	/* frag_num is 8 bits */
+
+  struct PacketKey {
+    EtherAddress src;
+    int packet;
+    PacketKey() : packet(0) { }
+    PacketKey(EtherAddress s, int p) : src(s), packet(p) { }
+    inline size_t hashcode() const {
+      const uint16_t *d = src.sdata();
+      return ((d[1] ^ d[2]) << 16) ^ packet;
+    }
+    inline bool operator==(const PacketKey &o) const {
+      return packet == o.packet && src == o.src;
+    }
+  };
+
   struct PacketInfo {
 
     EtherAddress src;
@@ -32,33 +66,56 @@ class Defragment : public Element { public:
     int frag_size;
     int fragments_rx;
 
-    Vector <Packet *> fragments;
-    PacketInfo() {
+    WritablePacket *p;		/* reassembled in place */
+    uint32_t have[MAX_FRAGS / 32];
+    uint64_t expire;		/* msec */
+
+    PacketInfo() : p(0) {
 
     }
-    PacketInfo(EtherAddress s, int p, 
+    PacketInfo(EtherAddress s, int pn,
 	       int fs, int nf) {
       src = s;
-      packet = p;
+      packet = pn;
       frag_size = fs;
       num_frags = nf;
       fragments_rx = 0;
-
-      fragments.clear();
-      for (int x = 0; x < num_frags; x++) {
-	fragments.push_back(0);
-      }
+      p = 0;
+      expire = 0;
+      memset(have, 0, sizeof(have));
     }
+    bool has(int x) const	{ return have[x >> 5] & (1U << (x & 31)); }
+    void set(int x)		{ have[x >> 5] |= 1U << (x & 31); }
   };
 
 
-  typedef HashMap<int, PacketInfo> PacketInfoTable;
+  typedef HashMap<PacketKey, PacketInfo> PacketInfoTable;
   typedef PacketInfoTable::const_iterator PIIter;
 
   PacketInfoTable _packets;
   bool _debug;
+  unsigned _timeout_ms;
+  unsigned _max_frag_size;
+  unsigned _max_bytes;
+  unsigned _bytes;		/* held by partial packets */
+
+  int _reassembled;
+  int _expired;
+  int _dupes;
+  int _overflows;
  private:
 
+  /*
+   * Expiry deadlines (msec).  An entry is ignored when it comes due if
+   * its packet completed or was restarted since.
+   */
+  enum { NSLOTS = 64 };
+  typedef TimerWheel<PacketKey, NSLOTS> ExpiryWheel;
+  ExpiryWheel _wheel;
+  Vector<ExpiryWheel::Entry> _due;
+  Timer _timer;
+
+  void schedule_expiry(const PacketKey &, uint64_t deadline);
 };
 
 CLICK_ENDDECLS
@@ -1,6 +1,6 @@
 #ifndef CLICK_FRAG_HH
 #define CLICK_FRAG_HH
-
+#include <click/vector.hh>
 CLICK_DECLS
 
 CLICK_SIZE_PACKED_STRUCTURE(
@@ -60,32 +60,23 @@ struct frag_header {
   }
 };
 
+/*
+ * An ack carries num_acked records, one per packet.  Each record is
+ * the packet number (2 bytes), a bitmap length n (1 byte) and an n-byte
+ * bitmap with bit x set if fragment x of the packet was received.
+ */
 struct frag_ack {
   uint16_t good_until;
   uint16_t num_acked;
 
-  uint16_t get_packet(int x) {
-    uint16_t *ndx = (uint16_t *) (this+1);
-    return ndx[x];
-  }
-
-  void  set_packet(int x, uint16_t n) {
-    uint16_t *ndx = (uint16_t *) (this+1);
-    ndx[x] = n;
-  }
-
-  uint8_t get_frag(int x) {
-    uint8_t *ndx = (uint8_t *) (this+1);
-    return ndx[2*num_acked +  x];
-  }
+  u_char *records() { return (u_char *) (this+1); }
 
-  void  set_frag(int x, uint8_t n) {
-    uint8_t *ndx = (uint8_t *) (this+1);
-    ndx[2*num_acked +  x] = n;
+  static size_t record_size(int bitmap_bytes) {
+    return sizeof(uint16_t) + sizeof(uint8_t) + bitmap_bytes;
   }
 
-  static size_t packet_size(int acks) {
-    return sizeof(click_ether) + sizeof(frag_ack) + acks*(sizeof(uint16_t) + sizeof(uint8_t));
+  static size_t packet_size(int record_bytes) {
+    return sizeof(click_ether) + sizeof(frag_ack) + record_bytes;
   }
   
 };
@@ -146,6 +137,105 @@ struct fragid {
 };
 
 
+/*
+ * The fragments received from one neighbor, for the last PACKETS
+ * packet numbers up to the newest one seen: one bit per frag_num,
+ * kept in a ring of per-packet bitmaps, so adding a fragment or
+ * checking for it is O(1).  Packet numbers are compared mod 2^16; the
+ * half of that space ahead of the newest packet counts as ahead.  A
+ * jump ahead of PACKETS or more empties the window and starts it again
+ * there.  A fragment of a packet that has already left the window is
+ * not remembered, so it is taken as new, as a late retransmission
+ * must be.  PACKETS such fragments in a row with nothing newer (say,
+ * after the neighbor restarts its packet numbers) empty the window and
+ * start it again at the last one.
+ */
+class FragWindow {
+ public:
+
+  enum { WORDS = 256 / 32 };	/* frag_num is 8 bits */
+  enum { MAX_PACKETS = 16384 };
+
+  FragWindow(int packets = 64) : _newest(-1), _stale(0) {
+    if (packets > MAX_PACKETS) {
+      packets = MAX_PACKETS;
+    }
+    int n = 1;
+    while (n < packets) {
+      n *= 2;
+    }
+    _slots.resize(n);
+    clear();
+  }
+
+  int packets() const		{ return _slots.size(); }
+
+  void clear() {
+    for (int x = 0; x < _slots.size(); x++) {
+      _slots[x].packet = -1;
+    }
+    _newest = -1;
+    _stale = 0;
+  }
+
+  /* the packet's bitmap, or 0 if nothing of it is in the window */
+  const uint32_t *frags(int packet) const {
+    const Slot &s = _slots[packet & (_slots.size() - 1)];
+    return s.packet == packet ? s.bits : 0;
+  }
+
+  bool has(int packet, int frag) const {
+    const uint32_t *bits = frags(packet);
+    return bits && (bits[frag >> 5] & (1U << (frag & 31)));
+  }
+
+  /* record a fragment; false if it was already there */
+  bool add(int packet, int frag) {
+    if (_newest < 0) {
+      _newest = packet;
+    }
+    uint16_t behind = _newest - packet;
+    uint16_t ahead = packet - _newest;
+    if (behind >= _slots.size()) {
+      if (ahead < 0x8000) {
+	if (ahead >= _slots.size()) {
+	  clear();
+	}
+      } else if (++_stale < _slots.size()) {
+	return true;
+      } else {
+	clear();
+      }
+      _newest = packet;
+    }
+    _stale = 0;
+    Slot &s = _slots[packet & (_slots.size() - 1)];
+    if (s.packet != packet) {
+      /* whatever was here has left the window */
+      s.packet = packet;
+      memset(s.bits, 0, sizeof(s.bits));
+    }
+    uint32_t mask = 1U << (frag & 31);
+    if (s.bits[frag >> 5] & mask) {
+      return false;
+    }
+    s.bits[frag >> 5] |= mask;
+    return true;
+  }
+
+ private:
+
+  struct Slot {
+    int packet;
+    uint32_t bits[WORDS];
+  };
+
+  Vector<Slot> _slots;
+  int _newest;
+  int _stale;			/* fragments behind the window in a row */
+};
+
+
 
 CLICK_ENDDECLS
 #endif /* CLICK_FRAG_HH */
@@ -64,8 +64,30 @@ FragmentAck::send_ack(EtherAddress src)
     return;
   }
   
-  int num_acked = nfo->frags_rx.size();
-  WritablePacket *p = Packet::make(frag_ack::packet_size(num_acked));
+  /* a bitmap per packet, just long enough for its last fragment */
+  Vector<int> packets;
+  Vector<int> lengths;
+  int len = 0;
+  for (int x = 0; x < nfo->packets_rx.size(); x++) {
+    const uint32_t *bits = nfo->frags_rx.frags(nfo->packets_rx[x]);
+    if (!bits) {
+      continue;
+    }
+    int w = FragWindow::WORDS - 1;
+    while (w > 0 && !bits[w]) {
+      w--;
+    }
+    int top = 31;
+    while (top > 0 && !(bits[w] & (1U << top))) {
+      top--;
+    }
+    int bytes = (w * 32 + top) / 8 + 1;
+    packets.push_back(nfo->packets_rx[x]);
+    lengths.push_back(bytes);
+    len += frag_ack::record_size(bytes);
+  }
+
+  WritablePacket *p = Packet::make(frag_ack::packet_size(len));
   click_ether *eh = (click_ether *) p->data();
 
   memcpy(eh->ether_shost, _en.data(), 6);
@@ -74,19 +96,30 @@ FragmentAck::send_ack(EtherAddress src)
 
   struct frag_ack *ack = (struct frag_ack *) (p->data() + sizeof(click_ether));
 
-  ack->num_acked = num_acked;
+  ack->good_until = 0;
+  ack->num_acked = packets.size();
 
   StringAccum sa;
   sa << "|";
-  int frag_num = 0;
-
-  for (int x = 0; x < nfo->frags_rx.size(); x++) {
-    struct fragid f = nfo->frags_rx[x];
-    sa << " " << (int) f.packet_num << " " << 
-      (int) f.frag_num << " |";
-    ack->set_packet(frag_num, f.packet_num);
-    ack->set_frag(frag_num, f.frag_num);
-    frag_num++;
+  u_char *r = ack->records();
+
+  for (int x = 0; x < packets.size(); x++) {
+    uint16_t packet = packets[x];
+    const uint32_t *bits = nfo->frags_rx.frags(packet);
+    memcpy(r, &packet, sizeof(packet));
+    r[2] = lengths[x];
+    u_char *bitmap = r + 3;
+    for (int y = 0; y < lengths[x]; y++) {
+      bitmap[y] = bits[y >> 2] >> ((y & 3) * 8);
+    }
+    if (_debug) {
+      for (int frag = 0; frag < lengths[x] * 8; frag++) {
+	if (bitmap[frag >> 3] & (1 << (frag & 7))) {
+	  sa << " " << (int) packet << " " << frag << " |";
+	}
+      }
+    }
+    r += frag_ack::record_size(lengths[x]);
   }
 
 
@@ -97,7 +130,7 @@ FragmentAck::send_ack(EtherAddress src)
   }
 
 
-  nfo->frags_rx.clear();
+  nfo->clear();
   nfo->waiting = false;
   output(1).push(p);
 }
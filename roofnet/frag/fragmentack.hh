@@ -23,23 +23,27 @@ class FragmentAck : public Element { public:
   void send_ack(EtherAddress src);
 
   Packet * simple_action(Packet *p);
+  enum { ACK_PACKETS = 256 };	/* packets one ack can cover */
+
   struct WindowInfo {
     EtherAddress src;
-    Vector<struct fragid> frags_rx;
+    FragWindow frags_rx;	/* received since the last ack */
+    Vector<int> packets_rx;	/* their packet numbers, oldest first */
     Timestamp first_rx;
     bool waiting;
-    WindowInfo() { }
-    WindowInfo(EtherAddress s) { src = s; }
+    WindowInfo() : frags_rx(ACK_PACKETS) { }
+    WindowInfo(EtherAddress s) : frags_rx(ACK_PACKETS) { src = s; }
     
     bool add(struct fragid f) {
-      for (int x = 0; x < frags_rx.size(); x++) {
-	if (frags_rx[x] == f) {
-	  return false;
-	}
+      if (!frags_rx.frags(f.packet_num)) {
+	packets_rx.push_back(f.packet_num);
       }
+      return frags_rx.add(f.packet_num, f.frag_num);
+    }
 
-      frags_rx.push_back(f);
-      return true;
+    void clear() {
+      frags_rx.clear();
+      packets_rx.clear();
     }
     
   };
@@ -41,13 +41,15 @@ int
 FragmentDupeFilter::configure(Vector<String> &conf, ErrorHandler *errh)
 {
 
-  _window_size = 500;
+  _window_size = 64;
   _debug = false;
   if (cp_va_kparse(conf, this, errh,
 		   "WINDOW", 0, cpUnsigned, &_window_size,
 		   "DEBUG", 0, cpBool, &_debug,
 		   cpEnd) < 0)
     return -1;
+  if (_window_size > FragWindow::MAX_PACKETS)
+    return errh->error("WINDOW must be at most %d", FragWindow::MAX_PACKETS);
   return 0;
 }
 
@@ -62,32 +64,22 @@ FragmentDupeFilter::simple_action(Packet *p)
   DstInfo *nfo = _frags.findp(src);
 
   if (!nfo) {
-    _frags.insert(src, DstInfo(src));
+    _frags.insert(src, DstInfo(src, _window_size));
     nfo = _frags.findp(src);
   }
 
   for (int x = 0; x < fh->num_frags; x++) {
     struct frag *f = fh->get_frag(x);
-    struct fragid fid = fragid(f->packet_num, f->frag_num);
-    for (int y = 0; y < nfo->frags.size(); y++) {
-      if (nfo->frags[y] == fid) {
-	if (_debug) {
-	  click_chatter("%{element} dupe [ %d %d ]\n",
-			this,
-			f->packet_num,
-			f->frag_num);
-	}
-	p->kill();
-	return 0;
+    if (!nfo->frags.add(f->packet_num, f->frag_num)) {
+      if (_debug) {
+	click_chatter("%{element} dupe [ %d %d ]\n",
+		      this,
+		      f->packet_num,
+		      f->frag_num);
       }
-    }  
-    nfo->frags.push_back(fid);
-  }
-
-
-  /* clear space for new seq */
-  while( (unsigned) nfo->frags.size() > _window_size) {
-    nfo->frags.pop_front();
+      p->kill();
+      return 0;
+    }
   }
   
   return p;
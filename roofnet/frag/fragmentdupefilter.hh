@@ -5,10 +5,19 @@
 #include <click/etheraddress.hh>
 #include <click/hashmap.hh>
 #include <click/timer.hh>
-#include <click/deque.hh>
 #include "frag.hh"
 CLICK_DECLS
 
+/*
+ * Drops packets carrying a fragment already received from the same
+ * source.  Fragments are remembered for the last WINDOW packet numbers
+ * from each source (default 64, at most 16384), however many fragments
+ * each packet has.  WINDOW used to count fragments, with a default of
+ * 500; a configuration that sized it in fragments now keeps that many
+ * packets.  A fragment of an older packet is passed, as it was once it
+ * left the fragment window.
+ */
+
 class FragmentDupeFilter : public Element { public:
 
   FragmentDupeFilter();
@@ -27,9 +36,9 @@ class FragmentDupeFilter : public Element { public:
 
   struct DstInfo {
     EtherAddress src;
-    Deque<struct fragid> frags;
+    FragWindow frags;
     DstInfo() { }
-    DstInfo(EtherAddress s) { src = s; }
+    DstInfo(EtherAddress s, int packets) : frags(packets) { src = s; }
   };
 
 
@@ -152,38 +152,57 @@ FragmentResender::process_ack(Packet *p) {
   int min_packet_acked = 65535;
   int max_packet_acked = -1;
 
+  u_char *r = ack->records();
+  const u_char *end = p->end_data();
   for (int x = 0; x < ack->num_acked; x++) {
-    int packet = ack->get_packet(x);
-    int frag = ack->get_frag(x);
-    struct fragid ack = fragid(packet, frag);
+    if (r + frag_ack::record_size(0) > end ||
+	r + frag_ack::record_size(r[2]) > end) {
+      click_chatter("%{element} short ack, %d of %d packets\n",
+		    this,
+		    x,
+		    ack->num_acked);
+      break;
+    }
+    uint16_t packet;
+    memcpy(&packet, r, sizeof(packet));
+    int bitmap_bytes = r[2];
+    u_char *bitmap = r + 3;
+    r += frag_ack::record_size(bitmap_bytes);
 
     min_packet_acked = (packet < min_packet_acked ? packet : min_packet_acked);
     max_packet_acked = (packet > max_packet_acked ? packet : max_packet_acked);
 
-    for (int y = 0; y < outstanding.size(); y++) {
-      if (ack == outstanding[y]) {
-	outstanding[y].mark_invalid();
+    for (int frag = 0; frag < bitmap_bytes * 8; frag++) {
+      if (!(bitmap[frag >> 3] & (1 << (frag & 7)))) {
+	continue;
       }
-    }
+      struct fragid ack = fragid(packet, frag);
 
-    PacketInfo *nfo = _packets.findp(packet);
-    if (!nfo || frag > nfo->frag_status.size()) {
-      click_chatter("%{element} weird fragid %s\n",
-		    this,
-		    ack.s().c_str());
-      continue;
-    }
-    nfo->frag_status[frag] = 1;
+      for (int y = 0; y < outstanding.size(); y++) {
+	if (ack == outstanding[y]) {
+	  outstanding[y].mark_invalid();
+	}
+      }
 
-    if (nfo->done()) {
-      click_chatter("%{element} done with packet %d\n",
-		    this,
-		    packet);
-      if (nfo->p) {
-	nfo->p->kill();
-	nfo->p = 0;
+      PacketInfo *nfo = _packets.findp(packet);
+      if (!nfo || frag >= nfo->frag_status.size()) {
+	click_chatter("%{element} weird fragid %s\n",
+		      this,
+		      ack.s().c_str());
+	continue;
+      }
+      nfo->frag_status[frag] = 1;
+
+      if (nfo->done()) {
+	click_chatter("%{element} done with packet %d\n",
+		      this,
+		      packet);
+	if (nfo->p) {
+	  nfo->p->kill();
+	  nfo->p = 0;
+	}
+	_packets.remove(packet);
       }
-      _packets.remove(packet);
     }
   }
 
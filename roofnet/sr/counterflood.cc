@@ -31,7 +31,8 @@ CounterFlood::CounterFlood()
      _et(0),
      _packets_originated(0),
      _packets_tx(0),
-     _packets_rx(0)
+     _packets_rx(0),
+     _timer(this)
 {
 
   static unsigned char bcast_addr[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
@@ -40,6 +41,9 @@ CounterFlood::CounterFlood()
 
 CounterFlood::~CounterFlood()
 {
+  for (int x = 0; x < _state.size(); x++) {
+    release(_packets[_state.slot(x)]);
+  }
 }
 
 int
@@ -77,6 +81,9 @@ CounterFlood::configure (Vector<String> &conf, ErrorHandler *errh)
 int
 CounterFlood::initialize (ErrorHandler *)
 {
+  _timer.initialize(this);
+  _state.initialize(_history, TICK, Timestamp::now().msecval());
+  _packets.resize(_state.capacity());
   return 0;
 }
 
@@ -126,7 +133,7 @@ CounterFlood::forward(Broadcast *bcast) {
   pk->_qdst = _bcast_ip;
   pk->set_num_links(hops);
   for (int x = 0; x < hops; x++) {
-    pk->set_link_node(x, pk_in->get_link_node(x));
+    pk->set_link_node(x, bcast->_originated ? _ip : pk_in->get_link_node(x));
   }
   pk->set_link_node(hops,_ip);
   pk->set_next(hops);
@@ -162,40 +169,91 @@ CounterFlood::forward(Broadcast *bcast) {
 void
 CounterFlood::forward_hook() 
 {
-  Timestamp now = Timestamp::now();
-  for (int x = 0; x < _packets.size(); x++) {
-    if (now > _packets[x]._to_send) {
-      /* this timer has expired */
-      if (!_packets[x]._forwarded && 
-	  (!_count || _packets[x]._num_rx < _count)) {
-	/* we haven't forwarded this packet yet */
-	forward(&_packets[x]);
-      }
-      _packets[x]._forwarded = true;
+  _due.clear();
+  _state.advance(Timestamp::now().msecval(), _due);
+  for (int x = 0; x < _due.size(); x++) {
+    Broadcast &bcast = _packets[_due[x]];
+    /* this timer has expired */
+    if (!bcast._forwarded && 
+	(!_count || bcast._num_rx < _count)) {
+      /* we haven't forwarded this packet yet */
+      forward(&bcast);
     }
+    bcast._forwarded = true;
   }
 }
 
+void
+CounterFlood::run_timer(Timer *)
+{
+  forward_hook();
+  if (_state.pending()) {
+    _timer.reschedule_after_msec(TICK);
+  }
+}
 
 void
-CounterFlood::trim_packets() {
-  /* only keep track of the last _max_packets */
+CounterFlood::release(Broadcast &bcast)
+{
+  if (bcast._p) {
+    bcast._p->kill();
+    bcast._p = 0;
+  }
+  bcast._rx_from.clear();
+  bcast._rx_from_seq.clear();
+  bcast._sent_seq.clear();
+}
 
-  while ((_packets.size() > _history)) {
-    /* unschedule and remove packet*/
+int
+CounterFlood::add_broadcast(IPAddress origin, uint32_t seq)
+{
+  /* only keep track of the last _history; the oldest slot is reused */
+  bool evicted;
+  int index = _state.insert(origin, seq, &evicted);
+  if (evicted) {
     if (_debug) {
       click_chatter("%{element} removing seq %d\n",
 		    this,
-		    _packets[0]._seq);
-    }
-    _packets[0].del_timer();
-    if (_packets[0]._p != 0) {
-      _packets[0]._p->kill();
+		    _packets[index]._seq);
     }
-    _packets.pop_front();
+    release(_packets[index]);
   }
+  _packets[index]._origin = origin;
+  _packets[index]._seq = seq;
+  return index;
+}
 
+void
+CounterFlood::set_history(int history)
+{
+  /* keep the newest broadcasts, and their pending forwards */
+  Vector<Broadcast> old;
+  for (int x = 0; x < _state.size(); x++) {
+    old.push_back(_packets[_state.slot(x)]);
+  }
+  int keep = history > 0 ? history : 0;
+  int drop = old.size() > keep ? old.size() - keep : 0;
+  for (int x = 0; x < drop; x++) {
+    release(old[x]);
+  }
+
+  _history = history;
+  _state.initialize(_history, TICK, Timestamp::now().msecval());
+  _packets.clear();
+  _packets.resize(_state.capacity());
+  for (int x = drop; x < old.size(); x++) {
+    bool evicted;
+    int index = _state.insert(old[x]._origin, old[x]._seq, &evicted);
+    _packets[index] = old[x];
+    if (!old[x]._forwarded) {
+      _state.schedule(index, old[x]._to_send.msecval());
+    }
+  }
+  if (_state.pending() && !_timer.scheduled()) {
+    _timer.schedule_after_msec(TICK);
+  }
 }
+
 void
 CounterFlood::push(int port, Packet *p_in)
 {
@@ -204,16 +262,13 @@ CounterFlood::push(int port, Packet *p_in)
   if (port == 1) {
     _packets_originated++;
     /* from me */
-    int index = _packets.size();
-    _packets.push_back(Broadcast());
-    _packets[index]._seq = click_random();
+    int index = add_broadcast(_ip, click_random());
     _packets[index]._originated = true;
     _packets[index]._p = p_in->clone();
     _packets[index]._num_rx = 0;
     _packets[index]._first_rx = now;
     _packets[index]._forwarded = true;
     _packets[index]._actually_sent = false;
-    _packets[index].t = NULL;
     _packets[index]._to_send = now;
     if (_debug) {
       click_chatter("%{element} original packet %d, seq %d\n",
@@ -231,28 +286,20 @@ CounterFlood::push(int port, Packet *p_in)
     
     uint32_t seq = pk->seq();
     uint32_t link_seq = pk->seq2();
+    IPAddress origin = pk->get_link_node(0);
 
-    int index = -1;
-    for (int x = 0; x < _packets.size(); x++) {
-      if (_packets[x]._seq == seq) {
-	index = x;
-	break;
-      }
-    }
+    int index = _state.find(origin, seq);
 
     IPAddress src = pk->get_link_node(pk->num_links() - 1);
     if (index == -1) {
       /* haven't seen this packet before */
-      index = _packets.size();
-      _packets.push_back(Broadcast());
-      _packets[index]._seq = seq;
+      index = add_broadcast(origin, seq);
       _packets[index]._originated = false;
       _packets[index]._p = p_in->clone();
       _packets[index]._num_rx = 0;
       _packets[index]._first_rx = now;
       _packets[index]._forwarded = false;
       _packets[index]._actually_sent = false;
-      _packets[index].t = NULL;
       _packets[index]._rx_from.push_back(src);
       _packets[index]._rx_from_seq.push_back(link_seq);
 
@@ -261,9 +308,10 @@ CounterFlood::push(int port, Packet *p_in)
       sr_assert(delay_time > 0);
       
       _packets[index]._to_send = now + Timestamp::make_msec(delay_time);
-      _packets[index].t = new Timer(static_forward_hook, (void *) this);
-      _packets[index].t->initialize(this);
-      _packets[index].t->schedule_at(_packets[index]._to_send);
+      _state.schedule(index, _packets[index]._to_send.msecval());
+      if (!_timer.scheduled()) {
+	_timer.schedule_after_msec(TICK);
+      }
 
       if (_debug) {
 	click_chatter("%{element} first_rx seq %d src %s",
@@ -289,8 +337,6 @@ CounterFlood::push(int port, Packet *p_in)
       
 
   }
-
-  trim_packets();
 }
 
 
@@ -298,7 +344,8 @@ String
 CounterFlood::print_packets()
 {
   StringAccum sa;
-  for (int x = 0; x < _packets.size(); x++) {
+  for (int i = 0; i < _state.size(); i++) {
+    int x = _state.slot(i);
     sa << "ip " << _ip;
     sa << " seq " << _packets[x]._seq;
     sa << " originated " << _packets[x]._originated;
@@ -359,7 +406,7 @@ CounterFlood::write_param(const String &in_s, Element *e, void *vparam,
     int history;
     if (!cp_integer(s, &history))
       return errh->error("history parameter must be integer");
-    f->_history = history;
+    f->set_history(history);
     break;
   }
 
@@ -379,7 +426,9 @@ CounterFlood::write_param(const String &in_s, Element *e, void *vparam,
   }
 
   case 5: {	// clear
-    f->_packets.clear();
+    int history = f->_history;
+    f->set_history(0);
+    f->set_history(history);
     break;
   }
   }
@@ -403,3 +452,4 @@ CounterFlood::add_handlers()
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(CounterFlood)
+ELEMENT_REQUIRES(FloodState)
@@ -62,6 +62,10 @@ class DupeFilter : public Element {
     }
   };
 
+  /*
+   * Keyed on the hop list itself: the path comes from each packet's
+   * header, so it is hashed once per packet whatever the key is.
+   */
   typedef HashMap <Path, PathInfo> PathTable;
   typedef PathTable::const_iterator PathIter;
 
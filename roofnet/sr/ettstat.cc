@@ -520,11 +520,11 @@ ETTStat::simple_action(Packet *p)
   } else if (l->_period != new_period) {
     click_chatter("%{element}: %s has changed its link probe period from %u to %u; clearing probe info",
 		  this, ip.unparse().c_str(), l->_period, new_period);
-    l->_probes.clear();
+    l->clear_probes();
   } else if (l->_tau != lp->_tau) {
     click_chatter("%{element}: %s has changed its link tau from %u to %u; clearing probe info",
 		  this, ip.unparse().c_str(), l->_tau, lp->_tau);
-    l->_probes.clear();
+    l->clear_probes();
   }
 
   if (lp->_sent < (unsigned)l->_sent) {
@@ -532,7 +532,7 @@ ETTStat::simple_action(Packet *p)
 		  click_chatter("%{element}: %s has reset; clearing probe info",
 				this, ip.unparse().c_str());
 	  }
-    l->_probes.clear();
+    l->clear_probes();
   }
   
   RateSize rs = RateSize(rate, lp->_size);
@@ -541,13 +541,16 @@ ETTStat::simple_action(Packet *p)
   l->_sent = lp->_sent;
   l->_last_rx = now;
   l->_num_probes = lp->_num_probes;
-  l->_probes.push_back(probe);
+  l->add_probe(probe);
   l->_seq = probe._seq;
 
   /* keep stats for at least the averaging period */
-  while ((unsigned) l->_probes.size() &&
-	 now.sec() - l->_probes[0]._when.sec() > (signed) (1 + (l->_tau / 1000)))
-    l->_probes.pop_front();
+  for (int w = 0; w < l->_windows.size(); w++) {
+    probe_window_t &pw = l->_windows[w];
+    while ((unsigned) pw._probes.size() &&
+	   now.sec() - pw._probes[0]._when.sec() > (signed) (1 + (l->_tau / 1000)))
+      pw.pop();
+  }
   
 
   
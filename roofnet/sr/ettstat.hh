@@ -163,6 +163,41 @@ public:
   };
 
 
+  // Received probes of one (rate, size), oldest first, with running
+  // sums of their rssi and noise.  Queries expire probes older than
+  // the averaging period from the front, so a window's count and
+  // means are always at hand instead of being recounted from every
+  // probe the neighbor sent.
+  struct probe_window_t {
+    int _rate;
+    int _size;
+    Deque<probe_t> _probes;
+    int _rssi_sum;
+    int _noise_sum;
+
+    probe_window_t() : _rate(0), _size(0), _rssi_sum(0), _noise_sum(0) { }
+    probe_window_t(int r, int sz) : _rate(r), _size(sz), _rssi_sum(0), _noise_sum(0) { }
+
+    void push(const probe_t &p) {
+      _probes.push_back(p);
+      _rssi_sum += p._rssi;
+      _noise_sum += p._noise;
+    }
+    void pop() {
+      _rssi_sum -= _probes[0]._rssi;
+      _noise_sum -= _probes[0]._noise;
+      _probes.pop_front();
+    }
+    // Timestamps only move forward, so what one query expires no
+    // later query would have counted.
+    int count(const Timestamp &earliest) {
+      while (_probes.size() && earliest > _probes[0]._when) {
+	pop();
+      }
+      return _probes.size();
+    }
+  };
+
   struct probe_list_t {
     IPAddress _ip;
     int _period;   // period of this node's probes, as reported by the node
@@ -175,7 +210,27 @@ public:
     Vector<int> _fwd_rates;
     
     Timestamp _last_rx;
-    Deque<probe_t> _probes;   // most recently received probes
+    Vector<probe_window_t> _windows;   // recent probes, by (rate, size)
+
+    probe_window_t *window(int rate, int size) {
+      for (int x = 0; x < _windows.size(); x++) {
+	if (_windows[x]._rate == rate && _windows[x]._size == size) {
+	  return &_windows[x];
+	}
+      }
+      return 0;
+    }
+    void add_probe(const probe_t &p) {
+      probe_window_t *w = window(p._rate, p._size);
+      if (!w) {
+	_windows.push_back(probe_window_t(p._rate, p._size));
+	w = &_windows.back();
+      }
+      w->push(p);
+    }
+    void clear_probes() {
+      _windows.clear();
+    }
     probe_list_t(const IPAddress &p, unsigned int per, unsigned int t) : 
       _ip(p), 
       _period(per), 
@@ -192,16 +247,8 @@ public:
 	click_chatter("period is 0\n");
 	return 0;
       }
-      int num = 0;
-      for (int i = _probes.size() - 1; i >= 0; i--) {
-	if (earliest > _probes[i]._when) {
-	  break;
-	} 
-	if ( _probes[i]._size == size &&
-	    _probes[i]._rate == rate) {
-	  num++;
-	}
-      }
+      probe_window_t *w = window(rate, size);
+      int num = w ? w->count(earliest) : 0;
       
       Timestamp since_start = now - start;
 
@@ -228,18 +275,9 @@ public:
 	click_chatter("period is 0\n");
 	return 0;
       }
-      int num = 0;
-      int sum = 0;
-      for (int i = _probes.size() - 1; i >= 0; i--) {
-	if (earliest > _probes[i]._when) {
-	  break;
-	} 
-	if ( _probes[i]._size == size &&
-	    _probes[i]._rate == rate) {
-	  num++;
-	  sum += _probes[i]._rssi;
-	}
-      }
+      probe_window_t *w = window(rate, size);
+      int num = w ? w->count(earliest) : 0;
+      int sum = w ? w->_rssi_sum : 0;
 
       if (!num) {
 	      return -1;
@@ -256,18 +294,9 @@ public:
 	click_chatter("period is 0\n");
 	return 0;
       }
-      int num = 0;
-      int sum = 0;
-      for (int i = _probes.size() - 1; i >= 0; i--) {
-	if (earliest > _probes[i]._when) {
-	  break;
-	} 
-	if ( _probes[i]._size == size &&
-	    _probes[i]._rate == rate) {
-	  num++;
-	  sum += _probes[i]._noise;
-	}
-      }
+      probe_window_t *w = window(rate, size);
+      int num = w ? w->count(earliest) : 0;
+      int sum = w ? w->_noise_sum : 0;
 
       if (!num) {
 	      return -1;
@@ -0,0 +1,90 @@
+/*
+ * floodstate.{cc,hh} -- seen broadcasts and forwarding timers for floods
+ *
+ * Copyright (c) 1999-2001 Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "floodstate.hh"
+CLICK_DECLS
+
+FloodState::FloodState()
+  : _head(0), _count(0)
+{
+}
+
+void
+FloodState::initialize(int capacity, uint32_t tick, uint64_t now)
+{
+  if (capacity < 1)
+    capacity = 1;
+  _index.clear();
+  _keys.clear();
+  _keys.resize(capacity);
+  _gen.resize(capacity, 0);
+  _head = 0;
+  _count = 0;
+
+  _wheel.initialize(tick, now);
+}
+
+int
+FloodState::find(IPAddress origin, uint32_t seq) const
+{
+  const int *s = _index.findp(FloodKey(origin, seq));
+  return s ? *s : -1;
+}
+
+int
+FloodState::insert(IPAddress origin, uint32_t seq, bool *evicted)
+{
+  int s;
+  if (_count < _keys.size()) {
+    s = slot(_count);
+    _count++;
+    *evicted = false;
+  } else {
+    s = _head;
+    _index.remove(_keys[s]);
+    _head = (_head + 1) % _keys.size();
+    *evicted = true;
+  }
+  _keys[s] = FloodKey(origin, seq);
+  _gen[s]++;
+  _index.insert(_keys[s], s);
+  return s;
+}
+
+void
+FloodState::schedule(int slot, uint64_t deadline)
+{
+  Forward f;
+  f._slot = slot;
+  f._gen = _gen[slot];
+  _wheel.schedule(f, deadline);
+}
+
+void
+FloodState::advance(uint64_t now, Vector<int> &due)
+{
+  _expired.clear();
+  _wheel.advance(now, _expired);
+  for (int i = 0; i < _expired.size(); i++) {
+    const Forward &f = _expired[i].key;
+    if (f._gen == _gen[f._slot])
+      due.push_back(f._slot);
+  }
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(FloodState)
@@ -0,0 +1,88 @@
+#ifndef CLICK_FLOODSTATE_HH
+#define CLICK_FLOODSTATE_HH
+#include <click/ipaddress.hh>
+#include <click/vector.hh>
+#include <click/hashmap.hh>
+#include "../timerwheel.hh"
+CLICK_DECLS
+
+/*
+ * FloodState: seen broadcasts and forwarding timers for CounterFlood
+ * and PFlood
+ *
+ * Remembers the last CAPACITY broadcasts in a ring of slots, found by
+ * (origin, seq) through a hash table.  The element keeps its
+ * per-broadcast record in a vector indexed by slot, so records are
+ * reused instead of allocated.  Adding a broadcast to a full ring
+ * reuses the oldest one's slot, as trimming to HISTORY did before.
+ *
+ * Jittered forwards go on one TimerWheel with msec deadlines, which the
+ * element advances from a single Timer.  An entry carries its slot's
+ * generation and is dropped when it comes due if the slot has since
+ * been reused.
+ */
+
+class FloodState {
+ public:
+
+  FloodState();
+
+  // Forget every broadcast and timer.
+  void initialize(int capacity, uint32_t tick, uint64_t now);
+
+  // The broadcast's slot, or -1.
+  int find(IPAddress origin, uint32_t seq) const;
+
+  // Add a broadcast and return its slot.  *evicted is set if the slot
+  // held the oldest broadcast, whose record the caller must release.
+  int insert(IPAddress origin, uint32_t seq, bool *evicted);
+
+  // Slots from oldest to newest, for i < size().
+  int slot(int i) const		{ return (_head + i) % _keys.size(); }
+  int size() const		{ return _count; }
+  int capacity() const		{ return _keys.size(); }
+
+  void schedule(int slot, uint64_t deadline);
+
+  // Append every live slot due at or before now to due.
+  void advance(uint64_t now, Vector<int> &due);
+
+  uint32_t tick() const		{ return _wheel.tick(); }
+  uint32_t pending() const	{ return _wheel.pending(); }
+
+  enum { NSLOTS = 256 };
+
+ private:
+
+  class FloodKey {
+  public:
+    IPAddress _origin;
+    uint32_t _seq;
+    FloodKey() : _seq(0) { }
+    FloodKey(IPAddress origin, uint32_t seq) : _origin(origin), _seq(seq) { }
+    inline size_t hashcode() const {
+      return (_origin.addr() * 2654435761U) ^ _seq;
+    }
+    inline bool operator==(const FloodKey &o) const {
+      return _origin == o._origin && _seq == o._seq;
+    }
+  };
+
+  struct Forward {
+    int _slot;
+    uint32_t _gen;
+  };
+  typedef TimerWheel<Forward, NSLOTS> Wheel;
+
+  HashMap<FloodKey, int> _index;
+  Vector<FloodKey> _keys;
+  Vector<uint32_t> _gen;
+  int _head;                    // oldest slot
+  int _count;
+
+  Wheel _wheel;
+  Vector<Wheel::Entry> _expired;
+};
+
+CLICK_ENDDECLS
+#endif
@@ -23,6 +23,7 @@
 #include <click/ipaddress.hh>
 #include <clicknet/ether.h>
 #include "srpacket.hh"
+#include "srrouteengine.hh"
 #include "gatewayselector.hh"
 
 CLICK_DECLS
@@ -32,6 +33,7 @@ GatewaySelector::GatewaySelector()
      _en(),
      _et(0),
      _link_table(0),
+     _route_engine(0),
      _arp_table(0),
      _timer(this)
 {
@@ -65,6 +67,7 @@ GatewaySelector::configure (Vector<String> &conf, ErrorHandler *errh)
 		     /* not required */
 		     "PERIOD", 0, cpUnsigned, &_period,
 		     "GW", 0, cpBool, &_is_gw,
+		     "ROUTES", 0, cpElement, &_route_engine,
 		     cpEnd);
 
   if (!_et) 
@@ -79,6 +82,8 @@ GatewaySelector::configure (Vector<String> &conf, ErrorHandler *errh)
 
   if (_link_table->cast("LinkTable") == 0) 
     return errh->error("LinkTable element is not a LinkTable");
+  if (_route_engine && _route_engine->cast("SRRouteEngine") == 0) 
+    return errh->error("ROUTES element is not a SRRouteEngine");
   if (_arp_table && _arp_table->cast("ARPTable") == 0) 
     return errh->error("ARPTable element is not an ARPtable");
 
@@ -147,7 +152,9 @@ GatewaySelector::send(WritablePacket *p)
 bool
 GatewaySelector::update_link(IPAddress from, IPAddress to, uint32_t seq, 
 			     uint32_t metric) {
-  if (_link_table && !_link_table->update_link(from, to, seq, 0, metric)) {
+  if (_route_engine
+      ? !_route_engine->update_link(from, to, seq, 0, metric)
+      : _link_table && !_link_table->update_link(from, to, seq, 0, metric)) {
     click_chatter("%{element} couldn't update link %s > %d > %s\n",
 		  this,
 		  from.unparse().c_str(),
@@ -158,6 +165,22 @@ GatewaySelector::update_link(IPAddress from, IPAddress to, uint32_t seq,
   return true;
 }
 
+Path
+GatewaySelector::best_route(IPAddress ip, bool from_me)
+{
+  if (_route_engine)
+    return _route_engine->best_route(ip, from_me);
+  return _link_table->best_route(ip, from_me);
+}
+
+unsigned
+GatewaySelector::route_metric(const Path &p)
+{
+  if (_route_engine)
+    return _route_engine->get_route_metric(p);
+  return _link_table->get_route_metric(p);
+}
+
 void
 GatewaySelector::forward_ad_hook() 
 {
@@ -173,9 +196,10 @@ GatewaySelector::forward_ad(Seen *s)
 {
 
   s->_forwarded = true;
-  _link_table->dijkstra(false);
+  if (!_route_engine)
+    _link_table->dijkstra(false);
   IPAddress src = s->_gw;
-  Path best = _link_table->best_route(src, false);
+  Path best = best_route(src, false);
   bool best_valid = _link_table->valid_route(best);
   
   if (!best_valid) {
@@ -233,8 +257,8 @@ GatewaySelector::best_gateway()
   for(GWIter iter = _gateways.begin(); iter.live(); iter++) {
     GWInfo nfo = iter.value();
     Timestamp expire = nfo._last_update + _gw_expire;
-    Path p = _link_table->best_route(nfo._ip, false);
-    int metric = _link_table->get_route_metric(p);
+    Path p = best_route(nfo._ip, false);
+    int metric = route_metric(p);
     if (now < expire &&
 	metric && 
 	((!best_metric) || best_metric > metric) &&
@@ -407,8 +431,8 @@ GatewaySelector::print_gateway_stats()
       sa << "first_update " << now - nfo._first_update << " ";
       sa << "last_update " << now - nfo._last_update << " ";
       
-      Path p = _link_table->best_route(nfo._ip, false);
-      int metric = _link_table->get_route_metric(p);
+      Path p = best_route(nfo._ip, false);
+      int metric = route_metric(p);
       sa << "current_metric " << metric << "\n";
     }
     
@@ -31,7 +31,8 @@ PFlood::PFlood()
      _et(0),
      _packets_originated(0),
      _packets_tx(0),
-     _packets_rx(0)
+     _packets_rx(0),
+     _timer(this)
 {
 
   static unsigned char bcast_addr[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
@@ -40,6 +41,12 @@ PFlood::PFlood()
 
 PFlood::~PFlood()
 {
+  for (int x = 0; x < _state.size(); x++) {
+    Packet *p = _packets[_state.slot(x)]._p;
+    if (p) {
+      p->kill();
+    }
+  }
 }
 
 int
@@ -80,6 +87,9 @@ PFlood::configure (Vector<String> &conf, ErrorHandler *errh)
 int
 PFlood::initialize (ErrorHandler *)
 {
+  _timer.initialize(this);
+  _state.initialize(_history, TICK, Timestamp::now().msecval());
+  _packets.resize(_state.capacity());
   return 0;
 }
 
@@ -140,39 +150,52 @@ PFlood::forward(Broadcast *bcast) {
 void
 PFlood::forward_hook() 
 {
-  Timestamp now = Timestamp::now();
-  for (int x = 0; x < _packets.size(); x++) {
-    if (_packets[x]._to_send <= now) {
-      /* this timer has expired */
-      if (!_packets[x]._forwarded) {
-	/* we haven't forwarded this packet yet */
-	if (click_random(0, 99) <= _p) {
-	  forward(&_packets[x]);
-	} 
-	_packets[x]._forwarded = true;
-      }
+  _due.clear();
+  _state.advance(Timestamp::now().msecval(), _due);
+  for (int x = 0; x < _due.size(); x++) {
+    Broadcast &bcast = _packets[_due[x]];
+    /* this timer has expired */
+    if (!bcast._forwarded) {
+      /* we haven't forwarded this packet yet */
+      if (click_random(0, 99) <= _p) {
+	forward(&bcast);
+      } 
+      bcast._forwarded = true;
     }
   }
 }
 
-
 void
-PFlood::trim_packets() {
-  /* only keep track of the last _max_packets */
-  while ((_packets.size() > _history)) {
-    /* unschedule and remove packet*/
+PFlood::run_timer(Timer *)
+{
+  forward_hook();
+  if (_state.pending()) {
+    _timer.reschedule_after_msec(TICK);
+  }
+}
+
+int
+PFlood::add_broadcast(IPAddress origin, uint32_t seq)
+{
+  /* only keep track of the last _history; the oldest slot is reused */
+  bool evicted;
+  int index = _state.insert(origin, seq, &evicted);
+  if (evicted) {
     if (_debug) {
       click_chatter("%{element} removing seq %d\n",
 		    this,
-		    _packets[0]._seq);
+		    _packets[index]._seq);
     }
-    _packets[0].del_timer();
-    if (_packets[0]._p) {
-      _packets[0]._p->kill();
+    if (_packets[index]._p) {
+      _packets[index]._p->kill();
+      _packets[index]._p = 0;
     }
-    _packets.pop_front();
   }
+  _packets[index]._origin = origin;
+  _packets[index]._seq = seq;
+  return index;
 }
+
 void
 PFlood::push(int port, Packet *p_in)
 {
@@ -181,16 +204,13 @@ PFlood::push(int port, Packet *p_in)
     if (port == 1) {
 	_packets_originated++;
 	/* from me */
-	int index = _packets.size();
-	_packets.push_back(Broadcast());
-	_packets[index]._seq = click_random();
+	int index = add_broadcast(_ip, click_random());
 	_packets[index]._originated = true;
 	_packets[index]._p = p_in;
 	_packets[index]._num_rx = 0;
 	_packets[index]._first_rx = now;
 	_packets[index]._forwarded = true;
 	_packets[index]._actually_sent = false;
-	_packets[index].t = NULL;
 	_packets[index]._to_send = now;
 	forward(&_packets[index]);
   } else {
@@ -200,35 +220,29 @@ PFlood::push(int port, Packet *p_in)
     struct srpacket *pk = (struct srpacket *) (eh+1);
     
     uint32_t seq = pk->seq();
+    IPAddress origin = pk->get_link_node(0);
     
-    int index = -1;
-    for (int x = 0; x < _packets.size(); x++) {
-      if (_packets[x]._seq == seq) {
-	index = x;
-	break;
-      }
-    }
+    int index = _state.find(origin, seq);
 
     if (index == -1) {
       /* haven't seen this packet before */
-      index = _packets.size();
-      _packets.push_back(Broadcast());
-      _packets[index]._seq = seq;
+      index = add_broadcast(origin, seq);
       _packets[index]._originated = false;
       _packets[index]._p = p_in;
       _packets[index]._num_rx = 1;
       _packets[index]._first_rx = now;
       _packets[index]._forwarded = false;
       _packets[index]._actually_sent = false;
-      _packets[index].t = NULL;
 
       /* schedule timer */
       int delay_time = click_random(1, _max_delay_ms);
       sr_assert(delay_time > 0);
       
-      _packets[index].t = new Timer(static_forward_hook, (void *) this);
-      _packets[index].t->initialize(this);
-      _packets[index].t->schedule_at(now + Timestamp::make_msec(delay_time));
+      _packets[index]._to_send = now + Timestamp::make_msec(delay_time);
+      _state.schedule(index, _packets[index]._to_send.msecval());
+      if (!_timer.scheduled()) {
+	_timer.schedule_after_msec(TICK);
+      }
 
       /* finally, clone the packet and push it out */
       Packet *p_out = p_in->clone();
@@ -239,8 +253,6 @@ PFlood::push(int port, Packet *p_in)
       _packets[index]._num_rx++;
     }
   }
-
-  trim_packets();
 }
 
 
@@ -314,7 +326,8 @@ String
 PFlood::print_packets()
 {
   StringAccum sa;
-  for (int x = 0; x < _packets.size(); x++) {
+  for (int i = 0; i < _state.size(); i++) {
+    int x = _state.slot(i);
     sa << "seq " << _packets[x]._seq;
     sa << " originated " << _packets[x]._originated;
     sa << " num_rx " << _packets[x]._num_rx;
@@ -347,3 +360,4 @@ PFlood::add_handlers()
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(PFlood)
+ELEMENT_REQUIRES(FloodState)
@@ -11,7 +11,7 @@
 #include <elements/wifi/linktable.hh>
 #include <elements/ethernet/arptable.hh>
 #include <elements/wifi/path.hh>
-#include "pflood.hh"
+#include "floodstate.hh"
 #include <elements/wifi/rxstats.hh>
 CLICK_DECLS
 
@@ -45,7 +45,10 @@ CLICK_DECLS
  *
  * number of sequence numbers to remember. default is 100
  *
+ * =back
  *
+ * Broadcasts are remembered by origin and sequence number in a hash
+ * table, and the delayed forwards all run off one timer wheel.
  *
  *
  */
@@ -62,6 +65,7 @@ class PFlood : public Element {
   const char *processing() const		{ return PUSH; }
   int initialize(ErrorHandler *);
   int configure(Vector<String> &conf, ErrorHandler *errh);
+  void run_timer(Timer *);
 
 
   static String static_print_debug(Element *f, void *);
@@ -86,6 +90,7 @@ private:
 
   class Broadcast {
   public:
+    IPAddress _origin;
     uint32_t _seq;
     bool _originated; /* this node started the bcast */
     Packet *_p;
@@ -93,20 +98,19 @@ private:
     Timestamp _first_rx;
     bool _forwarded;
     bool _actually_sent;
-    Timer *t;
     Timestamp _to_send;
 
-    void del_timer() {
-      if (t) {
-	t->unschedule();
-	delete t;
-	t = NULL;
-      }
-    }
+    Broadcast() : _seq(0), _originated(false), _p(0), _num_rx(0),
+		  _forwarded(false), _actually_sent(false) { }
   };
 
 
-  Deque<Broadcast> _packets;
+  enum { TICK = 10 };           // msec
+
+  FloodState _state;
+  Vector<Broadcast> _packets;   // indexed by _state slot
+  Timer _timer;
+  Vector<int> _due;
 
   IPAddress _ip;    // My IP address.
   EtherAddress _en; // My ethernet address.
@@ -129,10 +133,7 @@ private:
 
   void forward(Broadcast *bcast);
   void forward_hook();
-  void trim_packets();
-  static void static_forward_hook(Timer *, void *e) { 
-    ((PFlood *) e)->forward_hook(); 
-  }
+  int add_broadcast(IPAddress origin, uint32_t seq);
 };
 
 
@@ -37,7 +37,16 @@ SRForwarder::SRForwarder()
      _datas(0), 
      _databytes(0),
      _link_table(0),
-     _arp_table(0)
+     _arp_table(0),
+     _encap_next(0),
+     _encap_timer(this),
+     _encap_epoch(0),
+     _encap_hits(0),
+     _encap_misses(0),
+     _update_task(this),
+     _updates_queued(0),
+     _updates_merged(0),
+     _updates_applied(0)
 {
 
   static unsigned char bcast_addr[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
@@ -53,6 +62,7 @@ int
 SRForwarder::configure (Vector<String> &conf, ErrorHandler *errh)
 {
   int res;
+  uint32_t encap_timeout = 1000;
   res = cp_va_kparse(conf, this, errh,
 		     "ETHTYPE", 0, cpUnsigned, &_et,
 		     "IP", 0, cpIPAddress, &_ip,
@@ -60,6 +70,7 @@ SRForwarder::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "ARP", 0, cpElement, &_arp_table,
 		     /* below not required */
 		     "LT", 0, cpElement, &_link_table,
+		     "ENCAP_TIMEOUT", 0, cpUnsigned, &encap_timeout,
 		     cpEnd);
 
   if (!_et) 
@@ -80,15 +91,29 @@ SRForwarder::configure (Vector<String> &conf, ErrorHandler *errh)
   if (res < 0) {
     return res;
   }
+  if (!encap_timeout)
+    return errh->error("ENCAP_TIMEOUT must be positive");
+  _encap_timeout = encap_timeout;
   return res;
 }
 
 int
 SRForwarder::initialize (ErrorHandler *)
 {
+  _update_task.initialize(this, false);
+  _encap_order.resize(MAX_ENCAPS);
+  _encap_timer.initialize(this);
+  _encap_timer.schedule_after_msec(_encap_timeout);
   return 0;
 }
 
+void
+SRForwarder::run_timer(Timer *)
+{
+  _encap_epoch++;
+  _encap_timer.schedule_after_msec(_encap_timeout);
+}
+
 bool
 SRForwarder::update_link(IPAddress from, IPAddress to, 
 			 uint32_t seq, uint32_t age, uint32_t metric) 
@@ -107,20 +132,13 @@ SRForwarder::update_link(IPAddress from, IPAddress to,
 
 
 
-Packet *
-SRForwarder::encap(Packet *p_in, Vector<IPAddress> r, int flags)
+bool
+SRForwarder::build_encap(const Path &r, EncapInfo *e)
 {
-  sr_assert(r.size() > 1);
   int hops = r.size() - 1;
-  unsigned extra = srpacket::len_wo_data(hops) + sizeof(click_ether);
-  unsigned payload_len = p_in->length();
+  unsigned len = srpacket::len_wo_data(hops) + sizeof(click_ether);
   uint16_t ether_type = htons(_et);
 
-  WritablePacket *p = p_in->push(extra);
-
-  assert(extra + payload_len == p_in->length());
-
-
   int next = index_of(r, _ip) + 1;
   if (next < 0 || next >= r.size()) {
     click_chatter("%{element}: encap couldn't find %s (%d) in path %s",
@@ -128,60 +146,150 @@ SRForwarder::encap(Packet *p_in, Vector<IPAddress> r, int flags)
 		  _ip.unparse().c_str(),
 		  next,
 		  path_to_string(r).c_str());
-    p_in->kill();
-    return (0);
+    return false;
   }
-  EtherAddress eth_dest = _arp_table->lookup(r[next]);
-  if (eth_dest.is_broadcast()) {
+  e->_dst = _arp_table->lookup(r[next]);
+  if (e->_dst.is_broadcast()) {
     click_chatter("%{element}: arp lookup failed for %s",
 		  this,
 		  r[next].unparse().c_str());
   }
 
-  memcpy(p->data(), eth_dest.data(), 6);
-  memcpy(p->data() + 6, _eth.data(), 6);
-  memcpy(p->data() + 12, &ether_type, 2);
-    
+  e->_header.resize(len);
+  unsigned char *h = &e->_header[0];
+  memcpy(h, e->_dst.data(), 6);
+  memcpy(h + 6, _eth.data(), 6);
+  memcpy(h + 12, &ether_type, 2);
 
-  struct srpacket *pk = (struct srpacket *) (p->data() + sizeof(click_ether));
+  struct srpacket *pk = (struct srpacket *) (h + sizeof(click_ether));
   memset(pk, '\0', srpacket::len_wo_data(hops));
 
   pk->_version = _sr_version;
   pk->_type = PT_DATA;
-  pk->set_data_len(payload_len);
-
   pk->set_num_links(hops);
   pk->set_next(next);
-  pk->set_flag(flags);
   for(int i = 0; i < hops; i++) {
     pk->set_link_node(i, r[i]);
   }
-
   pk->set_link_node(hops, r[r.size()-1]);
   pk->set_data_seq(0);
+
+  e->_epoch = _encap_epoch;
+  return true;
+}
+
+Packet *
+SRForwarder::encap(Packet *p_in, const Path &r, int flags)
+{
+  sr_assert(r.size() > 1);
+
+  EncapInfo *e = _encaps.findp(r);
+  if (!e) {
+    /* the new route takes the oldest route's slot */
+    Path &slot = _encap_order[_encap_next];
+    if (slot.size()) {
+      _encaps.remove(slot);
+    }
+    slot = r;
+    _encap_next = (_encap_next + 1) % MAX_ENCAPS;
+    _encaps.insert(r, EncapInfo());
+    e = _encaps.findp(r);
+  }
+  if (!e->_header.size() || e->_dst.is_broadcast() ||
+      e->_epoch != _encap_epoch) {
+    _encap_misses++;
+    if (!build_encap(r, e)) {
+      p_in->kill();
+      return (0);
+    }
+  } else {
+    _encap_hits++;
+  }
+
+  unsigned extra = e->_header.size();
+  unsigned payload_len = p_in->length();
+  WritablePacket *p = p_in->push(extra);
+  if (!p) {
+    return (0);
+  }
+  memcpy(p->data(), &e->_header[0], extra);
+
+  struct srpacket *pk = (struct srpacket *) (p->data() + sizeof(click_ether));
+  pk->set_data_len(payload_len);
+  pk->set_flag(flags);
   
   /* set the ip header anno */
   const click_ip *ip = reinterpret_cast<const click_ip *>
-    (p->data() + pk->hlen_wo_data() + sizeof(click_ether));
+    (p->data() + extra);
   p->set_ip_header(ip, sizeof(click_ip));
   return p;
 }
 
 void
-SRForwarder::push(int port, Packet *p_in)
+SRForwarder::queue_update(IPAddress from, IPAddress to,
+			  uint32_t seq, uint32_t age, uint32_t metric)
 {
+  if (!_link_table || !from || !to || !metric) {
+    return;
+  }
 
-  WritablePacket *p = p_in->uniqueify();
-
-  if (!p) {
+  LinkKey key(from, to);
+  int *ndx = _update_index.findp(key);
+  if (ndx) {
+    /* the same link from another packet; keep the newest report */
+    LinkUpdate &u = _updates[*ndx];
+    if (seq > u._seq) {
+      u._seq = seq;
+      u._age = age;
+      u._metric = metric;
+    }
+    _updates_merged++;
     return;
   }
 
+  if (_updates.size() >= MAX_UPDATES) {
+    apply_updates();
+  }
+  _update_index.insert(key, _updates.size());
+  _updates.push_back(LinkUpdate(from, to, seq, age, metric));
+  _updates_queued++;
+  if (!_update_task.scheduled()) {
+    _update_task.reschedule();
+  }
+}
+
+void
+SRForwarder::apply_updates()
+{
+  for (int x = 0; x < _updates.size(); x++) {
+    LinkUpdate &u = _updates[x];
+    update_link(u._from, u._to, u._seq, u._age, u._metric);
+  }
+  _updates_applied += _updates.size();
+  _updates.clear();
+  _update_index.clear();
+}
+
+bool
+SRForwarder::run_task(Task *)
+{
+  apply_updates();
+  return true;
+}
+
+void
+SRForwarder::push(int port, Packet *p_in)
+{
   if (port > 1) {
-    p->kill();
+    p_in->kill();
     return;
   }
-  click_ether *eh = (click_ether *) p->data();
+
+  /* 
+   * everything up to the forwarding decision only reads the packet,
+   * so packets we drop or consume are never copied.
+   */
+  click_ether *eh = (click_ether *) p_in->data();
   EtherAddress edst = EtherAddress(eh->ether_dhost);
   struct srpacket *pk = (struct srpacket *) (eh+1);
 
@@ -190,7 +298,7 @@ SRForwarder::push(int port, Packet *p_in)
     click_chatter("SRForwarder %s: bad packet_type %04x",
                   _ip.unparse().c_str(),
                   pk->_type);
-    p->kill();
+    p_in->kill();
     return ;
   }
 
@@ -210,58 +318,30 @@ SRForwarder::push(int port, Packet *p_in)
 				pk->get_link_node(pk->next()).unparse().c_str(),
 				edst.unparse().c_str());
 	  }
-    p->kill();
+    p_in->kill();
     return;
   }
 
   if (1) {
-	  /* update the metrics from the packet */
+	  /* queue the metrics from the packet */
 	  IPAddress r_from = pk->get_random_from();
 	  IPAddress r_to = pk->get_random_to();
-	  uint32_t r_fwd_metric = pk->get_random_fwd_metric();
-	  uint32_t r_rev_metric = pk->get_random_rev_metric();
-	  uint32_t r_seq = pk->get_random_seq();
-	  uint32_t r_age = pk->get_random_age();
 	  
 	  if (r_from && r_to) {
-		  if (r_fwd_metric && !update_link(r_from, r_to, r_seq, r_age, r_fwd_metric)) {
-			  click_chatter("%{element} couldn't update r_fwd %s > %d > %s\n",
-					this,
-					r_from.unparse().c_str(),
-					r_fwd_metric,
-					r_to.unparse().c_str());
-		  }
-		  if (r_rev_metric && !update_link(r_to, r_from, r_seq, r_age, r_rev_metric)) {
-			  click_chatter("%{element} couldn't update r_rev %s > %d > %s\n",
-					this,
-					r_to.unparse().c_str(),
-					r_rev_metric, 
-					r_from.unparse().c_str());
-		  }
+		  queue_update(r_from, r_to, pk->get_random_seq(),
+			       pk->get_random_age(), pk->get_random_fwd_metric());
+		  queue_update(r_to, r_from, pk->get_random_seq(),
+			       pk->get_random_age(), pk->get_random_rev_metric());
 	  }
 
 	  for(int i = 0; i < pk->num_links(); i++) {
 		  IPAddress a = pk->get_link_node(i);
 		  IPAddress b = pk->get_link_node(i+1);
-		  uint32_t fwd_m = pk->get_link_fwd(i);
-		  uint32_t rev_m = pk->get_link_rev(i);
 		  uint32_t seq = pk->get_link_seq(i);
 		  uint32_t age = pk->get_link_age(i);
 		  
-		  if (fwd_m && !update_link(a,b,seq,age,fwd_m)) {
-			  click_chatter("%{element} couldn't update fwd_m %s > %d > %s\n",
-					this,
-					a.unparse().c_str(),
-					fwd_m,
-					b.unparse().c_str());
-		  }
-		  if (rev_m && !update_link(b,a,seq,age,rev_m)) {
-			  click_chatter("%{element} couldn't update rev_m %s > %d > %s\n",
-					this,
-					b.unparse().c_str(),
-					rev_m,
-					a.unparse().c_str());
-		  }
+		  queue_update(a, b, seq, age, pk->get_link_fwd(i));
+		  queue_update(b, a, seq, age, pk->get_link_rev(i));
 	  }
   }
   
@@ -269,7 +349,7 @@ SRForwarder::push(int port, Packet *p_in)
   /* set the ip header anno */
   const click_ip *ip = reinterpret_cast<const click_ip *>
     (pk->data());
-  p->set_ip_header(ip, sizeof(click_ip));
+  p_in->set_ip_header(ip, sizeof(click_ip));
   
   if(pk->next() == pk->num_links()){
     // I'm the ultimate consumer of this data.
@@ -277,11 +357,19 @@ SRForwarder::push(int port, Packet *p_in)
      * set the dst to the gateway it came from 
      * this is kinda weird.
      */
-    SET_MISC_IP_ANNO(p, pk->get_link_node(0));
-    output(1).push(p);
+    SET_MISC_IP_ANNO(p_in, pk->get_link_node(0));
+    output(1).push(p_in);
     return;
   } 
 
+  /* only copies if someone else holds a reference */
+  WritablePacket *p = p_in->uniqueify();
+  if (!p) {
+    return;
+  }
+  eh = (click_ether *) p->data();
+  pk = (struct srpacket *) (eh+1);
+
   if (1) {
 	  IPAddress prev = pk->get_link_node(pk->next()-1);
 	  _arp_table->insert(prev, EtherAddress(eh->ether_shost));
@@ -329,7 +417,12 @@ SRForwarder::print_stats()
   
   return
     String(_datas) + " datas sent\n" +
-    String(_databytes) + " bytes of data sent\n";
+    String(_databytes) + " bytes of data sent\n" +
+    String(_encap_hits) + " encap cache hits\n" +
+    String(_encap_misses) + " encap cache misses\n" +
+    String(_updates_queued) + " link updates queued\n" +
+    String(_updates_merged) + " link updates merged\n" +
+    String(_updates_applied) + " link updates applied\n";
 
 }
 
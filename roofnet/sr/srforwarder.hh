@@ -3,8 +3,11 @@
 #include <click/element.hh>
 #include <click/glue.hh>
 #include <click/timer.hh>
+#include <click/task.hh>
 #include <click/ipaddress.hh>
 #include <click/etheraddress.hh>
+#include <click/timestamp.hh>
+#include <click/hashmap.hh>
 #include <elements/wifi/linktable.hh>
 #include <click/vector.hh>
 #include <elements/wifi/path.hh>
@@ -14,7 +17,7 @@ CLICK_DECLS
 =c
 
 SRForwarder(ETHERTYPE, IP, ETH, ARPTable element, LT LinkTable element
-    [ETT element], [METRIC GridGenericMetric] )
+    [ETT element], [METRIC GridGenericMetric], [ENCAP_TIMEOUT msecs] )
 
 =s Roofnet
 
@@ -29,6 +32,9 @@ Output 1: packets that were addressed to me.
 
 Normally used in conjuction with ETT element
 
+Link metrics piggybacked on data packets are written to the LinkTable
+in batches from a task rather than per packet.
+
  */
 
 
@@ -53,8 +59,10 @@ class SRForwarder : public Element {
   String print_routes();
 
   void push(int, Packet *);
+  void run_timer(Timer *);
+  bool run_task(Task *);
   
-  Packet *encap(Packet *, Vector<IPAddress>, int flags);
+  Packet *encap(Packet *, const Path &, int flags);
   IPAddress ip() { return _ip; }
 private:
 
@@ -70,19 +78,82 @@ private:
   class LinkTable *_link_table;
   class ARPTable *_arp_table;
   
-  class PathInfo {
+  /*
+   * Ethernet and source-route headers for encap, built once per route
+   * with data length, flags and data seq left at 0.  _encap_timer bumps
+   * _encap_epoch every ENCAP_TIMEOUT, and a header built in an earlier
+   * epoch is rebuilt in case the next hop's ARP entry changed; it is
+   * also rebuilt on every use while ARP has no entry for it.  Once
+   * MAX_ENCAPS routes are cached, a new route replaces the oldest,
+   * found in the _encap_order ring.  Routes reach encap() as hop
+   * lists, so the table is keyed on the Path.
+   */
+  class EncapInfo {
   public:
-    Path _p;
-    int _seq;
-    void reset() { _seq = 0; }
-    PathInfo() :  _p() { reset(); }
-    PathInfo(Path p) :  _p(p)  { reset(); }
+    Vector<unsigned char> _header;
+    EtherAddress _dst;
+    uint32_t _epoch;
+    EncapInfo() : _epoch(0) { }
   };
-  typedef HashMap<Path, PathInfo> PathTable;
-  PathTable _paths;
+  typedef HashMap<Path, EncapInfo> EncapTable;
+  EncapTable _encaps;
+  Vector<Path> _encap_order;
+  int _encap_next;
+  Timer _encap_timer;
+  uint32_t _encap_timeout;	// msecs
+  uint32_t _encap_epoch;
+  int _encap_hits;
+  int _encap_misses;
+
+  enum { MAX_ENCAPS = 256 };
+  bool build_encap(const Path &, EncapInfo *);
   
   bool update_link(IPAddress from, IPAddress to, 
 		   uint32_t seq, uint32_t age, uint32_t metric);
+
+  /*
+   * Link metrics carried by data packets are queued here and written
+   * to the LinkTable in batches from _update_task, off the forwarding
+   * path.  One entry per link; reports with the same or an older
+   * sequence number are merged into it.
+   */
+  class LinkKey {
+  public:
+    IPAddress _from;
+    IPAddress _to;
+    LinkKey() { }
+    LinkKey(IPAddress from, IPAddress to) : _from(from), _to(to) { }
+    inline bool operator==(LinkKey other) const {
+      return _from == other._from && _to == other._to;
+    }
+    inline size_t hashcode() const {
+      return _from.addr() * 31 + _to.addr();
+    }
+  };
+  class LinkUpdate {
+  public:
+    IPAddress _from;
+    IPAddress _to;
+    uint32_t _seq;
+    uint32_t _age;
+    uint32_t _metric;
+    LinkUpdate() : _seq(0), _age(0), _metric(0) { }
+    LinkUpdate(IPAddress from, IPAddress to, uint32_t seq, uint32_t age,
+	       uint32_t metric)
+      : _from(from), _to(to), _seq(seq), _age(age), _metric(metric) { }
+  };
+  typedef HashMap<LinkKey, int> UpdateIndex;
+  UpdateIndex _update_index;
+  Vector<LinkUpdate> _updates;
+  Task _update_task;
+  int _updates_queued;
+  int _updates_merged;
+  int _updates_applied;
+
+  enum { MAX_UPDATES = 1024 };
+  void queue_update(IPAddress from, IPAddress to,
+		    uint32_t seq, uint32_t age, uint32_t metric);
+  void apply_updates();
 };
 
 
@@ -25,6 +25,7 @@
 #include <click/straccum.hh>
 #include <clicknet/ether.h>
 #include "srpacket.hh"
+#include "srrouteengine.hh"
 #include "srforwarder.hh"
 CLICK_DECLS
 
@@ -33,7 +34,8 @@ CLICK_DECLS
 SRQuerier::SRQuerier()
   :  _en(),
      _sr_forwarder(0),
-     _link_table(0)
+     _link_table(0),
+     _route_engine(0)
 {
 
   // Pick a starting sequence number that we have not used before.
@@ -64,6 +66,7 @@ SRQuerier::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "DEBUG", 0, cpBool, &_debug,
 		     "ROUTE_DAMPENING", 0, cpBool, &_route_dampening,
 		     "TIME_BEFORE_SWITCH", 0, cpUnsigned, &_time_before_switch_sec,
+		     "ROUTES", 0, cpElement, &_route_engine,
 		     cpEnd);
 
   if (!_en) 
@@ -78,6 +81,8 @@ SRQuerier::configure (Vector<String> &conf, ErrorHandler *errh)
     return errh->error("SRQuerier element is not a SRQuerier");
   if (_link_table->cast("LinkTable") == 0) 
     return errh->error("LinkTable element is not a LinkTable");
+  if (_route_engine && _route_engine->cast("SRRouteEngine") == 0) 
+    return errh->error("ROUTES element is not a SRRouteEngine");
 
   return ret;
 }
@@ -139,7 +144,7 @@ SRQuerier::push(int, Packet *p_in)
   
   
   if (!q->_best_metric || !q->_p.size() || expire < now) {
-	  Path best = _link_table->best_route(dst, true);
+	  Path best = best_route(dst, true);
 	  bool valid = _link_table->valid_route(best);
 	  q->_last_switch = now;
 	  if (valid) {
@@ -147,7 +152,7 @@ SRQuerier::push(int, Packet *p_in)
 			  q->_first_selected = now;
 		  }
 		  q->_p = best;
-		  q->_best_metric = _link_table->get_route_metric(best);
+		  q->_best_metric = route_metric(best);
 	  } else {
 		  do_query = true;
 		  q->_p = Path();
@@ -183,6 +188,22 @@ SRQuerier::push(int, Packet *p_in)
   
 }
 
+Path
+SRQuerier::best_route(IPAddress ip, bool from_me)
+{
+  if (_route_engine)
+    return _route_engine->best_route(ip, from_me);
+  return _link_table->best_route(ip, from_me);
+}
+
+unsigned
+SRQuerier::route_metric(const Path &p)
+{
+  if (_route_engine)
+    return _route_engine->get_route_metric(p);
+  return _link_table->get_route_metric(p);
+}
+
 enum {H_DEBUG, H_PATH_CACHE, H_RESET, H_QUERIES, H_QUERY};
 
 static String 
@@ -203,13 +224,13 @@ read_param(Element *e, void *thunk)
 	  sa << " last_query_ago " << now - dst._last_query;
 	  sa << " first_selected_ago " << now - dst._first_selected;
 	  sa << " last_switch_ago " << now - dst._last_switch;
-	  int current_path_metric = td->_link_table->get_route_metric(dst._p);
+	  int current_path_metric = td->route_metric(dst._p);
 	  sa << " current_path_metric " << current_path_metric;
 	  sa << " [ ";
 	  sa << path_to_string(dst._p);
 	  sa << " ]";
-	  Path best = td->_link_table->best_route(dst._ip, true);
-	  int best_metric = td->_link_table->get_route_metric(best);
+	  Path best = td->best_route(dst._ip, true);
+	  int best_metric = td->route_metric(best);
 	  sa << " best_metric " << best_metric;
 	  sa << " best_route [ ";
 	  sa << path_to_string(best);
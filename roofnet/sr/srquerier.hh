@@ -76,6 +76,10 @@ class SRQuerier : public Element {
 
   class SRForwarder *_sr_forwarder;
   class LinkTable *_link_table;
+  class SRRouteEngine *_route_engine;
+
+  Path best_route(IPAddress ip, bool from_me);
+  unsigned route_metric(const Path &p);
 
   bool _route_dampening;
   bool _debug;
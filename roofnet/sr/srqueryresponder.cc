@@ -24,6 +24,7 @@
 #include <click/straccum.hh>
 #include <clicknet/ether.h>
 #include "srpacket.hh"
+#include "srrouteengine.hh"
 CLICK_DECLS
 
 
@@ -33,6 +34,7 @@ SRQueryResponder::SRQueryResponder()
      _en(),
      _et(0),
      _link_table(0),
+     _route_engine(0),
      _arp_table(0)
 {
 }
@@ -54,6 +56,7 @@ SRQueryResponder::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "ARP", 0, cpElement, &_arp_table,
 		     /* below not required */
 		     "DEBUG", 0, cpBool, &_debug,
+		     "ROUTES", 0, cpElement, &_route_engine,
 		     cpEnd);
 
   if (!_et) 
@@ -70,6 +73,8 @@ SRQueryResponder::configure (Vector<String> &conf, ErrorHandler *errh)
 
   if (_link_table->cast("LinkTable") == 0) 
     return errh->error("LinkTable element is not a LinkTable");
+  if (_route_engine && _route_engine->cast("SRRouteEngine") == 0) 
+    return errh->error("ROUTES element is not a SRRouteEngine");
   if (_arp_table->cast("ARPTable") == 0) 
     return errh->error("ARPTable element is not a ARPTable");
 
@@ -106,7 +111,9 @@ SRQueryResponder::send(WritablePacket *p)
 
 bool
 SRQueryResponder::update_link(IPAddress from, IPAddress to, uint32_t seq, int metric) {
-  if (_link_table && !_link_table->update_link(from, to, seq, 0, metric)) {
+  if (_route_engine
+      ? !_route_engine->update_link(from, to, seq, 0, metric)
+      : _link_table && !_link_table->update_link(from, to, seq, 0, metric)) {
     click_chatter("%{element} couldn't update link %s > %d > %s\n",
 		  this,
 		  from.unparse().c_str(),
@@ -117,6 +124,14 @@ SRQueryResponder::update_link(IPAddress from, IPAddress to, uint32_t seq, int me
   return true;
 }
 
+Path
+SRQueryResponder::best_route(IPAddress ip, bool from_me)
+{
+  if (_route_engine)
+    return _route_engine->best_route(ip, from_me);
+  return _link_table->best_route(ip, from_me);
+}
+
 // Continue unicasting a reply packet.
 void
 SRQueryResponder::forward_reply(struct srpacket *pk1)
@@ -124,7 +139,8 @@ SRQueryResponder::forward_reply(struct srpacket *pk1)
   u_char type = pk1->_type;
   sr_assert(type == PT_REPLY);
 
-  _link_table->dijkstra(true);
+  if (!_route_engine)
+    _link_table->dijkstra(true);
   if (_debug) {
     click_chatter("%{element}: forward_reply %s <- %s\n", 
 		  this,
@@ -163,8 +179,9 @@ SRQueryResponder::forward_reply(struct srpacket *pk1)
 void 
 SRQueryResponder::start_reply(IPAddress src, IPAddress qdst, uint32_t seq)
 {
-  _link_table->dijkstra(false);
-  Path best = _link_table->best_route(src, false);
+  if (!_route_engine)
+    _link_table->dijkstra(false);
+  Path best = best_route(src, false);
   bool best_valid = _link_table->valid_route(best);
 
   
@@ -256,7 +273,8 @@ SRQueryResponder::got_reply(struct srpacket *pk)
 		  _ip.unparse().c_str(),
 		  dst.unparse().c_str());
   }
-  _link_table->dijkstra(true);
+  if (!_route_engine)
+    _link_table->dijkstra(true);
 
 }
 
@@ -0,0 +1,526 @@
+/*
+ * SRRouteEngine.{cc,hh} -- incremental shortest-path routes over a LinkTable
+ *
+ * Copyright (c) 1999-2001 Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/confparse.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/straccum.hh>
+#include "srrouteengine.hh"
+CLICK_DECLS
+
+SRRouteEngine::SRRouteEngine()
+  :  _debug(false),
+     _link_table(0),
+     _refresh(1000),
+     _timer(this),
+     _root(-1),
+     _sync_version(0),
+     _mark_version(0),
+     _link_changes(0),
+     _incremental(0),
+     _full(0),
+     _touched(0),
+     _cache_hits(0),
+     _cache_misses(0)
+{
+  _version[FROM_ME] = _version[TO_ME] = 1;
+}
+
+SRRouteEngine::~SRRouteEngine()
+{
+}
+
+int
+SRRouteEngine::configure (Vector<String> &conf, ErrorHandler *errh)
+{
+  int ret;
+  ret = cp_va_kparse(conf, this, errh,
+		     "IP", 0, cpIPAddress, &_ip,
+		     "LT", 0, cpElement, &_link_table,
+		     /* below not required */
+		     "REFRESH", 0, cpUnsigned, &_refresh,
+		     "DEBUG", 0, cpBool, &_debug,
+		     cpEnd);
+
+  if (!_ip)
+    return errh->error("IP not specified");
+  if (!_link_table)
+    return errh->error("LT not specified");
+  if (_link_table->cast("LinkTable") == 0)
+    return errh->error("LinkTable element is not a LinkTable");
+
+  return ret;
+}
+
+int
+SRRouteEngine::initialize (ErrorHandler *)
+{
+  recompute();
+  _timer.initialize(this);
+  if (_refresh)
+    _timer.schedule_after_msec(_refresh);
+  return 0;
+}
+
+void
+SRRouteEngine::run_timer (Timer *)
+{
+  sync();
+  _timer.schedule_after_msec(_refresh);
+}
+
+int
+SRRouteEngine::node_index(IPAddress ip, bool create)
+{
+  int *n = _index.findp(ip);
+  if (n)
+    return *n;
+  if (!create || !ip)
+    return -1;
+  int index = _nodes.size();
+  _nodes.push_back(Node(ip));
+  _mark.push_back(0);
+  _index.insert(ip, index);
+  return index;
+}
+
+SRRouteEngine::Edge *
+SRRouteEngine::find_edge(Vector<Edge> &edges, int node)
+{
+  for (int i = 0; i < edges.size(); i++)
+    if (edges[i]._node == node)
+      return &edges[i];
+  return 0;
+}
+
+void
+SRRouteEngine::remove_edge(Vector<Edge> &edges, int node)
+{
+  for (int i = 0; i < edges.size(); i++)
+    if (edges[i]._node == node) {
+      edges[i] = edges.back();
+      edges.pop_back();
+      return;
+    }
+}
+
+/*
+ * Record the metric of link from -> to in the graph copy, 0 meaning the
+ * link is gone, and queue the change for the trees.
+ */
+bool
+SRRouteEngine::set_link(int from, int to, unsigned metric)
+{
+  Edge *e = find_edge(_nodes[from]._out, to);
+  if (e)
+    e->_sync = _sync_version;
+  if ((e ? e->_metric : 0) == metric)
+    return false;
+
+  if (!metric) {
+    remove_edge(_nodes[from]._out, to);
+    remove_edge(_nodes[to]._in, from);
+  } else if (e) {
+    e->_metric = metric;
+    find_edge(_nodes[to]._in, from)->_metric = metric;
+  } else {
+    _nodes[from]._out.push_back(Edge(to, metric, _sync_version));
+    _nodes[to]._in.push_back(Edge(from, metric, _sync_version));
+  }
+
+  _pending.push_back(Change(from, to));
+  _link_changes++;
+  return true;
+}
+
+bool
+SRRouteEngine::update_link(IPAddress from, IPAddress to,
+			   uint32_t seq, uint32_t age, uint32_t metric)
+{
+  if (!_link_table->update_link(from, to, seq, age, metric))
+    return false;
+  /* the table may have kept a newer sequence number's metric */
+  int f = node_index(from, true);
+  int t = node_index(to, true);
+  set_link(f, t, _link_table->get_link_metric(from, to));
+  return true;
+}
+
+void
+SRRouteEngine::sync()
+{
+  _sync_version++;
+
+  Vector<IPAddress> hosts = _link_table->get_hosts();
+  for (int i = 0; i < hosts.size(); i++) {
+    int from = node_index(hosts[i], true);
+    Vector<IPAddress> neighbors = _link_table->get_neighbors(hosts[i]);
+    for (int j = 0; j < neighbors.size(); j++) {
+      unsigned metric = _link_table->get_link_metric(hosts[i], neighbors[j]);
+      if (metric)
+	set_link(from, node_index(neighbors[j], true), metric);
+    }
+  }
+
+  /* whatever the table no longer has was expired or removed */
+  Vector<Change> stale;
+  for (int n = 0; n < _nodes.size(); n++)
+    for (int i = 0; i < _nodes[n]._out.size(); i++)
+      if (_nodes[n]._out[i]._sync != _sync_version)
+	stale.push_back(Change(n, _nodes[n]._out[i]._node));
+  for (int i = 0; i < stale.size(); i++)
+    set_link(stale[i]._from, stale[i]._to, 0);
+
+  if (_debug && _pending.size())
+    click_chatter("%{element}: sync found %d changed links\n",
+		  this, _pending.size());
+}
+
+void
+SRRouteEngine::recompute()
+{
+  _index.clear();
+  _nodes.clear();
+  _mark.clear();
+  _pending.clear();
+  _root = node_index(_ip, true);
+  sync();
+  _pending.clear();
+  full_dijkstra(FROM_ME);
+  full_dijkstra(TO_ME);
+  _full++;
+}
+
+/*
+ * Bring both trees up to date with the queued link changes.  Each
+ * change is repaired on its own; past a quarter of the node count a
+ * full dijkstra is cheaper.
+ */
+void
+SRRouteEngine::process_pending()
+{
+  if (!_pending.size())
+    return;
+
+  if (_pending.size() * 4 > _nodes.size()) {
+    full_dijkstra(FROM_ME);
+    full_dijkstra(TO_ME);
+    _full++;
+  } else {
+    for (int i = 0; i < _pending.size(); i++) {
+      apply_change(FROM_ME, _pending[i]._from, _pending[i]._to);
+      apply_change(TO_ME, _pending[i]._to, _pending[i]._from);
+    }
+    _incremental++;
+  }
+  _pending.clear();
+}
+
+/*
+ * The weight of tree edge u -> v in tree t changed.  A better path to v
+ * only moves v (and whatever improves through it); a worse or missing
+ * tree edge invalidates v's whole subtree.
+ */
+void
+SRRouteEngine::apply_change(int t, int u, int v)
+{
+  Edge *e = find_edge(succ(t, u), v);
+  unsigned du = _nodes[u]._dist[t];
+  unsigned dist = (e && du != INFINITE) ? du + e->_metric : INFINITE;
+  Node &nv = _nodes[v];
+
+  if (nv._parent[t] == u) {
+    if (dist == nv._dist[t])
+      return;
+    if (dist < nv._dist[t]) {
+      nv._dist[t] = dist;
+      heap_push(dist, v);
+      propagate(t);
+    } else {
+      raise_subtree(t, v);
+    }
+  } else if (dist < nv._dist[t]) {
+    nv._dist[t] = dist;
+    set_parent(t, v, u);
+    heap_push(dist, v);
+    propagate(t);
+  } else {
+    return;
+  }
+  _version[t]++;
+}
+
+void
+SRRouteEngine::raise_subtree(int t, int v)
+{
+  _mark_version++;
+  _subtree.clear();
+  _subtree.push_back(v);
+  for (int i = 0; i < _subtree.size(); i++) {
+    int n = _subtree[i];
+    _mark[n] = _mark_version;
+    const Vector<int> &children = _nodes[n]._children[t];
+    for (int j = 0; j < children.size(); j++)
+      _subtree.push_back(children[j]);
+  }
+
+  set_parent(t, v, -1);
+  for (int i = 0; i < _subtree.size(); i++) {
+    Node &n = _nodes[_subtree[i]];
+    n._dist[t] = INFINITE;
+    n._parent[t] = -1;
+    n._children[t].clear();
+  }
+
+  /* reattach each node through its best neighbor outside the subtree */
+  for (int i = 0; i < _subtree.size(); i++) {
+    int n = _subtree[i];
+    Vector<Edge> &in = pred(t, n);
+    for (int j = 0; j < in.size(); j++) {
+      int y = in[j]._node;
+      unsigned dy = _nodes[y]._dist[t];
+      if (_mark[y] == _mark_version || dy == INFINITE)
+	continue;
+      if (dy + in[j]._metric < _nodes[n]._dist[t]) {
+	_nodes[n]._dist[t] = dy + in[j]._metric;
+	set_parent(t, n, y);
+      }
+    }
+    if (_nodes[n]._dist[t] != INFINITE)
+      heap_push(_nodes[n]._dist[t], n);
+  }
+  propagate(t);
+}
+
+void
+SRRouteEngine::propagate(int t)
+{
+  while (_heap.size()) {
+    HeapEntry h = heap_pop();
+    if (h._dist != _nodes[h._node]._dist[t])
+      continue;
+    _touched++;
+    Vector<Edge> &out = succ(t, h._node);
+    for (int i = 0; i < out.size(); i++) {
+      int y = out[i]._node;
+      unsigned dist = h._dist + out[i]._metric;
+      if (dist < _nodes[y]._dist[t]) {
+	_nodes[y]._dist[t] = dist;
+	set_parent(t, y, h._node);
+	heap_push(dist, y);
+      }
+    }
+  }
+}
+
+void
+SRRouteEngine::full_dijkstra(int t)
+{
+  for (int n = 0; n < _nodes.size(); n++) {
+    _nodes[n]._dist[t] = INFINITE;
+    _nodes[n]._parent[t] = -1;
+    _nodes[n]._children[t].clear();
+  }
+  _heap.clear();
+  if (_root >= 0) {
+    _nodes[_root]._dist[t] = 0;
+    heap_push(0, _root);
+    propagate(t);
+  }
+  _version[t]++;
+}
+
+void
+SRRouteEngine::set_parent(int t, int n, int parent)
+{
+  int old = _nodes[n]._parent[t];
+  if (old == parent)
+    return;
+  if (old >= 0) {
+    Vector<int> &children = _nodes[old]._children[t];
+    for (int i = 0; i < children.size(); i++)
+      if (children[i] == n) {
+	children[i] = children.back();
+	children.pop_back();
+	break;
+      }
+  }
+  _nodes[n]._parent[t] = parent;
+  if (parent >= 0)
+    _nodes[parent]._children[t].push_back(n);
+}
+
+void
+SRRouteEngine::heap_push(unsigned dist, int node)
+{
+  int i = _heap.size();
+  _heap.push_back(HeapEntry(dist, node));
+  while (i > 0) {
+    int p = (i - 1) / 2;
+    if (_heap[p]._dist <= _heap[i]._dist)
+      break;
+    HeapEntry tmp = _heap[p];
+    _heap[p] = _heap[i];
+    _heap[i] = tmp;
+    i = p;
+  }
+}
+
+SRRouteEngine::HeapEntry
+SRRouteEngine::heap_pop()
+{
+  HeapEntry top = _heap[0];
+  _heap[0] = _heap.back();
+  _heap.pop_back();
+  int i = 0;
+  for (;;) {
+    int l = 2 * i + 1, r = l + 1, min = i;
+    if (l < _heap.size() && _heap[l]._dist < _heap[min]._dist)
+      min = l;
+    if (r < _heap.size() && _heap[r]._dist < _heap[min]._dist)
+      min = r;
+    if (min == i)
+      break;
+    HeapEntry tmp = _heap[min];
+    _heap[min] = _heap[i];
+    _heap[i] = tmp;
+    i = min;
+  }
+  return top;
+}
+
+Path
+SRRouteEngine::best_route(IPAddress dst, bool from_me)
+{
+  process_pending();
+
+  int t = from_me ? FROM_ME : TO_ME;
+  int n = node_index(dst, false);
+  if (n < 0)
+    return Path();
+
+  if (_nodes[n]._route_version[t] == _version[t]) {
+    _cache_hits++;
+    return _nodes[n]._route[t];
+  }
+  _cache_misses++;
+
+  Path route;
+  if (_nodes[n]._dist[t] != INFINITE) {
+    for (int x = n; x >= 0 && route.size() <= _nodes.size(); x = _nodes[x]._parent[t])
+      route.push_back(_nodes[x]._ip);
+    if (from_me)
+      route = reverse_path(route);
+  }
+  _nodes[n]._route[t] = route;
+  _nodes[n]._route_version[t] = _version[t];
+  return route;
+}
+
+unsigned
+SRRouteEngine::get_route_metric(const Path &route)
+{
+  if (route.size() < 2)
+    return 0;
+
+  /* our own routes carry their metric in the tree */
+  if (route[0] == _ip && best_route(route.back(), true) == route)
+    return _nodes[node_index(route.back(), false)]._dist[FROM_ME];
+  if (route.back() == _ip && best_route(route[0], false) == route)
+    return _nodes[node_index(route[0], false)]._dist[TO_ME];
+
+  unsigned metric = 0;
+  for (int i = 0; i < route.size() - 1; i++) {
+    int a = node_index(route[i], false);
+    int b = node_index(route[i+1], false);
+    Edge *e = (a >= 0 && b >= 0) ? find_edge(_nodes[a]._out, b) : 0;
+    if (!e)
+      return 0;
+    metric += e->_metric;
+  }
+  return metric;
+}
+
+String
+SRRouteEngine::stats()
+{
+  int links = 0;
+  for (int n = 0; n < _nodes.size(); n++)
+    links += _nodes[n]._out.size();
+
+  StringAccum sa;
+  sa << "nodes " << _nodes.size() << "\n";
+  sa << "links " << links << "\n";
+  sa << "pending " << _pending.size() << "\n";
+  sa << "link_changes " << _link_changes << "\n";
+  sa << "incremental " << _incremental << "\n";
+  sa << "full " << _full << "\n";
+  sa << "nodes_touched " << _touched << "\n";
+  sa << "cache_hits " << _cache_hits << "\n";
+  sa << "cache_misses " << _cache_misses << "\n";
+  return sa.take_string();
+}
+
+enum {H_DEBUG, H_STATS, H_RECOMPUTE};
+
+String
+SRRouteEngine::read_param(Element *e, void *thunk)
+{
+  SRRouteEngine *td = (SRRouteEngine *)e;
+  switch ((uintptr_t) thunk) {
+  case H_DEBUG:
+    return String(td->_debug) + "\n";
+  case H_STATS:
+    return td->stats();
+  default:
+    return String();
+  }
+}
+
+int
+SRRouteEngine::write_param(const String &in_s, Element *e, void *vparam,
+			   ErrorHandler *errh)
+{
+  SRRouteEngine *f = (SRRouteEngine *)e;
+  String s = cp_uncomment(in_s);
+  switch((intptr_t)vparam) {
+  case H_DEBUG: {
+    bool debug;
+    if (!cp_bool(s, &debug))
+      return errh->error("debug parameter must be boolean");
+    f->_debug = debug;
+    break;
+  }
+  case H_RECOMPUTE:
+    f->recompute();
+    break;
+  }
+  return 0;
+}
+
+void
+SRRouteEngine::add_handlers()
+{
+  add_read_handler("debug", read_param, (void *) H_DEBUG);
+  add_read_handler("stats", read_param, (void *) H_STATS);
+
+  add_write_handler("debug", write_param, (void *) H_DEBUG);
+  add_write_handler("recompute", write_param, (void *) H_RECOMPUTE);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(SRRouteEngine)
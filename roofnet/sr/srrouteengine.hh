@@ -0,0 +1,188 @@
+#ifndef CLICK_SRROUTEENGINE_HH
+#define CLICK_SRROUTEENGINE_HH
+#include <click/element.hh>
+#include <click/glue.hh>
+#include <click/timer.hh>
+#include <click/ipaddress.hh>
+#include <click/vector.hh>
+#include <click/hashmap.hh>
+#include <elements/wifi/linktable.hh>
+#include <elements/wifi/path.hh>
+CLICK_DECLS
+
+/*
+=c
+
+SRRouteEngine(IP, LT LinkTable element, [REFRESH msecs], [DEBUG bool])
+
+=s Roofnet
+
+Incrementally maintained shortest-path routes over a LinkTable.
+
+=d
+
+Keeps a copy of the LinkTable's link graph and the two shortest-path
+trees rooted at IP (routes from this node, and routes to it) and
+repairs them after each link change instead of running a full
+dijkstra.  A metric that drops only relaxes outward from the link's
+far end; a tree link that gets worse or disappears only recomputes the
+subtree hanging off it.  Routes are served from a per-destination
+cache that is stamped with the tree's version, so repeated lookups
+between changes do not walk the tree again.
+
+SRQueryResponder, SRQueryForwarder, SRQuerier, GatewaySelector and their
+SR2 counterparts use the engine when given it with the ROUTES keyword.
+Link updates they make then go through update_link, which writes the
+LinkTable and queues the change; trees are repaired lazily on the next
+best_route or get_route_metric.  Give every element of a node the same
+engine: elements without one still call LinkTable::dijkstra, which is
+what they rely on.
+
+Other LinkTable writers (the link metrics, stale link expiry) are picked
+up every REFRESH milliseconds by comparing the table with the engine's
+copy.  Default is 1000; 0 disables the comparison.
+
+=h stats read-only
+
+Graph size, link changes, incremental and full recomputes, nodes
+touched and route cache hits.
+
+=h recompute write-only
+
+Reload the graph from the LinkTable and rebuild both trees.
+
+=a LinkTable, SRQueryResponder, SR2QueryResponder
+*/
+
+class SRRouteEngine : public Element {
+ public:
+
+  SRRouteEngine();
+  ~SRRouteEngine();
+
+  const char *class_name() const		{ return "SRRouteEngine"; }
+  const char *port_count() const		{ return PORTS_0_0; }
+  const char *processing() const		{ return AGNOSTIC; }
+
+  int configure(Vector<String> &conf, ErrorHandler *errh);
+  int initialize(ErrorHandler *);
+  void run_timer(Timer *);
+  void add_handlers();
+
+  // Same semantics as the LinkTable calls of the same name.
+  bool update_link(IPAddress from, IPAddress to,
+		   uint32_t seq, uint32_t age, uint32_t metric);
+  Path best_route(IPAddress dst, bool from_me);
+  unsigned get_route_metric(const Path &route);
+
+  // Reload every link from the LinkTable.  Changed links are repaired
+  // incrementally unless there are too many of them.
+  void sync();
+  void recompute();
+
+  String stats();
+  bool _debug;
+
+ private:
+
+  enum { FROM_ME = 0, TO_ME = 1 };
+  enum { INFINITE = 0xFFFFFFFFU };
+
+  struct Edge {
+    int _node;
+    unsigned _metric;
+    uint32_t _sync;             // last sync() that saw this link
+    Edge() : _node(-1), _metric(0), _sync(0) { }
+    Edge(int node, unsigned metric, uint32_t sync)
+      : _node(node), _metric(metric), _sync(sync) { }
+  };
+
+  struct Node {
+    IPAddress _ip;
+    Vector<Edge> _out;          // links from this node
+    Vector<Edge> _in;           // links to this node
+
+    // Per tree.  In the TO_ME tree _parent is the next hop towards us.
+    unsigned _dist[2];
+    int _parent[2];
+    Vector<int> _children[2];
+
+    Path _route[2];
+    uint32_t _route_version[2];
+
+    Node() { }
+    Node(IPAddress ip) : _ip(ip) {
+      for (int t = 0; t < 2; t++) {
+	_dist[t] = INFINITE;
+	_parent[t] = -1;
+	_route_version[t] = 0;
+      }
+    }
+  };
+
+  struct HeapEntry {
+    unsigned _dist;
+    int _node;
+    HeapEntry() : _dist(0), _node(-1) { }
+    HeapEntry(unsigned d, int n) : _dist(d), _node(n) { }
+  };
+
+  struct Change {
+    int _from;
+    int _to;
+    Change() : _from(-1), _to(-1) { }
+    Change(int from, int to) : _from(from), _to(to) { }
+  };
+
+  IPAddress _ip;
+  class LinkTable *_link_table;
+  uint32_t _refresh;            // msec
+  Timer _timer;
+
+  typedef HashMap<IPAddress, int> IndexTable;
+  IndexTable _index;
+  Vector<Node> _nodes;
+  int _root;
+
+  Vector<Change> _pending;
+  uint32_t _version[2];
+  uint32_t _sync_version;
+
+  Vector<HeapEntry> _heap;
+  Vector<int> _subtree;
+  Vector<uint32_t> _mark;
+  uint32_t _mark_version;
+
+  // statistics
+  uint32_t _link_changes;
+  uint32_t _incremental;
+  uint32_t _full;
+  uint32_t _touched;
+  uint32_t _cache_hits;
+  uint32_t _cache_misses;
+
+  int node_index(IPAddress ip, bool create);
+  Edge *find_edge(Vector<Edge> &edges, int node);
+  bool set_link(int from, int to, unsigned metric);
+  void remove_edge(Vector<Edge> &edges, int node);
+
+  // Tree t runs over the link graph as is (FROM_ME) or reversed (TO_ME).
+  Vector<Edge> &succ(int t, int n) { return t == FROM_ME ? _nodes[n]._out : _nodes[n]._in; }
+  Vector<Edge> &pred(int t, int n) { return t == FROM_ME ? _nodes[n]._in : _nodes[n]._out; }
+
+  void set_parent(int t, int n, int parent);
+  void process_pending();
+  void apply_change(int t, int u, int v);
+  void raise_subtree(int t, int v);
+  void propagate(int t);
+  void full_dijkstra(int t);
+
+  void heap_push(unsigned dist, int node);
+  HeapEntry heap_pop();
+
+  static String read_param(Element *, void *);
+  static int write_param(const String &, Element *, void *, ErrorHandler *);
+};
+
+CLICK_ENDDECLS
+#endif
@@ -518,11 +518,11 @@ SR2ETTStat::simple_action(Packet *p)
   } else if (l->_period != new_period) {
     click_chatter("SR2ETTStat %s: %s has changed its link probe period from %u to %u; clearing probe info",
 		  name().c_str(), ip.unparse().c_str(), l->_period, new_period);
-    l->_probes.clear();
+    l->clear_probes();
   } else if (l->_tau != tau) {
     click_chatter("SR2ETTStat %s: %s has changed its link tau from %u to %u; clearing probe info",
 		  name().c_str(), ip.unparse().c_str(), l->_tau, tau);
-    l->_probes.clear();
+    l->clear_probes();
   }
 
   if (ntohl(lp->_sent) < (unsigned)l->_sent) {
@@ -530,7 +530,7 @@ SR2ETTStat::simple_action(Packet *p)
 		  click_chatter("SR2ETTStat %s: %s has reset; clearing probe info",
 				name().c_str(), ip.unparse().c_str());
 	  }
-    l->_probes.clear();
+    l->clear_probes();
   }
   
   SR2RateSize rs = SR2RateSize(rate, ntohs(lp->_size));
@@ -539,13 +539,16 @@ SR2ETTStat::simple_action(Packet *p)
   l->_sent = ntohl(lp->_sent);
   l->_last_rx = now;
   l->_num_probes = ntohl(lp->_num_probes);
-  l->_probes.push_back(probe);
+  l->add_probe(probe);
   l->_seq = ntohl(probe._seq);
 
   /* keep stats for at least the averaging period */
-  while ((unsigned) l->_probes.size() &&
-	 now.sec() - l->_probes[0]._when.sec() > (signed) (1 + (l->_tau / 1000)))
-    l->_probes.pop_front();
+  for (int w = 0; w < l->_windows.size(); w++) {
+    probe_window_t &pw = l->_windows[w];
+    while ((unsigned) pw._probes.size() &&
+	   now.sec() - pw._probes[0]._when.sec() > (signed) (1 + (l->_tau / 1000)))
+      pw.pop();
+  }
   
 
   
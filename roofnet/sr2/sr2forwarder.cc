@@ -35,7 +35,12 @@ SR2Forwarder::SR2Forwarder()
      _et(0),
      _datas(0), 
      _databytes(0),
-     _arp_table(0)
+     _arp_table(0),
+     _encap_next(0),
+     _encap_timer(this),
+     _encap_epoch(0),
+     _encap_hits(0),
+     _encap_misses(0)
 {
 }
 
@@ -47,11 +52,13 @@ int
 SR2Forwarder::configure (Vector<String> &conf, ErrorHandler *errh)
 {
 	int res;
+	uint32_t encap_timeout = 1000;
 	res = cp_va_kparse(conf, this, errh,
 			   "ETHTYPE", 0, cpUnsignedShort, &_et,
 			   "IP", 0, cpIPAddress, &_ip,
 			   "ETH", 0, cpEtherAddress, &_eth,
 			   "ARP", 0, cpElement, &_arp_table,
+			   "ENCAP_TIMEOUT", 0, cpUnsigned, &encap_timeout,
 			   cpEnd);
 	
 	if (!_et) 
@@ -69,68 +76,115 @@ SR2Forwarder::configure (Vector<String> &conf, ErrorHandler *errh)
 	if (res < 0) {
 		return res;
 	}
+	if (!encap_timeout)
+		return errh->error("ENCAP_TIMEOUT must be positive");
+	_encap_timeout = encap_timeout;
 	return res;
 }
 
 int
 SR2Forwarder::initialize (ErrorHandler *)
 {
+	_encap_order.resize(MAX_ENCAPS);
+	_encap_timer.initialize(this);
+	_encap_timer.schedule_after_msec(_encap_timeout);
 	return 0;
 }
 
-Packet *
-SR2Forwarder::encap(Packet *p_in, Vector<IPAddress> r, int flags)
+void
+SR2Forwarder::run_timer(Timer *)
+{
+	_encap_epoch++;
+	_encap_timer.schedule_after_msec(_encap_timeout);
+}
+
+bool
+SR2Forwarder::build_encap(const Path &r, EncapInfo *e)
 {
-	assert(r.size() > 1);
 	int hops = r.size() - 1;
-	unsigned extra = sr2packet::len_wo_data(hops) + sizeof(click_ether);
-	unsigned payload_len = p_in->length();
+	unsigned len = sr2packet::len_wo_data(hops) + sizeof(click_ether);
 	uint16_t ether_type = htons(_et);
 
-	WritablePacket *p = p_in->push(extra);
-	
-	assert(extra + payload_len == p_in->length());
-	
-	
 	int next = index_of(r, _ip) + 1;
 	if (next < 0 || next >= r.size()) {
 		click_chatter("SR2Forwarder %s: encap couldn't find %s (%d) in path %s",
 			      name().c_str(), _ip.unparse().c_str(),
 			      next, path_to_string(r).c_str());
-		p_in->kill();
-		return (0);
+		return false;
 	}
-	EtherAddress eth_dest = _arp_table->lookup(r[next]);
-	if (eth_dest.is_group()) {
+	e->_dst = _arp_table->lookup(r[next]);
+	if (e->_dst.is_group()) {
 		click_chatter("SR2Forwarder %s: arp lookup failed for %s",
 			      name().c_str(), r[next].unparse().c_str());
 	}
-	
-	memcpy(p->data(), eth_dest.data(), 6);
-	memcpy(p->data() + 6, _eth.data(), 6);
-	memcpy(p->data() + 12, &ether_type, 2);	
-	
-	struct sr2packet *pk = (struct sr2packet *) (p->data() + sizeof(click_ether));
+
+	e->_header.resize(len);
+	unsigned char *h = &e->_header[0];
+	memcpy(h, e->_dst.data(), 6);
+	memcpy(h + 6, _eth.data(), 6);
+	memcpy(h + 12, &ether_type, 2);
+
+	struct sr2packet *pk = (struct sr2packet *) (h + sizeof(click_ether));
 	memset(pk, '\0', sr2packet::len_wo_data(hops));
-	
+
 	pk->_version = _sr2_version;
 	pk->_type = SR2_PT_DATA;
-	pk->set_data_len(payload_len);
-	
 	pk->set_num_links(hops);
 	pk->set_next(next);
-	pk->set_flag(flags);
 	int i;
 	for (i = 0; i < hops; i++) {
 		pk->set_link_node(i, r[i]);
 	}
-	
 	pk->set_link_node(hops, r[r.size()-1]);
 	pk->set_data_seq(0);
 
+	e->_epoch = _encap_epoch;
+	return true;
+}
+
+Packet *
+SR2Forwarder::encap(Packet *p_in, const Path &r, int flags)
+{
+	assert(r.size() > 1);
+
+	EncapInfo *e = _encaps.findp(r);
+	if (!e) {
+		/* the new route takes the oldest route's slot */
+		Path &slot = _encap_order[_encap_next];
+		if (slot.size()) {
+			_encaps.remove(slot);
+		}
+		slot = r;
+		_encap_next = (_encap_next + 1) % MAX_ENCAPS;
+		_encaps.insert(r, EncapInfo());
+		e = _encaps.findp(r);
+	}
+	if (!e->_header.size() || e->_dst.is_group() ||
+	    e->_epoch != _encap_epoch) {
+		_encap_misses++;
+		if (!build_encap(r, e)) {
+			p_in->kill();
+			return (0);
+		}
+	} else {
+		_encap_hits++;
+	}
+
+	unsigned extra = e->_header.size();
+	unsigned payload_len = p_in->length();
+	WritablePacket *p = p_in->push(extra);
+	if (!p) {
+		return (0);
+	}
+	memcpy(p->data(), &e->_header[0], extra);
+
+	struct sr2packet *pk = (struct sr2packet *) (p->data() + sizeof(click_ether));
+	pk->set_data_len(payload_len);
+	pk->set_flag(flags);
+
 	/* set the ip header anno */
 	const click_ip *ip = reinterpret_cast<const click_ip *>
-		(p->data() + pk->hlen_wo_data() + sizeof(click_ether));
+		(p->data() + extra);
 	p->set_ip_header(ip, sizeof(click_ip));
 	return p;
 }
@@ -205,7 +259,8 @@ SR2Forwarder::push(int port, Packet *p_in)
 String
 SR2Forwarder::print_stats()
 {
-	return String(_datas) + " datas sent\n" + String(_databytes) + " bytes of data sent\n";
+	return String(_datas) + " datas sent\n" + String(_databytes) + " bytes of data sent\n" +
+		String(_encap_hits) + " encap cache hits\n" + String(_encap_misses) + " encap cache misses\n";
 }
 
 enum { H_STATS };
@@ -5,6 +5,8 @@
 #include <click/timer.hh>
 #include <click/ipaddress.hh>
 #include <click/etheraddress.hh>
+#include <click/timestamp.hh>
+#include <click/hashmap.hh>
 #include <elements/wifi/linktable.hh>
 #include <click/vector.hh>
 #include <elements/wifi/path.hh>
@@ -14,7 +16,7 @@ CLICK_DECLS
 =c
 
 SR2Forwarder(ETHERTYPE, IP, ETH, ARPTable element, LT LinkTable element
-    [ETT element], [METRIC GridGenericMetric] )
+    [ETT element], [METRIC GridGenericMetric], [ENCAP_TIMEOUT msecs] )
 
 =s Roofnet
 
@@ -53,8 +55,9 @@ class SR2Forwarder : public Element {
   String print_routes();
 
   void push(int, Packet *);
+  void run_timer(Timer *);
   
-  Packet *encap(Packet *, Vector<IPAddress>, int flags);
+  Packet *encap(Packet *, const Path &, int flags);
   IPAddress ip() { return _ip; }
 private:
 
@@ -69,16 +72,35 @@ private:
   class LinkTable *_link_table;
   class ARPTable *_arp_table;
   
-  class PathInfo {
+  /*
+   * Ethernet and source-route headers for encap, built once per route
+   * with data length, flags and data seq left at 0.  _encap_timer bumps
+   * _encap_epoch every ENCAP_TIMEOUT, and a header built in an earlier
+   * epoch is rebuilt in case the next hop's ARP entry changed; it is
+   * also rebuilt on every use while ARP has no entry for it.  Once
+   * MAX_ENCAPS routes are cached, a new route replaces the oldest,
+   * found in the _encap_order ring.  Routes reach encap() as hop
+   * lists, so the table is keyed on the Path.
+   */
+  class EncapInfo {
   public:
-    Path _p;
-    int _seq;
-    void reset() { _seq = 0; }
-    PathInfo() :  _p() { reset(); }
-    PathInfo(Path p) :  _p(p)  { reset(); }
+    Vector<unsigned char> _header;
+    EtherAddress _dst;
+    uint32_t _epoch;
+    EncapInfo() : _epoch(0) { }
   };
-  typedef HashMap<Path, PathInfo> PathTable;
-  PathTable _paths;
+  typedef HashMap<Path, EncapInfo> EncapTable;
+  EncapTable _encaps;
+  Vector<Path> _encap_order;
+  int _encap_next;
+  Timer _encap_timer;
+  uint32_t _encap_timeout;	// msecs
+  uint32_t _encap_epoch;
+  int _encap_hits;
+  int _encap_misses;
+
+  enum { MAX_ENCAPS = 256 };
+  bool build_encap(const Path &, EncapInfo *);
 
   static String read_handler(Element *, void *);
 };
@@ -126,6 +126,10 @@ private:
   bool _is_gw;
 
   class LinkTable *_link_table;
+  class SRRouteEngine *_route_engine;
+
+  Path best_route(IPAddress ip, bool from_me);
+  unsigned route_metric(const Path &p);
   class ARPTable *_arp_table;
   Timer _timer;
 
@@ -24,6 +24,7 @@
 #include <click/straccum.hh>
 #include <clicknet/ether.h>
 #include "sr2packet.hh"
+#include "../sr/srrouteengine.hh"
 CLICK_DECLS
 
 
@@ -33,6 +34,7 @@ SR2QueryForwarder::SR2QueryForwarder()
      _en(),
      _et(0),
      _link_table(0),
+     _route_engine(0),
      _arp_table(0)
 {
 
@@ -66,6 +68,7 @@ SR2QueryForwarder::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "ARP", 0, cpElement, &_arp_table,
 		     /* below not required */
 		     "DEBUG", 0, cpBool, &_debug,
+		     "ROUTES", 0, cpElement, &_route_engine,
 		     cpEnd);
 
   if (!_et) 
@@ -83,6 +86,8 @@ SR2QueryForwarder::configure (Vector<String> &conf, ErrorHandler *errh)
 
   if (_link_table->cast("LinkTable") == 0) 
     return errh->error("LinkTable element is not a LinkTable");
+  if (_route_engine && _route_engine->cast("SRRouteEngine") == 0) 
+    return errh->error("ROUTES element is not a SRRouteEngine");
   if (_arp_table->cast("ARPTable") == 0) 
     return errh->error("ARPTable element is not a ARPTable");
 
@@ -114,7 +119,9 @@ SR2QueryForwarder::update_link(IPAddress from, IPAddress to,
   if (!from || !to || !metric) {
     return false;
   }
-  if (_link_table && !_link_table->update_link(from, to, seq, age, metric)) {
+  if (_route_engine
+      ? !_route_engine->update_link(from, to, seq, age, metric)
+      : _link_table && !_link_table->update_link(from, to, seq, age, metric)) {
     click_chatter("%{element} couldn't update link %s > %d > %s\n",
 		  this,
 		  from.unparse().c_str(),
@@ -125,6 +132,14 @@ SR2QueryForwarder::update_link(IPAddress from, IPAddress to,
   return true;
 }
 
+Path
+SR2QueryForwarder::best_route(IPAddress ip, bool from_me)
+{
+  if (_route_engine)
+    return _route_engine->best_route(ip, from_me);
+  return _link_table->best_route(ip, from_me);
+}
+
 // Continue flooding a query by broadcast.
 // Maintain a list of querys we've already seen.
 void
@@ -192,7 +207,8 @@ SR2QueryForwarder::forward_query(Seen *s)
 {
 
   s->_forwarded = true;
-  _link_table->dijkstra(false);
+  if (!_route_engine)
+    _link_table->dijkstra(false);
   if (0) {
     StringAccum sa;
     sa << (Timestamp::now() - s->_when);
@@ -203,7 +219,7 @@ SR2QueryForwarder::forward_query(Seen *s)
   }
 
   IPAddress src = s->_src;
-  Path best = _link_table->best_route(src, false);
+  Path best = best_route(src, false);
   bool best_valid = _link_table->valid_route(best);
 
   if (!best_valid) {
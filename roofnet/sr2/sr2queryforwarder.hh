@@ -96,6 +96,9 @@ class SR2QueryForwarder : public Element {
   EtherAddress _bcast;
 
   class LinkTable *_link_table;
+  class SRRouteEngine *_route_engine;
+
+  Path best_route(IPAddress ip, bool from_me);
   class ARPTable *_arp_table;
 
   bool _debug;
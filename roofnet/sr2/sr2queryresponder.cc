@@ -24,6 +24,7 @@
 #include <click/straccum.hh>
 #include <clicknet/ether.h>
 #include "sr2packet.hh"
+#include "../sr/srrouteengine.hh"
 CLICK_DECLS
 
 
@@ -33,6 +34,7 @@ SR2QueryResponder::SR2QueryResponder()
      _en(),
      _et(0),
      _link_table(0),
+     _route_engine(0),
      _arp_table(0)
 {
 }
@@ -54,6 +56,7 @@ SR2QueryResponder::configure (Vector<String> &conf, ErrorHandler *errh)
 		     "ARP", 0, cpElement, &_arp_table,
 		     /* below not required */
 		     "DEBUG", 0, cpBool, &_debug,
+		     "ROUTES", 0, cpElement, &_route_engine,
 		     cpEnd);
 
   if (!_et) 
@@ -70,6 +73,8 @@ SR2QueryResponder::configure (Vector<String> &conf, ErrorHandler *errh)
 
   if (_link_table->cast("LinkTable") == 0) 
     return errh->error("LinkTable element is not a LinkTable");
+  if (_route_engine && _route_engine->cast("SRRouteEngine") == 0) 
+    return errh->error("ROUTES element is not a SRRouteEngine");
   if (_arp_table->cast("ARPTable") == 0) 
     return errh->error("ARPTable element is not a ARPTable");
 
@@ -106,7 +111,9 @@ SR2QueryResponder::send(WritablePacket *p)
 
 bool
 SR2QueryResponder::update_link(IPAddress from, IPAddress to, uint32_t seq, int metric) {
-  if (_link_table && !_link_table->update_link(from, to, seq, 0, metric)) {
+  if (_route_engine
+      ? !_route_engine->update_link(from, to, seq, 0, metric)
+      : _link_table && !_link_table->update_link(from, to, seq, 0, metric)) {
     click_chatter("%{element} couldn't update link %s > %d > %s\n",
 		  this,
 		  from.unparse().c_str(),
@@ -117,6 +124,14 @@ SR2QueryResponder::update_link(IPAddress from, IPAddress to, uint32_t seq, int m
   return true;
 }
 
+Path
+SR2QueryResponder::best_route(IPAddress ip, bool from_me)
+{
+  if (_route_engine)
+    return _route_engine->best_route(ip, from_me);
+  return _link_table->best_route(ip, from_me);
+}
+
 // Continue unicasting a reply packet.
 void
 SR2QueryResponder::forward_reply(struct sr2packet *pk1)
@@ -124,7 +139,8 @@ SR2QueryResponder::forward_reply(struct sr2packet *pk1)
 	uint8_t type = pk1->_type;
 	assert(type == SR2_PT_REPLY);
 	
-  _link_table->dijkstra(true);
+  if (!_route_engine)
+    _link_table->dijkstra(true);
   if (_debug) {
     click_chatter("%{element}: forward_reply %s <- %s\n", 
 		  this,
@@ -163,8 +179,9 @@ SR2QueryResponder::forward_reply(struct sr2packet *pk1)
 void 
 SR2QueryResponder::start_reply(IPAddress src, IPAddress qdst, uint32_t seq)
 {
-  _link_table->dijkstra(false);
-  Path best = _link_table->best_route(src, false);
+  if (!_route_engine)
+    _link_table->dijkstra(false);
+  Path best = best_route(src, false);
   bool best_valid = _link_table->valid_route(best);
 
   
@@ -255,7 +272,8 @@ SR2QueryResponder::got_reply(struct sr2packet *pk)
 			      _ip.unparse().c_str(),
 			      dst.unparse().c_str());
 	}
-	_link_table->dijkstra(true);
+	if (!_route_engine)
+	  _link_table->dijkstra(true);
 }
 
 
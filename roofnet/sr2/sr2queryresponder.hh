@@ -73,6 +73,9 @@ class SR2QueryResponder : public Element {
   Deque<Seen> _seen;
 
   class LinkTable *_link_table;
+  class SRRouteEngine *_route_engine;
+
+  Path best_route(IPAddress ip, bool from_me);
   class ARPTable *_arp_table;
 
   bool _debug;
@@ -0,0 +1,105 @@
+#ifndef CLICK_TIMERWHEEL_HH
+#define CLICK_TIMERWHEEL_HH
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+ * TimerWheel<K, NSLOTS>: hashed timer wheel of (key, deadline) entries
+ *
+ * Roofnet elements that run many timers off one Timer keep their
+ * deadlines here.  It is header-only, so users need no ELEMENT_REQUIRES.
+ *
+ * Deadlines are in whatever unit the caller advances the wheel in.  A
+ * deadline goes in slot ceil(deadline / tick) mod NSLOTS, so it is due
+ * by the time its slot runs; one already due goes in the next slot to
+ * run.  Deadlines more than a turn away stay in their slot for later
+ * turns.  Entries are never removed early: restarting a timer schedules
+ * a new entry, and the caller ignores the old one when it comes due and
+ * no longer matches its records.  Scheduling is O(1), and an entry is
+ * looked at once per turn until it is due.
+ */
+
+template <typename K, int NSLOTS>
+class TimerWheel {
+ public:
+
+  struct Entry {
+	K key;
+	uint64_t deadline;
+  };
+
+  TimerWheel() : _tick(1), _last(0), _pending(0) { }
+
+  // Drop every entry and start counting ticks at now.
+  void initialize(uint32_t tick, uint64_t now);
+  void schedule(const K &key, uint64_t deadline);
+
+  // Append every entry due at or before now to due.
+  void advance(uint64_t now, Vector<Entry> &due);
+
+  uint32_t tick() const		{ return _tick; }
+  uint32_t pending() const	{ return _pending; }
+
+ private:
+
+  Vector<Entry> _slots[NSLOTS];
+  uint32_t _tick;
+  uint64_t _last;              // last tick advanced over
+  uint32_t _pending;
+
+  void run_slot(Vector<Entry> &slot, uint64_t now, Vector<Entry> &due);
+};
+
+template <typename K, int NSLOTS> void
+TimerWheel<K, NSLOTS>::initialize(uint32_t tick, uint64_t now)
+{
+  for (int i = 0; i < NSLOTS; i++)
+	_slots[i].clear();
+  _tick = tick ? tick : 1;
+  _last = now / _tick;
+  _pending = 0;
+}
+
+template <typename K, int NSLOTS> void
+TimerWheel<K, NSLOTS>::schedule(const K &key, uint64_t deadline)
+{
+  uint64_t t = deadline / _tick + (deadline % _tick != 0);
+  if (t <= _last)
+	t = _last + 1;
+  Entry e;
+  e.key = key;
+  e.deadline = deadline;
+  _slots[t % NSLOTS].push_back(e);
+  _pending++;
+}
+
+template <typename K, int NSLOTS> void
+TimerWheel<K, NSLOTS>::run_slot(Vector<Entry> &slot, uint64_t now, Vector<Entry> &due)
+{
+  int keep = 0;
+  for (int i = 0; i < slot.size(); i++)
+	if (slot[i].deadline <= now)
+	  due.push_back(slot[i]);
+	else
+	  slot[keep++] = slot[i];
+  _pending -= slot.size() - keep;
+  slot.resize(keep);
+}
+
+template <typename K, int NSLOTS> void
+TimerWheel<K, NSLOTS>::advance(uint64_t now, Vector<Entry> &due)
+{
+  uint64_t t = now / _tick;
+  if (t <= _last)
+	return;
+  // a stall longer than a turn still runs each slot only once
+  uint64_t n = t - _last;
+  if (n > NSLOTS)
+	n = NSLOTS;
+  for (uint64_t i = 1; i <= n; i++)
+	run_slot(_slots[(t - n + i) % NSLOTS], now, due);
+  _last = t;
+}
+
+CLICK_ENDDECLS
+#endif
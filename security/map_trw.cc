@@ -30,10 +30,31 @@
 #include "trw_packet_utils.hh"
 #include <clicknet/ether.h>
 #include <click/etheraddress.hh>
+#if CLICK_USERLEVEL
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <stdio.h>
+# include <errno.h>
+# include <sys/wait.h>
+#endif
 
 #define FIND_SRC 0
 #define FIND_DST 1
 
+// Table layout.  Sets and tables are aligned to TRW_CACHE_LINE, and
+// tables of at least TRW_HUGE_TABLE bytes may be backed by huge pages.
+#define TRW_CACHE_LINE 64
+#define TRW_HUGE_PAGE (2 * 1024 * 1024)
+#define TRW_HUGE_TABLE (1024 * 1024)
+
+#if defined(__GNUC__)
+# define TRW_PREFETCH(addr) __builtin_prefetch((addr), 1)
+#else
+# define TRW_PREFETCH(addr) ((void) (addr))
+#endif
+
 
 // This is for the map of the LOCAL area network.
 struct map_record {
@@ -106,12 +127,59 @@ struct con_record {
 };
 
 
+// The checkpoint format.  A header, then one trw_state_ip for every
+// valid IP table entry, the raw connection table, and one
+// trw_state_map per network map entry.  Everything is in host byte
+// order; a checkpoint from a machine of the other endianness fails
+// the magic check.
+#define TRW_STATE_MAGIC 0x54525753U   // "TRWS"
+#define TRW_STATE_VERSION 1
+
+struct trw_state_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rc5_seed;
+    uint32_t ip_table_size;
+    uint32_t ip_table_assoc;
+    uint32_t ip_records;      // trw_state_ip records that follow
+    uint32_t con_table_size;
+    uint32_t map_size;
+    uint32_t map_prefix;      // network byte order
+    uint32_t map_mask;        // network byte order
+    uint32_t last_time;
+    uint32_t last_map;
+};
+
+// IP records are stored by full encrypted address, so they can be
+// rehashed into a table of different associativity, or decrypted and
+// re-encrypted under a different key.
+struct trw_state_ip {
+    uint32_t ip_hash;
+    int8_t count;
+    int8_t passive_count;
+    uint8_t timestamp;
+    uint8_t pad;
+};
+
+struct trw_state_map {
+    uint32_t map_ip;
+    uint32_t last_valid;
+    uint8_t map_eth[6];
+    uint8_t port;
+    uint8_t flags;            // 1: passive_update, 2: arp_whitelist
+};
 
 
 CLICK_DECLS
 
 MapTRW::MapTRW()
+    : ip_table(0), con_table(0),
+      ip_table_mem(0), ip_table_mem_size(0), ip_table_mapped(false),
+      con_table_mem(0), con_table_mem_size(0), con_table_mapped(false),
+      arp_map(0), _checkpoint_interval(0), _checkpoint_timer(this),
+      _checkpoint_pid(0)
 {
+    reset_stats();
     // MOD_INC_USE_COUNT;
 }
 
@@ -158,9 +226,11 @@ MapTRW::handle_arp(int port, Packet *p){
 
 	uint32_t src_hash = rc5_encrypt((uint32_t) src, rc5_key);
 	uint32_t dst_hash = rc5_encrypt((uint32_t) dst, rc5_key);
+	uint32_t src_con_index = con_index(NULL, src_hash, dst_hash, FIND_SRC);
+	prefetch_ip(src_hash);
+	TRW_PREFETCH(&con_table[src_con_index]);
 	struct ip_record *src_record = find_ip(src_hash);
-	struct con_record *src_con = find_con(NULL,src_hash,
-					      dst_hash,FIND_SRC);
+	struct con_record *src_con = find_con(src_con_index);
 
 	if(src_con->status & 0x1){
 	    // arp already seen, ignoring.
@@ -173,7 +243,9 @@ MapTRW::handle_arp(int port, Packet *p){
 		src_con->status = src_con->status | 0x4;
 		src_record->count += 1;
 	    }
-	    click_chatter("Dropping ARP scan attempt\n");
+	    _drops++;
+	    if(!quiet)
+		click_chatter("Dropping ARP scan attempt\n");
 	    if(noutputs() == 4){
 		output(port + 2).push(p);
 	    } else {
@@ -191,9 +263,11 @@ MapTRW::handle_arp(int port, Packet *p){
 	      ntohs(ea->ea_hdr.ar_op) == ARPOP_REPLY) {
 	uint32_t src_hash = rc5_encrypt((uint32_t) src, rc5_key);
 	uint32_t dst_hash = rc5_encrypt((uint32_t) dst, rc5_key);
+	uint32_t dst_con_index = con_index(NULL, src_hash, dst_hash, FIND_DST);
+	prefetch_ip(dst_hash);
+	TRW_PREFETCH(&con_table[dst_con_index]);
 	struct ip_record *dst_record = find_ip(dst_hash);
-	struct con_record *dst_con = find_con(NULL,src_hash,
-					      dst_hash,FIND_DST);
+	struct con_record *dst_con = find_con(dst_con_index);
 	if(dst_con->status & 0x2){
 
 	} else {
@@ -203,7 +277,8 @@ MapTRW::handle_arp(int port, Packet *p){
     }
 
     else {
-	click_chatter("Ignoring non request/response ARP packet");
+	if(!quiet)
+	    click_chatter("Ignoring non request/response ARP packet");
     }
 
 
@@ -327,6 +402,7 @@ MapTRW::push(int port, Packet *p)
     const Timestamp ts = p->timestamp_anno();
     click_ether *e = (click_ether *) p->data();
     click_ether_arp *ea = (click_ether_arp *) (e + 1);
+    _packets++;
     if (last_time == 0 || last_time < (((unsigned) ts.sec()) / 60)){
 	last_time = (((unsigned) ts.sec()) / 60);
     }
@@ -346,7 +422,8 @@ MapTRW::push(int port, Packet *p)
     }
 
     if (!iph) {
-	click_chatter("Not an IP packet.  Dropping\n");
+	if(!quiet)
+	    click_chatter("Not an IP packet.  Dropping\n");
         if(noutputs() == 4){
             output(port + 2).push(p);
         } else {
@@ -361,10 +438,12 @@ MapTRW::push(int port, Packet *p)
     IPAddress dst(iph->ip_dst.s_addr);
 
     if(supress_broadcast(port, p)){
-	StringAccum sa;
-	sa << "Ignored broadcast from " << src << " to " << dst
-	   << " from port " << port << '\0';
-	click_chatter("%s", sa.data());
+	if(!quiet){
+	    StringAccum sa;
+	    sa << "Ignored broadcast from " << src << " to " << dst
+	       << " from port " << port << '\0';
+	    click_chatter("%s", sa.data());
+	}
 	output(port).push(p);
 	return;
     }
@@ -373,11 +452,21 @@ MapTRW::push(int port, Packet *p)
 
     uint32_t src_hash = rc5_encrypt((uint32_t) src, rc5_key);
     uint32_t dst_hash = rc5_encrypt((uint32_t) dst, rc5_key);
+    uint32_t src_con_index = con_index(p, src_hash, dst_hash, FIND_SRC);
+    uint32_t dst_con_index = con_index(p, src_hash, dst_hash, FIND_DST);
+
+    // All four buckets are known now, so get the misses going in
+    // parallel rather than taking them one lookup at a time.
+    prefetch_ip(src_hash);
+    prefetch_ip(dst_hash);
+    TRW_PREFETCH(&con_table[src_con_index]);
+    TRW_PREFETCH(&con_table[dst_con_index]);
+
     struct ip_record *src_record = find_ip(src_hash);
     struct ip_record *dst_record = find_ip(dst_hash);
 
-    struct con_record *src_con = find_con(p,src_hash,dst_hash,FIND_SRC);
-    struct con_record *dst_con = find_con(p,src_hash,dst_hash,FIND_DST);
+    struct con_record *src_con = find_con(src_con_index);
+    struct con_record *dst_con = find_con(dst_con_index);
 
     bool drop = false;
     // Already allowed packet in this direction
@@ -416,6 +505,7 @@ MapTRW::push(int port, Packet *p)
 		    }
 		    if(dst_record->count < ip_table_block_count &&
 		       !(dst_record->count + 2 < ip_table_block_count)){
+			_unblocks++;
 			StringAccum sa;
 			sa << dst << '\0';
 			click_chatter("Now Unblocking IP %s (count)",
@@ -460,6 +550,7 @@ MapTRW::push(int port, Packet *p)
 		// IP not being blocked, so this is OK, but INCR the count
 		src_record->count = src_record->count + 1;
 		if(src_record->count == ip_table_block_count){
+		    _blocks++;
 		    StringAccum sa;
 		    sa << src << '\0';
 		    click_chatter("Now Blocking IP %s\n",
@@ -481,7 +572,9 @@ MapTRW::push(int port, Packet *p)
     }
 
     if(drop){
-	click_chatter("Dropping packet");
+	_drops++;
+	if(!quiet)
+	    click_chatter("Dropping packet");
 	if(noutputs() == 4){
 	    output(port + 2).push(p);
 	} else{
@@ -498,6 +591,15 @@ struct con_record *MapTRW::find_con(Packet *p,
 				       uint32_t src_hash, 
 				       uint32_t dst_hash,
 				       int direction){
+    return find_con(con_index(p, src_hash, dst_hash, direction));
+}
+
+// Computes the connection table index without touching the table,
+// so the caller can prefetch the record before using it.
+uint32_t MapTRW::con_index(Packet *p,
+			   uint32_t src_hash,
+			   uint32_t dst_hash,
+			   int direction){
     uint32_t proto_hash;
     if(p == NULL){
 	proto_hash = rc5_encrypt(3,rc5_key);
@@ -522,22 +624,24 @@ struct con_record *MapTRW::find_con(Packet *p,
 	    proto_hash = rc5_encrypt(2,rc5_key);
 	}
     }
-    int index;
     if(direction == FIND_SRC){
-	index = ((src_hash << 2) ^
-		 (src_hash >> 30) ^ 
-		 dst_hash ^ proto_hash) % con_table_size;
+	return ((src_hash << 2) ^
+		(src_hash >> 30) ^ 
+		dst_hash ^ proto_hash) & con_table_mask;
     }
     else {
-	index = (src_hash ^ 
-		 (dst_hash << 2) ^
-		 (dst_hash >> 30) ^ proto_hash) % con_table_size;
+	return (src_hash ^ 
+		(dst_hash << 2) ^
+		(dst_hash >> 30) ^ proto_hash) & con_table_mask;
     }
+}
 
+struct con_record *MapTRW::find_con(uint32_t index){
     if( ((uint8_t) last_time) - con_table[index].timestamp 
 	>= ((uint8_t) con_table_maxage)){  
 	if(con_table[index].status) {
 	    // click_chatter("Table aged.  Clearing status\n");
+	    _con_expired++;
 	}
 	con_table[index].status = 0;
     }
@@ -546,6 +650,21 @@ struct con_record *MapTRW::find_con(Packet *p,
 }
 
 
+// The start of associative set ip_index.  Sets are ip_set_stride
+// bytes apart, which may include padding after the last record.
+inline struct ip_record *MapTRW::ip_set(uint32_t ip_index) const {
+    return (struct ip_record *) (((unsigned char *) ip_table)
+				 + ip_index * ip_set_stride);
+}
+
+void MapTRW::prefetch_ip(uint32_t ip_encrypted) const {
+    const unsigned char *set = 
+	(const unsigned char *) ip_set(ip_encrypted & ip_addr_index_mask);
+    for(unsigned off = 0; off < ip_set_stride; off += TRW_CACHE_LINE){
+	TRW_PREFETCH(set + off);
+    }
+}
+
 // Performs the lookup for the IP in the ip table.  Note
 // that because of the use of encrypted indexing for the lookup,
 // host or byte order DOES NOT MATTER as long as it is consistant
@@ -553,37 +672,38 @@ struct con_record *MapTRW::find_con(Packet *p,
 struct ip_record *MapTRW::find_ip(uint32_t ip_encrypted){
     uint32_t ip_index = ip_encrypted & ip_addr_index_mask; 
     uint16_t ip_tag   = (uint16_t) (ip_encrypted >> ip_addr_tag_shift);
+    struct ip_record *set = ip_set(ip_index);
     int i;
     // uint32_t ip = rc5_decrypt(ip_encrypted,rc5_key);
     // click_chatter("IP is %8x, encrypted %8x, index %8x, tag %4x\n",
     // ip, ip_encrypted, ip_index, (uint32_t) ip_tag);
     for(i = 0; i < (int) ip_table_assoc; ++i){
-	const int at_index = ip_index * ip_table_assoc + i;
-	if(ip_table[at_index].ip_tag == ip_tag){
-	    if(ip_table[at_index].count == -128){
-		ip_table[at_index].count = 0;
-		ip_table[at_index].timestamp = (uint8_t) last_time;
+	if(set[i].ip_tag == ip_tag){
+	    if(set[i].count == -128){
+		set[i].count = 0;
+		set[i].timestamp = (uint8_t) last_time;
 	    }
 	    // click_chatter("Found IP %x", 
 	    // rc5_decrypt(ip_encrypted, rc5_key));
-	    if(ip_table[at_index].count < 0){
-		if(((uint8_t) last_time) - ip_table[at_index].timestamp
+	    if(set[i].count < 0){
+		if(((uint8_t) last_time) - set[i].timestamp
 		   > (uint8_t) ip_table_incr_age){
-		    ip_table[at_index].timestamp += 
+		    set[i].timestamp += 
 			ip_table_incr_age;
-		    ip_table[at_index].count += 1;
+		    set[i].count += 1;
 		    // click_chatter("Incrementing count for aging\n");
 		    // Cheat and handle multiple agings by doing
 		    // a recursive call.
 		    return find_ip(ip_encrypted);
 		}
-	    } else if(ip_table[at_index].count > 0){
-		if(((uint8_t) last_time) - ip_table[at_index].timestamp
+	    } else if(set[i].count > 0){
+		if(((uint8_t) last_time) - set[i].timestamp
 		   > (uint8_t) ip_table_decr_age){
-		    ip_table[at_index].timestamp += 
+		    set[i].timestamp += 
 			ip_table_incr_age;
-		    ip_table[at_index].count += -1;
-                    if(ip_table[at_index].count + 1 == ip_table_block_count){
+		    set[i].count += -1;
+                    if(set[i].count + 1 == ip_table_block_count){
+			_unblocks++;
                         click_chatter("Now Unblocking IP (age)");
 		    }
 
@@ -593,43 +713,44 @@ struct ip_record *MapTRW::find_ip(uint32_t ip_encrypted){
 		    return find_ip(ip_encrypted);
 		}
 	    }
-	    return &(ip_table[at_index]);
+	    return &(set[i]);
 	}
     }
     for(i = 0; i < (int) ip_table_assoc; ++i){
-	const int at_index = ip_index * ip_table_assoc + i;
-	if(ip_table[at_index].count == -128){
-	    ip_table[at_index].count = 0;
-	    ip_table[at_index].ip_tag = ip_tag;
-	    ip_table[at_index].timestamp = 
+	if(set[i].count == -128){
+	    set[i].count = 0;
+	    set[i].ip_tag = ip_tag;
+	    set[i].timestamp = 
 		(uint8_t) last_time;
+	    _ip_allocs++;
 	    // click_chatter("Allocated new IP %x", 
 	    // rc5_decrypt(ip_encrypted, rc5_key));
-	    return &(ip_table[at_index]);
+	    return &(set[i]);
 	}
     }
     int min = 127;
     int min_index = 0;
     for(i = 0; i < (int) ip_table_assoc; ++i){
-	if(ip_table[ip_index * ip_table_assoc + i].count < min){
-	    min = ip_table[ip_index * ip_table_assoc + i].count;
+	if(set[i].count < min){
+	    min = set[i].count;
 	    min_index = i;
 	}
     }
-    int evict_index = ip_index * ip_table_assoc + min_index;
+    struct ip_record *evict = &set[min_index];
     //    click_chatter("Evicting entry for IP %x, count %i, index %i",
     // rc5_decrypt((((uint32_t) 
-    // ip_table[evict_index].ip_tag) 
+    // evict->ip_tag) 
     // << ip_addr_tag_shift)
     // | ip_index, rc5_key),
     // (int) 
-    // ip_table[evict_index].count,
+    // evict->count,
     // min_index);
-    ip_table[evict_index].count = 0;
-    ip_table[evict_index].ip_tag = ip_tag;
-    ip_table[evict_index].timestamp =
+    _ip_evictions++;
+    evict->count = 0;
+    evict->ip_tag = ip_tag;
+    evict->timestamp =
 	(uint8_t) last_time;
-    return &(ip_table[evict_index]);
+    return evict;
 }
 
 int
@@ -650,6 +771,10 @@ MapTRW::configure(Vector<String> &conf, ErrorHandler *errh){
     ip_table_max_count = 20;   // count shal not exceed
     ip_table_min_count = -20;  // both positive and negative
     tomato_chatter = false;
+    align_sets = true;
+    huge_pages = false;
+    _checkpoint_interval = 0;
+    quiet = false;
 
     rc5_seed = 0xCAFEBABE;
     click_chatter("Parsing Arguments\n");
@@ -662,6 +787,8 @@ MapTRW::configure(Vector<String> &conf, ErrorHandler *errh){
 
 		    "TOMATO_CHATTER", 0, cpBool, &tomato_chatter,
 
+		    "QUIET", 0, cpBool, &quiet,
+
 		    "IP_TABLE_SIZE", 0, cpUnsigned, &ip_table_size,
 		    "IP_TABLE_ASSOC", 0, cpUnsigned, &ip_table_assoc,
 		    
@@ -678,6 +805,14 @@ MapTRW::configure(Vector<String> &conf, ErrorHandler *errh){
 		    "CON_TABLE_SIZE", 0, cpUnsigned, &con_table_size,
 		    
 		    "CON_TABLE_AGE", 0, cpUnsigned, &con_table_maxage,
+
+		    "ALIGN_SETS", 0, cpBool, &align_sets,
+
+		    "HUGE_PAGES", 0, cpBool, &huge_pages,
+
+		    "STATE_FILE", 0, cpFilename, &_state_file,
+
+		    "CHECKPOINT_INTERVAL", 0, cpSeconds, &_checkpoint_interval,
 		    cpEnd
 		    ) < 0
 	
@@ -685,6 +820,10 @@ MapTRW::configure(Vector<String> &conf, ErrorHandler *errh){
 	click_chatter("Arguments Parse Failure\n");
 	return -1;
     } 
+#if !CLICK_USERLEVEL
+    if(_state_file)
+	return errh->error("STATE_FILE requires the user-level driver");
+#endif
 
     map_size = 1 << (32 - _my_mask.mask_to_prefix_len());
     arp_map = new struct map_record[map_size];
@@ -699,19 +838,6 @@ MapTRW::configure(Vector<String> &conf, ErrorHandler *errh){
     }
 
 
-    for(unsigned i = 0; i < map_size; ++i){
-	arp_map[i].last_valid = 0;
-	arp_map[i].port = 0;
-	arp_map[i].passive_update = false;
-	arp_map[i].map_ip = (uint32_t (_my_ip & _my_mask)) + htonl(i);
-	if(i == 1){
-	    arp_map[i].arp_whitelist = true;
-	} else {
-	    arp_map[i].arp_whitelist = false;
-	}
-    }
-
-
     if(ip_table_max_count <= 0 || ip_table_max_count > 120
        || ip_table_min_count >= 0 || ip_table_min_count < -120
        || ip_table_block_count > ip_table_max_count 
@@ -742,23 +868,6 @@ MapTRW::configure(Vector<String> &conf, ErrorHandler *errh){
 		  rc5_decrypt(rc5_encrypt(0xFEEDFACE, rc5_key),
 			      rc5_key));
 
-    click_chatter("Allocating space for %i entry IP table: %i bytes\n",
-		  ip_table_size, sizeof(struct ip_record) * ip_table_size);
-    ip_table = new struct ip_record[ip_table_size];
-    for(int i = 0; i < (int) ip_table_size; ++i){
-	ip_table[i].count = -128;
-    }
-    
-    click_chatter("Allocating space for %i entry connection table: %i bytes\n",
-		  con_table_size,
-		  sizeof(struct con_record) * con_table_size);
-    con_table = new struct con_record[con_table_size];
-    for(int i = 0; i < (int) con_table_size; ++i){
-	con_table[i].status = 0;
-	// Don't need to set the timestamp, as status gets properly
-	// zeroed out anyway.
-    }
-
     // The masks remove the need for mod calculations and recalculation
     // when finding the index and tag of an IP address
     ip_addr_index_mask = (ip_table_size / ip_table_assoc) - 1;
@@ -781,12 +890,604 @@ MapTRW::configure(Vector<String> &conf, ErrorHandler *errh){
 	    errh->error("Table Size / assoc must be >= 2^16. Was %i",
 			(ip_table_size / ip_table_assoc));
 
+    // A set is padded out to the next power of 2, so with 64 byte
+    // lines a set of up to 8 records sits in exactly one line.
+    ip_set_stride = sizeof(struct ip_record) * ip_table_assoc;
+    if(align_sets){
+	unsigned stride = 1;
+	while(stride < ip_set_stride)
+	    stride = stride * 2;
+	ip_set_stride = stride;
+    }
+
+    if(con_table_size < 1)
+	return errh->error("CON_TABLE_SIZE must be positive");
+    {
+	unsigned size = 1;
+	while(size * 2 <= con_table_size && size * 2 != 0)
+	    size = size * 2;
+	if(size != con_table_size)
+	    click_chatter("Rounding connection table size down to %u\n", size);
+	con_table_size = size;
+	con_table_mask = con_table_size - 1;
+    }
+
+    const unsigned ip_sets = ip_table_size / ip_table_assoc;
+    click_chatter("Allocating space for %i entry IP table: %i bytes\n",
+		  ip_table_size, ip_sets * ip_set_stride);
+    ip_table = (struct ip_record *)
+	alloc_table(ip_sets * ip_set_stride, ip_table_mem,
+		    ip_table_mem_size, ip_table_mapped);
+    if(!ip_table)
+	return errh->error("Out of memory for the IP table");
+    
+    click_chatter("Allocating space for %i entry connection table: %i bytes\n",
+		  con_table_size,
+		  sizeof(struct con_record) * con_table_size);
+    con_table = (struct con_record *)
+	alloc_table(sizeof(struct con_record) * con_table_size,
+		    con_table_mem, con_table_mem_size, con_table_mapped);
+    if(!con_table)
+	return errh->error("Out of memory for the connection table");
+    clear_tables();
+
     click_chatter("IP index mask is %x\n", ip_addr_index_mask);
     click_chatter("IP tag shift is %i\n",  ip_addr_tag_shift);
     
     click_chatter("IP table associativity is %i\n", ip_table_assoc);
+    click_chatter("IP table set stride is %i bytes\n", ip_set_stride);
+
+    return 0;
+}
+
+// Returns a table of at least bytes bytes starting on a cache line.
+// The raw allocation is returned in mem/mem_size/mem_mapped for
+// free_table.  Large tables can be put on huge pages at user level.
+unsigned char *
+MapTRW::alloc_table(size_t bytes, void *&mem, size_t &mem_size,
+		    bool &mem_mapped){
+    mem = 0;
+    mem_size = 0;
+    mem_mapped = false;
+#if CLICK_USERLEVEL && defined(MAP_ANONYMOUS)
+    if(huge_pages && bytes >= TRW_HUGE_TABLE){
+	size_t size = (bytes + TRW_HUGE_PAGE - 1) & ~((size_t) TRW_HUGE_PAGE - 1);
+	void *m = MAP_FAILED;
+# ifdef MAP_HUGETLB
+	m = mmap(0, size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+# endif
+	if(m == MAP_FAILED){
+	    // No reserved huge pages; ask for transparent ones instead.
+	    m = mmap(0, size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+# ifdef MADV_HUGEPAGE
+	    if(m != MAP_FAILED)
+		madvise(m, size, MADV_HUGEPAGE);
+# endif
+	}
+	if(m != MAP_FAILED){
+	    click_chatter("Using huge pages for %u byte table\n",
+			  (unsigned) size);
+	    mem = m;
+	    mem_size = size;
+	    mem_mapped = true;
+	    return (unsigned char *) m;
+	}
+	click_chatter("Huge pages unavailable, using normal memory\n");
+    }
+#endif
+    unsigned char *m = new unsigned char[bytes + TRW_CACHE_LINE - 1];
+    if(!m)
+	return 0;
+    mem = m;
+    mem_size = bytes + TRW_CACHE_LINE - 1;
+    uintptr_t addr = (uintptr_t) m;
+    addr = (addr + TRW_CACHE_LINE - 1) & ~((uintptr_t) TRW_CACHE_LINE - 1);
+    return (unsigned char *) addr;
+}
+
+void
+MapTRW::free_table(void *mem, size_t mem_size, bool mem_mapped){
+    if(!mem)
+	return;
+#if CLICK_USERLEVEL && defined(MAP_ANONYMOUS)
+    if(mem_mapped){
+	munmap(mem, mem_size);
+	return;
+    }
+#else
+    (void) mem_size;
+    (void) mem_mapped;
+#endif
+    delete[] (unsigned char *) mem;
+}
+
+// Empties the IP and connection tables and the network map.
+void
+MapTRW::clear_tables(){
+    const unsigned ip_sets = ip_table_size / ip_table_assoc;
+    for(unsigned index = 0; index < ip_sets; ++index){
+	struct ip_record *set = ip_set(index);
+	for(unsigned i = 0; i < ip_table_assoc; ++i){
+	    set[i].ip_tag = 0;
+	    set[i].count = -128;
+	    set[i].passive_count = 0;
+	    set[i].timestamp = 0;
+	}
+    }
+    for(int i = 0; i < (int) con_table_size; ++i){
+	con_table[i].status = 0;
+	// Don't need to set the timestamp, as status gets properly
+	// zeroed out anyway.
+    }
+    for(unsigned i = 0; i < map_size; ++i){
+	arp_map[i].last_valid = 0;
+	arp_map[i].port = 0;
+	arp_map[i].passive_update = false;
+	arp_map[i].map_ip = (uint32_t (_my_ip & _my_mask)) + htonl(i);
+	if(i == 1){
+	    arp_map[i].arp_whitelist = true;
+	} else {
+	    arp_map[i].arp_whitelist = false;
+	}
+    }
+}
+
+void
+MapTRW::cleanup(CleanupStage stage){
+    // Let a background checkpoint finish before writing the last one.
+    reap_checkpoint(true);
+    if(stage >= CLEANUP_INITIALIZED && _state_file){
+	ErrorHandler *errh = ErrorHandler::default_handler();
+	save_state(_state_file, errh);
+    }
+    free_table(ip_table_mem, ip_table_mem_size, ip_table_mapped);
+    free_table(con_table_mem, con_table_mem_size, con_table_mapped);
+    ip_table_mem = con_table_mem = 0;
+    ip_table = 0;
+    con_table = 0;
+    delete[] arp_map;
+    arp_map = 0;
+}
+
+int
+MapTRW::initialize(ErrorHandler *errh){
+#if CLICK_USERLEVEL
+    if(_state_file && access(_state_file.c_str(), F_OK) == 0){
+	if(load_state(_state_file, errh) < 0)
+	    errh->warning("starting with empty tables");
+    }
+    _checkpoint_timer.initialize(this);
+    if(_checkpoint_interval && _state_file)
+	_checkpoint_timer.schedule_after_sec(_checkpoint_interval);
+#endif
+    return 0;
+}
+
+// Periodic checkpoints are written by a forked child, which sees a
+// copy-on-write snapshot of the tables, so the forwarding path never
+// waits on the disk.  An interval is skipped if the previous
+// checkpoint is still being written.
+void
+MapTRW::run_timer(Timer *){
+#if CLICK_USERLEVEL
+    reap_checkpoint(false);
+    if(!_checkpoint_pid){
+	String tmpname = _state_file + ".tmp";
+	const char *tmp = tmpname.c_str();
+	const char *name = _state_file.c_str();
+	pid_t pid = fork();
+	if(pid == 0)
+	    _exit(write_state_file(tmp, name) < 0 ? 1 : 0);
+	else if(pid < 0)
+	    click_chatter("%s: checkpoint: fork: %s\n",
+			  declaration().c_str(), strerror(errno));
+	else
+	    _checkpoint_pid = pid;
+    } else {
+	click_chatter("%s: previous checkpoint still running, skipped\n",
+		      declaration().c_str());
+    }
+    _checkpoint_timer.reschedule_after_sec(_checkpoint_interval);
+#endif
+}
+
+// Collects a finished checkpoint child, waiting for it if wait is set.
+void
+MapTRW::reap_checkpoint(bool wait){
+#if CLICK_USERLEVEL
+    if(!_checkpoint_pid)
+	return;
+    int status;
+    pid_t r = waitpid(_checkpoint_pid, &status, wait ? 0 : WNOHANG);
+    if(r == 0)
+	return;
+    if(r < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	click_chatter("%s: checkpoint to %s failed\n",
+		      declaration().c_str(), _state_file.c_str());
+    _checkpoint_pid = 0;
+#else
+    (void) wait;
+#endif
+}
+
+size_t
+MapTRW::state_size() const{
+    const unsigned ip_sets = ip_table_size / ip_table_assoc;
+    size_t ip_records = 0;
+    for(unsigned index = 0; index < ip_sets; ++index){
+	const struct ip_record *set = ip_set(index);
+	for(unsigned i = 0; i < ip_table_assoc; ++i){
+	    if(set[i].count != -128)
+		++ip_records;
+	}
+    }
+    return sizeof(struct trw_state_header)
+	+ ip_records * sizeof(struct trw_state_ip)
+	+ con_table_size * sizeof(struct con_record)
+	+ map_size * sizeof(struct trw_state_map);
+}
+
+// buf must hold state_size() bytes.
+void
+MapTRW::write_state(unsigned char *buf) const{
+    struct trw_state_header *h = (struct trw_state_header *) buf;
+    memset(h, 0, sizeof(*h));
+    h->magic = TRW_STATE_MAGIC;
+    h->version = TRW_STATE_VERSION;
+    h->rc5_seed = rc5_seed;
+    h->ip_table_size = ip_table_size;
+    h->ip_table_assoc = ip_table_assoc;
+    h->con_table_size = con_table_size;
+    h->map_size = map_size;
+    h->map_prefix = (uint32_t) (_my_ip & _my_mask);
+    h->map_mask = (uint32_t) _my_mask;
+    h->last_time = last_time;
+    h->last_map = last_map;
+
+    struct trw_state_ip *ips = (struct trw_state_ip *) (h + 1);
+    const unsigned ip_sets = ip_table_size / ip_table_assoc;
+    uint32_t n = 0;
+    for(unsigned index = 0; index < ip_sets; ++index){
+	const struct ip_record *set = ip_set(index);
+	for(unsigned i = 0; i < ip_table_assoc; ++i){
+	    if(set[i].count == -128)
+		continue;
+	    ips[n].ip_hash = (((uint32_t) set[i].ip_tag) << ip_addr_tag_shift)
+		| index;
+	    ips[n].count = set[i].count;
+	    ips[n].passive_count = set[i].passive_count;
+	    ips[n].timestamp = set[i].timestamp;
+	    ips[n].pad = 0;
+	    ++n;
+	}
+    }
+    h->ip_records = n;
+
+    unsigned char *cons = (unsigned char *) (ips + n);
+    memcpy(cons, con_table, con_table_size * sizeof(struct con_record));
+
+    struct trw_state_map *maps = (struct trw_state_map *)
+	(cons + con_table_size * sizeof(struct con_record));
+    for(unsigned i = 0; i < map_size; ++i){
+	maps[i].map_ip = (uint32_t) arp_map[i].map_ip;
+	maps[i].last_valid = arp_map[i].last_valid;
+	memcpy(maps[i].map_eth, arp_map[i].map_eth.data(), 6);
+	maps[i].port = arp_map[i].port;
+	maps[i].flags = (arp_map[i].passive_update ? 1 : 0)
+	    | (arp_map[i].arp_whitelist ? 2 : 0);
+    }
+}
+
+// Puts a saved record into its set: into a free or matching slot if
+// there is one, else over the entry with the lowest count if the
+// saved count is higher (scanners are the state worth keeping).
+void
+MapTRW::restore_ip(uint32_t ip_hash, int8_t count, int8_t passive_count,
+		   uint8_t timestamp){
+    struct ip_record *set = ip_set(ip_hash & ip_addr_index_mask);
+    uint16_t ip_tag = (uint16_t) (ip_hash >> ip_addr_tag_shift);
+    int slot = -1;
+    for(int i = 0; i < (int) ip_table_assoc; ++i){
+	if(set[i].count != -128 && set[i].ip_tag == ip_tag){
+	    slot = i;
+	    break;
+	} else if(set[i].count == -128 && slot < 0){
+	    slot = i;
+	}
+    }
+    if(slot < 0){
+	slot = 0;
+	for(int i = 1; i < (int) ip_table_assoc; ++i){
+	    if(set[i].count < set[slot].count)
+		slot = i;
+	}
+	if(set[slot].count >= count)
+	    return;
+    }
+    set[slot].ip_tag = ip_tag;
+    set[slot].count = count;
+    set[slot].passive_count = passive_count;
+    set[slot].timestamp = timestamp;
+}
+
+int
+MapTRW::read_state(const unsigned char *buf, size_t len, ErrorHandler *errh){
+    const struct trw_state_header *h = (const struct trw_state_header *) buf;
+    if(len < sizeof(*h) || h->magic != TRW_STATE_MAGIC)
+	return errh->error("not a MapTRW checkpoint");
+    if(h->version != TRW_STATE_VERSION)
+	return errh->error("unsupported checkpoint version %u", h->version);
+    size_t need = sizeof(*h)
+	+ (size_t) h->ip_records * sizeof(struct trw_state_ip)
+	+ (size_t) h->con_table_size * sizeof(struct con_record)
+	+ (size_t) h->map_size * sizeof(struct trw_state_map);
+    if(len < need)
+	return errh->error("truncated checkpoint");
+
+    // The IP table.  Under a different key, recover each address
+    // with the old key and encrypt it again with ours.
+    uint16_t *old_key = 0;
+    if(h->rc5_seed != rc5_seed)
+	old_key = rc5_keygen(h->rc5_seed);
+    const struct trw_state_ip *ips = (const struct trw_state_ip *) (h + 1);
+    for(uint32_t n = 0; n < h->ip_records; ++n){
+	uint32_t ip_hash = ips[n].ip_hash;
+	if(old_key)
+	    ip_hash = rc5_encrypt(rc5_decrypt(ip_hash, old_key), rc5_key);
+	restore_ip(ip_hash, ips[n].count, ips[n].passive_count,
+		   ips[n].timestamp);
+    }
+    delete[] old_key;
+
+    // Connection records are indexed by an irreversible mix of
+    // hashes, so they only carry over to an identical table.
+    const unsigned char *cons = (const unsigned char *) (ips + h->ip_records);
+    if(h->rc5_seed == rc5_seed && h->con_table_size == con_table_size){
+	memcpy(con_table, cons, con_table_size * sizeof(struct con_record));
+    } else {
+	click_chatter("Connection table geometry or key changed, not restored\n");
+    }
+
+    const struct trw_state_map *maps = (const struct trw_state_map *)
+	(cons + h->con_table_size * sizeof(struct con_record));
+    if(h->map_size == map_size
+       && h->map_prefix == (uint32_t) (_my_ip & _my_mask)
+       && h->map_mask == (uint32_t) _my_mask){
+	for(unsigned i = 0; i < map_size; ++i){
+	    arp_map[i].map_ip = IPAddress(maps[i].map_ip);
+	    arp_map[i].last_valid = maps[i].last_valid;
+	    arp_map[i].map_eth = EtherAddress(maps[i].map_eth);
+	    arp_map[i].port = maps[i].port;
+	    arp_map[i].passive_update = (maps[i].flags & 1) != 0;
+	    arp_map[i].arp_whitelist = (maps[i].flags & 2) != 0;
+	}
+    } else {
+	click_chatter("Local network changed, network map not restored\n");
+    }
+
+    if(h->last_time > last_time)
+	last_time = h->last_time;
+    click_chatter("Restored %u IP records from checkpoint\n", h->ip_records);
+    return 0;
+}
+
+#if CLICK_USERLEVEL
+// Writes a checkpoint to tmpname and renames it to filename.  Returns
+// 0 or -errno.  Makes no allocations and reports nothing, so it is
+// safe in a checkpoint child.
+int
+MapTRW::write_state_file(const char *tmpname, const char *filename) const{
+    size_t size = state_size();
+    int fd = open(tmpname, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0)
+	return -errno;
+    if(ftruncate(fd, size) < 0){
+	int e = errno;
+	close(fd);
+	unlink(tmpname);
+	return -e;
+    }
+    void *m = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(m == MAP_FAILED){
+	int e = errno;
+	close(fd);
+	unlink(tmpname);
+	return -e;
+    }
+    write_state((unsigned char *) m);
+    int r = msync(m, size, MS_SYNC);
+    int e = errno;
+    munmap(m, size);
+    close(fd);
+    if(r < 0 || rename(tmpname, filename) < 0){
+	if(r >= 0)
+	    e = errno;
+	unlink(tmpname);
+	return -e;
+    }
+    return 0;
+}
+#endif
 
+int
+MapTRW::save_state(const String &filename, ErrorHandler *errh){
+#if CLICK_USERLEVEL
+    String tmpname = filename + ".tmp";
+    int r = write_state_file(tmpname.c_str(), filename.c_str());
+    if(r < 0)
+	return errh->error("%s: %s", filename.c_str(), strerror(-r));
     return 0;
+#else
+    (void) filename;
+    return errh->error("checkpoint files require the user-level driver");
+#endif
+}
+
+int
+MapTRW::load_state(const String &filename, ErrorHandler *errh){
+#if CLICK_USERLEVEL
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+	return errh->error("%s: %s", filename.c_str(), strerror(errno));
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size == 0){
+	close(fd);
+	return errh->error("%s: empty or unreadable", filename.c_str());
+    }
+    void *m = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED)
+	return errh->error("%s: %s", filename.c_str(), strerror(errno));
+    ContextErrorHandler cerrh(errh, "%s:", filename.c_str());
+    int r = read_state((const unsigned char *) m, st.st_size, &cerrh);
+    munmap(m, st.st_size);
+    return r;
+#else
+    (void) filename;
+    return errh->error("checkpoint files require the user-level driver");
+#endif
+}
+
+void
+MapTRW::take_state(Element *e, ErrorHandler *errh){
+    MapTRW *old = (MapTRW *) e->cast("MapTRW");
+    if(!old){
+	errh->error("Couldn't cast old MapTRW");
+	return;
+    }
+
+    if(old->rc5_seed == rc5_seed
+       && old->ip_table_size == ip_table_size
+       && old->ip_table_assoc == ip_table_assoc
+       && old->ip_set_stride == ip_set_stride
+       && old->con_table_size == con_table_size
+       && old->map_size == map_size
+       && (old->_my_ip & old->_my_mask) == (_my_ip & _my_mask)){
+	// Same geometry: just trade tables, no copying.  The old element
+	// is about to be cleaned up, so it must not checkpoint the empty
+	// tables it got in exchange.
+	click_swap(ip_table, old->ip_table);
+	click_swap(ip_table_mem, old->ip_table_mem);
+	click_swap(ip_table_mem_size, old->ip_table_mem_size);
+	click_swap(ip_table_mapped, old->ip_table_mapped);
+	click_swap(con_table, old->con_table);
+	click_swap(con_table_mem, old->con_table_mem);
+	click_swap(con_table_mem_size, old->con_table_mem_size);
+	click_swap(con_table_mapped, old->con_table_mapped);
+	click_swap(arp_map, old->arp_map);
+	last_time = old->last_time;
+	last_map = old->last_map;
+    } else {
+	// The running element's state wins over anything initialize
+	// loaded from STATE_FILE, so start again from empty tables
+	// rather than merging the two.
+	clear_tables();
+	last_time = 0;
+	String buf = String::make_garbage(old->state_size());
+	old->write_state((unsigned char *) buf.mutable_data());
+	if(read_state((const unsigned char *) buf.data(), buf.length(),
+		      errh) < 0)
+	    return;
+	last_map = old->last_map;
+    }
+    old->_state_file = String();
+}
+
+void
+MapTRW::reset_stats(){
+    _packets = _drops = 0;
+    _blocks = _unblocks = 0;
+    _ip_allocs = _ip_evictions = 0;
+    _con_expired = 0;
+}
+
+enum { H_SAVE, H_LOAD, H_STATS, H_IP_OCCUPANCY, H_CON_OCCUPANCY,
+       H_RESET_STATS };
+
+String
+MapTRW::read_handler(Element *e, void *thunk){
+    MapTRW *trw = (MapTRW *) e;
+    switch((intptr_t) thunk){
+    case H_STATS: {
+	StringAccum sa;
+	sa << "packets " << trw->_packets << "\n"
+	   << "drops " << trw->_drops << "\n"
+	   << "blocks " << trw->_blocks << "\n"
+	   << "unblocks " << trw->_unblocks << "\n"
+	   << "ip_allocs " << trw->_ip_allocs << "\n"
+	   << "ip_evictions " << trw->_ip_evictions << "\n"
+	   << "con_expired " << trw->_con_expired << "\n";
+	return sa.take_string();
+    }
+    case H_IP_OCCUPANCY: {
+	// Entries in use, and entries that are currently blocked.
+	const unsigned ip_sets = trw->ip_table_size / trw->ip_table_assoc;
+	unsigned used = 0, blocked = 0;
+	for(unsigned index = 0; index < ip_sets; ++index){
+	    const struct ip_record *set = trw->ip_set(index);
+	    for(unsigned i = 0; i < trw->ip_table_assoc; ++i){
+		if(set[i].count != -128){
+		    used++;
+		    if(set[i].count >= trw->ip_table_block_count)
+			blocked++;
+		}
+	    }
+	}
+	StringAccum sa;
+	sa << used << " " << trw->ip_table_size << " " << blocked << "\n";
+	return sa.take_string();
+    }
+    case H_CON_OCCUPANCY: {
+	unsigned used = 0;
+	for(unsigned i = 0; i < trw->con_table_size; ++i){
+	    if(trw->con_table[i].status)
+		used++;
+	}
+	StringAccum sa;
+	sa << used << " " << trw->con_table_size << "\n";
+	return sa.take_string();
+    }
+    default:
+	return String();
+    }
+}
+
+
+int
+MapTRW::write_handler(const String &in_s, Element *e, void *thunk,
+		      ErrorHandler *errh){
+    MapTRW *trw = (MapTRW *) e;
+    if((intptr_t) thunk == H_RESET_STATS){
+	trw->reset_stats();
+	return 0;
+    }
+    String filename = cp_uncomment(in_s);
+    if(!filename)
+	filename = trw->_state_file;
+    else if(!cp_filename(filename, &filename))
+	return errh->error("expected filename");
+    if(!filename)
+	return errh->error("no file given and no STATE_FILE configured");
+    switch((intptr_t) thunk){
+    case H_SAVE:
+	return trw->save_state(filename, errh);
+    case H_LOAD:
+	return trw->load_state(filename, errh);
+    default:
+	return -1;
+    }
+}
+
+void
+MapTRW::add_handlers(){
+    add_write_handler("save", write_handler, (void *) H_SAVE);
+    add_write_handler("load", write_handler, (void *) H_LOAD);
+    add_read_handler("stats", read_handler, (void *) H_STATS);
+    add_read_handler("ip_occupancy", read_handler, (void *) H_IP_OCCUPANCY);
+    add_read_handler("con_occupancy", read_handler, (void *) H_CON_OCCUPANCY);
+    add_write_handler("reset_stats", write_handler, (void *) H_RESET_STATS);
 }
 
 void MapTRW::chatter_map(struct map_record &rec){
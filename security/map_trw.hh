@@ -5,6 +5,7 @@
 #include <click/string.hh>
 #include <click/etheraddress.hh>
 #include <click/ipaddress.hh>
+#include <click/timer.hh>
 CLICK_DECLS
 
 // This file is copyright 2005/2006 by the International Computer
@@ -45,7 +46,52 @@ CLICK_DECLS
  *
  * ETH is a mac to use for active mapping (not implemented)
  *
- * =a 
+ * ALIGN_SETS (default true) pads each associative set of the IP table
+ * out to a power-of-two stride, so that a set never straddles a 64 byte
+ * cache line (for associativity up to 8) and a lookup touches a single
+ * line.  Both tables are allocated cache line aligned, and the hashes
+ * for a packet's four buckets are prefetched as soon as they are known.
+ *
+ * HUGE_PAGES (default false) backs tables of 1 MB or more with huge
+ * pages when the user-level driver supports it, falling back to normal
+ * memory otherwise.
+ *
+ * STATE_FILE names a checkpoint file.  At initialize the IP table,
+ * connection table and network map are restored from it if it exists,
+ * and they are saved to it again at cleanup and, if CHECKPOINT_INTERVAL
+ * is nonzero, every CHECKPOINT_INTERVAL seconds.  Periodic checkpoints
+ * are written by a forked child from a copy-on-write snapshot, so
+ * packet processing does not wait for them.  The file starts with a
+ * header recording the RC5 key and the table geometry.  If the key or
+ * associativity changed, scan counts are rehashed into the new table;
+ * connection state is only kept if the key and CON_TABLE_SIZE match.
+ * The file is written to a temporary name and renamed into place, so a
+ * crash never leaves a torn checkpoint.  STATE_FILE is user-level only.
+ *
+ * On hot-swap, the new MapTRW takes over the old one's tables directly
+ * when the geometry matches, and otherwise converts them through the
+ * checkpoint format.  Either way the old element's state replaces
+ * whatever was loaded from STATE_FILE; the file is only read on a cold
+ * start.
+ *
+ * QUIET (default false) turns off the per-packet chatter for drops and
+ * ignored broadcasts, which otherwise dominates the cost under load.
+ *
+ * =h stats read-only
+ * Packets seen, drops, block and unblock transitions, IP table
+ * allocations and evictions, and connection records expired by age.
+ * =h ip_occupancy read-only
+ * IP table entries in use, table size, and entries currently blocked.
+ * =h con_occupancy read-only
+ * Connection table records with any status bit set, and table size.
+ * =h reset_stats write-only
+ * Zero the stats counters.
+ * =h save write-only
+ * Write a checkpoint to the given file, or to STATE_FILE.
+ * =h load write-only
+ * Restore a checkpoint from the given file, or from STATE_FILE.
+ *
+ * =a TRWTrafficGen
  */
 
 class MapTRW : public Element { public:
@@ -57,9 +103,15 @@ class MapTRW : public Element { public:
     const char *processing() const	{ return PUSH; }
 
     int configure(Vector<String> &conf, ErrorHandler *errh);
+    int initialize(ErrorHandler *errh);
+    void take_state(Element *old, ErrorHandler *errh);
+    void add_handlers();
+    void run_timer(Timer *);
 
     const char * port_count () const {return "2/4";}
     
+    void cleanup(CleanupStage);
+
     void push(int port, Packet *p);
   
 private:
@@ -68,9 +120,44 @@ private:
 				uint32_t dst_hash,
 				int direction);
 
+    inline struct ip_record *ip_set(uint32_t ip_index) const;
+    uint32_t con_index(Packet *p, uint32_t src_hash, uint32_t dst_hash,
+		       int direction);
+    struct con_record *find_con(uint32_t index);
+    void prefetch_ip(uint32_t ip_hash) const;
+
+    unsigned char *alloc_table(size_t bytes, void *&mem, size_t &mem_size,
+			       bool &mem_mapped);
+    void free_table(void *mem, size_t mem_size, bool mem_mapped);
+
+    size_t state_size() const;
+    void write_state(unsigned char *buf) const;
+    int read_state(const unsigned char *buf, size_t len, ErrorHandler *errh);
+    void restore_ip(uint32_t ip_hash, int8_t count, int8_t passive_count,
+		    uint8_t timestamp);
+    void clear_tables();
+    int write_state_file(const char *tmpname, const char *filename) const;
+    int save_state(const String &filename, ErrorHandler *errh);
+    int load_state(const String &filename, ErrorHandler *errh);
+
+    void reset_stats();
+
+    static String read_handler(Element *, void *);
+    static int write_handler(const String &, Element *, void *,
+			     ErrorHandler *);
+
     struct ip_record *ip_table;
     struct con_record *con_table;
 
+    // The raw allocations backing the two tables.  The tables
+    // themselves start at the first cache line boundary.
+    void *ip_table_mem;
+    size_t ip_table_mem_size;
+    bool ip_table_mapped;
+    void *con_table_mem;
+    size_t con_table_mem_size;
+    bool con_table_mapped;
+
 
     struct map_record *arp_map;
 
@@ -86,6 +173,11 @@ private:
     unsigned ip_table_size;
     unsigned ip_table_assoc;
 
+    // The number of bytes between the starts of two associative
+    // sets.  With ALIGN_SETS this is a power of 2, so sets never
+    // straddle a cache line.
+    unsigned ip_set_stride;
+
     unsigned ip_table_decr_age;
     unsigned ip_table_incr_age;
     
@@ -95,8 +187,10 @@ private:
 
 
     // The size of the connection table.  Default is 2^18 entries
-    // which requires 1 MB.
+    // which requires 1 MB.  Rounded DOWN to a power of 2 so that
+    // con_table_mask can replace the modulo.
     unsigned con_table_size;
+    uint32_t con_table_mask;
 
     // The number of idle minutes before a connection table record is aged
     unsigned con_table_maxage;
@@ -117,6 +211,29 @@ private:
     // Controls whether to chatter for tomato
     bool tomato_chatter;
 
+    // Table layout options
+    bool align_sets;
+    bool huge_pages;
+
+    // Controls the per-packet drop chatter
+    bool quiet;
+
+    // Statistics, for benchmarking table geometry
+    uint64_t _packets;
+    uint64_t _drops;
+    uint64_t _blocks;
+    uint64_t _unblocks;
+    uint64_t _ip_allocs;
+    uint64_t _ip_evictions;
+    uint64_t _con_expired;
+
+    // Checkpointing
+    String _state_file;
+    unsigned _checkpoint_interval;
+    Timer _checkpoint_timer;
+    int _checkpoint_pid;	// checkpoint child being written, or 0
+    void reap_checkpoint(bool wait);
+
 
     // The ethernet and IP addresses
     EtherAddress _my_en;
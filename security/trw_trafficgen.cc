@@ -0,0 +1,343 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * trw_trafficgen.{cc,hh} -- synthetic benign and scanning traffic
+ *
+ * Drives both inputs of MapTRW with a reproducible mix of clients,
+ * servers and horizontal/vertical scanners, painting every packet with
+ * its ground-truth class so that block decisions can be scored.
+ */
+
+#include <click/config.h>
+#include <click/confparse.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include <click/router.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+#include "trw_trafficgen.hh"
+
+// Outside address pools, as host indices into OUTSIDE
+#define TRW_GEN_OUT_CLIENTS 4096
+#define TRW_GEN_OUT_SERVERS 64
+#define TRW_GEN_OUT_SCANNERS 8192
+
+#define TRW_GEN_HSCAN_PORT 445
+#define TRW_GEN_PKT_LEN (sizeof(click_ether) + sizeof(click_ip) \
+			 + sizeof(click_tcp))
+
+CLICK_DECLS
+
+TRWTrafficGen::TRWTrafficGen()
+    : _task(this)
+{
+}
+
+TRWTrafficGen::~TRWTrafficGen()
+{
+}
+
+int
+TRWTrafficGen::configure(Vector<String> &conf, ErrorHandler *errh){
+    _inside = IPAddress(htonl(0x0A0A0000));        // 10.10.0.0/16
+    _inside_mask = IPAddress(htonl(0xFFFF0000));
+    _outside = IPAddress(htonl(0xAC100000));       // 172.16.0.0/12
+    _outside_mask = IPAddress(htonl(0xFFF00000));
+    _nclients = 100;
+    _nservers = 10;
+    _nhscanners = 4;
+    _nvscanners = 4;
+    _hit_rate = 5;
+    _limit = 0;
+    _burst = 32;
+    _seed = 0xCAFEBABE;
+    _stop = false;
+    _active = true;
+
+    if(cp_va_kparse(conf, this, errh,
+		    "INSIDE", 0, cpIPPrefix, &_inside, &_inside_mask,
+		    "OUTSIDE", 0, cpIPPrefix, &_outside, &_outside_mask,
+		    "CLIENTS", 0, cpUnsigned, &_nclients,
+		    "SERVERS", 0, cpUnsigned, &_nservers,
+		    "HSCANNERS", 0, cpUnsigned, &_nhscanners,
+		    "VSCANNERS", 0, cpUnsigned, &_nvscanners,
+		    "HIT_RATE", 0, cpUnsigned, &_hit_rate,
+		    "LIMIT", 0, cpUnsigned, &_limit,
+		    "BURST", 0, cpUnsigned, &_burst,
+		    "SEED", 0, cpUnsigned, &_seed,
+		    "STOP", 0, cpBool, &_stop,
+		    "ACTIVE", 0, cpBool, &_active,
+		    cpEnd) < 0)
+	return -1;
+
+    uint32_t inside_hosts = ~ntohl(_inside_mask) - 2;
+    uint32_t outside_hosts = ~ntohl(_outside_mask) - 1;
+    if(~ntohl(_inside_mask) < 4 || _nclients + _nservers
+       + _nhscanners + _nvscanners > inside_hosts)
+	return errh->error("INSIDE is too small for the number of hosts");
+    if(~ntohl(_outside_mask) + 1 < 2 * TRW_GEN_OUT_SCANNERS
+       || outside_hosts < TRW_GEN_OUT_SCANNERS + _nhscanners + _nvscanners)
+	return errh->error("OUTSIDE must be at least a /18");
+    if(_nclients + _nservers + _nhscanners + _nvscanners == 0)
+	return errh->error("no hosts to generate traffic for");
+    if(_hit_rate > 100)
+	return errh->error("HIT_RATE is a percentage");
+    if(_burst < 1)
+	_burst = 1;
+    return 0;
+}
+
+int
+TRWTrafficGen::initialize(ErrorHandler *){
+    setup_actors();
+    _task.initialize(this, _active);
+    return 0;
+}
+
+// xorshift32: cheap, and reproducible across runs for a given SEED
+uint32_t
+TRWTrafficGen::random(){
+    _rand ^= _rand << 13;
+    _rand ^= _rand >> 17;
+    _rand ^= _rand << 5;
+    return _rand;
+}
+
+// Host addresses skip the network address, the gateway (.1, which
+// MapTRW treats specially) and the broadcast address.
+uint32_t
+TRWTrafficGen::inside_host(uint32_t index) const{
+    uint32_t hostmask = ~ntohl(_inside_mask);
+    return (ntohl(_inside) & ~hostmask) | (2 + index % (hostmask - 2));
+}
+
+uint32_t
+TRWTrafficGen::outside_host(uint32_t index) const{
+    uint32_t hostmask = ~ntohl(_outside_mask);
+    return (ntohl(_outside) & ~hostmask) | (1 + index % (hostmask - 1));
+}
+
+void
+TRWTrafficGen::setup_actors(){
+    _rand = _seed ? _seed : 1;
+    _count = 0;
+    for(int i = 0; i < NPAINT; ++i)
+	_sent[i] = 0;
+    _pending.clear();
+    _actors.clear();
+
+    uint32_t inside_index = 0;
+    for(unsigned i = 0; i < _nclients + _nservers; ++i){
+	actor a;
+	a.addr = inside_host(inside_index++);
+	a.side = 0;
+	a.kind = (i < _nclients ? PAINT_CLIENT : PAINT_SERVER);
+	a.target = 0;
+	a.next_port = 1;
+	a.seq = random();
+	_actors.push_back(a);
+    }
+    // Scanners alternate sides, starting outside.
+    for(unsigned i = 0; i < _nhscanners + _nvscanners; ++i){
+	actor a;
+	a.side = (i % 2 == 0 ? 1 : 0);
+	if(a.side == 1)
+	    a.addr = outside_host(TRW_GEN_OUT_SCANNERS + i);
+	else
+	    a.addr = inside_host(inside_index++);
+	a.kind = (i < _nhscanners ? PAINT_HSCAN : PAINT_VSCAN);
+	if(a.side == 1)
+	    a.target = inside_host(random());
+	else
+	    a.target = outside_host(random());
+	a.next_port = 1;
+	a.seq = random();
+	_actors.push_back(a);
+    }
+}
+
+void
+TRWTrafficGen::act(actor &a){
+    pending pk;
+    uint16_t eph = 1024 + random() % 60000;
+    a.seq++;
+    switch(a.kind){
+    case PAINT_CLIENT: {
+	uint32_t server = outside_host(TRW_GEN_OUT_CLIENTS
+				       + random() % TRW_GEN_OUT_SERVERS);
+	pending syn = { a.addr, server, eph, 80, TH_SYN, 0, PAINT_CLIENT };
+	pending synack = { server, a.addr, 80, eph, TH_SYN | TH_ACK, 1,
+			   PAINT_CLIENT };
+	pending ack = { a.addr, server, eph, 80, TH_ACK, 0, PAINT_CLIENT };
+	send(syn);
+	_pending.push_back(synack);
+	_pending.push_back(ack);
+	break;
+    }
+    case PAINT_SERVER: {
+	uint32_t client = outside_host(random() % TRW_GEN_OUT_CLIENTS);
+	pending syn = { client, a.addr, eph, 80, TH_SYN, 1, PAINT_SERVER };
+	pending synack = { a.addr, client, 80, eph, TH_SYN | TH_ACK, 0,
+			   PAINT_SERVER };
+	pending ack = { client, a.addr, eph, 80, TH_ACK, 1, PAINT_SERVER };
+	send(syn);
+	_pending.push_back(synack);
+	_pending.push_back(ack);
+	break;
+    }
+    case PAINT_HSCAN:
+    case PAINT_VSCAN: {
+	pk.src = a.addr;
+	pk.sport = eph;
+	if(a.kind == PAINT_HSCAN){
+	    pk.dst = (a.side == 1 ? inside_host(random())
+		      : outside_host(random()));
+	    pk.dport = TRW_GEN_HSCAN_PORT;
+	} else {
+	    pk.dst = a.target;
+	    pk.dport = a.next_port++;
+	    if(a.next_port == 0)
+		a.next_port = 1;
+	}
+	pk.flags = TH_SYN;
+	pk.side = a.side;
+	pk.paint = a.kind;
+	send(pk);
+	if(random() % 100 < _hit_rate){
+	    pending synack = { pk.dst, pk.src, pk.dport, pk.sport,
+			       TH_SYN | TH_ACK, (uint8_t) !a.side,
+			       PAINT_SCAN_REPLY };
+	    _pending.push_back(synack);
+	}
+	break;
+    }
+    }
+}
+
+void
+TRWTrafficGen::send(const pending &pk){
+    WritablePacket *p = Packet::make(Packet::default_headroom, 0,
+				     TRW_GEN_PKT_LEN, 0);
+    if(!p)
+	return;
+    memset(p->data(), 0, TRW_GEN_PKT_LEN);
+
+    // Locally administered MACs derived from the addresses, so the
+    // passive map never sees a host change identity.
+    click_ether *e = (click_ether *) p->data();
+    uint32_t src = htonl(pk.src), dst = htonl(pk.dst);
+    e->ether_shost[0] = e->ether_dhost[0] = 0x02;
+    memcpy(&e->ether_shost[2], &src, 4);
+    memcpy(&e->ether_dhost[2], &dst, 4);
+    e->ether_type = htons(ETHERTYPE_IP);
+
+    click_ip *iph = (click_ip *) (e + 1);
+    iph->ip_v = 4;
+    iph->ip_hl = sizeof(click_ip) >> 2;
+    iph->ip_len = htons(sizeof(click_ip) + sizeof(click_tcp));
+    iph->ip_id = htons((uint16_t) _count);
+    iph->ip_ttl = 64;
+    iph->ip_p = IP_PROTO_TCP;
+    iph->ip_src.s_addr = src;
+    iph->ip_dst.s_addr = dst;
+    iph->ip_sum = click_in_cksum((unsigned char *) iph, sizeof(click_ip));
+
+    // MapTRW never looks at the TCP checksum, so it is left zero.
+    click_tcp *tcph = (click_tcp *) (iph + 1);
+    tcph->th_sport = htons(pk.sport);
+    tcph->th_dport = htons(pk.dport);
+    tcph->th_seq = htonl(random());
+    tcph->th_off = sizeof(click_tcp) >> 2;
+    tcph->th_flags = pk.flags;
+    tcph->th_win = htons(65535);
+
+    p->set_ip_header(iph, sizeof(click_ip));
+    p->timestamp_anno().set_now();
+    SET_PAINT_ANNO(p, pk.paint);
+
+    _count++;
+    _sent[pk.paint]++;
+    output(pk.side).push(p);
+}
+
+bool
+TRWTrafficGen::run_task(Task *){
+    if(!_active)
+	return false;
+    unsigned n;
+    for(n = 0; n < _burst; ++n){
+	if(_limit && _count >= _limit)
+	    break;
+	if(!_pending.empty()){
+	    pending pk = _pending.front();
+	    _pending.pop_front();
+	    send(pk);
+	} else
+	    act(_actors[random() % _actors.size()]);
+    }
+    if(_limit && _count >= _limit){
+	if(_stop)
+	    router()->please_stop_driver();
+	return n > 0;
+    }
+    _task.fast_reschedule();
+    return n > 0;
+}
+
+enum { H_COUNT, H_STATS, H_ACTIVE, H_RESET };
+
+String
+TRWTrafficGen::read_handler(Element *e, void *thunk){
+    TRWTrafficGen *g = (TRWTrafficGen *) e;
+    switch((intptr_t) thunk){
+    case H_COUNT:
+	return String(g->_count);
+    case H_STATS: {
+	StringAccum sa;
+	sa << "client " << g->_sent[PAINT_CLIENT] << "\n"
+	   << "server " << g->_sent[PAINT_SERVER] << "\n"
+	   << "hscan " << g->_sent[PAINT_HSCAN] << "\n"
+	   << "vscan " << g->_sent[PAINT_VSCAN] << "\n"
+	   << "scan_reply " << g->_sent[PAINT_SCAN_REPLY] << "\n";
+	return sa.take_string();
+    }
+    case H_ACTIVE:
+	return cp_unparse_bool(g->_active);
+    default:
+	return String();
+    }
+}
+
+int
+TRWTrafficGen::write_handler(const String &in_s, Element *e, void *thunk,
+			     ErrorHandler *errh){
+    TRWTrafficGen *g = (TRWTrafficGen *) e;
+    switch((intptr_t) thunk){
+    case H_ACTIVE:
+	if(!cp_bool(cp_uncomment(in_s), &g->_active))
+	    return errh->error("expected boolean");
+	break;
+    case H_RESET:
+	g->setup_actors();
+	break;
+    default:
+	return -1;
+    }
+    if(g->_active && !g->_task.scheduled())
+	g->_task.reschedule();
+    return 0;
+}
+
+void
+TRWTrafficGen::add_handlers(){
+    add_read_handler("count", read_handler, (void *) H_COUNT);
+    add_read_handler("stats", read_handler, (void *) H_STATS);
+    add_read_handler("active", read_handler, (void *) H_ACTIVE);
+    add_write_handler("active", write_handler, (void *) H_ACTIVE);
+    add_write_handler("reset", write_handler, (void *) H_RESET);
+    add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(TRWTrafficGen)
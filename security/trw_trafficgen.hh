@@ -0,0 +1,137 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef NW_TRW_TRAFFICGEN_HH
+#define NW_TRW_TRAFFICGEN_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/deque.hh>
+#include <click/ipaddress.hh>
+CLICK_DECLS
+
+/*
+ * =c
+ * TRWTrafficGen(I<keywords>)
+ * =s Packet processing for security
+ * Synthetic scan/benign traffic for benchmarking MapTRW
+ * =d
+ * Generates a mix of benign and scanning TCP traffic to drive the two
+ * inputs of MapTRW.  Output 0 carries packets sent by hosts on the
+ * INSIDE network, output 1 packets sent by hosts OUTSIDE.  Packets are
+ * Ethernet/IP/TCP with the IP header marked and the timestamp
+ * annotation set.
+ *
+ * The mix is made of CLIENTS inside hosts connecting to a pool of
+ * outside servers, SERVERS inside hosts receiving connections from
+ * outside clients, HSCANNERS horizontal scanners (one port, many
+ * hosts) and VSCANNERS vertical scanners (one host, many ports).
+ * Scanners alternate between the outside and the inside, so both
+ * MapTRW ports see scans.  Benign connections are always answered; a
+ * scan probe is answered with probability HIT_RATE percent.  Each tick
+ * one actor, picked at random, sends one packet; replies go out before
+ * new connections.
+ *
+ * The paint annotation records ground truth, so a PaintSwitch behind
+ * MapTRW can count false positives and false negatives:
+ *
+ * 0: benign client traffic, 1: benign server traffic,
+ * 2: horizontal scan probes, 3: vertical scan probes, 4: scan replies.
+ *
+ * Keywords:
+ *
+ * INSIDE, OUTSIDE: address prefixes (defaults 10.10.0.0/16 and
+ * 172.16.0.0/12).  CLIENTS, SERVERS, HSCANNERS, VSCANNERS: actor counts
+ * (defaults 100, 10, 4, 4).  HIT_RATE: percent (default 5).  LIMIT:
+ * number of packets to send, 0 for no limit (default 0).  BURST:
+ * packets per task run (default 32).  SEED: random seed.  STOP: stop
+ * the driver once LIMIT is reached (default false).  ACTIVE (default
+ * true).
+ *
+ * =h count read-only
+ * Packets sent.
+ * =h stats read-only
+ * Packets sent per paint class.
+ * =h active read/write
+ * =h reset write-only
+ * Reset the counters and restart the mix from the beginning.
+ *
+ * =a MapTRW, PaintSwitch
+ */
+
+class TRWTrafficGen : public Element { public:
+
+    TRWTrafficGen();
+    ~TRWTrafficGen();
+
+    const char *class_name() const	{ return "TRWTrafficGen"; }
+    const char *port_count() const	{ return "0/2"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh);
+    int initialize(ErrorHandler *errh);
+    void add_handlers();
+
+    bool run_task(Task *);
+
+    enum { PAINT_CLIENT = 0, PAINT_SERVER = 1, PAINT_HSCAN = 2,
+	   PAINT_VSCAN = 3, PAINT_SCAN_REPLY = 4, NPAINT = 5 };
+
+private:
+    struct actor {
+	uint32_t addr;      // host byte order
+	int side;           // 0 inside, 1 outside
+	int kind;           // a PAINT_ value
+	uint32_t target;    // vertical scanners: the victim
+	uint16_t next_port;
+	uint32_t seq;
+    };
+
+    // A packet owed to the network: a reply, or the ACK finishing a
+    // benign handshake.
+    struct pending {
+	uint32_t src;
+	uint32_t dst;
+	uint16_t sport;
+	uint16_t dport;
+	uint8_t flags;
+	uint8_t side;
+	uint8_t paint;
+    };
+
+    Task _task;
+
+    IPAddress _inside;
+    IPAddress _inside_mask;
+    IPAddress _outside;
+    IPAddress _outside_mask;
+
+    unsigned _nclients;
+    unsigned _nservers;
+    unsigned _nhscanners;
+    unsigned _nvscanners;
+    unsigned _hit_rate;
+    unsigned _limit;
+    unsigned _burst;
+    uint32_t _seed;
+    bool _stop;
+    bool _active;
+
+    Vector<actor> _actors;
+    Deque<pending> _pending;
+    uint32_t _rand;
+
+    uint64_t _count;
+    uint64_t _sent[NPAINT];
+
+    uint32_t random();
+    uint32_t inside_host(uint32_t index) const;
+    uint32_t outside_host(uint32_t index) const;
+    void setup_actors();
+    void act(actor &a);
+    void send(const pending &pk);
+
+    static String read_handler(Element *, void *);
+    static int write_handler(const String &, Element *, void *,
+			     ErrorHandler *);
+};
+
+CLICK_ENDDECLS
+#endif